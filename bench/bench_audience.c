@@ -0,0 +1,136 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audience.h"
+
+#define WATCHERS 4000
+#define FRAMES_PER_FLUSH 4 // A move, a bot's reply and then some, within one event loop iteration.
+#define FLUSHES 200
+#define DROP_MS 100
+
+static int readers[WATCHERS];
+static int writers[WATCHERS];
+
+static double elapsed(const struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (double)(end.tv_sec - start->tv_sec) + (double)(end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void drain(size_t from, size_t to) {
+	char buf[4096];
+	for (size_t i = from; i < to; i++) {
+		while (recv(readers[i], buf, sizeof buf, MSG_DONTWAIT) > 0) {
+		}
+	}
+}
+
+static AudienceFrame move_frame(int i) {
+	AudienceFrame result = { .lobby = 1 };
+	result.data_len = (size_t)snprintf(result.data, sizeof result.data, "GOTMOVE %d %d\r\n", i / 9 % 9, i % 9);
+	result.snapshot_len = (size_t)snprintf(result.snapshot, sizeof result.snapshot, "GOTBOARD 9 9 %d\r\n", i);
+	return result;
+}
+
+/**
+ * @brief Sends every frame to every watcher on its own, which is what
+ * broadcasting to spectators like players would do.
+ *
+ */
+static double per_frame(void) {
+	struct timespec start;
+	double total = 0;
+
+	for (int f = 0; f < FLUSHES; f++) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (int k = 0; k < FRAMES_PER_FLUSH; k++) {
+			const AudienceFrame frame = move_frame(f * FRAMES_PER_FLUSH + k);
+			for (size_t i = 0; i < WATCHERS; i++) {
+				send(writers[i], frame.data, frame.data_len, MSG_DONTWAIT);
+			}
+		}
+		total += elapsed(&start);
+		drain(0, WATCHERS);
+	}
+
+	return total;
+}
+
+/**
+ * @brief Publishes and flushes through the audience, after flushing what was
+ * left waiting in the coalescer like the event loop does. Watchers from
+ * slow_from on never read.
+ *
+ */
+static double batched(Audience *a, Coalescer *out, size_t slow_from, size_t *dropped_total) {
+	struct timespec start;
+	double total = 0;
+	static int dropped[WATCHERS];
+	uint64_t now_ms = 0;
+
+	for (int f = 0; f < FLUSHES; f++) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (int k = 0; k < FRAMES_PER_FLUSH; k++) {
+			const AudienceFrame frame = move_frame(f * FRAMES_PER_FLUSH + k);
+			audience_publish(a, &frame);
+		}
+		*dropped_total += coalescer_flush(out, now_ms, dropped, WATCHERS);
+		*dropped_total += audience_flush(a, out, dropped, WATCHERS);
+		total += elapsed(&start);
+
+		drain(0, slow_from);
+		now_ms += 5;
+	}
+
+	return total;
+}
+
+int main(void) {
+	for (size_t i = 0; i < WATCHERS; i++) {
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+			perror("socketpair");
+			return 1;
+		}
+		writers[i] = sv[0];
+		readers[i] = sv[1];
+
+		// Small enough for watchers that never read to fill up within the run.
+		const int sndbuf = 4096;
+		setsockopt(writers[i], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof sndbuf);
+	}
+
+	const double naive = per_frame();
+	printf("per_frame   watchers=%d frames=%d flush_us=%-8.1f watcher_ns=%-6.1f sends=%d\n", WATCHERS, FRAMES_PER_FLUSH,
+		naive / FLUSHES * 1e6, naive / FLUSHES / WATCHERS * 1e9, WATCHERS * FRAMES_PER_FLUSH);
+
+	const size_t slow[] = { WATCHERS, WATCHERS / 2 };
+	for (size_t s = 0; s < sizeof slow / sizeof *slow; s++) {
+		Audience *a = audience_create();
+		Coalescer *out = coalescer_create(DROP_MS);
+		for (size_t i = 0; i < WATCHERS; i++) {
+			audience_watch(a, writers[i], 1);
+		}
+
+		size_t dropped = 0;
+		const double took = batched(a, out, slow[s], &dropped);
+		printf("batched     watchers=%d frames=%d flush_us=%-8.1f watcher_ns=%-6.1f sends=%d slow=%zu dropped=%zu\n",
+			WATCHERS, FRAMES_PER_FLUSH, took / FLUSHES * 1e6, took / FLUSHES / WATCHERS * 1e9, WATCHERS,
+			WATCHERS - slow[s], dropped);
+
+		audience_free(a);
+		coalescer_free(out);
+		drain(0, WATCHERS);
+	}
+
+	for (size_t i = 0; i < WATCHERS; i++) {
+		close(writers[i]);
+		close(readers[i]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bot.h"
+#include "lobby.h"
+
+#define BUDGET_MS 2000
+
+/**
+ * @brief Runs a search from the empty board and reports playout throughput.
+ * 
+ */
+static void bench_search(size_t rows, size_t cols, size_t threads) {
+	Bot *bot = bot_create(threads, BUDGET_MS);
+	Lobby *l = lobby_create(rows, cols);
+	if (!bot || !l) {
+		fprintf(stderr, "failed to create bot\n");
+		exit(1);
+	}
+
+	LobbyMove move;
+	BotStats stats;
+	bot_choose(bot, l, &move, &stats);
+
+	const double per_sec = (double)stats.playouts / stats.seconds;
+	printf("%zux%zu threads=%-3zu playouts=%-9lu playouts/sec=%-11.0f playouts/sec/core=%.0f\n",
+		rows, cols, stats.threads, stats.playouts, per_sec, per_sec / (double)stats.threads);
+
+	lobby_free(l);
+	bot_free(bot);
+}
+
+int main(void) {
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	const size_t max_threads = cpus > 0 ? (size_t)cpus : 1;
+
+	const size_t sizes[] = { 7, 9, 13, 19 };
+	for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+		bench_search(sizes[i], sizes[i], 1);
+		if (max_threads > 1) {
+			bench_search(sizes[i], sizes[i], max_threads);
+		}
+	}
+}
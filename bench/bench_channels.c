@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "channels.h"
+
+#define SUBSCRIBERS 8000 // Bounded by the descriptors a process may open here. Scaled up to TARGET below.
+#define TARGET 100000
+#define ANNOUNCEMENTS 20
+#define DROP_MS 10000
+#define ANNOUNCE_TOPIC ((uint64_t)1 << 32)
+#define MESSAGE "GOTANNOUNCE the server restarts in 5 minutes\r\n"
+
+static int readers[SUBSCRIBERS];
+static int writers[SUBSCRIBERS];
+
+static double elapsed(const struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (double)(end.tv_sec - start->tv_sec) + (double)(end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void drain(void) {
+	char buf[4096];
+	for (size_t i = 0; i < SUBSCRIBERS; i++) {
+		while (recv(readers[i], buf, sizeof buf, MSG_DONTWAIT) > 0) {
+		}
+	}
+}
+
+/**
+ * @brief Announces to every subscriber and flushes until everyone was sent
+ * it, the way the event loop would between serving everything else. Reports
+ * the whole fan-out and the longest flush, which is how long game traffic
+ * waits at most.
+ *
+ */
+static void bench_announce(const char *name, size_t flush_sends) {
+	Channels *c = channels_create(flush_sends);
+	Coalescer *out = coalescer_create(DROP_MS);
+	for (size_t i = 0; i < SUBSCRIBERS; i++) {
+		channels_subscribe(c, writers[i], ANNOUNCE_TOPIC);
+	}
+
+	static int dropped[SUBSCRIBERS];
+	double total = 0;
+	double longest = 0;
+	size_t flushes = 0;
+	for (int a = 0; a < ANNOUNCEMENTS; a++) {
+		channels_publish(c, ANNOUNCE_TOPIC, MESSAGE, strlen(MESSAGE));
+		while (channels_is_busy(c)) {
+			struct timespec start;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			channels_flush(c, out, dropped, SUBSCRIBERS);
+			const double took = elapsed(&start);
+
+			total += took;
+			longest = took > longest ? took : longest;
+			flushes++;
+		}
+		drain();
+	}
+
+	// Announcing to TARGET subscribers at once takes as long as it does per
+	// subscriber here. In slices it takes more flushes, each as long as here.
+	const double per_subscriber = total / ANNOUNCEMENTS / SUBSCRIBERS;
+	const double stall = flush_sends < SUBSCRIBERS ? longest : per_subscriber * TARGET;
+	printf("%-6s subscribers=%d flush_sends=%-5zu fanout_ms=%-6.2f flush_mean_ms=%-6.3f flush_max_ms=%-6.3f "
+		   "fanout_%dk_ms=%-6.1f stall_%dk_ms=%.3f\n",
+		name, SUBSCRIBERS, flush_sends, total / ANNOUNCEMENTS * 1e3, total / (double)flushes * 1e3, longest * 1e3,
+		TARGET / 1000, per_subscriber * TARGET * 1e3, TARGET / 1000, stall * 1e3);
+
+	channels_free(c);
+	coalescer_free(out);
+}
+
+int main(void) {
+	for (size_t i = 0; i < SUBSCRIBERS; i++) {
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+			perror("socketpair");
+			return 1;
+		}
+		writers[i] = sv[0];
+		readers[i] = sv[1];
+	}
+
+	bench_announce("whole", SUBSCRIBERS);
+	bench_announce("sliced", 1024);
+	bench_announce("sliced", 512);
+	bench_announce("sliced", 256);
+
+	for (size_t i = 0; i < SUBSCRIBERS; i++) {
+		close(writers[i]);
+		close(readers[i]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "coalescer.h"
+
+#define GAMES 1000
+#define ITERATIONS 200
+#define DROP_MS 10000
+
+static int readers[GAMES * 2];
+static int writers[GAMES * 2];
+
+static double elapsed(const struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (double)(end.tv_sec - start->tv_sec) + (double)(end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void drain(void) {
+	char buf[4096];
+	for (size_t i = 0; i < GAMES * 2; i++) {
+		while (recv(readers[i], buf, sizeof buf, MSG_DONTWAIT) > 0) {
+		}
+	}
+}
+
+typedef struct Send {
+	size_t to; // 0 for the mover, 1 for the opponent.
+	const char *data;
+} Send;
+
+// What a game sends in one event loop iteration when a move is answered right
+// away and wins: the reply to the mover, the move to the opponent, the answer
+// to the mover and the winner to both.
+static const Send MOVE[] = {
+	{ 0, "OK\r\n" },
+	{ 1, "GOTMOVE 4 4\r\n" },
+	{ 0, "GOTMOVE 3 4\r\n" },
+	{ 1, "GOTWINNER O\r\n" },
+	{ 0, "GOTWINNER O\r\n" },
+};
+
+static double run(Coalescer *c, size_t *sends) {
+	struct timespec start;
+	double total = 0;
+
+	for (int it = 0; it < ITERATIONS; it++) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (size_t g = 0; g < GAMES; g++) {
+			for (size_t m = 0; m < sizeof MOVE / sizeof *MOVE; m++) {
+				const int fd = writers[g * 2 + MOVE[m].to];
+				const size_t len = strlen(MOVE[m].data);
+				if (c) {
+					coalescer_add(c, fd, MOVE[m].data, len);
+				} else {
+					send(fd, MOVE[m].data, len, 0);
+					(*sends)++;
+				}
+			}
+		}
+		if (c) {
+			int dropped[1];
+			coalescer_flush(c, 0, dropped, 1);
+			*sends += GAMES * 2; // Every connection was sent to, once.
+		}
+		total += elapsed(&start);
+		drain();
+	}
+
+	return total;
+}
+
+int main(void) {
+	for (size_t i = 0; i < GAMES * 2; i++) {
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+			perror("socketpair");
+			return 1;
+		}
+		writers[i] = sv[0];
+		readers[i] = sv[1];
+	}
+
+	size_t sends = 0;
+	const double naive = run(NULL, &sends);
+	printf("per_message games=%d iteration_us=%-8.1f sends=%zu\n", GAMES, naive / ITERATIONS * 1e6, sends / ITERATIONS);
+
+	Coalescer *c = coalescer_create(DROP_MS);
+	sends = 0;
+	const double coalesced = run(c, &sends);
+	printf("coalesced   games=%d iteration_us=%-8.1f sends=%zu\n", GAMES, coalesced / ITERATIONS * 1e6, sends / ITERATIONS);
+	coalescer_free(c);
+
+	for (size_t i = 0; i < GAMES * 2; i++) {
+		close(writers[i]);
+		close(readers[i]);
+	}
+
+	return 0;
+}
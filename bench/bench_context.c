@@ -0,0 +1,123 @@
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "context.h"
+#include "player.h"
+
+#define CONNECTIONS 100000
+#define READY 1000 // Connections with something to read in one event loop iteration.
+#define ITERATIONS 20
+
+static volatile uintptr_t sink; // Keeps the lookups from being optimized out.
+
+static double elapsed(const struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (double)(end.tv_sec - start->tv_sec) + (double)(end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief Finds a player by scanning every player, which is how the players
+ * were looked up before they were indexed.
+ *
+ */
+static Player *scan_players(Context *ctx, int fd) {
+	for (size_t i = 0; i < ctx->players_len; i++) {
+		if (ctx->players[i].fd == fd) {
+			return &ctx->players[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Finds a player by scanning a dense copy of every fd, which is what
+ * only splitting the fds from the rest of the players would do.
+ *
+ */
+static Player *scan_fds(Context *ctx, const int *fds, int fd) {
+	for (size_t i = 0; i < ctx->players_len; i++) {
+		if (fds[i] == fd) {
+			return &ctx->players[i];
+		}
+	}
+
+	return NULL;
+}
+
+static uint64_t next(uint64_t *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+int main(void) {
+	Context *ctx = ctx_create();
+	if (!ctx || ctx_reserve(ctx, CONNECTIONS) < 0) {
+		return 1;
+	}
+	for (int fd = 0; fd < CONNECTIONS; fd++) {
+		if (ctx_add_player(ctx, &(Player){ .fd = fd, .read = player_read, .write = player_write }) < 0) {
+			return 1;
+		}
+	}
+
+	// Accepted and closed in a random order, like a server that has been up a while.
+	uint64_t state = 0x9e3779b97f4a7c15ull;
+	for (int i = 0; i < CONNECTIONS; i++) {
+		const int fd = (int)(next(&state) % CONNECTIONS);
+		Player player = *ctx_get_player(ctx, fd);
+		ctx_remove_player(ctx, fd);
+		ctx_add_player(ctx, &player);
+	}
+
+	int *fds = malloc(sizeof *fds * CONNECTIONS);
+	int *ready = malloc(sizeof *ready * READY * ITERATIONS);
+	if (!fds || !ready) {
+		return 1;
+	}
+	for (size_t i = 0; i < ctx->players_len; i++) {
+		fds[i] = ctx->players[i].fd;
+	}
+	for (size_t i = 0; i < READY * ITERATIONS; i++) {
+		ready[i] = (int)(next(&state) % CONNECTIONS);
+	}
+
+	// What dispatch does with each connection that is ready.
+	const char *names[] = { "scan_players", "scan_fds", "indexed" };
+	for (int variant = 0; variant < 3; variant++) {
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		for (size_t i = 0; i < READY * ITERATIONS; i++) {
+			const Player *player = variant == 0 ? scan_players(ctx, ready[i]) :
+				variant == 1 ? scan_fds(ctx, fds, ready[i]) : ctx_get_player(ctx, ready[i]);
+			sink += (uintptr_t)player->read;
+		}
+
+		const double total = elapsed(&start);
+		printf("%-12s connections=%d ready=%d iteration_us=%.1f\n", names[variant], CONNECTIONS, READY, total / ITERATIONS * 1e6);
+	}
+
+	// Closing and accepting as many as were ready.
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t i = 0; i < READY * ITERATIONS; i++) {
+		Player player = *ctx_get_player(ctx, ready[i]);
+		ctx_remove_player(ctx, ready[i]);
+		ctx_add_player(ctx, &player);
+	}
+	const double churn = elapsed(&start);
+	printf("%-12s connections=%d ready=%d iteration_us=%.1f\n", "churn", CONNECTIONS, READY, churn / ITERATIONS * 1e6);
+
+	free(fds);
+	free(ready);
+	ctx_destory(ctx);
+
+	return 0;
+}
@@ -0,0 +1,318 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "lobby.h"
+
+#define MOVE_GAMES 20000
+#define COLLISION_GAMES 20000
+#define COLLISION_SIZE 9
+#define BUCKET_BITS 16
+#define SNAPSHOT_GAMES 2000
+#define SNAPSHOT_REQUESTS 64 // BOARD requests served between two moves.
+#define MEMORY_GAMES 100000
+
+/**
+ * @brief A position seen during a random game and where its board is stored.
+ *
+ */
+typedef struct Position {
+	uint64_t hash;
+	size_t board;
+} Position;
+
+static const unsigned char *boards;
+static size_t board_size;
+
+static uint64_t next_random(uint64_t *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545f4914f6cdd1dULL;
+}
+
+static double elapsed(const struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (double)(end.tv_sec - start->tv_sec) + (double)(end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief Plays random moves until the game is over.
+ *
+ * @return size_t The number of moves played.
+ */
+static size_t play_random(Lobby *l, uint64_t *rng, uint16_t *empty) {
+	size_t empty_len = l->board.rows * l->board.cols;
+	for (size_t i = 0; i < empty_len; i++) {
+		empty[i] = (uint16_t)i;
+	}
+
+	size_t played = 0;
+	while (lobby_winner(l) == -1 && empty_len > 0) {
+		const size_t pick = (size_t)(next_random(rng) % empty_len);
+		const uint16_t space = empty[pick];
+		empty[pick] = empty[--empty_len];
+
+		lobby_place(l, lobby_turn(l), space / l->board.cols, space % l->board.cols);
+		played++;
+	}
+
+	return played;
+}
+
+/**
+ * @brief Reports the cost of playing and undoing a move, which includes keeping
+ * the hash up to date, next to the cost of reading the hash and of walking the
+ * whole board, which is what identifying a position took before.
+ *
+ */
+static void bench_moves(size_t size) {
+	Lobby *l = lobby_create(size, size);
+	uint16_t *empty = malloc(sizeof *empty * size * size);
+	uint64_t rng = 0x9e3779b97f4a7c15ULL;
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	size_t moves = 0;
+	for (size_t i = 0; i < MOVE_GAMES; i++) {
+		const size_t played = play_random(l, &rng, empty);
+		for (size_t j = 0; j < played; j++) {
+			lobby_undo(l);
+		}
+		moves += played;
+	}
+	const double move_ns = elapsed(&start) / (double)moves * 1e9;
+
+	// Leave a position with pieces on the board to measure against.
+	play_random(l, &rng, empty);
+
+	volatile uint64_t sink = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t i = 0; i < moves; i++) {
+		sink ^= lobby_hash(l);
+	}
+	const double hash_ns = elapsed(&start) / (double)moves * 1e9;
+
+	const size_t walks = moves / (size * size) + 1;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t i = 0; i < walks; i++) {
+		for (size_t row = 0; row < size; row++) {
+			for (size_t col = 0; col < size; col++) {
+				sink ^= (uint64_t)lobby_get(l, row, col);
+			}
+		}
+	}
+	const double walk_ns = elapsed(&start) / (double)walks * 1e9;
+	(void)sink;
+
+	printf("%zux%zu moves=%-9zu place+undo_ns=%-7.1f lobby_hash_ns=%-6.2f board_walk_ns=%.1f\n",
+		size, size, moves, move_ns, hash_ns, walk_ns);
+
+	free(empty);
+	lobby_free(l);
+}
+
+static long max_rss_kb(void) {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss; // Kilobytes on Linux.
+}
+
+/**
+ * @brief Reports how much memory a game takes by keeping many games of random
+ * moves around at once, like a server hosting them. Runs before anything else
+ * so the peak is from the games.
+ *
+ */
+static void bench_memory(size_t size) {
+	Lobby **lobbies = malloc(sizeof *lobbies * MEMORY_GAMES);
+	uint16_t *empty = malloc(sizeof *empty * size * size);
+	uint64_t rng = 0x9e3779b97f4a7c15ULL;
+	if (!lobbies || !empty) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	const long before = max_rss_kb();
+	size_t moves = 0;
+	for (size_t i = 0; i < MEMORY_GAMES; i++) {
+		lobbies[i] = lobby_create(size, size);
+		lobby_join(lobbies[i], &(Player){ .fd = 1, .name = "alice" });
+		lobby_join(lobbies[i], &(Player){ .fd = 2, .name = "bob" });
+		moves += play_random(lobbies[i], &rng, empty);
+	}
+	const long after = max_rss_kb();
+
+	printf("%zux%zu games=%d avg_moves=%-6.1f bytes_per_game=%.0f\n", size, size, MEMORY_GAMES,
+		(double)moves / MEMORY_GAMES, (double)(after - before) * 1024 / MEMORY_GAMES);
+
+	for (size_t i = 0; i < MEMORY_GAMES; i++) {
+		lobby_free(lobbies[i]);
+	}
+	free(empty);
+	free(lobbies);
+}
+
+static int compare_positions(const void *a, const void *b) {
+	const Position *pa = a;
+	const Position *pb = b;
+	if (pa->hash != pb->hash) {
+		return pa->hash < pb->hash ? -1 : 1;
+	}
+	return memcmp(boards + pa->board * board_size, boards + pb->board * board_size, board_size);
+}
+
+/**
+ * @brief Hashes every position of many random games and counts how often
+ * different positions share a hash, and how often distinct hashes share a
+ * bucket of a table indexed by the low bits of the hash.
+ *
+ */
+static void bench_collisions(void) {
+	board_size = COLLISION_SIZE * COLLISION_SIZE;
+	const size_t positions_size = COLLISION_GAMES * (board_size + 1);
+
+	Position *positions = malloc(sizeof *positions * positions_size);
+	unsigned char *stored = malloc(board_size * positions_size);
+	uint16_t *empty = malloc(sizeof *empty * board_size);
+	uint64_t rng = 0x2545f4914f6cdd1dULL;
+	if (!positions || !stored || !empty) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	size_t positions_len = 0;
+	for (size_t i = 0; i < COLLISION_GAMES; i++) {
+		Lobby *l = lobby_create(COLLISION_SIZE, COLLISION_SIZE);
+		const size_t played = play_random(l, &rng, empty);
+
+		// Record the positions from the last move back to the empty board.
+		for (size_t j = 0; j <= played; j++) {
+			unsigned char *board = stored + positions_len * board_size;
+			for (size_t space = 0; space < board_size; space++) {
+				board[space] = (unsigned char)lobby_get(l, space / COLLISION_SIZE, space % COLLISION_SIZE);
+			}
+			positions[positions_len] = (Position){ .hash = lobby_hash(l), .board = positions_len };
+			positions_len++;
+
+			lobby_undo(l);
+		}
+
+		lobby_free(l);
+	}
+
+	boards = stored;
+	qsort(positions, positions_len, sizeof *positions, compare_positions);
+
+	size_t distinct = 0;
+	size_t hashes = 0;
+	size_t collisions = 0;
+	for (size_t i = 0; i < positions_len; i++) {
+		if (i > 0 && compare_positions(&positions[i - 1], &positions[i]) == 0) {
+			continue;
+		}
+
+		distinct++;
+		if (i > 0 && positions[i - 1].hash == positions[i].hash) {
+			collisions++;
+		} else {
+			hashes++;
+		}
+	}
+
+	const size_t buckets = (size_t)1 << BUCKET_BITS;
+	unsigned char *used = calloc(buckets, 1);
+	size_t occupied = 0;
+	for (size_t i = 0; i < positions_len; i++) {
+		if (i > 0 && positions[i - 1].hash == positions[i].hash) {
+			continue;
+		}
+
+		const size_t bucket = positions[i].hash & (buckets - 1);
+		if (!used[bucket]) {
+			used[bucket] = 1;
+			occupied++;
+		}
+	}
+
+	// Distinct hashes that can't get a bucket of their own, against what a
+	// uniformly random hash would give.
+	const double expected = (double)hashes - (double)buckets * (1 - pow(1 - 1 / (double)buckets, (double)hashes));
+	printf("%dx%d positions=%-8zu distinct=%-8zu hash_collisions=%zu\n",
+		COLLISION_SIZE, COLLISION_SIZE, positions_len, distinct, collisions);
+	printf("%zu buckets: shared=%-8zu expected_shared=%.0f\n", buckets, hashes - occupied, expected);
+
+	free(used);
+	free(empty);
+	free(stored);
+	free(positions);
+}
+
+/**
+ * @brief Reports the cost of encoding a snapshot after a move against serving
+ * it from the cache, and the average snapshot length over whole games.
+ *
+ */
+static void bench_snapshots(size_t size) {
+	Lobby *l = lobby_create(size, size);
+	uint16_t *empty = malloc(sizeof *empty * size * size);
+	uint64_t rng = 0x9e3779b97f4a7c15ULL;
+
+	double encode = 0;
+	double cached = 0;
+	size_t encodes = 0;
+	size_t bytes = 0;
+	volatile size_t sink = 0;
+	for (size_t i = 0; i < SNAPSHOT_GAMES; i++) {
+		const size_t played = play_random(l, &rng, empty);
+		for (size_t j = 0; j <= played; j++) {
+			struct timespec start;
+			size_t len;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			lobby_snapshot(l, &len);
+			encode += elapsed(&start);
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			for (size_t k = 0; k < SNAPSHOT_REQUESTS; k++) {
+				sink += (size_t)lobby_snapshot(l, &len)[0];
+			}
+			cached += elapsed(&start);
+
+			encodes++;
+			bytes += len;
+			lobby_undo(l);
+		}
+	}
+	(void)sink;
+
+	printf("%zux%zu snapshots=%-8zu encode_ns=%-7.1f cached_ns=%-6.2f avg_bytes=%.1f board_cells=%zu\n",
+		size, size, encodes, encode / (double)encodes * 1e9, cached / (double)(encodes * SNAPSHOT_REQUESTS) * 1e9,
+		(double)bytes / (double)encodes, size * size);
+
+	free(empty);
+	lobby_free(l);
+}
+
+int main(int argc, char **argv) {
+	const size_t sizes[] = { 7, 9, 13, 19 };
+
+	// The peak only goes up, so one size is measured per run.
+	if (argc > 1 && strcmp(argv[1], "memory") == 0) {
+		bench_memory(argc > 2 ? (size_t)strtoul(argv[2], NULL, 10) : 19);
+		return 0;
+	}
+	for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+		bench_moves(sizes[i]);
+	}
+
+	for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+		bench_snapshots(sizes[i]);
+	}
+
+	bench_collisions();
+}
@@ -0,0 +1,90 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "matchmaker.h"
+
+#define PLAYERS 100000
+#define STEADY_TICKS 100000
+
+static uint64_t next_random(uint64_t *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545f4914f6cdd1dULL;
+}
+
+static double elapsed(const struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (double)(end.tv_sec - start->tv_sec) + (double)(end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief A rating drawn from a rough bell curve around the starting rating.
+ *
+ */
+static int random_rating(uint64_t *rng) {
+	int sum = 0;
+	for (int i = 0; i < 4; i++) {
+		sum += (int)(next_random(rng) % 500);
+	}
+
+	return MATCHMAKER_RATING_START - 1000 + sum;
+}
+
+int main(void) {
+	const MatchmakerConfig config = { .window_base = 50, .window_per_sec = 50, .window_max = 500 };
+	Matchmaker *mm = matchmaker_create(&config);
+	if (!mm) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	static MatchmakerPair pairs[PLAYERS / 2];
+	uint64_t rng = 0x9e3779b97f4a7c15ULL;
+	struct timespec start;
+
+	// A burst of players arriving during one tick, all paired by the next.
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int fd = 0; fd < PLAYERS; fd++) {
+		matchmaker_enqueue(mm, fd, random_rating(&rng), (uint64_t)fd / 100);
+	}
+	const double enqueue = elapsed(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	const size_t made = matchmaker_tick(mm, PLAYERS / 100, pairs, PLAYERS / 2);
+	const double burst = elapsed(&start);
+
+	printf("burst players=%d enqueue_ns=%-6.1f tick_ms=%-7.3f pair_ns=%-6.1f pairs=%zu left=%zu\n",
+		PLAYERS, enqueue / PLAYERS * 1e9, burst * 1e3, burst / (double)made * 1e9, made, matchmaker_queued(mm));
+
+	// Players trickling in one at a time with a tick after each, so every
+	// tick only has the leftovers of the last one to look at.
+	double worst = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < STEADY_TICKS; i++) {
+		struct timespec tick_start;
+		clock_gettime(CLOCK_MONOTONIC, &tick_start);
+
+		const uint64_t now = (uint64_t)PLAYERS / 100 + (uint64_t)i;
+		matchmaker_enqueue(mm, PLAYERS + i, random_rating(&rng), now);
+		matchmaker_tick(mm, now, pairs, PLAYERS / 2);
+
+		const double took = elapsed(&tick_start);
+		if (took > worst) {
+			worst = took;
+		}
+	}
+	const double steady = elapsed(&start);
+
+	MatchmakerStats stats;
+	matchmaker_stats(mm, &stats);
+	printf("steady ticks=%d enqueue+tick_us=%-6.3f worst_us=%-7.1f queued=%zu wait_avg_ms=%llu p50_ms=%llu p99_ms=%llu max_ms=%llu\n",
+		STEADY_TICKS, steady / STEADY_TICKS * 1e6, worst * 1e6, stats.queued, (unsigned long long)stats.wait_avg_ms,
+		(unsigned long long)stats.wait_p50_ms, (unsigned long long)stats.wait_p99_ms, (unsigned long long)stats.wait_max_ms);
+
+	matchmaker_free(mm);
+
+	return 0;
+}
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lobby.h"
+#include "solver.h"
+
+#define BUDGET_MS 10000
+#define TABLE_BITS 22
+#define PROBES 100000
+
+static double elapsed(const struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (double)(end.tv_sec - start->tv_sec) + (double)(end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static const char *result_name(SolverResult result) {
+	switch (result) {
+	case SOLVER_WIN:
+		return "win";
+	case SOLVER_LOSS:
+		return "loss";
+	case SOLVER_UNKNOWN:
+	default:
+		return "unknown";
+	}
+}
+
+/**
+ * @brief Solves the empty board and reports the search time, then reports how
+ * long a lookup of the solved position takes.
+ *
+ */
+static void bench_solve(size_t rows, size_t cols, size_t threads) {
+	Solver *solver = solver_create(threads, TABLE_BITS);
+	Lobby *l = lobby_create(rows, cols);
+	if (!solver || !l) {
+		fprintf(stderr, "failed to create solver\n");
+		exit(1);
+	}
+
+	SolverStats stats;
+	const SolverResult result = solver_solve(solver, l, BUDGET_MS, NULL, &stats);
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t i = 0; i < PROBES; i++) {
+		solver_probe(solver, l, NULL);
+	}
+	const double probe_us = elapsed(&start) / PROBES * 1e6;
+
+	printf("%zux%zu threads=%-3zu result=%-7s nodes=%-11lu seconds=%-8.3f nodes/sec=%-11.0f probe_us=%.3f\n",
+		rows, cols, threads, result_name(result), stats.nodes, stats.seconds, (double)stats.nodes / stats.seconds, probe_us);
+
+	lobby_free(l);
+	solver_free(solver);
+}
+
+int main(void) {
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	const size_t max_threads = cpus > 0 ? (size_t)cpus : 1;
+
+	const size_t sizes[][2] = { { 3, 3 }, { 3, 4 }, { 4, 4 } };
+	for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+		bench_solve(sizes[i][0], sizes[i][1], 1);
+		if (max_threads > 1) {
+			bench_solve(sizes[i][0], sizes[i][1], max_threads);
+		}
+	}
+}
@@ -0,0 +1,132 @@
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "lobby.h"
+#include "store.h"
+
+#define GAMES 100000
+
+static uint64_t next_random(uint64_t *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+static double elapsed_us(const struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (double)(end.tv_sec - start->tv_sec) * 1e6 + (double)(end.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+	const double da = *(const double *)a;
+	const double db = *(const double *)b;
+	return da < db ? -1 : da > db;
+}
+
+static size_t heap_bytes(void) {
+	return mallinfo2().uordblks;
+}
+
+/**
+ * @brief Plays random moves until the game is over, then takes back the last
+ * one, leaving a game that is still going like one waiting on a player.
+ *
+ */
+static size_t play_random(Lobby *l, uint64_t *rng, uint16_t *empty) {
+	while (lobby_winner(l) == -1) {
+		const size_t empty_len = lobby_empty(l, empty);
+		const uint16_t space = empty[next_random(rng) % empty_len];
+		lobby_place(l, lobby_turn(l), space / l->board.cols, space % l->board.cols);
+	}
+	lobby_undo(l);
+
+	return lobby_moves_len(l);
+}
+
+/**
+ * @brief Reports how much memory many games in progress take awake and asleep,
+ * and how long putting them to sleep and waking them takes.
+ *
+ */
+static void bench_store(Store *s, size_t size) {
+	Lobby **lobbies = malloc(sizeof *lobbies * GAMES);
+	uint16_t *empty = malloc(sizeof *empty * size * size);
+	double *takes_us = malloc(sizeof *takes_us * GAMES);
+	uint64_t rng = 0x9e3779b97f4a7c15ULL;
+	if (!lobbies || !empty || !takes_us) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	const size_t before = heap_bytes();
+	size_t moves = 0;
+	for (size_t i = 0; i < GAMES; i++) {
+		lobbies[i] = lobby_create(size, size);
+		lobby_join(lobbies[i], &(Player){ .fd = 1, .name = "alice" });
+		lobby_join(lobbies[i], &(Player){ .fd = 2, .name = "bob" });
+		moves += play_random(lobbies[i], &rng, empty);
+	}
+	const size_t awake = heap_bytes();
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t i = 0; i < GAMES; i++) {
+		if (store_put(s, lobbies[i]) < 0) {
+			fprintf(stderr, "failed to put lobby to sleep\n");
+			exit(1);
+		}
+	}
+	const double put_us = elapsed_us(&start);
+	const size_t asleep = heap_bytes();
+
+	// Woken in a random order, as players come back.
+	for (size_t i = GAMES - 1; i > 0; i--) {
+		const size_t j = (size_t)(next_random(&rng) % (i + 1));
+		Lobby *tmp = lobbies[i];
+		lobbies[i] = lobbies[j];
+		lobbies[j] = tmp;
+	}
+
+	double take_us = 0;
+	for (size_t i = 0; i < GAMES; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (store_take(s, lobbies[i]) < 0) {
+			fprintf(stderr, "failed to wake lobby\n");
+			exit(1);
+		}
+		takes_us[i] = elapsed_us(&start);
+		take_us += takes_us[i];
+	}
+	qsort(takes_us, GAMES, sizeof *takes_us, compare_doubles);
+
+	printf("%zux%zu games=%d avg_moves=%-6.1f awake_bytes=%-5.0f asleep_bytes=%-5.0f put_us=%-5.2f take_us=%-5.2f take_p99_us=%.2f\n",
+		size, size, GAMES, (double)moves / GAMES, (double)(awake - before) / GAMES, (double)(asleep - before) / GAMES,
+		put_us / GAMES, take_us / GAMES, takes_us[GAMES * 99 / 100]);
+
+	for (size_t i = 0; i < GAMES; i++) {
+		lobby_free(lobbies[i]);
+	}
+	free(takes_us);
+	free(empty);
+	free(lobbies);
+}
+
+int main(int argc, char **argv) {
+	Store *s = store_open(argc > 1 ? argv[1] : ".");
+	if (!s) {
+		return 1;
+	}
+
+	const size_t sizes[] = { 9, 19 };
+	for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+		bench_store(s, sizes[i]);
+	}
+
+	store_close(s);
+	return 0;
+}
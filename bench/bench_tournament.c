@@ -0,0 +1,95 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "tournament.h"
+
+#define ENTRANTS 10000
+#define PARALLEL 512
+#define ROUND_ROBIN_ROUNDS 20 // A full round robin of this size is 10,000 rounds, so only time the first few.
+
+static uint64_t next_random(uint64_t *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545f4914f6cdd1dULL;
+}
+
+static double elapsed(const struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (double)(end.tv_sec - start->tv_sec) + (double)(end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief Plays rounds with random results in waves of PARALLEL games. Time
+ * spent pairing is measured around the result that finishes each round, since
+ * that is what pairs the next one.
+ *
+ */
+static void run(const char *name, TournamentFormat format, size_t max_rounds) {
+	Tournament *t = tournament_create(&(TournamentConfig){ .format = format, .parallel = PARALLEL, .seed = 1 });
+	if (!t) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	for (int i = 0; i < ENTRANTS; i++) {
+		tournament_enter(t, i);
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (tournament_begin(t) < 0) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	double pairing = elapsed(&start);
+	double worst = pairing;
+
+	static TournamentGame games[PARALLEL];
+	uint64_t rng = 0x9e3779b97f4a7c15ULL;
+	unsigned long played = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (!tournament_is_over(t) && tournament_round(t) < max_rounds) {
+		const size_t made = tournament_start_games(t, games, PARALLEL);
+		for (size_t i = 0; i < made; i++) {
+			const size_t round = tournament_round(t);
+
+			struct timespec finish_start;
+			clock_gettime(CLOCK_MONOTONIC, &finish_start);
+			tournament_finish(t, games[i].id, (int)(next_random(&rng) % 2));
+			const double took = elapsed(&finish_start);
+
+			if (tournament_round(t) != round) {
+				pairing += took;
+				if (took > worst) {
+					worst = took;
+				}
+			}
+			played++;
+		}
+	}
+	const double total = elapsed(&start);
+	const size_t rounds = tournament_round(t);
+
+	TournamentStanding top;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	tournament_standings(t, &top, 1);
+	const double standings = elapsed(&start);
+
+	printf("%-11s entrants=%d rounds=%zu games=%lu game_ns=%-6.1f pair_round_us=%-7.1f worst_us=%-7.1f standings_us=%-7.1f top_score=%u\n",
+		name, ENTRANTS, rounds, played, total / (double)played * 1e9, pairing / (double)(rounds + 1) * 1e6,
+		worst * 1e6, standings * 1e6, top.score);
+
+	tournament_free(t);
+}
+
+int main(void) {
+	run("swiss", TOURNAMENT_SWISS, SIZE_MAX);
+	run("round_robin", TOURNAMENT_ROUND_ROBIN, ROUND_ROBIN_ROUNDS);
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "player.h"
+
+#define ROUNDS 200000
+#define WARMUP 10000
+#define MOVE "MOVE 3 4\r\n"
+#define REPLY "OK\r\n"
+
+static double now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+	const double da = *(const double *)a;
+	const double db = *(const double *)b;
+	return da < db ? -1 : da > db;
+}
+
+/**
+ * @brief Answers every message on the connection the way the server answers a
+ * move, through the player's hooks, until the client hangs up.
+ *
+ */
+static void *serve(void *arg) {
+	const int listener = *(int *)arg;
+	Player player = { .fd = accept(listener, NULL, NULL), .read = player_read, .write = player_write };
+	if (player.fd < 0) {
+		perror("accept");
+		exit(1);
+	}
+
+	// Like the server. Fails without harm on UNIX sockets.
+	const int yes = 1;
+	setsockopt(player.fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof yes);
+
+	char buf[512];
+	while (player.read(&player, buf, sizeof buf) > 0) {
+		player.write(&player, REPLY, strlen(REPLY));
+	}
+
+	close(player.fd);
+	return NULL;
+}
+
+/**
+ * @brief Sends moves one at a time and waits for each reply, like a client
+ * playing, and reports the round trips.
+ *
+ */
+static void bench_transport(const char *name, int listener, const struct sockaddr *addr, socklen_t addrlen) {
+	pthread_t server;
+	pthread_create(&server, NULL, serve, &listener);
+
+	const int fd = socket(addr->sa_family, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, addr, addrlen) < 0) {
+		perror("connect");
+		exit(1);
+	}
+	const int yes = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof yes);
+
+	double *rtts_us = malloc(sizeof *rtts_us * ROUNDS);
+	if (!rtts_us) {
+		exit(1);
+	}
+
+	char buf[512];
+	double total_us = 0;
+	for (size_t i = 0; i < WARMUP + ROUNDS; i++) {
+		const double start = now_us();
+		if (send(fd, MOVE, strlen(MOVE), 0) < 0 || recv(fd, buf, sizeof buf, 0) <= 0) {
+			perror("round trip");
+			exit(1);
+		}
+		if (i >= WARMUP) {
+			rtts_us[i - WARMUP] = now_us() - start;
+			total_us += rtts_us[i - WARMUP];
+		}
+	}
+	qsort(rtts_us, ROUNDS, sizeof *rtts_us, compare_doubles);
+
+	printf("%-8s rounds=%d rtt_us=%-6.2f rtt_p99_us=%-6.2f msgs_per_sec=%.0f\n",
+		name, ROUNDS, total_us / ROUNDS, rtts_us[ROUNDS * 99 / 100], ROUNDS / (total_us / 1e6));
+
+	close(fd);
+	pthread_join(server, NULL);
+	close(listener);
+	free(rtts_us);
+}
+
+int main(void) {
+	struct sockaddr_in tcp = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+	socklen_t tcp_len = sizeof tcp;
+	const int tcp_listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (tcp_listener < 0 || bind(tcp_listener, (struct sockaddr *)&tcp, sizeof tcp) < 0 || listen(tcp_listener, 1) < 0 ||
+		getsockname(tcp_listener, (struct sockaddr *)&tcp, &tcp_len) < 0) {
+		perror("tcp");
+		return 1;
+	}
+	bench_transport("tcp", tcp_listener, (struct sockaddr *)&tcp, tcp_len);
+
+	struct sockaddr_un local = { .sun_family = AF_UNIX };
+	snprintf(local.sun_path, sizeof local.sun_path, "bench_transport_%d.sock", (int)getpid());
+	const int local_listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (local_listener < 0 || bind(local_listener, (struct sockaddr *)&local, sizeof local) < 0 || listen(local_listener, 1) < 0) {
+		perror("unix");
+		return 1;
+	}
+	bench_transport("unix", local_listener, (struct sockaddr *)&local, sizeof local);
+	unlink(local.sun_path);
+
+	return 0;
+}
@@ -0,0 +1,813 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libnogo/nogo.h"
+
+#include "archive.h"
+#include "bytes.h"
+#include "log.h"
+
+#define INDEX_MAGIC "NOGOAIX1"
+#define INDEX_MAGIC_SIZE 8
+
+#define RECORD_HEADER_SIZE 23
+#define MAX_BOARD_SIZE 255 // Rows and cols are stored in one byte.
+
+// Address space reserved for the segment being written so records never move
+// while it grows. Only the pages that are written take memory.
+#define SEGMENT_MAX_BYTES ((size_t)64 * 1024 * 1024)
+
+#define PATH_SIZE 4096
+
+/**
+ * @brief Layout of a sealed index file. The index is derived from its segment
+ * and is rebuilt if it is missing or unreadable, so it is stored in the host's
+ * byte order and mapped directly.
+ *
+ * The header is followed by count IndexEntry sorted by id, count uint32_t
+ * entry numbers sorted by date, and 2 * count NameEntry sorted by name.
+ */
+typedef struct IndexHeader {
+	char magic[INDEX_MAGIC_SIZE];
+	uint32_t count;
+	uint32_t reserved;
+} IndexHeader;
+
+typedef struct IndexEntry {
+	uint64_t id;
+	int64_t date;
+	uint32_t offset; // Where the record starts in the segment.
+	uint32_t size;
+} IndexEntry;
+
+typedef struct NameEntry {
+	char name[PLAYER_NAME_SIZE];
+	uint32_t entry; // Index into the entries of the segment.
+} NameEntry;
+
+typedef struct Segment {
+	uint32_t n; // Number in the segment's file name.
+
+	unsigned char *data; // Mapped read-only records.
+	size_t data_len; // Number of valid bytes in data.
+	size_t data_map_size;
+
+	void *index; // Mapped index file. NULL while the segment is being written.
+	size_t index_size;
+
+	const IndexEntry *entries;
+	const uint32_t *dates;
+	const NameEntry *names;
+	size_t count;
+} Segment;
+
+struct Archive {
+	pthread_mutex_t lock; // Held by every public function but open and close.
+	char *dir;
+
+	Segment *segments; // Sealed segments ordered by number, followed by the active one.
+	size_t segments_len;
+
+	// The segment being written. Its index lives in memory until it is sealed.
+	int active_fd;
+	IndexEntry *active_entries;
+	NameEntry *active_names;
+
+	uint64_t next_id;
+};
+
+static Segment *active_segment(Archive *a) {
+	return &a->segments[a->segments_len - 1];
+}
+
+static void segment_path(char *dst, const Archive *a, uint32_t n, const char *ext) {
+	snprintf(dst, PATH_SIZE, "%s/seg-%06u.%s", a->dir, n, ext);
+}
+
+/**
+ * @brief Parses the record at the start of buf.
+ *
+ * @return size_t The size of the record. 0 if the record is incomplete.
+ */
+static size_t parse_record(const unsigned char *buf, size_t len, ArchiveGame *game) {
+	if (len < RECORD_HEADER_SIZE) {
+		return 0;
+	}
+
+	memset(game, 0, sizeof *game);
+	game->id = get_u64(buf);
+	game->date = (int64_t)get_u64(buf + 8);
+	game->rows = buf[16];
+	game->cols = buf[17];
+	game->winner = (char)buf[18];
+	game->moves_len = get_u16(buf + 21);
+
+	const size_t names_len[2] = { buf[19], buf[20] };
+	const size_t move_size = game->rows * game->cols > 256 ? 2 : 1;
+	const size_t size = RECORD_HEADER_SIZE + names_len[0] + names_len[1] + game->moves_len * move_size;
+	if (size > len || names_len[0] >= PLAYER_NAME_SIZE || names_len[1] >= PLAYER_NAME_SIZE) {
+		return 0;
+	}
+
+	memcpy(game->players[0], buf + RECORD_HEADER_SIZE, names_len[0]);
+	memcpy(game->players[1], buf + RECORD_HEADER_SIZE + names_len[0], names_len[1]);
+	game->moves = buf + RECORD_HEADER_SIZE + names_len[0] + names_len[1];
+
+	return size;
+}
+
+/**
+ * @brief Encodes the game in the lobby into buf.
+ *
+ * @return size_t The size of the record.
+ */
+static size_t encode_record(unsigned char *buf, const Lobby *l, uint64_t id, int64_t date) {
+	const char *names[2] = { "", "" };
+	for (int i = 0; i < l->players_len; i++) {
+		names[l->players[i].team == 'X'] = l->players[i].name;
+	}
+
+	const size_t names_len[2] = { strnlen(names[0], PLAYER_NAME_SIZE), strnlen(names[1], PLAYER_NAME_SIZE) };
+	const size_t moves_len = lobby_moves_len(l);
+
+	put_u64(buf, id);
+	put_u64(buf + 8, (uint64_t)date);
+	buf[16] = (unsigned char)l->board.rows;
+	buf[17] = (unsigned char)l->board.cols;
+	buf[18] = (unsigned char)lobby_winner(l);
+	buf[19] = (unsigned char)names_len[0];
+	buf[20] = (unsigned char)names_len[1];
+	put_u16(buf + 21, (uint16_t)moves_len);
+
+	unsigned char *p = buf + RECORD_HEADER_SIZE;
+	memcpy(p, names[0], names_len[0]);
+	p += names_len[0];
+	memcpy(p, names[1], names_len[1]);
+	p += names_len[1];
+
+	const bool wide = l->board.rows * l->board.cols > 256;
+	for (size_t i = 0; i < moves_len; i++) {
+		const LobbyMove move = lobby_move_at(l, i);
+		const size_t cell = move.row * l->board.cols + move.col;
+		if (wide) {
+			put_u16(p, (uint16_t)cell);
+			p += 2;
+		} else {
+			*p++ = (unsigned char)cell;
+		}
+	}
+
+	return (size_t)(p - buf);
+}
+
+static const IndexEntry *sort_entries; // Entries that compare_dates() looks up while sorting.
+
+static int compare_dates(const void *a, const void *b) {
+	const IndexEntry *ea = &sort_entries[*(const uint32_t *)a];
+	const IndexEntry *eb = &sort_entries[*(const uint32_t *)b];
+	if (ea->date != eb->date) {
+		return ea->date < eb->date ? -1 : 1;
+	}
+	return ea->id < eb->id ? -1 : ea->id > eb->id;
+}
+
+static int compare_names(const void *a, const void *b) {
+	const NameEntry *na = a;
+	const NameEntry *nb = b;
+	const int cmp = strncmp(na->name, nb->name, PLAYER_NAME_SIZE);
+	if (cmp != 0) {
+		return cmp;
+	}
+	return na->entry < nb->entry ? -1 : na->entry > nb->entry;
+}
+
+/**
+ * @brief Writes the index of a segment and maps it.
+ *
+ * @param entries The segment's entries in id order.
+ * @param names The segment's names, two per entry, in any order. Sorted in place.
+ * @return int -1 on error. 0 otherwise.
+ */
+static int seal(Archive *a, Segment *seg, const IndexEntry *entries, NameEntry *names) {
+	const size_t count = seg->count;
+	uint32_t *dates = malloc(sizeof *dates * (count ? count : 1));
+	if (!dates) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		dates[i] = (uint32_t)i;
+	}
+	sort_entries = entries;
+	qsort(dates, count, sizeof *dates, compare_dates);
+	qsort(names, count * 2, sizeof *names, compare_names);
+
+	IndexHeader header;
+	memset(&header, 0, sizeof header);
+	memcpy(header.magic, INDEX_MAGIC, INDEX_MAGIC_SIZE);
+	header.count = (uint32_t)count;
+
+	char path[PATH_SIZE];
+	char tmp_path[PATH_SIZE + 4];
+	segment_path(path, a, seg->n, "idx");
+	snprintf(tmp_path, sizeof tmp_path, "%s.tmp", path);
+
+	int result = -1;
+	FILE *f = fopen(tmp_path, "wb");
+	if (f) {
+		const bool wrote = fwrite(&header, sizeof header, 1, f) == 1
+			&& fwrite(entries, sizeof *entries, count, f) == count
+			&& fwrite(dates, sizeof *dates, count, f) == count
+			&& fwrite(names, sizeof *names, count * 2, f) == count * 2;
+		if (fclose(f) == 0 && wrote) {
+			result = rename(tmp_path, path);
+		}
+	}
+	free(dates);
+
+	if (result < 0) {
+		perror("archive: seal");
+		return -1;
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+
+	seg->index_size = sizeof header + count * (sizeof *entries + sizeof *dates + 2 * sizeof *names);
+	seg->index = mmap(NULL, seg->index_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (seg->index == MAP_FAILED) {
+		seg->index = NULL;
+		return -1;
+	}
+
+	const unsigned char *base = seg->index;
+	seg->entries = (const IndexEntry *)(const void *)(base + sizeof header);
+	seg->dates = (const uint32_t *)(const void *)(base + sizeof header + count * sizeof *entries);
+	seg->names = (const NameEntry *)(const void *)(base + sizeof header + count * (sizeof *entries + sizeof *dates));
+
+	return 0;
+}
+
+/**
+ * @brief Maps the index of a sealed segment if it exists and matches the
+ * segment.
+ *
+ * @return int -1 if the index needs to be rebuilt. 0 otherwise.
+ */
+static int map_index(Archive *a, Segment *seg) {
+	char path[PATH_SIZE];
+	segment_path(path, a, seg->n, "idx");
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+
+	struct stat st;
+	void *index = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(IndexHeader)) {
+		index = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+
+	if (index == MAP_FAILED) {
+		return -1;
+	}
+
+	const IndexHeader *header = index;
+	const size_t count = header->count;
+	const size_t expect = sizeof *header + count * (sizeof(IndexEntry) + sizeof(uint32_t) + 2 * sizeof(NameEntry));
+	if (memcmp(header->magic, INDEX_MAGIC, INDEX_MAGIC_SIZE) != 0 || expect != (size_t)st.st_size) {
+		munmap(index, (size_t)st.st_size);
+		return -1;
+	}
+
+	const unsigned char *base = index;
+	seg->index = index;
+	seg->index_size = (size_t)st.st_size;
+	seg->count = count;
+	seg->entries = (const IndexEntry *)(const void *)(base + sizeof *header);
+	seg->dates = (const uint32_t *)(const void *)(base + sizeof *header + count * sizeof(IndexEntry));
+	seg->names = (const NameEntry *)(const void *)(base + sizeof *header + count * (sizeof(IndexEntry) + sizeof(uint32_t)));
+
+	return 0;
+}
+
+/**
+ * @brief Rebuilds the index of a segment that was not sealed by scanning its
+ * records. A torn record at the end is cut off.
+ *
+ * @return int -1 on error. 0 otherwise.
+ */
+static int rebuild_index(Archive *a, Segment *seg) {
+	IndexEntry *entries = malloc(sizeof *entries * ARCHIVE_SEGMENT_GAMES);
+	NameEntry *names = calloc(ARCHIVE_SEGMENT_GAMES * 2, sizeof *names);
+	if (!entries || !names) {
+		free(entries);
+		free(names);
+		return -1;
+	}
+
+	size_t offset = 0;
+	seg->count = 0;
+	while (seg->count < ARCHIVE_SEGMENT_GAMES) {
+		ArchiveGame game;
+		const size_t size = parse_record(seg->data + offset, seg->data_len - offset, &game);
+		if (size == 0) {
+			break;
+		}
+
+		entries[seg->count] = (IndexEntry){ .id = game.id, .date = game.date, .offset = (uint32_t)offset, .size = (uint32_t)size };
+		for (size_t p = 0; p < 2; p++) {
+			memcpy(names[seg->count * 2 + p].name, game.players[p], PLAYER_NAME_SIZE);
+			names[seg->count * 2 + p].entry = (uint32_t)seg->count;
+		}
+		seg->count++;
+		offset += size;
+	}
+
+	if (offset != seg->data_len) {
+		LOG_ERROR("archive: discarding %zu bytes of torn record in segment %u\n", seg->data_len - offset, seg->n);
+
+		char path[PATH_SIZE];
+		segment_path(path, a, seg->n, "dat");
+		if (truncate(path, (off_t)offset) < 0) {
+			perror("archive: truncate");
+		}
+		seg->data_len = offset;
+	}
+
+	const int result = seal(a, seg, entries, names);
+	free(entries);
+	free(names);
+	return result;
+}
+
+static int load_segment(Archive *a, Segment *seg) {
+	char path[PATH_SIZE];
+	segment_path(path, a, seg->n, "dat");
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	seg->data_len = (size_t)st.st_size;
+	seg->data_map_size = seg->data_len;
+	if (seg->data_len > 0) {
+		void *data = mmap(NULL, seg->data_len, PROT_READ, MAP_SHARED, fd, 0);
+		seg->data = data == MAP_FAILED ? NULL : data;
+	}
+	close(fd);
+
+	if (seg->data_len > 0 && !seg->data) {
+		return -1;
+	}
+
+	if (map_index(a, seg) < 0) {
+		return rebuild_index(a, seg);
+	}
+
+	return 0;
+}
+
+static int compare_u32(const void *a, const void *b) {
+	const uint32_t ua = *(const uint32_t *)a;
+	const uint32_t ub = *(const uint32_t *)b;
+	return ua < ub ? -1 : ua > ub;
+}
+
+/**
+ * @brief Lists the numbers of all segment files in the archive directory.
+ *
+ * @return uint32_t* Sorted segment numbers. NULL on error.
+ */
+static uint32_t *list_segments(const char *dir, size_t *len) {
+	DIR *d = opendir(dir);
+	if (!d) {
+		perror("archive: opendir");
+		return NULL;
+	}
+
+	size_t size = 16;
+	uint32_t *result = malloc(sizeof *result * size);
+	*len = 0;
+
+	struct dirent *ent;
+	while (result && (ent = readdir(d)) != NULL) {
+		unsigned n;
+		char ext[4];
+		if (sscanf(ent->d_name, "seg-%6u.%3s", &n, ext) != 2 || strcmp(ext, "dat") != 0) {
+			continue;
+		}
+
+		if (*len == size) {
+			size *= 2;
+			uint32_t *grown = realloc(result, sizeof *result * size);
+			if (!grown) {
+				free(result);
+				result = NULL;
+				break;
+			}
+			result = grown;
+		}
+		result[(*len)++] = n;
+	}
+	closedir(d);
+
+	if (result) {
+		qsort(result, *len, sizeof *result, compare_u32);
+	}
+
+	return result;
+}
+
+/**
+ * @brief Starts a new segment to append games to.
+ *
+ * @return int -1 on error. 0 otherwise.
+ */
+static int start_segment(Archive *a) {
+	const uint32_t n = a->segments_len > 0 ? a->segments[a->segments_len - 1].n + 1 : 0;
+
+	Segment *grown = realloc(a->segments, sizeof *a->segments * (a->segments_len + 1));
+	if (!grown) {
+		return -1;
+	}
+	a->segments = grown;
+
+	Segment *seg = &a->segments[a->segments_len];
+	memset(seg, 0, sizeof *seg);
+	seg->n = n;
+
+	char path[PATH_SIZE];
+	segment_path(path, a, n, "dat");
+	a->active_fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if (a->active_fd < 0) {
+		perror("archive: open segment");
+		return -1;
+	}
+
+	void *data = mmap(NULL, SEGMENT_MAX_BYTES, PROT_READ, MAP_SHARED, a->active_fd, 0);
+	if (data == MAP_FAILED) {
+		perror("archive: mmap segment");
+		close(a->active_fd);
+		return -1;
+	}
+
+	seg->data = data;
+	seg->data_map_size = SEGMENT_MAX_BYTES;
+	seg->entries = a->active_entries;
+	seg->names = a->active_names;
+	a->segments_len++;
+
+	return 0;
+}
+
+/**
+ * @brief Unmaps a segment that holds no games and deletes its files.
+ *
+ */
+static void remove_segment(Archive *a, Segment *seg) {
+	char path[PATH_SIZE];
+	segment_path(path, a, seg->n, "dat");
+	unlink(path);
+	segment_path(path, a, seg->n, "idx");
+	unlink(path);
+
+	if (seg->data) {
+		munmap(seg->data, seg->data_map_size);
+	}
+	if (seg->index) {
+		munmap(seg->index, seg->index_size);
+	}
+	memset(seg, 0, sizeof *seg);
+}
+
+/**
+ * @brief Seals the active segment. Empty segments are removed instead.
+ *
+ * @return int -1 on error. 0 otherwise.
+ */
+static int seal_active(Archive *a) {
+	Segment *seg = active_segment(a);
+	close(a->active_fd);
+	a->active_fd = -1;
+
+	if (seg->count == 0) {
+		remove_segment(a, seg);
+		a->segments_len--;
+		return 0;
+	}
+
+	return seal(a, seg, a->active_entries, a->active_names);
+}
+
+Archive *archive_open(const char *dir) {
+	Archive *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+
+	result->dir = malloc(strlen(dir) + 1);
+	result->active_entries = malloc(sizeof *result->active_entries * ARCHIVE_SEGMENT_GAMES);
+	result->active_names = calloc(ARCHIVE_SEGMENT_GAMES * 2, sizeof *result->active_names);
+	result->active_fd = -1;
+	result->next_id = 1;
+	pthread_mutex_init(&result->lock, NULL);
+	if (!result->dir || !result->active_entries || !result->active_names) {
+		archive_close(result);
+		return NULL;
+	}
+	strcpy(result->dir, dir);
+
+	size_t numbers_len;
+	uint32_t *numbers = list_segments(dir, &numbers_len);
+	if (!numbers) {
+		archive_close(result);
+		return NULL;
+	}
+
+	result->segments = calloc(numbers_len ? numbers_len : 1, sizeof *result->segments);
+	for (size_t i = 0; result->segments && i < numbers_len; i++) {
+		Segment *seg = &result->segments[result->segments_len];
+		seg->n = numbers[i];
+		if (load_segment(result, seg) < 0) {
+			LOG_ERROR("archive: failed to load segment %u\n", numbers[i]);
+			free(numbers);
+			archive_close(result);
+			return NULL;
+		}
+
+		if (seg->count == 0) {
+			remove_segment(result, seg);
+			continue;
+		}
+		result->segments_len++;
+
+		if (seg->count > 0) {
+			result->next_id = seg->entries[seg->count - 1].id + 1;
+		}
+	}
+	free(numbers);
+
+	if (!result->segments || start_segment(result) < 0) {
+		archive_close(result);
+		return NULL;
+	}
+
+	return result;
+}
+
+void archive_close(Archive *a) {
+	if (a->active_fd >= 0 && seal_active(a) < 0) {
+		LOG_ERROR("archive: failed to seal segment\n");
+	}
+
+	for (size_t i = 0; i < a->segments_len; i++) {
+		if (a->segments[i].data) {
+			munmap(a->segments[i].data, a->segments[i].data_map_size);
+		}
+		if (a->segments[i].index) {
+			munmap(a->segments[i].index, a->segments[i].index_size);
+		}
+	}
+
+	free(a->segments);
+	free(a->active_entries);
+	free(a->active_names);
+	pthread_mutex_destroy(&a->lock);
+	free(a->dir);
+	free(a);
+}
+
+static int append(Archive *a, const Lobby *l, int64_t date, uint64_t *id) {
+	if (l->board.rows > MAX_BOARD_SIZE || l->board.cols > MAX_BOARD_SIZE) {
+		LOG_ERROR("archive: board is too large to archive\n");
+		return -1;
+	}
+
+	Segment *seg = active_segment(a);
+	const size_t max_size = RECORD_HEADER_SIZE + 2 * PLAYER_NAME_SIZE + 2 * lobby_moves_len(l);
+	if (seg->count == ARCHIVE_SEGMENT_GAMES || seg->data_len + max_size > SEGMENT_MAX_BYTES) {
+		if (seal_active(a) < 0 || start_segment(a) < 0) {
+			return -1;
+		}
+		seg = active_segment(a);
+	}
+
+	unsigned char *record = malloc(max_size);
+	if (!record) {
+		return -1;
+	}
+
+	const size_t size = encode_record(record, l, a->next_id, date);
+	ssize_t wrote = write(a->active_fd, record, size);
+	free(record);
+
+	if (wrote != (ssize_t)size) {
+		perror("archive: write");
+		return -1;
+	}
+
+	ArchiveGame game;
+	parse_record(seg->data + seg->data_len, size, &game);
+
+	a->active_entries[seg->count] = (IndexEntry){ .id = a->next_id, .date = date, .offset = (uint32_t)seg->data_len, .size = (uint32_t)size };
+	for (size_t p = 0; p < 2; p++) {
+		memcpy(a->active_names[seg->count * 2 + p].name, game.players[p], PLAYER_NAME_SIZE);
+		a->active_names[seg->count * 2 + p].entry = (uint32_t)seg->count;
+	}
+
+	seg->count++;
+	seg->data_len += size;
+	*id = a->next_id++;
+
+	return 0;
+}
+
+int archive_append(Archive *a, const Lobby *l, int64_t date, uint64_t *id) {
+	pthread_mutex_lock(&a->lock);
+	const int result = append(a, l, date, id);
+	pthread_mutex_unlock(&a->lock);
+	return result;
+}
+
+/**
+ * @brief Returns the first entry with an id greater than or equal to the given id.
+ *
+ */
+static size_t lower_bound_id(const IndexEntry *entries, size_t count, uint64_t id) {
+	size_t lo = 0;
+	size_t hi = count;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (entries[mid].id < id) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static int get(Archive *a, uint64_t id, ArchiveGame *game) {
+	// Ids increase across segments so the segment can be found by its last id.
+	size_t lo = 0;
+	size_t hi = a->segments_len;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		const Segment *seg = &a->segments[mid];
+		if (seg->count > 0 && seg->entries[seg->count - 1].id < id) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo == a->segments_len) {
+		return -1;
+	}
+
+	const Segment *seg = &a->segments[lo];
+	const size_t i = lower_bound_id(seg->entries, seg->count, id);
+	if (i == seg->count || seg->entries[i].id != id) {
+		return -1;
+	}
+
+	const IndexEntry *entry = &seg->entries[i];
+	return parse_record(seg->data + entry->offset, entry->size, game) ? 0 : -1;
+}
+
+int archive_get(Archive *a, uint64_t id, ArchiveGame *game) {
+	pthread_mutex_lock(&a->lock);
+	const int result = get(a, id, game);
+	pthread_mutex_unlock(&a->lock);
+	return result;
+}
+
+static size_t find_player(Archive *a, const char *name, uint64_t *ids, size_t ids_size) {
+	NameEntry key;
+	memset(&key, 0, sizeof key);
+	strncpy(key.name, name, PLAYER_NAME_SIZE - 1);
+
+	size_t found = 0;
+	for (size_t s = 0; s < a->segments_len; s++) {
+		const Segment *seg = &a->segments[s];
+
+		if (!seg->index) {
+			// The active segment is small and unsorted so it is scanned.
+			for (size_t i = 0; i < seg->count * 2; i++) {
+				if (strncmp(seg->names[i].name, key.name, PLAYER_NAME_SIZE) == 0) {
+					if (found < ids_size) {
+						ids[found] = seg->entries[seg->names[i].entry].id;
+					}
+					found++;
+				}
+			}
+			continue;
+		}
+
+		size_t lo = 0;
+		size_t hi = seg->count * 2;
+		while (lo < hi) {
+			const size_t mid = lo + (hi - lo) / 2;
+			if (compare_names(&seg->names[mid], &key) < 0) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+
+		for (size_t i = lo; i < seg->count * 2 && strncmp(seg->names[i].name, key.name, PLAYER_NAME_SIZE) == 0; i++) {
+			if (found < ids_size) {
+				ids[found] = seg->entries[seg->names[i].entry].id;
+			}
+			found++;
+		}
+	}
+
+	return found;
+}
+
+size_t archive_find_player(Archive *a, const char *name, uint64_t *ids, size_t ids_size) {
+	pthread_mutex_lock(&a->lock);
+	const size_t result = find_player(a, name, ids, ids_size);
+	pthread_mutex_unlock(&a->lock);
+	return result;
+}
+
+static size_t find_date(Archive *a, int64_t from, int64_t to, uint64_t *ids, size_t ids_size) {
+	size_t found = 0;
+	for (size_t s = 0; s < a->segments_len; s++) {
+		const Segment *seg = &a->segments[s];
+
+		if (!seg->index) {
+			for (size_t i = 0; i < seg->count; i++) {
+				if (seg->entries[i].date >= from && seg->entries[i].date <= to) {
+					if (found < ids_size) {
+						ids[found] = seg->entries[i].id;
+					}
+					found++;
+				}
+			}
+			continue;
+		}
+
+		size_t lo = 0;
+		size_t hi = seg->count;
+		while (lo < hi) {
+			const size_t mid = lo + (hi - lo) / 2;
+			if (seg->entries[seg->dates[mid]].date < from) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+
+		for (size_t i = lo; i < seg->count && seg->entries[seg->dates[i]].date <= to; i++) {
+			if (found < ids_size) {
+				ids[found] = seg->entries[seg->dates[i]].id;
+			}
+			found++;
+		}
+	}
+
+	return found;
+}
+
+size_t archive_find_date(Archive *a, int64_t from, int64_t to, uint64_t *ids, size_t ids_size) {
+	pthread_mutex_lock(&a->lock);
+	const size_t result = find_date(a, from, to, ids, ids_size);
+	pthread_mutex_unlock(&a->lock);
+	return result;
+}
+
+LobbyMove archive_game_move(const ArchiveGame *game, size_t i) {
+	size_t cell;
+	if (game->rows * game->cols > 256) {
+		cell = get_u16(game->moves + i * 2);
+	} else {
+		cell = game->moves[i];
+	}
+
+	return (LobbyMove){ .team = i % 2 == 0 ? 'O' : 'X', .row = cell / game->cols, .col = cell % game->cols };
+}
@@ -0,0 +1,118 @@
+#ifndef ARCHIVE_H_
+#define ARCHIVE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lobby.h"
+#include "player.h"
+
+/**
+ * @brief Stores finished games in a directory of append-only segment files.
+ * Each game is written as a compact record holding the players, the winner
+ * and the move sequence, one byte per move on boards of up to 256 spaces.
+ *
+ * Once a segment holds ARCHIVE_SEGMENT_GAMES games it is sealed: an index
+ * sorted by game id, date and player name is written beside it. Sealed
+ * segments and their indexes are only ever read through mmap(2), so looking
+ * up a game costs a few page faults instead of loading whole files, and
+ * memory use does not grow with the number of archived games. Only the index
+ * of the segment currently being written is kept in memory.
+ *
+ * The functions below may be called from any thread.
+ *
+ */
+typedef struct Archive Archive;
+
+#define ARCHIVE_SEGMENT_GAMES 16384
+
+/**
+ * @brief A game read from the archive. The moves point into the archive's
+ * mapped files and stay valid until the archive is closed.
+ *
+ */
+typedef struct ArchiveGame {
+	uint64_t id;
+	int64_t date; // Seconds since the epoch when the game was archived.
+	size_t rows;
+	size_t cols;
+	char winner;
+	char players[2][PLAYER_NAME_SIZE]; // Names of the 'O' and 'X' players.
+
+	size_t moves_len;
+	const unsigned char *moves; // Encoded moves. Use archive_game_move() to decode.
+} ArchiveGame;
+
+/**
+ * @brief Opens the archive stored in the given directory. Segments that were
+ * being written when the server stopped are sealed. The directory must exist.
+ *
+ * @param dir The directory holding the segment files.
+ * @return Archive* The opened archive. NULL if an error occurred.
+ */
+Archive *archive_open(const char *dir);
+
+/**
+ * @brief Seals the segment being written and frees the archive.
+ *
+ * @param a The archive to close.
+ */
+void archive_close(Archive *a);
+
+/**
+ * @brief Appends the finished game in the given lobby to the archive.
+ *
+ * @param a The archive to append to.
+ * @param l The lobby holding the finished game.
+ * @param date Seconds since the epoch to store with the game.
+ * @param id Set to the id the game was archived under.
+ * @return int -1 on error. 0 otherwise.
+ */
+int archive_append(Archive *a, const Lobby *l, int64_t date, uint64_t *id);
+
+/**
+ * @brief Looks up a game by id.
+ *
+ * @param a The archive to search.
+ * @param id The id of the game.
+ * @param game Set to the found game.
+ * @return int -1 if there is no game with the given id. 0 otherwise.
+ */
+int archive_get(Archive *a, uint64_t id, ArchiveGame *game);
+
+/**
+ * @brief Finds the games the given player took part in, oldest first.
+ *
+ * @param a The archive to search.
+ * @param name The name of the player.
+ * @param ids Set to the ids of the found games.
+ * @param ids_size The number of ids that fit in ids.
+ * @return size_t The number of games found. May be larger than ids_size, in
+ * which case only the first ids_size ids were written.
+ */
+size_t archive_find_player(Archive *a, const char *name, uint64_t *ids, size_t ids_size);
+
+/**
+ * @brief Finds the games archived between the given dates, inclusive.
+ *
+ * @param a The archive to search.
+ * @param from The earliest date to include.
+ * @param to The latest date to include.
+ * @param ids Set to the ids of the found games.
+ * @param ids_size The number of ids that fit in ids.
+ * @return size_t The number of games found. May be larger than ids_size, in
+ * which case only the first ids_size ids were written.
+ */
+size_t archive_find_date(Archive *a, int64_t from, int64_t to, uint64_t *ids, size_t ids_size);
+
+/**
+ * @brief Decodes a move of an archived game. The team alternates starting with
+ * 'O' so it is not stored.
+ *
+ * @param game The game to decode from.
+ * @param i The index of the move. Must be less than game->moves_len.
+ * @return LobbyMove The decoded move.
+ */
+LobbyMove archive_game_move(const ArchiveGame *game, size_t i);
+
+#endif
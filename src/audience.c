@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "audience.h"
+
+#define WATCHERS_START 64
+#define STAGES_START 4
+
+typedef struct Watcher {
+	bool is_watching;
+	bool is_stale; // Missed frames. Sent the latest snapshot instead of the next frames.
+	uint32_t lobby;
+	size_t slot; // Index in the stage's list of fds.
+} Watcher;
+
+/**
+ * @brief A lobby that is being watched.
+ *
+ */
+typedef struct Stage {
+	uint32_t lobby;
+
+	int *fds;
+	size_t fds_len;
+	size_t fds_size;
+
+	char *batch; // Frames published since the last flush.
+	size_t batch_len;
+	size_t batch_size;
+
+	char snapshot[AUDIENCE_SNAPSHOT_SIZE];
+	size_t snapshot_len;
+
+	size_t stale; // Watchers owed the snapshot.
+	bool is_dirty; // Published to since the last flush.
+} Stage;
+
+struct Audience {
+	Watcher *watchers; // Indexed by fd.
+	size_t watchers_len;
+
+	Stage **stages;
+	size_t stages_len;
+	size_t stages_size;
+};
+
+Audience *audience_create(void) {
+	Audience *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+
+	result->watchers = calloc(WATCHERS_START, sizeof *result->watchers);
+	result->watchers_len = WATCHERS_START;
+	result->stages = malloc(sizeof *result->stages * STAGES_START);
+	result->stages_size = STAGES_START;
+	if (!result->watchers || !result->stages) {
+		audience_free(result);
+		return NULL;
+	}
+
+	return result;
+}
+
+static void free_stage(Stage *s) {
+	free(s->fds);
+	free(s->batch);
+	free(s);
+}
+
+void audience_free(Audience *a) {
+	for (size_t i = 0; i < a->stages_len; i++) {
+		free_stage(a->stages[i]);
+	}
+	free(a->watchers);
+	free(a->stages);
+	free(a);
+}
+
+static Stage *find_stage(const Audience *a, uint32_t lobby, size_t *index) {
+	for (size_t i = 0; i < a->stages_len; i++) {
+		if (a->stages[i]->lobby == lobby) {
+			if (index) {
+				*index = i;
+			}
+			return a->stages[i];
+		}
+	}
+
+	return NULL;
+}
+
+static Stage *add_stage(Audience *a, uint32_t lobby) {
+	if (a->stages_len == a->stages_size) {
+		Stage **stages = realloc(a->stages, sizeof *stages * a->stages_size * 2);
+		if (!stages) {
+			return NULL;
+		}
+		a->stages = stages;
+		a->stages_size *= 2;
+	}
+
+	Stage *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+	result->lobby = lobby;
+	a->stages[a->stages_len++] = result;
+
+	return result;
+}
+
+int audience_watch(Audience *a, int fd, uint32_t lobby) {
+	if (fd < 0 || ((size_t)fd < a->watchers_len && a->watchers[fd].is_watching)) {
+		return -1;
+	}
+
+	if ((size_t)fd >= a->watchers_len) {
+		size_t len = a->watchers_len;
+		while ((size_t)fd >= len) {
+			len *= 2;
+		}
+
+		Watcher *watchers = realloc(a->watchers, sizeof *watchers * len);
+		if (!watchers) {
+			return -1;
+		}
+		memset(&watchers[a->watchers_len], 0, sizeof *watchers * (len - a->watchers_len));
+		a->watchers = watchers;
+		a->watchers_len = len;
+	}
+
+	Stage *s = find_stage(a, lobby, NULL);
+	if (!s && (s = add_stage(a, lobby)) == NULL) {
+		return -1;
+	}
+
+	if (s->fds_len == s->fds_size) {
+		const size_t size = s->fds_size > 0 ? s->fds_size * 2 : WATCHERS_START;
+		int *fds = realloc(s->fds, sizeof *fds * size);
+		if (!fds) {
+			return -1;
+		}
+		s->fds = fds;
+		s->fds_size = size;
+	}
+
+	// Starts out with the snapshot.
+	a->watchers[fd] = (Watcher){ .is_watching = true, .is_stale = true, .lobby = lobby, .slot = s->fds_len };
+	s->fds[s->fds_len++] = fd;
+	s->stale++;
+	s->is_dirty = s->is_dirty || s->snapshot_len > 0;
+
+	return 0;
+}
+
+/**
+ * @brief Takes the watcher out of its stage. The stage is removed along with
+ * its last watcher.
+ *
+ */
+static void remove_watcher(Audience *a, int fd) {
+	Watcher *w = &a->watchers[fd];
+	size_t index;
+	Stage *s = find_stage(a, w->lobby, &index);
+
+	s->fds[w->slot] = s->fds[--s->fds_len];
+	a->watchers[s->fds[w->slot]].slot = w->slot;
+
+	s->stale -= w->is_stale ? 1 : 0;
+	w->is_watching = false;
+
+	if (s->fds_len == 0) {
+		free_stage(s);
+		a->stages[index] = a->stages[--a->stages_len];
+	}
+}
+
+int audience_unwatch(Audience *a, int fd, uint32_t *lobby) {
+	if (fd < 0 || (size_t)fd >= a->watchers_len || !a->watchers[fd].is_watching) {
+		return -1;
+	}
+
+	*lobby = a->watchers[fd].lobby;
+	remove_watcher(a, fd);
+	return 0;
+}
+
+void audience_close_lobby(Audience *a, uint32_t lobby) {
+	const Stage *s;
+	while ((s = find_stage(a, lobby, NULL)) != NULL) {
+		remove_watcher(a, s->fds[s->fds_len - 1]);
+	}
+}
+
+size_t audience_watchers(const Audience *a, uint32_t lobby) {
+	const Stage *s = find_stage(a, lobby, NULL);
+	return s ? s->fds_len : 0;
+}
+
+int audience_publish(Audience *a, const AudienceFrame *frame) {
+	Stage *s = find_stage(a, frame->lobby, NULL);
+	if (!s) {
+		return 0;
+	}
+
+	if (s->batch_len + frame->data_len > s->batch_size) {
+		size_t size = s->batch_size > 0 ? s->batch_size : AUDIENCE_FRAME_SIZE;
+		while (s->batch_len + frame->data_len > size) {
+			size *= 2;
+		}
+
+		char *batch = realloc(s->batch, size);
+		if (!batch) {
+			return -1;
+		}
+		s->batch = batch;
+		s->batch_size = size;
+	}
+
+	if (frame->data_len > 0) {
+		memcpy(&s->batch[s->batch_len], frame->data, frame->data_len);
+		s->batch_len += frame->data_len;
+	}
+
+	if (frame->snapshot_len > 0) {
+		memcpy(s->snapshot, frame->snapshot, frame->snapshot_len);
+		s->snapshot_len = frame->snapshot_len;
+	}
+	s->is_dirty = true;
+
+	return 0;
+}
+
+/**
+ * @brief Sends whatever a watcher is owed.
+ *
+ * @return int -1 if the watcher should be dropped. 0 otherwise.
+ */
+static int flush_watcher(Audience *a, Stage *s, int fd, Coalescer *out) {
+	Watcher *w = &a->watchers[fd];
+
+	// Sending now would overtake what is waiting. Whatever was published is
+	// shed instead.
+	if (coalescer_is_pending(out, fd)) {
+		if (!w->is_stale && s->batch_len > 0) {
+			w->is_stale = true;
+			s->stale++;
+		}
+		return 0;
+	}
+
+	if (w->is_stale) {
+		// The snapshot covers the frames of this batch as well.
+		if (s->snapshot_len == 0) {
+			return 0;
+		}
+		w->is_stale = false;
+		s->stale--;
+		return coalescer_send(out, fd, s->snapshot, s->snapshot_len);
+	}
+
+	return s->batch_len > 0 ? coalescer_send(out, fd, s->batch, s->batch_len) : 0;
+}
+
+size_t audience_flush(Audience *a, Coalescer *out, int *dropped, size_t dropped_size) {
+	size_t dropped_len = 0;
+
+	for (size_t i = 0; i < a->stages_len; i++) {
+		Stage *s = a->stages[i];
+		if (!s->is_dirty && (s->stale == 0 || s->snapshot_len == 0)) {
+			continue;
+		}
+
+		bool is_removed = false;
+		for (size_t j = 0; j < s->fds_len;) {
+			const int fd = s->fds[j];
+			if (flush_watcher(a, s, fd, out) == 0 || dropped_len == dropped_size) {
+				j++;
+				continue;
+			}
+
+			// The last watcher takes this slot, or the stage goes with its last watcher.
+			dropped[dropped_len++] = fd;
+			if (s->fds_len == 1) {
+				remove_watcher(a, fd);
+				is_removed = true;
+				break;
+			}
+			remove_watcher(a, fd);
+		}
+
+		if (is_removed) {
+			i--; // The last stage took this index.
+		} else {
+			s->batch_len = 0;
+			s->is_dirty = false;
+		}
+	}
+
+	return dropped_len;
+}
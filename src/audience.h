@@ -0,0 +1,125 @@
+#ifndef AUDIENCE_H_
+#define AUDIENCE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "coalescer.h"
+
+#define AUDIENCE_FRAME_SIZE 512
+#define AUDIENCE_SNAPSHOT_SIZE 512 // Fits a 19x19 board.
+
+/**
+ * @brief Sends what happens in lobbies to the connections watching them.
+ * Meant to be owned by the thread that owns the connections.
+ *
+ * Frames published for a lobby are appended to a single buffer that is sent to
+ * every watcher of the lobby on the next flush, so a frame is encoded once and
+ * each watcher costs one send(2) per flush no matter how many frames there
+ * were.
+ *
+ * Watchers are sent to without blocking, through the same coalescer as the
+ * rest of their connection's output. A watcher whose socket is full leaves the
+ * unsent rest in the coalescer and misses frames until that rest, and anything
+ * else waiting for the connection, goes out. It is then sent the latest
+ * snapshot of the lobby instead of the frames it missed. Watchers who can't
+ * take anything for too long are dropped by the coalescer. Neither slows down
+ * the players or the other watchers.
+ *
+ */
+typedef struct Audience Audience;
+
+/**
+ * @brief Something that happened in a lobby, encoded by whoever runs the lobby.
+ *
+ */
+typedef struct AudienceFrame {
+	uint32_t lobby;
+
+	char data[AUDIENCE_FRAME_SIZE]; // Sent to watchers who are caught up. Empty to only update the snapshot.
+	size_t data_len;
+
+	char snapshot[AUDIENCE_SNAPSHOT_SIZE]; // The lobby after the frame. Sent to watchers who fell behind.
+	size_t snapshot_len;
+} AudienceFrame;
+
+/**
+ * @brief Creates an audience.
+ *
+ * @return Audience* The created audience. NULL if an error occurred.
+ */
+Audience *audience_create(void);
+
+/**
+ * @brief Frees the audience. The watchers' connections are not closed.
+ *
+ * @param a The audience to free.
+ */
+void audience_free(Audience *a);
+
+/**
+ * @brief Starts sending a lobby to a connection. The connection is sent the
+ * lobby's snapshot before any frame, which needs a frame to be published for
+ * the lobby first if it has no watchers yet.
+ *
+ * @param a The audience to add to.
+ * @param fd The connection.
+ * @param lobby The lobby to watch.
+ * @return int -1 if the connection already watches a lobby or memory ran out. 0 otherwise.
+ */
+int audience_watch(Audience *a, int fd, uint32_t lobby);
+
+/**
+ * @brief Stops sending a lobby to a connection.
+ *
+ * @param a The audience to remove from.
+ * @param fd The connection.
+ * @param lobby Set to the lobby the connection watched.
+ * @return int -1 if the connection watched no lobby. 0 otherwise.
+ */
+int audience_unwatch(Audience *a, int fd, uint32_t *lobby);
+
+/**
+ * @brief Stops sending a lobby to all of its watchers, such as when it is closed.
+ *
+ * @param a The audience to remove from.
+ * @param lobby The lobby.
+ */
+void audience_close_lobby(Audience *a, uint32_t lobby);
+
+/**
+ * @brief Returns the number of connections watching a lobby.
+ *
+ * @param a The audience to check.
+ * @param lobby The lobby.
+ * @return size_t The number of watchers.
+ */
+size_t audience_watchers(const Audience *a, uint32_t lobby);
+
+/**
+ * @brief Adds a frame to be sent on the next flush. Frames of lobbies that
+ * nobody watches are ignored.
+ *
+ * @param a The audience to send the frame to.
+ * @param frame The frame.
+ * @return int -1 if memory ran out. 0 otherwise.
+ */
+int audience_publish(Audience *a, const AudienceFrame *frame);
+
+/**
+ * @brief Sends the frames published since the last flush, and the snapshot to
+ * watchers who fell behind and have caught up since. Watchers with output
+ * waiting in the coalescer are skipped, and whatever a send leaves over is
+ * added to it.
+ *
+ * @param a The audience to flush.
+ * @param out The coalescer holding what is waiting for each connection.
+ * @param dropped Set to connections that failed and no longer watch
+ * anything. The caller should close them.
+ * @param dropped_size The most connections to drop.
+ * @return size_t The number of dropped connections.
+ */
+size_t audience_flush(Audience *a, Coalescer *out, int *dropped, size_t dropped_size);
+
+#endif
@@ -0,0 +1,502 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bot.h"
+#include "log.h"
+#include "pool.h"
+
+#define EXPLORATION 1.4 // UCT exploration constant, roughly sqrt(2).
+#define MAX_NODES ((size_t)1 << 20) // Per thread. Past this the tree stops growing.
+#define NO_NODE UINT32_MAX
+
+/**
+ * @brief A board that only playouts are played on. Pieces are never removed,
+ * so groups only ever grow and each keeps how many of its pieces' neighbours
+ * are empty, counting a space once per piece next to it. That is 0 exactly
+ * when the group has no liberties. A move only touches the groups next to it,
+ * so unlike lobby_place() it never has to look at the rest of the board.
+ *
+ */
+typedef struct Board {
+	size_t rows;
+	size_t cols;
+	char turn;
+	int winner; // -1 while the game is not over.
+
+	// One allocation, in this order. The last three are only kept up to date
+	// at the root piece of each group.
+	uint32_t *liberties;
+	uint16_t *parent; // The piece a piece was joined to. A root is its own parent.
+	uint16_t *first; // The group's first piece in board order.
+	uint8_t *cells; // See LOBBY_CELL_EMPTY.
+} Board;
+
+typedef struct Node {
+	uint32_t parent;
+	uint32_t first_child; // Children are stored next to each other.
+	uint16_t children_len;
+	uint16_t space; // The move that led to this node as row * cols + col.
+	char team; // The team that played the move.
+	bool is_expanded;
+	uint32_t visits;
+	uint32_t wins; // Playouts won by team.
+} Node;
+
+/**
+ * @brief The state of one thread's search.
+ *
+ */
+typedef struct Search {
+	const Board *root; // The position being searched, shared by every thread.
+	Board board; // Private copy of root that each iteration is played on.
+	struct timespec deadline;
+	uint64_t rng;
+
+	Node *nodes;
+	size_t nodes_len;
+	size_t nodes_size;
+
+	uint16_t *empty; // Scratch space for the empty spaces during a playout.
+	unsigned long playouts;
+} Search;
+
+struct Bot {
+	Pool *pool;
+	long budget_ms;
+	uint64_t seed; // Advanced atomically, as searches may start on several threads at once.
+	size_t searching; // Searches running at once, which split the pool between them.
+};
+
+static long bot_write(const Player *p, const void *buf, size_t size) {
+	(void)p;
+	(void)buf;
+	return (long)size;
+}
+
+/**
+ * @brief xorshift64*. Each search has its own state so threads never share it.
+ *
+ */
+static uint64_t next_random(uint64_t *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545f4914f6cdd1dULL;
+}
+
+static bool past_deadline(const struct timespec *deadline) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+static size_t board_bytes(size_t spaces) {
+	return spaces * (sizeof(uint32_t) + sizeof(uint16_t) * 2 + sizeof(uint8_t));
+}
+
+static int board_init(Board *b, size_t rows, size_t cols) {
+	const size_t spaces = rows * cols;
+	uint8_t *bytes = malloc(board_bytes(spaces));
+	if (!bytes) {
+		return -1;
+	}
+
+	b->rows = rows;
+	b->cols = cols;
+	b->liberties = (uint32_t*)(void*)bytes;
+	b->parent = (uint16_t*)(void*)&bytes[spaces * sizeof(uint32_t)];
+	b->first = &b->parent[spaces];
+	b->cells = (uint8_t*)&b->first[spaces];
+
+	return 0;
+}
+
+static void board_free(Board *b) {
+	free(b->liberties);
+}
+
+/**
+ * @brief Copies a board of the same size.
+ *
+ */
+static void board_copy(Board *dst, const Board *src) {
+	memcpy(dst->liberties, src->liberties, board_bytes(src->rows * src->cols));
+	dst->turn = src->turn;
+	dst->winner = src->winner;
+}
+
+static uint16_t find_root(Board *b, uint16_t space) {
+	while (b->parent[space] != space) {
+		b->parent[space] = b->parent[b->parent[space]];
+		space = b->parent[space];
+	}
+	return space;
+}
+
+/**
+ * @brief Finds the neighbours of a space.
+ *
+ * @return size_t The number of neighbours, at most 4.
+ */
+static size_t neighbours(const Board *b, uint16_t space, uint16_t *result) {
+	const size_t col = space % b->cols;
+
+	size_t len = 0;
+	if (space >= b->cols) {
+		result[len++] = (uint16_t)(space - b->cols);
+	}
+	if (space < (b->rows - 1) * b->cols) {
+		result[len++] = (uint16_t)(space + b->cols);
+	}
+	if (col > 0) {
+		result[len++] = (uint16_t)(space - 1);
+	}
+	if (col < b->cols - 1) {
+		result[len++] = (uint16_t)(space + 1);
+	}
+
+	return len;
+}
+
+/**
+ * @brief Places a piece for the team whose turn it is and ends the game if
+ * that left a group without liberties. The space must be empty.
+ *
+ * Only the new piece's group and the groups next to it can have lost their
+ * last liberty. If groups of both teams did, the team of the first piece in
+ * board order loses, as in lobby_place().
+ *
+ */
+static void board_place(Board *b, uint16_t space) {
+	const uint8_t team = b->turn == 'O' ? LOBBY_CELL_O : LOBBY_CELL_X;
+	uint16_t next[4];
+	const size_t next_len = neighbours(b, space, next);
+
+	b->cells[space] = team;
+	b->parent[space] = space;
+	b->first[space] = space;
+	b->liberties[space] = 0;
+
+	for (size_t i = 0; i < next_len; i++) {
+		if (b->cells[next[i]] == LOBBY_CELL_EMPTY) {
+			b->liberties[space]++;
+		} else {
+			b->liberties[find_root(b, next[i])]--;
+		}
+	}
+
+	for (size_t i = 0; i < next_len; i++) {
+		if (b->cells[next[i]] != team) {
+			continue;
+		}
+
+		const uint16_t root = find_root(b, space);
+		const uint16_t other = find_root(b, next[i]);
+		if (root != other) {
+			b->parent[other] = root;
+			b->liberties[root] += b->liberties[other];
+			b->first[root] = b->first[other] < b->first[root] ? b->first[other] : b->first[root];
+		}
+	}
+
+	uint16_t loser = UINT16_MAX; // The first piece of a group without liberties.
+	const uint16_t root = find_root(b, space);
+	if (b->liberties[root] == 0) {
+		loser = b->first[root];
+	}
+	for (size_t i = 0; i < next_len; i++) {
+		if (b->cells[next[i]] == LOBBY_CELL_EMPTY) {
+			continue;
+		}
+
+		const uint16_t other = find_root(b, next[i]);
+		if (b->liberties[other] == 0 && b->first[other] < loser) {
+			loser = b->first[other];
+		}
+	}
+
+	if (loser != UINT16_MAX) {
+		b->winner = b->cells[loser] == LOBBY_CELL_O ? 'X' : 'O';
+	}
+	b->turn = b->turn == 'O' ? 'X' : 'O';
+}
+
+/**
+ * @brief Sets up the board from the lobby's position, which must not be over.
+ *
+ */
+static void board_load(Board *b, const Lobby *l) {
+	b->turn = lobby_turn(l);
+	b->winner = -1;
+
+	// Placing in board order only ever joins a piece to those above and left
+	// of it, which were placed already.
+	const size_t spaces = b->rows * b->cols;
+	memset(b->cells, LOBBY_CELL_EMPTY, spaces);
+	for (size_t space = 0; space < spaces; space++) {
+		const char piece = lobby_get(l, space / b->cols, space % b->cols);
+		if (piece == 'O' || piece == 'X') {
+			b->turn = piece;
+			board_place(b, (uint16_t)space);
+		}
+	}
+	b->turn = lobby_turn(l);
+}
+
+/**
+ * @brief Finds the empty spaces in board order.
+ *
+ * @return size_t The number of empty spaces.
+ */
+static size_t board_empty(const Board *b, uint16_t *spaces) {
+	size_t len = 0;
+	for (size_t space = 0; space < b->rows * b->cols; space++) {
+		if (b->cells[space] == LOBBY_CELL_EMPTY) {
+			spaces[len++] = (uint16_t)space;
+		}
+	}
+	return len;
+}
+
+/**
+ * @brief Adds a child for every free space to the given node.
+ *
+ */
+static void expand(Search *s, uint32_t node) {
+	s->nodes[node].is_expanded = true;
+
+	const size_t empty_len = board_empty(&s->board, s->empty);
+	if (s->nodes_len + empty_len > s->nodes_size) {
+		return; // Out of nodes. The node is treated as a leaf from now on.
+	}
+
+	const char team = s->board.turn;
+	s->nodes[node].first_child = (uint32_t)s->nodes_len;
+	s->nodes[node].children_len = (uint16_t)empty_len;
+
+	for (size_t i = 0; i < empty_len; i++) {
+		s->nodes[s->nodes_len++] = (Node){ .parent = node, .first_child = NO_NODE, .space = s->empty[i], .team = team };
+	}
+}
+
+static uint32_t select_child(const Search *s, uint32_t node) {
+	const Node *parent = &s->nodes[node];
+	const double log_visits = log((double)parent->visits + 1);
+
+	uint32_t best = parent->first_child;
+	double best_score = -1;
+	for (uint32_t i = parent->first_child; i < parent->first_child + parent->children_len; i++) {
+		const Node *child = &s->nodes[i];
+		if (child->visits == 0) {
+			return i;
+		}
+
+		const double score = (double)child->wins / child->visits + EXPLORATION * sqrt(log_visits / child->visits);
+		if (score > best_score) {
+			best_score = score;
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+/**
+ * @brief Plays random moves until the game is over.
+ *
+ */
+static void playout(Search *s) {
+	size_t empty_len = board_empty(&s->board, s->empty);
+
+	while (s->board.winner == -1 && empty_len > 0) {
+		const size_t pick = (size_t)(next_random(&s->rng) % empty_len);
+		const uint16_t space = s->empty[pick];
+		s->empty[pick] = s->empty[--empty_len];
+
+		board_place(&s->board, space);
+	}
+}
+
+static void search_iteration(Search *s) {
+	uint32_t node = 0;
+	board_copy(&s->board, s->root);
+
+	while (s->nodes[node].children_len > 0 && s->board.winner == -1) {
+		node = select_child(s, node);
+		board_place(&s->board, s->nodes[node].space);
+	}
+
+	if (s->board.winner == -1 && !s->nodes[node].is_expanded && s->nodes[node].visits > 0) {
+		expand(s, node);
+		if (s->nodes[node].children_len > 0) {
+			node = s->nodes[node].first_child;
+			board_place(&s->board, s->nodes[node].space);
+		}
+	}
+
+	playout(s);
+	const int winner = s->board.winner;
+
+	for (uint32_t n = node; n != NO_NODE; n = s->nodes[n].parent) {
+		s->nodes[n].visits++;
+		if (s->nodes[n].team == winner) {
+			s->nodes[n].wins++;
+		}
+	}
+
+	s->playouts++;
+}
+
+static void search_run(void *arg) {
+	Search *s = arg;
+
+	s->nodes[0] = (Node){ .parent = NO_NODE, .first_child = NO_NODE };
+	s->nodes_len = 1;
+	board_copy(&s->board, s->root);
+	expand(s, 0);
+
+	do {
+		search_iteration(s);
+	} while (!past_deadline(&s->deadline));
+}
+
+Bot *bot_create(size_t threads, long budget_ms) {
+	Bot *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+
+	result->pool = pool_create(threads);
+	if (!result->pool) {
+		free(result);
+		return NULL;
+	}
+
+	result->budget_ms = budget_ms;
+	result->seed = (uint64_t)time(NULL) | 1;
+
+	return result;
+}
+
+void bot_free(Bot *b) {
+	pool_free(b->pool);
+	free(b);
+}
+
+int bot_choose(Bot *b, const Lobby *l, LobbyMove *move, BotStats *stats) {
+	if (lobby_winner(l) != -1) {
+		return -1;
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	struct timespec deadline = start;
+	deadline.tv_sec += b->budget_ms / 1000;
+	deadline.tv_nsec += (b->budget_ms % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	// Searches running at once split the pool between them. The calling
+	// thread searches as well, so a search gets somewhere even while the pool
+	// is busy with the others.
+	const size_t searching = __atomic_add_fetch(&b->searching, 1, __ATOMIC_RELAXED);
+	const size_t slice = pool_threads(b->pool) / searching;
+	const size_t threads = slice > 0 ? slice : 1;
+
+	const size_t spaces = l->board.rows * l->board.cols;
+	Board position;
+	Search *searches = calloc(threads, sizeof *searches);
+	if (!searches || board_init(&position, l->board.rows, l->board.cols) < 0) {
+		__atomic_sub_fetch(&b->searching, 1, __ATOMIC_RELAXED);
+		free(searches);
+		return -1;
+	}
+	board_load(&position, l);
+
+	int result = 0;
+	PoolGroup group = { 0 };
+	for (size_t i = 0; i < threads; i++) {
+		Search *s = &searches[i];
+		s->root = &position;
+		s->deadline = deadline;
+		s->rng = __atomic_add_fetch(&b->seed, 0x9e3779b97f4a7c15ULL, __ATOMIC_RELAXED) | 1;
+		s->nodes_size = MAX_NODES;
+		s->nodes = malloc(sizeof *s->nodes * s->nodes_size);
+		s->empty = malloc(sizeof *s->empty * spaces);
+
+		if (board_init(&s->board, l->board.rows, l->board.cols) < 0 || !s->nodes || !s->empty || (i > 0 && pool_submit_group(b->pool, &group, search_run, s) < 0)) {
+			result = -1;
+			break;
+		}
+	}
+	if (result == 0) {
+		search_run(&searches[0]);
+	}
+	pool_wait_group(b->pool, &group);
+	__atomic_sub_fetch(&b->searching, 1, __ATOMIC_RELAXED);
+
+	// Sum how often each first move was tried across all threads.
+	unsigned long *visits = calloc(spaces, sizeof *visits);
+	unsigned long playouts = 0;
+	for (size_t i = 0; i < threads && visits; i++) {
+		const Search *s = &searches[i];
+		if (s->nodes_len > 0) {
+			const Node *root = &s->nodes[0];
+			for (uint32_t c = root->first_child; c < root->first_child + root->children_len; c++) {
+				visits[s->nodes[c].space] += s->nodes[c].visits;
+			}
+		}
+		playouts += s->playouts;
+	}
+
+	size_t best = spaces;
+	for (size_t i = 0; i < spaces && visits; i++) {
+		if (visits[i] > 0 && (best == spaces || visits[i] > visits[best])) {
+			best = i;
+		}
+	}
+
+	if (best == spaces) {
+		result = -1;
+	} else if (result == 0) {
+		*move = (LobbyMove){ .team = lobby_turn(l), .row = best / l->board.cols, .col = best % l->board.cols };
+	}
+
+	if (stats) {
+		struct timespec end;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		stats->playouts = playouts;
+		stats->seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+		stats->threads = threads;
+	}
+
+	for (size_t i = 0; i < threads; i++) {
+		board_free(&searches[i].board);
+		free(searches[i].nodes);
+		free(searches[i].empty);
+	}
+	free(searches);
+	free(visits);
+	board_free(&position);
+
+	return result;
+}
+
+Player bot_player(void) {
+	Player result;
+	memset(&result, 0, sizeof result);
+
+	strcpy(result.name, BOT_NAME);
+	result.is_login = true;
+	result.is_bot = true;
+	result.fd = BOT_FD;
+	result.write = bot_write;
+
+	return result;
+}
@@ -0,0 +1,72 @@
+#ifndef BOT_H_
+#define BOT_H_
+
+#include <limits.h>
+#include <stddef.h>
+
+#include "lobby.h"
+#include "player.h"
+
+// The fd given to bot seats. Bots have no connection, so like seats restored
+// from the journal their fd is negative and nothing is sent to them.
+#define BOT_FD INT_MIN
+#define BOT_NAME "BOT"
+
+/**
+ * @brief Chooses moves with Monte Carlo tree search. Every worker thread of the
+ * bot searches its own copy of the position with random playouts until the
+ * time budget runs out, then the visit counts of the first moves are summed
+ * and the most visited move is played.
+ *
+ * Searches from several threads run at the same time, each with its own trees
+ * and an even share of the worker threads, and each takes one time budget.
+ *
+ */
+typedef struct Bot Bot;
+
+/**
+ * @brief Statistics of a single search.
+ *
+ */
+typedef struct BotStats {
+	unsigned long playouts; // Number of playouts across all threads.
+	double seconds; // Wall clock time the search took.
+	size_t threads; // Number of threads that searched.
+} BotStats;
+
+/**
+ * @brief Creates a bot and starts its worker threads.
+ *
+ * @param threads The number of threads to search with.
+ * @param budget_ms How long each search may take in milliseconds.
+ * @return Bot* The created bot. NULL if an error occurred.
+ */
+Bot *bot_create(size_t threads, long budget_ms);
+
+/**
+ * @brief Stops the bot's threads and frees it.
+ *
+ * @param b The bot to free.
+ */
+void bot_free(Bot *b);
+
+/**
+ * @brief Searches for the best move for the team whose turn it is. The
+ * calling thread searches along with its share of the bot's threads.
+ *
+ * @param b The bot to search with.
+ * @param l The lobby holding the position. It is not modified.
+ * @param move Set to the chosen move.
+ * @param stats Set to the statistics of the search. May be NULL.
+ * @return int -1 if there is no move to play. 0 otherwise.
+ */
+int bot_choose(Bot *b, const Lobby *l, LobbyMove *move, BotStats *stats);
+
+/**
+ * @brief Returns a player that can be used to seat the bot in a lobby.
+ *
+ * @return Player The bot player.
+ */
+Player bot_player(void);
+
+#endif
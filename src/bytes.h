@@ -0,0 +1,39 @@
+#ifndef BYTES_H_
+#define BYTES_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Helpers for reading and writing little-endian integers in on-disk
+ * formats so files can be read regardless of the host's byte order.
+ * 
+ */
+
+static inline void put_u16(unsigned char *dst, uint16_t n) {
+	dst[0] = (unsigned char)(n & 0xff);
+	dst[1] = (unsigned char)((n >> 8) & 0xff);
+}
+
+static inline void put_u32(unsigned char *dst, uint32_t n) {
+	put_u16(dst, (uint16_t)(n & 0xffff));
+	put_u16(dst + 2, (uint16_t)(n >> 16));
+}
+
+static inline void put_u64(unsigned char *dst, uint64_t n) {
+	put_u32(dst, (uint32_t)(n & 0xffffffff));
+	put_u32(dst + 4, (uint32_t)(n >> 32));
+}
+
+static inline uint16_t get_u16(const unsigned char *src) {
+	return (uint16_t)(src[0] | src[1] << 8);
+}
+
+static inline uint32_t get_u32(const unsigned char *src) {
+	return (uint32_t)get_u16(src) | (uint32_t)get_u16(src + 2) << 16;
+}
+
+static inline uint64_t get_u64(const unsigned char *src) {
+	return (uint64_t)get_u32(src) | (uint64_t)get_u32(src + 4) << 32;
+}
+
+#endif
@@ -0,0 +1,450 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "channels.h"
+
+#define SUBSCRIBERS_START 64
+#define TOPICS_START 64 // Slots of the topic table, which is kept at most half full.
+#define BATCH_START 512
+
+typedef struct Subscriber {
+	uint64_t topics[CHANNELS_TOPICS_MAX];
+	size_t slots[CHANNELS_TOPICS_MAX]; // Index in each topic's list of fds.
+	size_t topics_len;
+} Subscriber;
+
+/**
+ * @brief A topic that has subscribers.
+ *
+ */
+typedef struct Topic {
+	uint64_t id;
+
+	int *fds; // The first cursor of them were sent what is being sent.
+	size_t fds_len;
+	size_t fds_size;
+	size_t cursor;
+
+	char *sending; // Being sent to the subscribers. Empty if nothing is.
+	size_t sending_len;
+	size_t sending_size;
+
+	char *batch; // Published since sending started. Sent next.
+	size_t batch_len;
+	size_t batch_size;
+
+	bool is_queued;
+	struct Topic *prev; // Neighbours in the queue of topics to send to.
+	struct Topic *next;
+} Topic;
+
+struct Channels {
+	size_t flush_sends;
+
+	Subscriber *subscribers; // Indexed by fd.
+	size_t subscribers_len;
+
+	Topic **topics; // Open addressing by id. Empty slots are NULL.
+	size_t topics_size;
+	size_t topics_len;
+
+	Topic *head; // Topics with something to send, in the order they were published to.
+	Topic *tail;
+};
+
+Channels *channels_create(size_t flush_sends) {
+	Channels *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+
+	result->flush_sends = flush_sends > 0 ? flush_sends : 1;
+	result->subscribers = calloc(SUBSCRIBERS_START, sizeof *result->subscribers);
+	result->subscribers_len = SUBSCRIBERS_START;
+	result->topics = calloc(TOPICS_START, sizeof *result->topics);
+	result->topics_size = TOPICS_START;
+	if (!result->subscribers || !result->topics) {
+		channels_free(result);
+		return NULL;
+	}
+
+	return result;
+}
+
+static void free_topic(Topic *t) {
+	free(t->fds);
+	free(t->sending);
+	free(t->batch);
+	free(t);
+}
+
+void channels_free(Channels *c) {
+	if (c->topics) {
+		for (size_t i = 0; i < c->topics_size; i++) {
+			if (c->topics[i]) {
+				free_topic(c->topics[i]);
+			}
+		}
+	}
+	free(c->subscribers);
+	free(c->topics);
+	free(c);
+}
+
+static size_t hash(uint64_t id) {
+	id ^= id >> 33;
+	id *= 0xff51afd7ed558ccdULL;
+	id ^= id >> 33;
+	return (size_t)id;
+}
+
+/**
+ * @brief Finds the slot of the topic table that holds the topic, or where it
+ * would go.
+ *
+ */
+static size_t find_slot(const Channels *c, uint64_t id) {
+	const size_t mask = c->topics_size - 1;
+	size_t i = hash(id) & mask;
+	while (c->topics[i] && c->topics[i]->id != id) {
+		i = (i + 1) & mask;
+	}
+
+	return i;
+}
+
+static Topic *find_topic(const Channels *c, uint64_t id) {
+	return c->topics[find_slot(c, id)];
+}
+
+static Topic *add_topic(Channels *c, uint64_t id) {
+	if ((c->topics_len + 1) * 2 > c->topics_size) {
+		Topic **old = c->topics;
+		const size_t old_size = c->topics_size;
+		Topic **topics = calloc(old_size * 2, sizeof *topics);
+		if (!topics) {
+			return NULL;
+		}
+
+		c->topics = topics;
+		c->topics_size = old_size * 2;
+		for (size_t i = 0; i < old_size; i++) {
+			if (old[i]) {
+				c->topics[find_slot(c, old[i]->id)] = old[i];
+			}
+		}
+		free(old);
+	}
+
+	Topic *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+	result->id = id;
+	c->topics[find_slot(c, id)] = result;
+	c->topics_len++;
+
+	return result;
+}
+
+static void enqueue(Channels *c, Topic *t) {
+	t->is_queued = true;
+	t->next = NULL;
+	t->prev = c->tail;
+	if (c->tail) {
+		c->tail->next = t;
+	} else {
+		c->head = t;
+	}
+	c->tail = t;
+}
+
+static void dequeue(Channels *c, Topic *t) {
+	if (t->prev) {
+		t->prev->next = t->next;
+	} else {
+		c->head = t->next;
+	}
+	if (t->next) {
+		t->next->prev = t->prev;
+	} else {
+		c->tail = t->prev;
+	}
+	t->is_queued = false;
+}
+
+/**
+ * @brief Takes a topic out of the table, shifting back the topics that probed
+ * past it, and frees it.
+ *
+ */
+static void remove_topic(Channels *c, Topic *t) {
+	if (t->is_queued) {
+		dequeue(c, t);
+	}
+
+	const size_t mask = c->topics_size - 1;
+	size_t i = find_slot(c, t->id);
+	c->topics[i] = NULL;
+	for (size_t j = (i + 1) & mask; c->topics[j]; j = (j + 1) & mask) {
+		// Moved unless its home lies cyclically between the hole and j.
+		const size_t home = hash(c->topics[j]->id) & mask;
+		if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+			c->topics[i] = c->topics[j];
+			c->topics[j] = NULL;
+			i = j;
+		}
+	}
+	c->topics_len--;
+
+	free_topic(t);
+}
+
+static int reserve_subscriber(Channels *c, int fd) {
+	if ((size_t)fd < c->subscribers_len) {
+		return 0;
+	}
+
+	size_t len = c->subscribers_len;
+	while ((size_t)fd >= len) {
+		len *= 2;
+	}
+
+	Subscriber *subscribers = realloc(c->subscribers, sizeof *subscribers * len);
+	if (!subscribers) {
+		return -1;
+	}
+	memset(&subscribers[c->subscribers_len], 0, sizeof *subscribers * (len - c->subscribers_len));
+	c->subscribers = subscribers;
+	c->subscribers_len = len;
+
+	return 0;
+}
+
+static Subscriber *get_subscriber(const Channels *c, int fd) {
+	return fd >= 0 && (size_t)fd < c->subscribers_len ? &c->subscribers[fd] : NULL;
+}
+
+/**
+ * @brief Finds where a subscriber keeps a topic among its topics.
+ *
+ * @return int The index. -1 if it is not subscribed to the topic.
+ */
+static int find_subscription(const Subscriber *s, uint64_t id) {
+	for (size_t i = 0; i < s->topics_len; i++) {
+		if (s->topics[i] == id) {
+			return (int)i;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * @brief Moves the subscriber at one index of a topic's list of fds to another.
+ *
+ */
+static void move_fd(Channels *c, Topic *t, size_t from, size_t to) {
+	if (from == to) {
+		return;
+	}
+
+	t->fds[to] = t->fds[from];
+	Subscriber *s = &c->subscribers[t->fds[to]];
+	const int i = find_subscription(s, t->id);
+	if (i >= 0) {
+		s->slots[i] = to;
+	}
+}
+
+/**
+ * @brief Takes the subscriber at an index out of a topic's list of fds,
+ * keeping the ones that were sent to ahead of the cursor. The topic is
+ * removed along with its last subscriber.
+ *
+ */
+static void remove_fd(Channels *c, Topic *t, size_t index) {
+	const size_t last = --t->fds_len;
+	if (index < t->cursor) {
+		const size_t sent = --t->cursor;
+		move_fd(c, t, sent, index);
+		move_fd(c, t, last, sent);
+	} else {
+		move_fd(c, t, last, index);
+	}
+
+	if (t->fds_len == 0) {
+		remove_topic(c, t);
+	}
+}
+
+int channels_subscribe(Channels *c, int fd, uint64_t topic) {
+	if (fd < 0 || reserve_subscriber(c, fd) < 0) {
+		return -1;
+	}
+
+	Subscriber *s = &c->subscribers[fd];
+	if (s->topics_len == CHANNELS_TOPICS_MAX || find_subscription(s, topic) >= 0) {
+		return -1;
+	}
+
+	Topic *t = find_topic(c, topic);
+	if (!t && (t = add_topic(c, topic)) == NULL) {
+		return -1;
+	}
+
+	if (t->fds_len == t->fds_size) {
+		const size_t size = t->fds_size > 0 ? t->fds_size * 2 : SUBSCRIBERS_START;
+		int *fds = realloc(t->fds, sizeof *fds * size);
+		if (!fds) {
+			if (t->fds_len == 0) {
+				remove_topic(c, t);
+			}
+			return -1;
+		}
+		t->fds = fds;
+		t->fds_size = size;
+	}
+
+	// Counted as sent to already, so it is not sent what came before it.
+	size_t slot = t->fds_len++;
+	t->fds[slot] = fd;
+	if (t->sending_len > 0) {
+		move_fd(c, t, t->cursor, slot);
+		t->fds[t->cursor] = fd;
+		slot = t->cursor++;
+	}
+
+	s->topics[s->topics_len] = topic;
+	s->slots[s->topics_len] = slot;
+	s->topics_len++;
+
+	return 0;
+}
+
+int channels_unsubscribe(Channels *c, int fd, uint64_t topic) {
+	Subscriber *s = get_subscriber(c, fd);
+	const int i = s ? find_subscription(s, topic) : -1;
+	if (i < 0) {
+		return -1;
+	}
+
+	const size_t slot = s->slots[i];
+	s->topics_len--;
+	s->topics[i] = s->topics[s->topics_len];
+	s->slots[i] = s->slots[s->topics_len];
+
+	remove_fd(c, find_topic(c, topic), slot);
+	return 0;
+}
+
+void channels_remove(Channels *c, int fd) {
+	Subscriber *s = get_subscriber(c, fd);
+	if (!s) {
+		return;
+	}
+
+	while (s->topics_len > 0) {
+		channels_unsubscribe(c, fd, s->topics[s->topics_len - 1]);
+	}
+}
+
+void channels_close_topic(Channels *c, uint64_t topic) {
+	const Topic *t;
+	while ((t = find_topic(c, topic)) != NULL) {
+		channels_unsubscribe(c, t->fds[t->fds_len - 1], topic);
+	}
+}
+
+size_t channels_subscribers(const Channels *c, uint64_t topic) {
+	const Topic *t = find_topic(c, topic);
+	return t ? t->fds_len : 0;
+}
+
+int channels_publish(Channels *c, uint64_t topic, const void *data, size_t len) {
+	Topic *t = find_topic(c, topic);
+	if (!t || len == 0) {
+		return 0;
+	} else if (t->batch_len + len > CHANNELS_BATCH_MAX) {
+		return -1;
+	}
+
+	if (t->batch_len + len > t->batch_size) {
+		size_t size = t->batch_size > 0 ? t->batch_size : BATCH_START;
+		while (t->batch_len + len > size) {
+			size *= 2;
+		}
+
+		char *batch = realloc(t->batch, size);
+		if (!batch) {
+			return -1;
+		}
+		t->batch = batch;
+		t->batch_size = size;
+	}
+
+	memcpy(&t->batch[t->batch_len], data, len);
+	t->batch_len += len;
+	if (!t->is_queued) {
+		enqueue(c, t);
+	}
+
+	return 0;
+}
+
+size_t channels_flush(Channels *c, Coalescer *out, int *dropped, size_t dropped_size) {
+	size_t dropped_len = 0;
+	size_t sends = 0;
+
+	while (c->head && sends < c->flush_sends) {
+		Topic *t = c->head;
+		if (t->sending_len == 0) {
+			char *sending = t->sending;
+			const size_t sending_size = t->sending_size;
+			t->sending = t->batch;
+			t->sending_len = t->batch_len;
+			t->sending_size = t->batch_size;
+			t->batch = sending;
+			t->batch_len = 0;
+			t->batch_size = sending_size;
+			t->cursor = 0;
+		}
+
+		bool is_removed = false;
+		while (t->cursor < t->fds_len && sends < c->flush_sends) {
+			const int fd = t->fds[t->cursor];
+			if (coalescer_is_pending(out, fd)) {
+				t->cursor++; // Still behind. Misses this.
+				continue;
+			}
+
+			sends++;
+			if (coalescer_send(out, fd, t->sending, t->sending_len) == 0 || dropped_len == dropped_size) {
+				t->cursor++;
+				continue;
+			}
+
+			// Another subscriber takes its place, or the topic goes with its last subscriber.
+			dropped[dropped_len++] = fd;
+			is_removed = t->fds_len == 1;
+			channels_remove(c, fd);
+			if (is_removed) {
+				break;
+			}
+		}
+
+		if (!is_removed && t->cursor == t->fds_len) {
+			t->sending_len = 0;
+			dequeue(c, t);
+			if (t->batch_len > 0) {
+				enqueue(c, t);
+			}
+		}
+	}
+
+	return dropped_len;
+}
+
+bool channels_is_busy(const Channels *c) {
+	return c->head != NULL;
+}
@@ -0,0 +1,139 @@
+#ifndef CHANNELS_H_
+#define CHANNELS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "coalescer.h"
+
+#define CHANNELS_TOPICS_MAX 8 // Topics one connection may be subscribed to at once.
+#define CHANNELS_BATCH_MAX 65536 // Published to a topic and not yet sent before publishing is refused.
+
+/**
+ * @brief Sends what is published to a topic to every connection subscribed to
+ * it, such as chat in a lobby or announcements to everyone. Meant to be owned
+ * by the thread that owns the connections.
+ *
+ * What is published to a topic is appended to a single buffer, so a message
+ * is encoded once and each subscriber costs one send(2) for everything
+ * published to the topic since it was last sent to. Topics are sent to in the
+ * order they were published to.
+ *
+ * A flush only makes a limited number of sends. A topic with more subscribers
+ * than that is sent to over several flushes, picking up where the last one
+ * stopped, so one publish to every connection does not hold up the rest of the
+ * server. Subscribers who subscribe during that are not sent what was
+ * published before, and subscribers who leave are not sent anything more.
+ *
+ * Subscribers are sent to without blocking, through the same coalescer as the
+ * rest of their connection's output. A subscriber whose socket is full leaves
+ * the unsent rest in the coalescer and misses what is published until that
+ * rest, and anything else waiting for the connection, goes out. Subscribers
+ * who can't take anything for too long are dropped by the coalescer. Neither
+ * slows down the other subscribers.
+ *
+ */
+typedef struct Channels Channels;
+
+/**
+ * @brief Creates channels without topics.
+ *
+ * @param flush_sends The most sends a flush makes.
+ * @return Channels* The created channels. NULL if an error occurred.
+ */
+Channels *channels_create(size_t flush_sends);
+
+/**
+ * @brief Frees the channels. The subscribers' connections are not closed.
+ *
+ * @param c The channels to free.
+ */
+void channels_free(Channels *c);
+
+/**
+ * @brief Subscribes a connection to a topic. It is sent what is published
+ * from now on.
+ *
+ * @param c The channels to add to.
+ * @param fd The connection.
+ * @param topic The topic.
+ * @return int -1 if the connection is subscribed already, is subscribed to
+ * CHANNELS_TOPICS_MAX topics or memory ran out. 0 otherwise.
+ */
+int channels_subscribe(Channels *c, int fd, uint64_t topic);
+
+/**
+ * @brief Unsubscribes a connection from a topic.
+ *
+ * @param c The channels to remove from.
+ * @param fd The connection.
+ * @param topic The topic.
+ * @return int -1 if the connection was not subscribed to the topic. 0 otherwise.
+ */
+int channels_unsubscribe(Channels *c, int fd, uint64_t topic);
+
+/**
+ * @brief Unsubscribes a connection from every topic, such as when it is
+ * closed.
+ *
+ * @param c The channels to remove from.
+ * @param fd The connection.
+ */
+void channels_remove(Channels *c, int fd);
+
+/**
+ * @brief Unsubscribes every subscriber of a topic, such as when its lobby is
+ * closed. Whatever was published to it and not sent yet is dropped.
+ *
+ * @param c The channels to remove from.
+ * @param topic The topic.
+ */
+void channels_close_topic(Channels *c, uint64_t topic);
+
+/**
+ * @brief Returns the number of connections subscribed to a topic.
+ *
+ * @param c The channels to check.
+ * @param topic The topic.
+ * @return size_t The number of subscribers.
+ */
+size_t channels_subscribers(const Channels *c, uint64_t topic);
+
+/**
+ * @brief Adds a message to be sent to the topic's subscribers. Messages to
+ * topics without subscribers are ignored.
+ *
+ * @param c The channels to publish to.
+ * @param topic The topic.
+ * @param data The message, complete with its line ending.
+ * @param len The length of data.
+ * @return int -1 if memory ran out or more than CHANNELS_BATCH_MAX is waiting
+ * to be sent to the topic. 0 otherwise.
+ */
+int channels_publish(Channels *c, uint64_t topic, const void *data, size_t len);
+
+/**
+ * @brief Sends what was published, up to the number of sends the channels
+ * were created with. Subscribers with output waiting in the coalescer are
+ * skipped, and whatever a send leaves over is added to it.
+ *
+ * @param c The channels to flush.
+ * @param out The coalescer holding what is waiting for each connection.
+ * @param dropped Set to connections that failed. They are subscribed to
+ * nothing anymore. The caller should close them.
+ * @param dropped_size The most connections to drop.
+ * @return size_t The number of dropped connections.
+ */
+size_t channels_flush(Channels *c, Coalescer *out, int *dropped, size_t dropped_size);
+
+/**
+ * @brief Returns whether something published was not sent to every subscriber
+ * yet, which needs another flush as soon as possible.
+ *
+ * @param c The channels to check.
+ * @return bool true if a topic is being sent to.
+ */
+bool channels_is_busy(const Channels *c);
+
+#endif
@@ -0,0 +1,287 @@
+#define _GNU_SOURCE // MSG_CMSG_CLOEXEC.
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "bytes.h"
+#include "cluster.h"
+#include "log.h"
+
+#define PACKET_SIZE (1 + MSG_MAX_SIZE) // The type, then the fields of the message.
+#define LISTEN_BACKLOG 64
+
+typedef struct Worker {
+	int sock; // -1 if the node is free.
+	uint32_t players;
+	uint32_t lobbies;
+	uint32_t handed; // Connections handed over since the last report.
+} Worker;
+
+struct Cluster {
+	Worker workers[CLUSTER_MAX_WORKERS]; // Indexed by node.
+	size_t workers_len;
+};
+
+int cluster_listen(const char *path) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof addr.sun_path) {
+		LOG_ERROR("cluster: path too long: %s\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	const int result = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (result < 0) {
+		perror("cluster: socket");
+		return -1;
+	}
+
+	unlink(path);
+	if (bind(result, (struct sockaddr *)&addr, sizeof addr) < 0 || listen(result, LISTEN_BACKLOG) < 0) {
+		perror("cluster: bind");
+		close(result);
+		return -1;
+	}
+
+	return result;
+}
+
+int cluster_connect(const char *path) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof addr.sun_path) {
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	const int result = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (result < 0) {
+		return -1;
+	}
+
+	if (connect(result, (struct sockaddr *)&addr, sizeof addr) < 0) {
+		close(result);
+		return -1;
+	}
+
+	return result;
+}
+
+int cluster_send(int sock, const ClusterMessage *m) {
+	unsigned char packet[PACKET_SIZE];
+	size_t len = 1;
+	packet[0] = (unsigned char)m->type;
+
+	switch (m->type) {
+	case CLUSTER_WELCOME:
+		put_u32(&packet[len], m->node);
+		len += 4;
+		break;
+	case CLUSTER_LOAD:
+		put_u32(&packet[len], m->players);
+		put_u32(&packet[len + 4], m->lobbies);
+		len += 8;
+		break;
+	case CLUSTER_CONN:
+		if (m->data_len > MSG_MAX_SIZE) {
+			return -1;
+		}
+		memcpy(&packet[len], m->data, m->data_len);
+		len += m->data_len;
+		break;
+	default:
+		return -1;
+	}
+
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof control);
+
+	struct iovec iov = { .iov_base = packet, .iov_len = len };
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+	if (m->type == CLUSTER_CONN) {
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof control.buf;
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &m->fd, sizeof(int));
+	}
+
+	ssize_t sent;
+	while ((sent = sendmsg(sock, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR) {
+	}
+
+	return sent == (ssize_t)len ? 0 : -1;
+}
+
+int cluster_recv(int sock, ClusterMessage *m) {
+	unsigned char packet[PACKET_SIZE];
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+
+	struct iovec iov = { .iov_base = packet, .iov_len = sizeof packet };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.buf,
+		.msg_controllen = sizeof control.buf,
+	};
+
+	ssize_t len;
+	while ((len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {
+	}
+
+	// Whatever descriptor came along is closed unless it is what was expected.
+	int fd = -1;
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); len > 0 && cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+			memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+		}
+	}
+
+	memset(m, 0, sizeof *m);
+	m->fd = -1;
+	bool is_valid = len > 0 && !(msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC));
+	if (is_valid) {
+		m->type = (ClusterType)packet[0];
+		switch (m->type) {
+		case CLUSTER_WELCOME:
+			is_valid = len == 5 && fd < 0;
+			m->node = is_valid ? get_u32(&packet[1]) : 0;
+			break;
+		case CLUSTER_LOAD:
+			is_valid = len == 9 && fd < 0;
+			m->players = is_valid ? get_u32(&packet[1]) : 0;
+			m->lobbies = is_valid ? get_u32(&packet[5]) : 0;
+			break;
+		case CLUSTER_CONN:
+			is_valid = fd >= 0;
+			m->fd = fd;
+			m->data_len = (size_t)len - 1;
+			memcpy(m->data, &packet[1], m->data_len);
+			break;
+		default:
+			is_valid = false;
+		}
+	}
+
+	if (!is_valid) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		m->fd = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+Cluster *cluster_create(void) {
+	Cluster *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+
+	for (size_t i = 0; i < CLUSTER_MAX_WORKERS; i++) {
+		result->workers[i].sock = -1;
+	}
+
+	return result;
+}
+
+void cluster_free(Cluster *c) {
+	free(c);
+}
+
+static Worker *get_worker(Cluster *c, uint32_t node) {
+	return node < CLUSTER_MAX_WORKERS && c->workers[node].sock >= 0 ? &c->workers[node] : NULL;
+}
+
+int cluster_add(Cluster *c, int sock) {
+	for (size_t i = 0; i < CLUSTER_MAX_WORKERS; i++) {
+		if (c->workers[i].sock < 0) {
+			c->workers[i] = (Worker){ .sock = sock };
+			c->workers_len++;
+			return (int)i;
+		}
+	}
+
+	return -1;
+}
+
+void cluster_remove(Cluster *c, uint32_t node) {
+	Worker *w = get_worker(c, node);
+	if (w) {
+		w->sock = -1;
+		c->workers_len--;
+	}
+}
+
+void cluster_report(Cluster *c, uint32_t node, uint32_t players, uint32_t lobbies) {
+	Worker *w = get_worker(c, node);
+	if (w) {
+		w->players = players;
+		w->lobbies = lobbies;
+		w->handed = 0;
+	}
+}
+
+int cluster_pick(Cluster *c) {
+	Worker *best = NULL;
+	for (size_t i = 0; i < CLUSTER_MAX_WORKERS; i++) {
+		Worker *w = &c->workers[i];
+		if (w->sock < 0) {
+			continue;
+		}
+
+		const uint64_t load = (uint64_t)w->players + w->handed;
+		const uint64_t best_load = best ? (uint64_t)best->players + best->handed : UINT64_MAX;
+		if (load < best_load || (load == best_load && w->lobbies < best->lobbies)) {
+			best = w;
+		}
+	}
+
+	if (!best) {
+		return -1;
+	}
+
+	best->handed++;
+	return (int)(best - c->workers);
+}
+
+void cluster_count(Cluster *c, uint32_t node) {
+	Worker *w = get_worker(c, node);
+	if (w) {
+		w->handed++;
+	}
+}
+
+int cluster_sock(const Cluster *c, uint32_t node) {
+	return node < CLUSTER_MAX_WORKERS ? c->workers[node].sock : -1;
+}
+
+int cluster_node(const Cluster *c, int sock) {
+	for (size_t i = 0; i < CLUSTER_MAX_WORKERS && sock >= 0; i++) {
+		if (c->workers[i].sock == sock) {
+			return (int)i;
+		}
+	}
+
+	return -1;
+}
+
+size_t cluster_workers(const Cluster *c) {
+	return c->workers_len;
+}
@@ -0,0 +1,177 @@
+#ifndef CLUSTER_H_
+#define CLUSTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "message.h"
+
+#define CLUSTER_MAX_WORKERS 256 // Nodes fit in the top byte of a session token. See session.h.
+
+/**
+ * @brief Runs several servers on one host behind a router, so games are
+ * spread over more processes than one event loop can serve.
+ *
+ * Servers, called workers here, connect to the router over a UNIX socket and
+ * are welcomed with the node they are. The router accepts every connection
+ * and reads its first message. A RESUME goes to the node its token names, as
+ * the session is held there. Anything else, normally a LOGIN, goes to the
+ * worker with the least load. The connection is handed over with SCM_RIGHTS
+ * together with the message, which the worker serves as if it had read it
+ * itself. From then on the router is out of the way: the client talks to the
+ * worker directly, and every lobby the player is matched in or creates lives
+ * in that worker.
+ *
+ * Workers report how many players and lobbies they hold every now and then.
+ * Connections handed to a worker since its last report count towards its
+ * load, so a burst of logins is spread out before the next report comes in.
+ *
+ * Every message is one packet of a SOCK_SEQPACKET socket.
+ *
+ */
+
+typedef enum ClusterType {
+	CLUSTER_WELCOME, // Router to worker. Names the worker's node.
+	CLUSTER_LOAD, // Worker to router. How many players and lobbies the worker holds.
+	CLUSTER_CONN, // Router to worker. A connection and the first message read from it.
+} ClusterType;
+
+typedef struct ClusterMessage {
+	ClusterType type;
+	uint32_t node; // CLUSTER_WELCOME only.
+	uint32_t players; // CLUSTER_LOAD only.
+	uint32_t lobbies; // CLUSTER_LOAD only.
+	int fd; // CLUSTER_CONN only. Received as a new descriptor, which belongs to the receiver.
+	char data[MSG_MAX_SIZE]; // CLUSTER_CONN only. What was read from the connection.
+	size_t data_len;
+} ClusterMessage;
+
+/**
+ * @brief Listens for workers on a UNIX socket, replacing whatever was left at
+ * the path.
+ *
+ * @param path The path of the socket.
+ * @return int The listening socket. -1 if an error occurred.
+ */
+int cluster_listen(const char *path);
+
+/**
+ * @brief Connects a worker to the router listening at the path.
+ *
+ * @param path The path of the socket.
+ * @return int The connected socket. -1 if nobody listens at the path.
+ */
+int cluster_connect(const char *path);
+
+/**
+ * @brief Sends a message. Blocks until it was sent. Nothing is closed.
+ *
+ * @param sock The socket to send on.
+ * @param m The message.
+ * @return int -1 on error. 0 otherwise.
+ */
+int cluster_send(int sock, const ClusterMessage *m);
+
+/**
+ * @brief Receives a message. Blocks until one arrives.
+ *
+ * @param sock The socket to receive from.
+ * @param m Set to the message.
+ * @return int -1 if the peer went away or sent something malformed. 0 otherwise.
+ */
+int cluster_recv(int sock, ClusterMessage *m);
+
+/**
+ * @brief The router's view of its workers.
+ *
+ */
+typedef struct Cluster Cluster;
+
+/**
+ * @brief Creates a cluster without workers.
+ *
+ * @return Cluster* The created cluster. NULL if an error occurred.
+ */
+Cluster *cluster_create(void);
+
+/**
+ * @brief Frees the cluster. No socket is closed.
+ *
+ * @param c The cluster to free.
+ */
+void cluster_free(Cluster *c);
+
+/**
+ * @brief Adds a worker under the lowest node that is free.
+ *
+ * @param c The cluster to add to.
+ * @param sock The socket connected to the worker.
+ * @return int The node of the worker. -1 if there are CLUSTER_MAX_WORKERS already.
+ */
+int cluster_add(Cluster *c, int sock);
+
+/**
+ * @brief Removes a worker, such as when it went away. Does nothing if there is
+ * no worker at the node.
+ *
+ * @param c The cluster to remove from.
+ * @param node The node of the worker.
+ */
+void cluster_remove(Cluster *c, uint32_t node);
+
+/**
+ * @brief Updates the load of a worker with what it reported.
+ *
+ * @param c The cluster to update.
+ * @param node The node of the worker.
+ * @param players The players the worker holds.
+ * @param lobbies The lobbies the worker holds.
+ */
+void cluster_report(Cluster *c, uint32_t node, uint32_t players, uint32_t lobbies);
+
+/**
+ * @brief Picks the worker with the least load to hand a connection to, and
+ * counts the connection towards its load. Ties go to the worker with fewer
+ * lobbies, then to the lowest node.
+ *
+ * @param c The cluster to pick from.
+ * @return int The node of the worker. -1 if there are no workers.
+ */
+int cluster_pick(Cluster *c);
+
+/**
+ * @brief Counts a connection handed to a worker that was not picked, such as
+ * for a RESUME, towards its load.
+ *
+ * @param c The cluster to update.
+ * @param node The node of the worker.
+ */
+void cluster_count(Cluster *c, uint32_t node);
+
+/**
+ * @brief Gets the socket of a worker.
+ *
+ * @param c The cluster to check.
+ * @param node The node of the worker.
+ * @return int The socket. -1 if there is no worker at the node.
+ */
+int cluster_sock(const Cluster *c, uint32_t node);
+
+/**
+ * @brief Finds the worker connected on a socket.
+ *
+ * @param c The cluster to check.
+ * @param sock The socket.
+ * @return int The node of the worker. -1 if no worker is connected on it.
+ */
+int cluster_node(const Cluster *c, int sock);
+
+/**
+ * @brief Gets the number of workers.
+ *
+ * @param c The cluster to check.
+ * @return size_t The number of workers.
+ */
+size_t cluster_workers(const Cluster *c);
+
+#endif
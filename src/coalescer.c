@@ -0,0 +1,281 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "coalescer.h"
+
+#define BUFFERS_START 64
+#define BUFFER_START 512
+
+typedef struct Buffer {
+	char *data;
+	size_t sent; // Bytes at the start of data that went out already.
+	size_t len;
+	size_t size;
+	uint64_t since_ms; // When the connection last took anything while behind.
+	bool is_dirty; // Listed in dirty.
+	bool is_behind; // Did not take everything on the last flush.
+	bool is_dropped;
+} Buffer;
+
+struct Coalescer {
+	Buffer *buffers; // Indexed by fd.
+	size_t buffers_len;
+
+	int *dirty; // Connections with something to send, in the order they were first added to.
+	size_t dirty_len;
+	size_t dirty_size;
+
+	uint64_t drop_ms;
+};
+
+Coalescer *coalescer_create(uint64_t drop_ms) {
+	Coalescer *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+
+	result->buffers = calloc(BUFFERS_START, sizeof *result->buffers);
+	result->buffers_len = BUFFERS_START;
+	result->dirty = malloc(sizeof *result->dirty * BUFFERS_START);
+	result->dirty_size = BUFFERS_START;
+	result->drop_ms = drop_ms;
+	if (!result->buffers || !result->dirty) {
+		coalescer_free(result);
+		return NULL;
+	}
+
+	return result;
+}
+
+void coalescer_free(Coalescer *c) {
+	if (c->buffers) {
+		for (size_t i = 0; i < c->buffers_len; i++) {
+			free(c->buffers[i].data);
+		}
+	}
+	free(c->buffers);
+	free(c->dirty);
+	free(c);
+}
+
+/**
+ * @brief Makes sure there is a buffer for the connection and room to mark it
+ * dirty.
+ *
+ * @return int -1 if the function failed to allocate extra space. 0 otherwise.
+ */
+static int reserve(Coalescer *c, int fd) {
+	if ((size_t)fd >= c->buffers_len) {
+		size_t len = c->buffers_len;
+		while ((size_t)fd >= len) {
+			len *= 2;
+		}
+
+		Buffer *buffers = realloc(c->buffers, sizeof *buffers * len);
+		if (!buffers) {
+			return -1;
+		}
+		memset(&buffers[c->buffers_len], 0, sizeof *buffers * (len - c->buffers_len));
+		c->buffers = buffers;
+		c->buffers_len = len;
+	}
+
+	if (c->dirty_len == c->dirty_size) {
+		int *dirty = realloc(c->dirty, sizeof *dirty * c->dirty_size * 2);
+		if (!dirty) {
+			return -1;
+		}
+		c->dirty = dirty;
+		c->dirty_size *= 2;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Empties the buffer, giving back its memory if it grew large.
+ *
+ */
+static void clear(Buffer *b) {
+	b->sent = 0;
+	b->len = 0;
+	b->is_behind = false;
+	if (b->size > COALESCER_KEEP_SIZE) {
+		free(b->data);
+		b->data = NULL;
+		b->size = 0;
+	}
+}
+
+static void mark_dirty(Coalescer *c, int fd) {
+	Buffer *b = &c->buffers[fd];
+	if (!b->is_dirty) {
+		b->is_dirty = true;
+		c->dirty[c->dirty_len++] = fd;
+	}
+}
+
+/**
+ * @brief Throws away what is waiting and mutes the connection. It stays dirty
+ * until the flush that reports it.
+ *
+ */
+static void drop(Coalescer *c, int fd) {
+	Buffer *b = &c->buffers[fd];
+	clear(b);
+	b->is_dropped = true;
+	mark_dirty(c, fd);
+}
+
+int coalescer_add(Coalescer *c, int fd, const void *buf, size_t len) {
+	if (fd < 0 || reserve(c, fd) < 0) {
+		return -1;
+	}
+
+	Buffer *b = &c->buffers[fd];
+	if (len == 0 || b->is_dropped) {
+		return 0;
+	} else if (b->len - b->sent + len > COALESCER_PENDING_MAX) {
+		drop(c, fd);
+		return 0;
+	}
+
+	if (b->len + len > b->size && b->sent > 0) {
+		memmove(b->data, &b->data[b->sent], b->len - b->sent);
+		b->len -= b->sent;
+		b->sent = 0;
+	}
+
+	if (b->len + len > b->size) {
+		size_t size = b->size > 0 ? b->size : BUFFER_START;
+		while (b->len + len > size) {
+			size *= 2;
+		}
+
+		char *data = realloc(b->data, size);
+		if (!data) {
+			return -1;
+		}
+		b->data = data;
+		b->size = size;
+	}
+
+	mark_dirty(c, fd);
+	memcpy(&b->data[b->len], buf, len);
+	b->len += len;
+
+	return 0;
+}
+
+int coalescer_send(Coalescer *c, int fd, const void *buf, size_t len) {
+	const long sent = (long)send(fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+		return -1;
+	}
+
+	const size_t done = sent > 0 ? (size_t)sent : 0;
+	return done == len ? 0 : coalescer_add(c, fd, (const char *)buf + done, len - done);
+}
+
+/**
+ * @brief Sends as much of what is waiting as the connection takes without
+ * blocking. Drops the connection if it is gone or has taken nothing for too
+ * long.
+ *
+ */
+static void send_rest(Coalescer *c, int fd, uint64_t now_ms) {
+	Buffer *b = &c->buffers[fd];
+	const long sent = (long)send(fd, &b->data[b->sent], b->len - b->sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+		drop(c, fd);
+		return;
+	}
+
+	if (sent > 0) {
+		b->sent += (size_t)sent;
+	}
+
+	if (b->sent == b->len) {
+		clear(b);
+	} else if (!b->is_behind || sent > 0) {
+		b->is_behind = true;
+		b->since_ms = now_ms;
+	} else if (now_ms - b->since_ms >= c->drop_ms) {
+		drop(c, fd);
+	}
+}
+
+size_t coalescer_flush(Coalescer *c, uint64_t now_ms, int *dropped, size_t dropped_size) {
+	size_t result = 0;
+	size_t kept = 0;
+
+	for (size_t i = 0; i < c->dirty_len; i++) {
+		const int fd = c->dirty[i];
+		Buffer *b = &c->buffers[fd];
+		if (!b->is_dropped) {
+			send_rest(c, fd, now_ms);
+		}
+
+		if (b->is_dropped ? result < dropped_size : b->len == 0) {
+			if (b->is_dropped) {
+				dropped[result++] = fd;
+			}
+			b->is_dirty = false;
+		} else {
+			c->dirty[kept++] = fd;
+		}
+	}
+
+	c->dirty_len = kept;
+	return result;
+}
+
+bool coalescer_is_pending(const Coalescer *c, int fd) {
+	if (fd < 0 || (size_t)fd >= c->buffers_len) {
+		return false;
+	}
+
+	const Buffer *b = &c->buffers[fd];
+	return b->len > b->sent || b->is_dropped;
+}
+
+const char *coalescer_pending(const Coalescer *c, int fd, size_t *len) {
+	*len = 0;
+	if (fd < 0 || (size_t)fd >= c->buffers_len) {
+		return NULL;
+	}
+
+	const Buffer *b = &c->buffers[fd];
+	if (b->is_dropped || b->len == b->sent) {
+		return NULL;
+	}
+
+	*len = b->len - b->sent;
+	return b->data + b->sent;
+}
+
+bool coalescer_is_behind(const Coalescer *c) {
+	return c->dirty_len > 0;
+}
+
+void coalescer_remove(Coalescer *c, int fd) {
+	if (fd < 0 || (size_t)fd >= c->buffers_len) {
+		return;
+	}
+
+	Buffer *b = &c->buffers[fd];
+	if (b->is_dirty) {
+		for (size_t i = 0; i < c->dirty_len; i++) {
+			if (c->dirty[i] == fd) {
+				memmove(&c->dirty[i], &c->dirty[i + 1], sizeof *c->dirty * (c->dirty_len - i - 1));
+				c->dirty_len--;
+				break;
+			}
+		}
+	}
+
+	free(b->data);
+	memset(b, 0, sizeof *b);
+}
@@ -0,0 +1,122 @@
+#ifndef COALESCER_H_
+#define COALESCER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define COALESCER_KEEP_SIZE 4096 // Larger buffers are freed after a flush instead of kept for the next one.
+#define COALESCER_PENDING_MAX (1 << 20) // A connection with more than this waiting is dropped.
+
+/**
+ * @brief Gathers everything sent to a connection during one event loop
+ * iteration so it goes out in a single send, instead of one small segment per
+ * message. Meant to be owned by the thread that owns the connections.
+ *
+ * Buffers are indexed by connection and kept between flushes, so adding is a
+ * copy and nothing is searched. Sends never block: whatever a connection does
+ * not take stays in its buffer, ahead of anything added later, and is sent on
+ * the next flush. A connection that takes nothing for too long, or lets too
+ * much pile up, is dropped.
+ *
+ */
+typedef struct Coalescer Coalescer;
+
+/**
+ * @brief Creates a coalescer.
+ *
+ * @param drop_ms How long a connection may take nothing that is waiting for
+ * it before it is dropped.
+ * @return Coalescer* The created coalescer. NULL if an error occurred.
+ */
+Coalescer *coalescer_create(uint64_t drop_ms);
+
+/**
+ * @brief Frees the coalescer. Nothing is sent.
+ *
+ * @param c The coalescer to free.
+ */
+void coalescer_free(Coalescer *c);
+
+/**
+ * @brief Adds bytes to be sent to a connection on the next flush, after
+ * everything added for it before. Bytes added to a dropped connection are
+ * discarded.
+ *
+ * @param c The coalescer to add to.
+ * @param fd The connection.
+ * @param buf The bytes to send.
+ * @param len The length of buf.
+ * @return int -1 if memory ran out, in which case nothing was added. 0 otherwise.
+ */
+int coalescer_add(Coalescer *c, int fd, const void *buf, size_t len);
+
+/**
+ * @brief Sends to a connection right away without blocking, and adds whatever
+ * it did not take as if by coalescer_add(). Should only be called when nothing
+ * is waiting for the connection, or it would overtake it. See
+ * coalescer_is_pending().
+ *
+ * @param c The coalescer to add the rest to.
+ * @param fd The connection.
+ * @param buf The bytes to send.
+ * @param len The length of buf.
+ * @return int -1 if the connection failed or memory ran out. 0 otherwise.
+ */
+int coalescer_send(Coalescer *c, int fd, const void *buf, size_t len);
+
+/**
+ * @brief Sends what is waiting for every connection, one send per
+ * connection, in the order the connections were first added to. Never blocks.
+ *
+ * @param c The coalescer to flush.
+ * @param now_ms The current time in milliseconds.
+ * @param dropped Set to the connections dropped since the last flush. They
+ * are sent nothing more until coalescer_remove() and should be closed.
+ * @param dropped_size The number of connections dropped can hold. Any more
+ * are reported by the next flush.
+ * @return size_t The number of connections set in dropped.
+ */
+size_t coalescer_flush(Coalescer *c, uint64_t now_ms, int *dropped, size_t dropped_size);
+
+/**
+ * @brief Returns whether anything is waiting to be sent to a connection, or
+ * the connection was dropped. Anything else sending to it should go through
+ * coalescer_add() until this is false, or it would overtake what is waiting.
+ *
+ * @param c The coalescer to look in.
+ * @param fd The connection.
+ */
+bool coalescer_is_pending(const Coalescer *c, int fd);
+
+/**
+ * @brief Returns what is still waiting to be sent to a connection. It stays
+ * waiting.
+ *
+ * @param c The coalescer to look in.
+ * @param fd The connection.
+ * @param len Set to the number of bytes waiting.
+ * @return const char* The bytes waiting. NULL if there are none, or if the
+ * connection was dropped.
+ */
+const char *coalescer_pending(const Coalescer *c, int fd, size_t *len);
+
+/**
+ * @brief Returns whether anything is still waiting to be sent, so the next
+ * flush should not wait for other work.
+ *
+ * @param c The coalescer to look in.
+ */
+bool coalescer_is_behind(const Coalescer *c);
+
+/**
+ * @brief Forgets a connection along with anything still waiting for it.
+ * Should be called before the connection is closed, as its number may be
+ * reused.
+ *
+ * @param c The coalescer to remove from.
+ * @param fd The connection.
+ */
+void coalescer_remove(Coalescer *c, int fd);
+
+#endif
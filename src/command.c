@@ -0,0 +1,136 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "command.h"
+
+/**
+ * @brief Returns whether buf holds exactly the given word followed by CRLF.
+ * A bare LF is accepted as well.
+ * 
+ */
+static bool is_word(const char *buf, size_t len, const char *word) {
+	const size_t word_len = strlen(word);
+	if (len < word_len + 1 || memcmp(buf, word, word_len) != 0) {
+		return false;
+	}
+
+	const char *rest = buf + word_len;
+	const size_t rest_len = len - word_len;
+	return (rest_len == 2 && rest[0] == '\r' && rest[1] == '\n') || (rest_len == 1 && rest[0] == '\n');
+}
+
+/**
+ * @brief Parses a non-negative integer that takes up the rest of the message up
+ * to its line ending.
+ *
+ * @return bool false if the rest is not a number or the number is larger than max.
+ */
+static bool parse_number(const char *buf, size_t len, uint64_t max, uint64_t *n) {
+	size_t digits = 0;
+	uint64_t value = 0;
+	while (digits < len && buf[digits] >= '0' && buf[digits] <= '9') {
+		value = value * 10 + (uint64_t)(buf[digits] - '0');
+		if (value > max) {
+			return false;
+		}
+		digits++;
+	}
+
+	const char *rest = buf + digits;
+	const size_t rest_len = len - digits;
+	if (digits == 0 || !((rest_len == 2 && rest[0] == '\r' && rest[1] == '\n') || (rest_len == 1 && rest[0] == '\n'))) {
+		return false;
+	}
+
+	*n = value;
+	return true;
+}
+
+/**
+ * @brief Parses a lowercase hex token that takes up the rest of the message up
+ * to its line ending.
+ *
+ * @return bool false if the rest is not a token or does not fit in to token.
+ */
+static bool parse_token(const char *buf, size_t len, char *token, size_t size) {
+	size_t token_len = 0;
+	while (token_len < len && ((buf[token_len] >= '0' && buf[token_len] <= '9') || (buf[token_len] >= 'a' && buf[token_len] <= 'f'))) {
+		token_len++;
+	}
+
+	const char *rest = buf + token_len;
+	const size_t rest_len = len - token_len;
+	if (token_len == 0 || token_len >= size || !((rest_len == 2 && rest[0] == '\r' && rest[1] == '\n') || (rest_len == 1 && rest[0] == '\n'))) {
+		return false;
+	}
+
+	memcpy(token, buf, token_len);
+	token[token_len] = '\0';
+	return true;
+}
+
+/**
+ * @brief Parses text that takes up the rest of the message up to its line
+ * ending.
+ *
+ * @return bool false if the rest is empty, holds control characters or does
+ * not fit in to text.
+ */
+static bool parse_text(const char *buf, size_t len, char *text, size_t size) {
+	size_t text_len = 0;
+	while (text_len < len && (unsigned char)buf[text_len] >= ' ' && buf[text_len] != 0x7f) {
+		text_len++;
+	}
+
+	const char *rest = buf + text_len;
+	const size_t rest_len = len - text_len;
+	if (text_len == 0 || text_len >= size || !((rest_len == 2 && rest[0] == '\r' && rest[1] == '\n') || (rest_len == 1 && rest[0] == '\n'))) {
+		return false;
+	}
+
+	memcpy(text, buf, text_len);
+	text[text_len] = '\0';
+	return true;
+}
+
+Command command_parse(const char *buf, size_t len) {
+	Command result = { .type = COMMAND_NONE };
+	uint64_t n;
+
+	if (is_word(buf, len, "BOT")) {
+		result.type = COMMAND_BOT;
+	} else if (is_word(buf, len, "ANALYZE")) {
+		result.type = COMMAND_ANALYZE;
+	} else if (len > 7 && memcmp(buf, "RATING ", 7) == 0 && parse_number(buf + 7, len - 7, 1000000, &n)) {
+		result.type = COMMAND_RATING;
+		result.rating = (int)n;
+	} else if (is_word(buf, len, "ENTER")) {
+		result.type = COMMAND_ENTER;
+	} else if (is_word(buf, len, "ENTER BOT")) {
+		result.type = COMMAND_ENTER;
+		result.is_bot = true;
+	} else if (len > 6 && memcmp(buf, "WATCH ", 6) == 0 && parse_number(buf + 6, len - 6, UINT32_MAX, &n)) {
+		result.type = COMMAND_WATCH;
+		result.lobby = (uint32_t)n;
+	} else if (is_word(buf, len, "UNWATCH")) {
+		result.type = COMMAND_UNWATCH;
+	} else if (is_word(buf, len, "BOARD")) {
+		result.type = COMMAND_BOARD;
+	} else if (len > 7 && memcmp(buf, "RESUME ", 7) == 0 && parse_token(buf + 7, len - 7, result.token, COMMAND_TOKEN_SIZE)) {
+		result.type = COMMAND_RESUME;
+	} else if (len > 8 && memcmp(buf, "RECLAIM ", 8) == 0 && parse_token(buf + 8, len - 8, result.token, COMMAND_TOKEN_SIZE)) {
+		result.type = COMMAND_RECLAIM;
+	} else if (len > 4 && memcmp(buf, "SAY ", 4) == 0 && parse_text(buf + 4, len - 4, result.text, COMMAND_TEXT_SIZE)) {
+		result.type = COMMAND_SAY;
+	} else if (len > 9 && memcmp(buf, "ANNOUNCE ", 9) == 0 && parse_text(buf + 9, len - 9, result.text, COMMAND_TEXT_SIZE)) {
+		result.type = COMMAND_ANNOUNCE;
+	} else if (len > 10 && memcmp(buf, "SUBSCRIBE ", 10) == 0 && parse_number(buf + 10, len - 10, UINT32_MAX, &n)) {
+		result.type = COMMAND_SUBSCRIBE;
+		result.lobby = (uint32_t)n;
+	} else if (len > 12 && memcmp(buf, "UNSUBSCRIBE ", 12) == 0 && parse_number(buf + 12, len - 12, UINT32_MAX, &n)) {
+		result.type = COMMAND_UNSUBSCRIBE;
+		result.lobby = (uint32_t)n;
+	}
+
+	return result;
+}
@@ -0,0 +1,53 @@
+#ifndef COMMAND_H_
+#define COMMAND_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define COMMAND_TOKEN_SIZE 64 // Fits a session token. See session.h.
+#define COMMAND_TEXT_SIZE 256 // Fits the text of a chat message or an announcement.
+
+/**
+ * @brief Commands that only this server understands. They are checked before
+ * handing a message to nogo_parse(), which rejects anything outside of the
+ * base nogo protocol.
+ * 
+ */
+typedef enum CommandType {
+	COMMAND_NONE, // Not a server command. Should be parsed as nogo protocol.
+	COMMAND_BOT, // BOT: seats the server's bot in the sender's lobby.
+	COMMAND_ANALYZE, // ANALYZE: replies whether the team to move can force a win.
+	COMMAND_RATING, // RATING r: sets the rating the sender is matched by.
+	COMMAND_ENTER, // ENTER or ENTER BOT: enters the sender or the bot in to the tournament.
+	COMMAND_WATCH, // WATCH id: sends the sender everything that happens in a lobby.
+	COMMAND_UNWATCH, // UNWATCH: stops sending the sender the lobby they watch.
+	COMMAND_BOARD, // BOARD: replies with a snapshot of the sender's lobby.
+	COMMAND_RESUME, // RESUME token: takes over the session of a lost connection.
+	COMMAND_RECLAIM, // RECLAIM key: takes back a seat restored from the journal. See lobby_reclaim().
+	COMMAND_SAY, // SAY text: sends text to everyone subscribed to the chat of the sender's lobby.
+	COMMAND_ANNOUNCE, // ANNOUNCE text: sends text to everyone logged in. Only from local connections.
+	COMMAND_SUBSCRIBE, // SUBSCRIBE id: sends the sender the chat of a lobby.
+	COMMAND_UNSUBSCRIBE, // UNSUBSCRIBE id: stops sending the sender the chat of a lobby.
+} CommandType;
+
+typedef struct Command {
+	CommandType type;
+	int rating; // Only set for COMMAND_RATING.
+	bool is_bot; // Only set for COMMAND_ENTER. Enters the server's bot instead of the sender.
+	uint32_t lobby; // Only set for COMMAND_WATCH, COMMAND_SUBSCRIBE and COMMAND_UNSUBSCRIBE.
+	char token[COMMAND_TOKEN_SIZE]; // Only set for COMMAND_RESUME and COMMAND_RECLAIM, which holds the key. Null terminated.
+	char text[COMMAND_TEXT_SIZE]; // Only set for COMMAND_SAY and COMMAND_ANNOUNCE. Null terminated.
+} Command;
+
+/**
+ * @brief Parses a server command from the given message.
+ * 
+ * @param buf The message that was received.
+ * @param len The length of buf.
+ * @return Command The parsed command. The type is COMMAND_NONE if the message
+ * is not a server command.
+ */
+Command command_parse(const char *buf, size_t len);
+
+#endif
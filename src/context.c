@@ -3,11 +3,48 @@
 #include <string.h>
 
 #include "context.h"
+#include "lobby.h"
 #include "log.h"
 #include "player.h"
 
 #define PLAYERS_START 2
 #define PFDS_START 2
+#define LOBBIES_START 2
+#define AT_START 64
+
+/**
+ * @brief Makes sure fd can be looked up.
+ *
+ * @return int -1 if the function failed to allocate extra space. 0 otherwise.
+ */
+static int reserve_at(Context *ctx, size_t fd) {
+	if (fd < ctx->at_len) {
+		return 0;
+	}
+
+	size_t len = ctx->at_len;
+	while (fd >= len) {
+		len *= 2;
+	}
+
+	uint32_t *player_at = realloc(ctx->player_at, sizeof *player_at * len);
+	if (!player_at) {
+		return -1;
+	}
+	ctx->player_at = player_at;
+
+	uint32_t *pfd_at = realloc(ctx->pfd_at, sizeof *pfd_at * len);
+	if (!pfd_at) {
+		return -1;
+	}
+	ctx->pfd_at = pfd_at;
+
+	memset(&player_at[ctx->at_len], 0, sizeof *player_at * (len - ctx->at_len));
+	memset(&pfd_at[ctx->at_len], 0, sizeof *pfd_at * (len - ctx->at_len));
+	ctx->at_len = len;
+
+	return 0;
+}
 
 static int resize(Context *ctx) {
 	if (ctx->players_len == ctx->players_size) {
@@ -15,6 +52,7 @@ static int resize(Context *ctx) {
 		if (!ctx->players) {
 			return -1;
 		}
+		ctx->players_size *= 2;
 	}
 
 	if (ctx->pfds_len == ctx->pfds_size) {
@@ -22,6 +60,7 @@ static int resize(Context *ctx) {
 		if (!ctx->pfds) {
 			return -1;
 		}
+		ctx->pfds_size *= 2;
 	}
 
 	return 0;
@@ -35,6 +74,13 @@ Context *ctx_create(void) {
 
 		result->pfds = calloc(PFDS_START, sizeof *result->pfds);
 		result->pfds_size = PFDS_START;
+
+		result->lobbies = calloc(LOBBIES_START, sizeof *result->lobbies);
+		result->lobbies_size = LOBBIES_START;
+
+		result->player_at = calloc(AT_START, sizeof *result->player_at);
+		result->pfd_at = calloc(AT_START, sizeof *result->pfd_at);
+		result->at_len = AT_START;
 	}
 
 	return result;
@@ -43,11 +89,14 @@ Context *ctx_create(void) {
 void ctx_destory(Context *ctx) {
 	free(ctx->players);
 	free(ctx->pfds);
+	free(ctx->lobbies);
+	free(ctx->player_at);
+	free(ctx->pfd_at);
 	free(ctx);
 }
 
 int ctx_add_player(Context *ctx, const Player *player) {
-	if (resize(ctx) < 0) {
+	if (player->fd < 0 || ctx->pfds_len >= UINT32_MAX || resize(ctx) < 0 || reserve_at(ctx, (size_t)player->fd) < 0) {
 		return -1;
 	}
 
@@ -58,42 +107,95 @@ int ctx_add_player(Context *ctx, const Player *player) {
 
 	ctx->players[ctx->players_len] = *player;
 	ctx->players_len++;
+	ctx->player_at[player->fd] = (uint32_t)ctx->players_len;
 
 	ctx->pfds[ctx->pfds_len].fd = player->fd;
 	ctx->pfds[ctx->pfds_len].events = POLLIN;
 	ctx->pfds[ctx->pfds_len].revents = 0;
 	ctx->pfds_len++;
+	ctx->pfd_at[player->fd] = (uint32_t)ctx->pfds_len;
 
 	return 0;
 }
 
-Player *ctx_get_player(Context *ctx, int fd) {
-	Player *found = NULL;
-	for (size_t i = 0; i < ctx->players_len; i++) {
-		if (ctx->players[i].fd == fd) {
-			found = &ctx->players[i];
-			break;
+int ctx_reserve(Context *ctx, size_t players) {
+	if (players > ctx->players_size) {
+		Player *grown = realloc(ctx->players, sizeof *ctx->players * players);
+		if (!grown) {
+			return -1;
 		}
+		ctx->players = grown;
+		ctx->players_size = players;
 	}
 
-	return found;
+	if (players > ctx->pfds_size) {
+		struct pollfd *grown = realloc(ctx->pfds, sizeof *ctx->pfds * players);
+		if (!grown) {
+			return -1;
+		}
+		ctx->pfds = grown;
+		ctx->pfds_size = players;
+	}
+
+	// Connections are numbered from the lowest free fd, so they are about as
+	// many as there are players.
+	return players > 0 ? reserve_at(ctx, players - 1) : 0;
+}
+
+Player *ctx_get_player(Context *ctx, int fd) {
+	if (fd < 0 || (size_t)fd >= ctx->at_len || ctx->player_at[fd] == 0) {
+		return NULL;
+	}
+
+	return &ctx->players[ctx->player_at[fd] - 1];
 }
 
 void ctx_remove_player(Context *ctx, int fd) {
-	// Remove from players.
-	for (size_t i = 0; i < ctx->players_len; i++) {
-		if (ctx->players[i].fd == fd) {
-			ctx->players[i] = ctx->players[ctx->players_len - 1];
-			ctx->players_len--;
-			break;
+	// Remove from players. The last player takes its place.
+	Player *player = ctx_get_player(ctx, fd);
+	if (player) {
+		*player = ctx->players[ctx->players_len - 1];
+		ctx->player_at[player->fd] = ctx->player_at[fd];
+		ctx->player_at[fd] = 0;
+		ctx->players_len--;
+	}
+
+	ctx_unpoll(ctx, fd);
+}
+
+void ctx_unpoll(Context *ctx, int fd) {
+	if (fd < 0 || (size_t)fd >= ctx->at_len || ctx->pfd_at[fd] == 0) {
+		return;
+	}
+
+	struct pollfd *pfd = &ctx->pfds[ctx->pfd_at[fd] - 1];
+	*pfd = ctx->pfds[ctx->pfds_len - 1];
+	ctx->pfd_at[pfd->fd] = ctx->pfd_at[fd];
+	ctx->pfd_at[fd] = 0;
+	ctx->pfds_len--;
+}
+
+int ctx_add_lobby(Context *ctx, Lobby *l) {
+	if (ctx->lobbies_len == ctx->lobbies_size) {
+		Lobby **lobbies = realloc(ctx->lobbies, sizeof *ctx->lobbies * ctx->lobbies_size * 2);
+		if (!lobbies) {
+			return -1;
 		}
+		ctx->lobbies = lobbies;
+		ctx->lobbies_size *= 2;
 	}
 
-	// Remove from pfds.
-	for (size_t i = 0; i < ctx->pfds_len; i++) {
-		if (ctx->pfds[i].fd == fd) {
-			ctx->pfds[i] = ctx->pfds[ctx->pfds_len - 1];
-			ctx->pfds_len--;
+	ctx->lobbies[ctx->lobbies_len] = l;
+	ctx->lobbies_len++;
+
+	return 0;
+}
+
+void ctx_remove_lobby(Context *ctx, const Lobby *l) {
+	for (size_t i = 0; i < ctx->lobbies_len; i++) {
+		if (ctx->lobbies[i] == l) {
+			ctx->lobbies[i] = ctx->lobbies[ctx->lobbies_len - 1];
+			ctx->lobbies_len--;
 			break;
 		}
 	}
@@ -2,12 +2,42 @@
 #define CONTEXT_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 typedef struct Context {
 	struct Lobby *l;
 	struct Queue *msgq; // Contains messages that need to be sent.
 	struct Queue *closeq; // Contains file descriptors that need to be closed.
+	struct Coalescer *coalescer; // Output waiting to be sent to each connection. Owned by the I/O thread.
+	struct Executor *executor; // Runs lobby commands off the I/O thread. NULL to run them inline.
+	struct Mailbox *outbox; // Messages queued by the executor's threads. NULL without an executor.
+	struct Mailbox *closebox; // File descriptors the executor's threads want closed. NULL without an executor.
+	struct Bot *bot; // Plays bot seats. NULL if bots are disabled.
+	struct Mailbox *botbox; // Ids of lobbies where a bot is to move again, from the executor's threads. NULL without a bot.
+	struct Solver *solver; // Solves small boards exactly. NULL if disabled.
+	struct Archive *archive; // Stores finished games. NULL if disabled.
+	struct Journal *journal; // Records lobby changes for crash recovery. NULL if disabled.
+	struct Matchmaker *matchmaker; // Pairs JOINs in to new lobbies. NULL to seat every JOIN in l.
+	uint32_t next_lobby_id;
+	struct Tournament *tournament; // Plays a tournament between players who send ENTER. NULL if disabled.
+	size_t tournament_size; // Entrants the tournament begins with.
+	struct Queue *resultq; // Results of tournament games that still need to be recorded.
+	struct Mailbox *resultbox; // Results of tournament games the executor's threads finished. NULL without an executor.
+	struct Audience *audience; // Spectators of the lobbies.
+	struct Queue *frameq; // Frames for the audience that still need to be published.
+	struct Mailbox *framebox; // Frames for the audience from the executor's threads. NULL without an executor.
+	struct Channels *channels; // Chat in the lobbies and announcements to everyone.
+	struct Sessions *sessions; // Lets players pick up where they left off from a new connection. NULL if disabled.
+	struct Limiter *limiter; // Limits how fast connections and addresses may send commands. NULL if disabled.
+	struct Store *store; // Keeps the moves of idle lobbies while their boards are freed. NULL if disabled.
+	uint64_t idle_ms; // How long a lobby goes without a job before it is put to sleep in the store.
 
+	struct Lobby **lobbies; // Lobbies made for matches. Does not hold l.
+	size_t lobbies_len;
+	size_t lobbies_size;
+
+	// Looked up through player_at and pfd_at, which are small and dense so
+	// that finding a connection only touches the player it finds.
 	struct Player *players;
 	size_t players_len;
 	size_t players_size;
@@ -15,6 +45,10 @@ typedef struct Context {
 	struct pollfd *pfds;
 	size_t pfds_len;
 	size_t pfds_size;
+
+	uint32_t *player_at; // Indexed by fd. One more than the index in players, 0 if there is none.
+	uint32_t *pfd_at; // Indexed by fd. One more than the index in pfds, 0 if not polled.
+	size_t at_len;
 } Context;
 
 /**
@@ -40,8 +74,19 @@ void ctx_destory(Context *ctx);
  */
 int ctx_add_player(Context *ctx, const struct Player *player);
 
+/**
+ * @brief Makes room for the given number of players so that adding up to that
+ * many does not reallocate.
+ * 
+ * @param ctx The context instance to grow.
+ * @param players The number of players to make room for.
+ * @return int -1 on error. 0 otherwise.
+ */
+int ctx_reserve(Context *ctx, size_t players);
+
 /**
  * @brief Get the player that is associated to the given file descriptor.
+ * Takes constant time.
  * 
  * @param ctx The context isntance to search.
  * @param fd The file descriptor  to match.
@@ -57,4 +102,31 @@ struct Player *ctx_get_player(Context *ctx, int fd);
  */
 void ctx_remove_player(Context *ctx, int fd);
 
+/**
+ * @brief Stops polling the given player's connection. The player stays in
+ * context's list of players.
+ * 
+ * @param ctx The context instance to update.
+ * @param fd The player's file descriptor.
+ */
+void ctx_unpoll(Context *ctx, int fd);
+
+/**
+ * @brief Adds the given lobby to context's list of lobbies.
+ * 
+ * @param ctx The context instance to add to.
+ * @param l The lobby to be added.
+ * @return int -1 on error. 0 otherwise.
+ */
+int ctx_add_lobby(Context *ctx, struct Lobby *l);
+
+/**
+ * @brief Remove the given lobby from context's list of lobbies. The lobby is
+ * not freed.
+ * 
+ * @param ctx The context instance to be removed from.
+ * @param l The lobby to be removed.
+ */
+void ctx_remove_lobby(Context *ctx, const struct Lobby *l);
+
 #endif
@@ -0,0 +1,435 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "executor.h"
+#include "log.h"
+#include "queue.h"
+
+#define BUCKETS_START 64
+#define ACTOR_BATCH 64 // Tasks an actor runs before giving its thread to other actors.
+#define BALANCE_MIN_TASKS 64 // Imbalance below this many tasks is left alone.
+
+typedef struct Job {
+	ExecutorTask task;
+	void *arg;
+} Job;
+
+typedef struct Worker Worker;
+
+typedef struct Actor {
+	uint32_t key;
+	Worker *owner; // Only changed by the balancer while the actor is idle.
+	struct Actor *next_in_bucket;
+
+	// Guarded by the owner's lock.
+	Queue *jobs; // The mailbox.
+	bool is_scheduled; // Queued on or running on the owner. Set while jobs is not empty.
+	struct Actor *next_ready;
+	unsigned long load; // Tasks run since the last balance.
+} Actor;
+
+struct Worker {
+	Executor *e;
+	pthread_t thread;
+	size_t actors_len; // Guarded by the executor's lock.
+
+	pthread_mutex_t lock;
+	pthread_cond_t has_work; // Signaled when an actor is scheduled or the worker stops.
+	Actor *ready_head;
+	Actor *ready_tail;
+	unsigned long load; // Tasks run since the last balance.
+	bool stop;
+};
+
+struct Executor {
+	Worker *workers;
+	size_t workers_len;
+
+	// Guards the actor table, actor owners and the statistics. Taken before
+	// any worker's lock, never after.
+	pthread_mutex_t lock;
+	Actor **buckets;
+	size_t buckets_len;
+	size_t actors_len;
+	struct timespec balanced_at;
+	unsigned long migrations;
+	unsigned long retired;
+
+	pthread_mutex_t wait_lock;
+	pthread_cond_t is_idle; // Signaled when the last pending task finishes.
+	size_t pending; // Tasks that are queued or running.
+};
+
+static size_t bucket_of(const Executor *e, uint32_t key) {
+	key ^= key >> 16;
+	key *= 0x45d9f3bU;
+	key ^= key >> 16;
+	return key & (e->buckets_len - 1);
+}
+
+static long elapsed_ms(const struct timespec *since) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+/**
+ * @brief Puts an actor at the back of its owner's ready list. The owner's lock
+ * must be held.
+ *
+ */
+static void push_ready(Worker *w, Actor *a) {
+	a->next_ready = NULL;
+	if (w->ready_tail) {
+		w->ready_tail->next_ready = a;
+	} else {
+		w->ready_head = a;
+	}
+	w->ready_tail = a;
+}
+
+static Actor *pop_ready(Worker *w) {
+	Actor *result = w->ready_head;
+	w->ready_head = result->next_ready;
+	if (!w->ready_head) {
+		w->ready_tail = NULL;
+	}
+
+	return result;
+}
+
+static void finish_job(Executor *e) {
+	if (__atomic_sub_fetch(&e->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+		pthread_mutex_lock(&e->wait_lock);
+		pthread_cond_broadcast(&e->is_idle);
+		pthread_mutex_unlock(&e->wait_lock);
+	}
+}
+
+static void *worker(void *arg) {
+	Worker *w = arg;
+
+	pthread_mutex_lock(&w->lock);
+	for (;;) {
+		while (!w->ready_head && !w->stop) {
+			pthread_cond_wait(&w->has_work, &w->lock);
+		}
+
+		if (!w->ready_head) {
+			break;
+		}
+
+		Actor *a = pop_ready(w);
+		for (size_t ran = 0; ran < ACTOR_BATCH && !queue_isempty(a->jobs); ran++) {
+			const Job job = *(Job *)queue_get(a->jobs);
+			pthread_mutex_unlock(&w->lock);
+
+			job.task(job.arg);
+			free(job.arg);
+			finish_job(w->e);
+
+			pthread_mutex_lock(&w->lock);
+			a->load++;
+			w->load++;
+		}
+
+		if (queue_isempty(a->jobs)) {
+			a->is_scheduled = false;
+		} else {
+			// Requeued behind the other actors of this worker.
+			push_ready(w, a);
+		}
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	return NULL;
+}
+
+static void free_actor(Actor *a) {
+	queue_free(a->jobs);
+	free(a);
+}
+
+static int grow_buckets(Executor *e) {
+	const size_t old_len = e->buckets_len;
+	Actor **old = e->buckets;
+
+	e->buckets = calloc(old_len * 2, sizeof *e->buckets);
+	if (!e->buckets) {
+		e->buckets = old;
+		return -1;
+	}
+	e->buckets_len = old_len * 2;
+
+	for (size_t i = 0; i < old_len; i++) {
+		Actor *next;
+		for (Actor *a = old[i]; a; a = next) {
+			next = a->next_in_bucket;
+			const size_t b = bucket_of(e, a->key);
+			a->next_in_bucket = e->buckets[b];
+			e->buckets[b] = a;
+		}
+	}
+
+	free(old);
+	return 0;
+}
+
+static Actor *find_actor(const Executor *e, uint32_t key) {
+	for (Actor *a = e->buckets[bucket_of(e, key)]; a; a = a->next_in_bucket) {
+		if (a->key == key) {
+			return a;
+		}
+	}
+
+	return NULL;
+}
+
+static Actor *create_actor(Executor *e, uint32_t key) {
+	if (e->actors_len == e->buckets_len && grow_buckets(e) < 0) {
+		return NULL;
+	}
+
+	Actor *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+
+	result->jobs = queue_create(sizeof(Job));
+	if (!result->jobs) {
+		free(result);
+		return NULL;
+	}
+
+	Worker *owner = &e->workers[0];
+	for (size_t i = 1; i < e->workers_len; i++) {
+		if (e->workers[i].actors_len < owner->actors_len) {
+			owner = &e->workers[i];
+		}
+	}
+
+	result->key = key;
+	result->owner = owner;
+	owner->actors_len++;
+
+	const size_t b = bucket_of(e, key);
+	result->next_in_bucket = e->buckets[b];
+	e->buckets[b] = result;
+	e->actors_len++;
+
+	return result;
+}
+
+/**
+ * @brief Moves idle actors from the worker that ran the most tasks since the
+ * last balance to the one that ran the fewest, and drops actors that ran
+ * nothing. An actor only moves if that does not just make the other worker
+ * the busiest one, so a single hot actor stays where it is. The executor's
+ * lock must be held.
+ *
+ */
+static void balance(Executor *e) {
+	Worker *hot = NULL;
+	Worker *cold = NULL;
+	unsigned long hot_load = 0;
+	unsigned long cold_load = 0;
+	for (size_t i = 0; i < e->workers_len; i++) {
+		Worker *w = &e->workers[i];
+
+		pthread_mutex_lock(&w->lock);
+		const unsigned long load = w->load;
+		w->load = 0;
+		pthread_mutex_unlock(&w->lock);
+
+		if (!hot || load > hot_load) {
+			hot = w;
+			hot_load = load;
+		}
+		if (!cold || load < cold_load) {
+			cold = w;
+			cold_load = load;
+		}
+	}
+
+	unsigned long excess = 0;
+	if (hot_load - cold_load >= BALANCE_MIN_TASKS && hot_load > cold_load * 2) {
+		excess = (hot_load - cold_load) / 2;
+	}
+
+	for (size_t i = 0; i < e->buckets_len; i++) {
+		Actor **link = &e->buckets[i];
+		while (*link) {
+			Actor *a = *link;
+			Worker *owner = a->owner;
+
+			pthread_mutex_lock(&owner->lock);
+			const unsigned long load = a->load;
+			const bool is_idle = !a->is_scheduled;
+			a->load = 0;
+			pthread_mutex_unlock(&owner->lock);
+
+			if (is_idle && load == 0) {
+				*link = a->next_in_bucket;
+				owner->actors_len--;
+				e->actors_len--;
+				e->retired++;
+				free_actor(a);
+				continue;
+			}
+
+			if (is_idle && owner == hot && load <= excess) {
+				a->owner = cold;
+				hot->actors_len--;
+				cold->actors_len++;
+				excess -= load;
+				e->migrations++;
+			}
+
+			link = &a->next_in_bucket;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &e->balanced_at);
+}
+
+Executor *executor_create(size_t threads) {
+	Executor *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+
+	result->workers = calloc(threads, sizeof *result->workers);
+	result->buckets = calloc(BUCKETS_START, sizeof *result->buckets);
+	if (!result->workers || !result->buckets) {
+		free(result->workers);
+		free(result->buckets);
+		free(result);
+		return NULL;
+	}
+	result->buckets_len = BUCKETS_START;
+
+	pthread_mutex_init(&result->lock, NULL);
+	pthread_mutex_init(&result->wait_lock, NULL);
+	pthread_cond_init(&result->is_idle, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &result->balanced_at);
+
+	for (size_t i = 0; i < threads; i++) {
+		Worker *w = &result->workers[i];
+		w->e = result;
+		pthread_mutex_init(&w->lock, NULL);
+		pthread_cond_init(&w->has_work, NULL);
+
+		if (pthread_create(&w->thread, NULL, worker, w) != 0) {
+			LOG_ERROR("failed to start executor thread\n");
+			pthread_mutex_destroy(&w->lock);
+			pthread_cond_destroy(&w->has_work);
+			break;
+		}
+		result->workers_len++;
+	}
+
+	if (result->workers_len == 0) {
+		executor_free(result);
+		return NULL;
+	}
+
+	return result;
+}
+
+void executor_free(Executor *e) {
+	executor_wait(e);
+
+	for (size_t i = 0; i < e->workers_len; i++) {
+		Worker *w = &e->workers[i];
+		pthread_mutex_lock(&w->lock);
+		w->stop = true;
+		pthread_cond_signal(&w->has_work);
+		pthread_mutex_unlock(&w->lock);
+	}
+
+	for (size_t i = 0; i < e->workers_len; i++) {
+		Worker *w = &e->workers[i];
+		pthread_join(w->thread, NULL);
+		pthread_mutex_destroy(&w->lock);
+		pthread_cond_destroy(&w->has_work);
+	}
+
+	for (size_t i = 0; i < e->buckets_len; i++) {
+		Actor *next;
+		for (Actor *a = e->buckets[i]; a; a = next) {
+			next = a->next_in_bucket;
+			free_actor(a);
+		}
+	}
+
+	pthread_mutex_destroy(&e->lock);
+	pthread_mutex_destroy(&e->wait_lock);
+	pthread_cond_destroy(&e->is_idle);
+	free(e->buckets);
+	free(e->workers);
+	free(e);
+}
+
+int executor_submit(Executor *e, uint32_t key, ExecutorTask task, const void *arg, size_t arg_size) {
+	Job job = { .task = task, .arg = malloc(arg_size) };
+	if (!job.arg) {
+		return -1;
+	}
+	memcpy(job.arg, arg, arg_size);
+
+	pthread_mutex_lock(&e->lock);
+
+	if (elapsed_ms(&e->balanced_at) >= EXECUTOR_BALANCE_MS) {
+		balance(e);
+	}
+
+	Actor *a = find_actor(e, key);
+	if (!a) {
+		a = create_actor(e, key);
+	}
+
+	int result = -1;
+	if (a) {
+		Worker *w = a->owner;
+		pthread_mutex_lock(&w->lock);
+
+		result = queue_put(a->jobs, &job);
+		if (result == 0) {
+			__atomic_add_fetch(&e->pending, 1, __ATOMIC_ACQ_REL);
+			if (!a->is_scheduled) {
+				a->is_scheduled = true;
+				push_ready(w, a);
+				pthread_cond_signal(&w->has_work);
+			}
+		}
+
+		pthread_mutex_unlock(&w->lock);
+	}
+
+	pthread_mutex_unlock(&e->lock);
+
+	if (result < 0) {
+		free(job.arg);
+	}
+
+	return result;
+}
+
+void executor_wait(Executor *e) {
+	pthread_mutex_lock(&e->wait_lock);
+	while (__atomic_load_n(&e->pending, __ATOMIC_ACQUIRE) > 0) {
+		pthread_cond_wait(&e->is_idle, &e->wait_lock);
+	}
+	pthread_mutex_unlock(&e->wait_lock);
+}
+
+void executor_stats(Executor *e, ExecutorStats *stats) {
+	pthread_mutex_lock(&e->lock);
+	stats->actors = e->actors_len;
+	stats->migrations = e->migrations;
+	stats->retired = e->retired;
+	pthread_mutex_unlock(&e->lock);
+}
@@ -0,0 +1,85 @@
+#ifndef EXECUTOR_H_
+#define EXECUTOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Runs tasks on worker threads as actors. Every key is an actor with its
+ * own mailbox of tasks, and every actor is owned by exactly one worker thread,
+ * which runs the actor's tasks one at a time in the order they were
+ * submitted. Tasks of different actors run in parallel when their actors are
+ * owned by different threads.
+ *
+ * The server keys tasks by lobby id, so a lobby is only ever touched by the
+ * thread that owns it and lobby functions need no locks.
+ *
+ * New actors go to the thread that owns the fewest. Every
+ * EXECUTOR_BALANCE_MS the executor compares how many tasks each thread ran
+ * and moves idle actors from the busiest thread to the least busy one, so a
+ * few hot lobbies don't all end up waiting on the same thread. Actors that ran
+ * nothing over a whole period are dropped and created again on their next
+ * task.
+ *
+ */
+typedef struct Executor Executor;
+
+typedef void (*ExecutorTask)(void *arg);
+
+#define EXECUTOR_BALANCE_MS 100
+
+/**
+ * @brief Statistics of an executor.
+ *
+ */
+typedef struct ExecutorStats {
+	size_t actors; // Actors that currently exist.
+	unsigned long migrations; // Times an actor was moved to another thread.
+	unsigned long retired; // Times an idle actor was dropped.
+} ExecutorStats;
+
+/**
+ * @brief Creates an executor and starts its worker threads.
+ *
+ * @param threads The number of worker threads.
+ * @return Executor* The created executor. NULL if an error occurred.
+ */
+Executor *executor_create(size_t threads);
+
+/**
+ * @brief Waits for every submitted task to finish, then stops the worker
+ * threads and frees the executor.
+ *
+ * @param e The executor to free.
+ */
+void executor_free(Executor *e);
+
+/**
+ * @brief Puts a task in the mailbox of the key's actor, to run after every
+ * task already submitted with the same key.
+ *
+ * @param e The executor to run the task on.
+ * @param key The actor to run the task on.
+ * @param task The function to run.
+ * @param arg Copied and passed to task. The copy is freed once task returns.
+ * @param arg_size The size of arg.
+ * @return int -1 if the task could not be queued. 0 otherwise.
+ */
+int executor_submit(Executor *e, uint32_t key, ExecutorTask task, const void *arg, size_t arg_size);
+
+/**
+ * @brief Waits until every submitted task has finished.
+ *
+ * @param e The executor to wait on.
+ */
+void executor_wait(Executor *e);
+
+/**
+ * @brief Gets the statistics of the executor.
+ *
+ * @param e The executor to check.
+ * @param stats Set to the statistics.
+ */
+void executor_stats(Executor *e, ExecutorStats *stats);
+
+#endif
@@ -0,0 +1,699 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "libnogo/nogo.h"
+
+#include "bot.h"
+#include "bytes.h"
+#include "handoff.h"
+#include "log.h"
+
+#define MAGIC "NOGOHND1"
+#define MAGIC_SIZE 8
+#define HEADER_SIZE (MAGIC_SIZE + 4 + 8) // Magic, then the number of fds and the size of the state.
+#define BUFFER_START 4096
+
+#define NAME_LEN_MASK 0x7f
+#define NAME_BOT_FLAG 0x80 // Set in the name length when the seat is the server's bot.
+
+// Flags of a connection.
+#define CONN_LOGIN 0x01
+#define CONN_IN_LOBBY 0x02
+#define CONN_QUEUED 0x04
+#define CONN_WATCHING 0x08
+
+/**
+ * @brief The state being encoded. Stops growing once an allocation failed.
+ *
+ */
+typedef struct Writer {
+	unsigned char *data;
+	size_t len;
+	size_t size;
+	bool is_failed;
+} Writer;
+
+/**
+ * @brief The state being decoded. Reads nothing past the end.
+ *
+ */
+typedef struct Reader {
+	const unsigned char *data;
+	size_t len;
+	size_t offset;
+	bool is_failed;
+} Reader;
+
+static unsigned char *reserve(Writer *w, size_t n) {
+	if (w->is_failed) {
+		return NULL;
+	}
+
+	if (w->len + n > w->size) {
+		size_t size = w->size > 0 ? w->size : BUFFER_START;
+		while (w->len + n > size) {
+			size *= 2;
+		}
+
+		unsigned char *data = realloc(w->data, size);
+		if (!data) {
+			w->is_failed = true;
+			return NULL;
+		}
+		w->data = data;
+		w->size = size;
+	}
+
+	unsigned char *result = w->data + w->len;
+	w->len += n;
+	return result;
+}
+
+static void write_u8(Writer *w, unsigned int n) {
+	unsigned char *dst = reserve(w, 1);
+	if (dst) {
+		dst[0] = (unsigned char)n;
+	}
+}
+
+static void write_u32(Writer *w, uint32_t n) {
+	unsigned char *dst = reserve(w, 4);
+	if (dst) {
+		put_u32(dst, n);
+	}
+}
+
+static void write_name(Writer *w, const char *name, bool is_bot) {
+	const size_t len = strnlen(name, PLAYER_NAME_SIZE - 1);
+	write_u8(w, (unsigned int)len | (is_bot ? NAME_BOT_FLAG : 0));
+	unsigned char *dst = reserve(w, len);
+	if (dst) {
+		memcpy(dst, name, len);
+	}
+}
+
+static const unsigned char *take(Reader *r, size_t n) {
+	if (r->is_failed || r->len - r->offset < n) {
+		r->is_failed = true;
+		return NULL;
+	}
+
+	const unsigned char *result = r->data + r->offset;
+	r->offset += n;
+	return result;
+}
+
+static unsigned int read_u8(Reader *r) {
+	const unsigned char *src = take(r, 1);
+	return src ? src[0] : 0;
+}
+
+static uint32_t read_u32(Reader *r) {
+	const unsigned char *src = take(r, 4);
+	return src ? get_u32(src) : 0;
+}
+
+/**
+ * @brief Reads a name written by write_name().
+ *
+ * @return bool Whether the name was the bot's.
+ */
+static bool read_name(Reader *r, char name[PLAYER_NAME_SIZE]) {
+	const unsigned int len_flags = read_u8(r);
+	const size_t len = len_flags & NAME_LEN_MASK;
+	memset(name, 0, PLAYER_NAME_SIZE);
+
+	const unsigned char *src = len < PLAYER_NAME_SIZE ? take(r, len) : NULL;
+	if (src) {
+		memcpy(name, src, len);
+	} else {
+		r->is_failed = true;
+	}
+
+	return len_flags & NAME_BOT_FLAG;
+}
+
+/**
+ * @brief Writes a lobby's seats and the moves played in it. Boards and
+ * positions fit in one byte like in the journal.
+ *
+ */
+static void write_lobby(Writer *w, const Lobby *l) {
+	write_u32(w, l->id);
+	write_u8(w, (unsigned int)l->board.rows);
+	write_u8(w, (unsigned int)l->board.cols);
+
+	write_u8(w, (unsigned int)l->players_len);
+	for (int i = 0; i < l->players_len; i++) {
+		const Player *seat = &l->players[i];
+		write_name(w, seat->name, seat->is_bot);
+		write_u8(w, (unsigned char)seat->team);
+		write_u32(w, (uint32_t)seat->fd);
+	}
+
+	const size_t moves_len = lobby_moves_len(l);
+	write_u32(w, (uint32_t)moves_len);
+	for (size_t i = 0; i < moves_len; i++) {
+		const LobbyMove move = lobby_move_at(l, i);
+		write_u8(w, (unsigned char)move.team);
+		write_u8(w, (unsigned int)move.row);
+		write_u8(w, (unsigned int)move.col);
+	}
+}
+
+/**
+ * @brief Rebuilds a lobby written by write_lobby() by seating its players in
+ * order and playing its moves again.
+ *
+ * @return Lobby* The lobby. NULL if it could not be rebuilt.
+ */
+static Lobby *read_lobby(Reader *r) {
+	const uint32_t id = read_u32(r);
+	const size_t rows = read_u8(r);
+	const size_t cols = read_u8(r);
+	Lobby *l = r->is_failed ? NULL : lobby_create(rows, cols);
+	if (!l) {
+		return NULL;
+	}
+	l->id = id;
+
+	const unsigned int seats = read_u8(r);
+	char teams[LOBBY_MAX_PLAYERS];
+	for (unsigned int i = 0; i < seats && !r->is_failed; i++) {
+		Player seat;
+		memset(&seat, 0, sizeof seat);
+		if (read_name(r, seat.name)) {
+			seat = bot_player();
+		} else {
+			seat.is_login = true;
+		}
+		const char team = (char)read_u8(r);
+		const int fd = (int)read_u32(r);
+		if (!seat.is_bot) {
+			seat.fd = fd;
+		}
+
+		if (r->is_failed || i >= LOBBY_MAX_PLAYERS || lobby_join(l, &seat) < 0) {
+			r->is_failed = true;
+			break;
+		}
+		teams[i] = team;
+	}
+
+	// Seats keep their team even if somebody left before them.
+	for (int i = 0; i < l->players_len && !r->is_failed; i++) {
+		l->players[i].team = teams[i];
+	}
+
+	const uint32_t moves_len = read_u32(r);
+	for (uint32_t i = 0; i < moves_len && !r->is_failed; i++) {
+		const char team = (char)read_u8(r);
+		const size_t row = read_u8(r);
+		const size_t col = read_u8(r);
+		if (r->is_failed || lobby_place(l, team, row, col) < 0) {
+			r->is_failed = true;
+		}
+	}
+
+	if (r->is_failed) {
+		lobby_free(l);
+		return NULL;
+	}
+
+	return l;
+}
+
+static void write_connection(Writer *w, const HandoffConnection *c) {
+	const Player *p = &c->player;
+	write_u32(w, (uint32_t)p->fd);
+	write_name(w, p->name, false);
+	write_u8(w, (unsigned char)p->team);
+	write_u8(w, (p->is_login ? CONN_LOGIN : 0) | (c->in_lobby ? CONN_IN_LOBBY : 0) | (c->is_queued ? CONN_QUEUED : 0) |
+		(c->is_watching ? CONN_WATCHING : 0));
+	write_u32(w, (uint32_t)p->rating);
+	write_u32(w, p->route);
+	write_u32(w, c->lobby_id);
+	write_u32(w, c->watched);
+
+	const size_t token_len = strnlen(c->token, SESSION_TOKEN_LEN);
+	write_u8(w, (unsigned int)token_len);
+	unsigned char *dst = reserve(w, token_len);
+	if (dst) {
+		memcpy(dst, c->token, token_len);
+	}
+
+	write_u32(w, (uint32_t)c->pending_len);
+	dst = reserve(w, c->pending_len);
+	if (dst && c->pending_len > 0) {
+		memcpy(dst, c->pending, c->pending_len);
+	}
+}
+
+static void read_connection(Reader *r, HandoffConnection *c) {
+	memset(c, 0, sizeof *c);
+	Player *p = &c->player;
+	p->fd = (int)read_u32(r);
+	read_name(r, p->name);
+	p->team = (char)read_u8(r);
+
+	const unsigned int flags = read_u8(r);
+	p->is_login = flags & CONN_LOGIN;
+	c->in_lobby = flags & CONN_IN_LOBBY;
+	c->is_queued = flags & CONN_QUEUED;
+	c->is_watching = flags & CONN_WATCHING;
+
+	p->rating = (int)read_u32(r);
+	p->route = read_u32(r);
+	c->lobby_id = read_u32(r);
+	c->watched = read_u32(r);
+
+	const size_t token_len = read_u8(r);
+	const unsigned char *src = token_len <= SESSION_TOKEN_LEN ? take(r, token_len) : NULL;
+	if (src) {
+		memcpy(c->token, src, token_len);
+	} else {
+		r->is_failed = true;
+	}
+
+	const size_t pending_len = read_u32(r);
+	src = take(r, pending_len);
+	if (!src) {
+		r->is_failed = true;
+	} else if (pending_len > 0) {
+		if ((c->pending = malloc(pending_len)) == NULL) {
+			r->is_failed = true;
+			return;
+		}
+		memcpy(c->pending, src, pending_len);
+		c->pending_len = pending_len;
+	}
+}
+
+/**
+ * @brief Writes the whole buffer, retrying on short writes and interrupts.
+ *
+ * @return int -1 on error. 0 otherwise.
+ */
+static int send_all(int sock, const unsigned char *buf, size_t len) {
+	while (len > 0) {
+		const ssize_t sent = send(sock, buf, len, 0);
+		if (sent < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		buf += sent;
+		len -= (size_t)sent;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Reads exactly len bytes.
+ *
+ * @return int -1 on error or if the other end went away. 0 otherwise.
+ */
+static int recv_all(int sock, unsigned char *buf, size_t len) {
+	while (len > 0) {
+		const ssize_t got = recv(sock, buf, len, 0);
+		if (got < 0 && errno == EINTR) {
+			continue;
+		} else if (got <= 0) {
+			return -1;
+		}
+		buf += got;
+		len -= (size_t)got;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Passes up to HANDOFF_FDS_BATCH file descriptors along with a single
+ * byte, which keeps every batch apart in the stream.
+ *
+ * @return int -1 on error. 0 otherwise.
+ */
+static int send_fds(int sock, const int *fds, size_t len) {
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * HANDOFF_FDS_BATCH)];
+		struct cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof control);
+
+	unsigned char byte = 0;
+	struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.buf,
+		.msg_controllen = CMSG_SPACE(sizeof(int) * len),
+	};
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * len);
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * len);
+
+	ssize_t sent;
+	while ((sent = sendmsg(sock, &msg, 0)) < 0 && errno == EINTR) {
+	}
+
+	return sent == 1 ? 0 : -1;
+}
+
+/**
+ * @brief Receives a batch sent with send_fds().
+ *
+ * @return long The number of file descriptors received. -1 on error.
+ */
+static long recv_fds(int sock, int *fds, size_t size) {
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * HANDOFF_FDS_BATCH)];
+		struct cmsghdr align;
+	} control;
+
+	unsigned char byte;
+	struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.buf,
+		.msg_controllen = sizeof control.buf,
+	};
+
+	ssize_t got;
+	while ((got = recvmsg(sock, &msg, 0)) < 0 && errno == EINTR) {
+	}
+
+	struct cmsghdr *cmsg = got == 1 ? CMSG_FIRSTHDR(&msg) : NULL;
+	if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+		return -1;
+	}
+
+	const size_t len = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * (len < size ? len : size));
+	if (len > size || msg.msg_flags & MSG_CTRUNC) {
+		for (size_t i = 0; i < (len < size ? len : size); i++) {
+			close(fds[i]);
+		}
+		return -1;
+	}
+
+	return (long)len;
+}
+
+/**
+ * @brief Moves every received file descriptor to the number it had in the
+ * old server. They are moved above every such number first, so that none is
+ * overwritten by another.
+ *
+ * @param fds The received file descriptors. Closed.
+ * @param numbers The numbers they should get.
+ * @param len The number of file descriptors.
+ * @return int -1 if a number is taken or an error occurred. Nothing is kept
+ * open then. 0 otherwise.
+ */
+static int place_fds(int *fds, const int *numbers, size_t len) {
+	int highest = 0;
+	for (size_t i = 0; i < len; i++) {
+		if (numbers[i] < 0) {
+			highest = -1;
+			break;
+		}
+		highest = numbers[i] > highest ? numbers[i] : highest;
+	}
+
+	int result = highest < 0 ? -1 : 0;
+	for (size_t i = 0; i < len; i++) {
+		const int fd = result == 0 ? fcntl(fds[i], F_DUPFD, highest + 1) : -1;
+		close(fds[i]);
+		fds[i] = fd;
+		if (fd < 0) {
+			result = -1;
+		}
+	}
+
+	size_t placed = 0;
+	for (; placed < len && result == 0; placed++) {
+		if (fcntl(numbers[placed], F_GETFD) != -1) {
+			LOG_ERROR("handoff: fd %d is taken\n", numbers[placed]);
+			result = -1;
+			break;
+		}
+		if (dup2(fds[placed], numbers[placed]) < 0) {
+			result = -1;
+			break;
+		}
+		close(fds[placed]);
+	}
+
+	if (result < 0) {
+		for (size_t i = 0; i < len; i++) {
+			if (i < placed) {
+				close(numbers[i]);
+			} else if (fds[i] >= 0) {
+				close(fds[i]);
+			}
+		}
+	}
+
+	return result;
+}
+
+int handoff_listen(const char *path) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof addr.sun_path) {
+		LOG_ERROR("handoff: path too long: %s\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	const int result = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (result < 0) {
+		perror("handoff: socket");
+		return -1;
+	}
+
+	unlink(path);
+	if (bind(result, (struct sockaddr *)&addr, sizeof addr) < 0 || listen(result, 1) < 0) {
+		perror("handoff: bind");
+		close(result);
+		return -1;
+	}
+
+	return result;
+}
+
+int handoff_connect(const char *path) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof addr.sun_path) {
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	const int result = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (result < 0) {
+		return -1;
+	}
+
+	if (connect(result, (struct sockaddr *)&addr, sizeof addr) < 0) {
+		close(result);
+		return -1;
+	}
+
+	return result;
+}
+
+int handoff_send(int sock, const Handoff *h) {
+	Writer w = { 0 };
+	write_u32(&w, (uint32_t)h->listener);
+	write_u32(&w, h->next_lobby_id);
+	write_u32(&w, (uint32_t)(h->lobbies_len + 1));
+	write_u32(&w, (uint32_t)h->conns_len);
+
+	write_lobby(&w, h->l);
+	for (size_t i = 0; i < h->lobbies_len; i++) {
+		write_lobby(&w, h->lobbies[i]);
+	}
+	for (size_t i = 0; i < h->conns_len; i++) {
+		write_connection(&w, &h->conns[i]);
+	}
+
+	if (w.is_failed) {
+		free(w.data);
+		return -1;
+	}
+
+	unsigned char header[HEADER_SIZE];
+	memcpy(header, MAGIC, MAGIC_SIZE);
+	put_u32(header + MAGIC_SIZE, (uint32_t)(h->conns_len + 1));
+	put_u64(header + MAGIC_SIZE + 4, w.len);
+	int result = send_all(sock, header, sizeof header);
+
+	// The listener goes first.
+	int batch[HANDOFF_FDS_BATCH];
+	size_t batch_len = 0;
+	batch[batch_len++] = h->listener;
+	for (size_t i = 0; i <= h->conns_len && result == 0; i++) {
+		if (batch_len == HANDOFF_FDS_BATCH || (i == h->conns_len && batch_len > 0)) {
+			result = send_fds(sock, batch, batch_len);
+			batch_len = 0;
+		}
+		if (i < h->conns_len) {
+			batch[batch_len++] = h->conns[i].player.fd;
+		}
+	}
+
+	if (result == 0) {
+		result = send_all(sock, w.data, w.len);
+	}
+
+	if (result < 0) {
+		perror("handoff: send");
+	}
+
+	free(w.data);
+	return result;
+}
+
+/**
+ * @brief Reads the state that comes with the file descriptors.
+ *
+ * @return int -1 if the state is malformed or memory ran out. 0 otherwise.
+ */
+static int read_state(Reader *r, Handoff *h) {
+	h->listener = (int)read_u32(r);
+	h->next_lobby_id = read_u32(r);
+	const uint32_t lobbies_len = read_u32(r);
+	const uint32_t conns_len = read_u32(r);
+
+	// Every lobby and connection takes at least a few bytes.
+	if (r->is_failed || lobbies_len == 0 || lobbies_len > r->len || conns_len > r->len) {
+		return -1;
+	}
+
+	h->l = read_lobby(r);
+	h->lobbies = malloc(sizeof *h->lobbies * lobbies_len);
+	h->conns = malloc(sizeof *h->conns * (conns_len > 0 ? conns_len : 1));
+	if (!h->l || !h->lobbies || !h->conns) {
+		return -1;
+	}
+
+	for (uint32_t i = 1; i < lobbies_len; i++) {
+		Lobby *l = read_lobby(r);
+		if (!l) {
+			return -1;
+		}
+		h->lobbies[h->lobbies_len++] = l;
+	}
+
+	for (uint32_t i = 0; i < conns_len && !r->is_failed; i++) {
+		read_connection(r, &h->conns[h->conns_len++]);
+	}
+
+	return r->is_failed || r->offset != r->len ? -1 : 0;
+}
+
+/**
+ * @brief Receives the file descriptors and the state that goes with them.
+ *
+ * @param fds Set to the received file descriptors, which are left open even on
+ * error. Should be freed.
+ * @param fds_len Set to the number of file descriptors received.
+ * @return int -1 on error. 0 otherwise.
+ */
+static int receive(int sock, Handoff *h, int **fds, size_t *fds_len) {
+	unsigned char header[HEADER_SIZE];
+	if (recv_all(sock, header, sizeof header) < 0 || memcmp(header, MAGIC, MAGIC_SIZE) != 0) {
+		LOG_ERROR("handoff: no server to take over from\n");
+		return -1;
+	}
+
+	const size_t fds_size = get_u32(header + MAGIC_SIZE);
+	const uint64_t state_len = get_u64(header + MAGIC_SIZE + 4);
+	if (fds_size == 0 || state_len > SIZE_MAX || (*fds = malloc(sizeof **fds * fds_size)) == NULL) {
+		return -1;
+	}
+
+	while (*fds_len < fds_size) {
+		const size_t want = fds_size - *fds_len < HANDOFF_FDS_BATCH ? fds_size - *fds_len : HANDOFF_FDS_BATCH;
+		const long got = recv_fds(sock, &(*fds)[*fds_len], want);
+		if (got <= 0) {
+			return -1;
+		}
+		*fds_len += (size_t)got;
+	}
+
+	unsigned char *state = malloc(state_len > 0 ? (size_t)state_len : 1);
+	Reader r = { .data = state, .len = (size_t)state_len };
+	const int result = state && recv_all(sock, state, r.len) == 0 && read_state(&r, h) == 0 &&
+		h->conns_len + 1 == *fds_len ? 0 : -1;
+	if (result < 0) {
+		LOG_ERROR("handoff: malformed state\n");
+	}
+
+	free(state);
+	return result;
+}
+
+int handoff_recv(int sock, Handoff *h) {
+	memset(h, 0, sizeof *h);
+
+	int *fds = NULL;
+	size_t fds_len = 0;
+	int result = receive(sock, h, &fds, &fds_len);
+	close(sock); // Its number may be needed below.
+
+	int *numbers = result == 0 ? malloc(sizeof *numbers * fds_len) : NULL;
+	if (numbers) {
+		numbers[0] = h->listener;
+		for (size_t i = 0; i < h->conns_len; i++) {
+			numbers[i + 1] = h->conns[i].player.fd;
+		}
+		result = place_fds(fds, numbers, fds_len);
+		free(numbers);
+	} else {
+		for (size_t i = 0; i < fds_len; i++) {
+			close(fds[i]);
+		}
+		result = -1;
+	}
+	free(fds);
+
+	if (result < 0) {
+		if (h->l) {
+			lobby_free(h->l);
+		}
+		for (size_t i = 0; i < h->lobbies_len; i++) {
+			lobby_free(h->lobbies[i]);
+		}
+		handoff_clear(h);
+		h->l = NULL;
+		h->listener = -1;
+	}
+
+	return result;
+}
+
+void handoff_clear(Handoff *h) {
+	for (size_t i = 0; i < h->conns_len; i++) {
+		free(h->conns[i].pending);
+	}
+	free(h->lobbies);
+	free(h->conns);
+	h->lobbies = NULL;
+	h->lobbies_len = 0;
+	h->conns = NULL;
+	h->conns_len = 0;
+}
@@ -0,0 +1,112 @@
+#ifndef HANDOFF_H_
+#define HANDOFF_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lobby.h"
+#include "player.h"
+#include "session.h"
+
+#define HANDOFF_FDS_BATCH 250 // File descriptors passed in one message. Linux takes at most 253.
+
+/**
+ * @brief Hands a running server's listener, connections and lobbies to a new
+ * server over a UNIX socket, so the server can be upgraded without anyone
+ * losing their connection.
+ *
+ * The running server listens on the socket with handoff_listen(). A new
+ * server connects with handoff_connect() and is sent the file descriptors
+ * with SCM_RIGHTS, followed by the state that goes with them. The new server
+ * puts every file descriptor back under the number it had, so seats, session
+ * tokens and everything else that names a connection stay valid.
+ *
+ * Whatever a client sent in the meantime waits in its socket, and the
+ * listener keeps queueing new connections, so clients only see a pause.
+ *
+ */
+
+/**
+ * @brief A connection and where it was in the server.
+ *
+ */
+typedef struct HandoffConnection {
+	Player player; // Has no lobby, queues or functions. See lobby_id.
+	bool in_lobby; // Whether the player was sent to the lobby lobby_id.
+	uint32_t lobby_id;
+	bool is_queued; // Waiting in the matchmaker.
+	bool is_watching; // Spectating the lobby watched.
+	uint32_t watched;
+	char token[SESSION_TOKEN_SIZE]; // Token of the connection's session. Empty if none.
+	char *pending; // What the connection had not taken yet, to be sent before anything else. NULL if nothing.
+	size_t pending_len;
+} HandoffConnection;
+
+/**
+ * @brief Everything that is handed to the new server.
+ *
+ */
+typedef struct Handoff {
+	int listener;
+	uint32_t next_lobby_id;
+
+	Lobby *l; // The lobby every JOIN is seated in without matchmaking.
+	Lobby **lobbies; // Lobbies made for matches. Does not hold l.
+	size_t lobbies_len;
+
+	HandoffConnection *conns;
+	size_t conns_len;
+} Handoff;
+
+/**
+ * @brief Listens for new servers on a UNIX socket, replacing whatever was left
+ * at the path.
+ *
+ * @param path The path of the socket.
+ * @return int The listening socket. -1 if an error occurred.
+ */
+int handoff_listen(const char *path);
+
+/**
+ * @brief Connects to the server listening at the path, if there is one.
+ *
+ * @param path The path of the socket.
+ * @return int The connected socket. -1 if nobody listens at the path.
+ */
+int handoff_connect(const char *path);
+
+/**
+ * @brief Sends the listener, the connections and the lobbies. Blocks until
+ * everything was sent. Nothing is closed.
+ *
+ * @param sock A socket connected to the new server.
+ * @param h What to hand over. The fds of the lobbies' seats should be among
+ * the connections, or negative.
+ * @return int -1 on error. 0 otherwise.
+ */
+int handoff_send(int sock, const Handoff *h);
+
+/**
+ * @brief Takes over what a server sent with handoff_send(). Every file
+ * descriptor gets the number it had in the old server. Seats are given no
+ * queues or functions, except the bot's, which are set up like bot_player().
+ *
+ * @param sock A socket connected to the old server. Closed once everything was
+ * received, as its number may be needed.
+ * @param h Set to what was handed over. The lobbies belong to the caller. The
+ * rest is freed with handoff_clear().
+ * @return int -1 if anything went wrong, such as a number being taken already.
+ * Nothing is kept then. 0 otherwise.
+ */
+int handoff_recv(int sock, Handoff *h);
+
+/**
+ * @brief Frees the connections, along with what was pending for them, and the
+ * list of lobbies. The lobbies themselves are not freed.
+ *
+ * @param h The handoff to clear.
+ */
+void handoff_clear(Handoff *h);
+
+#endif
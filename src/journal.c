@@ -0,0 +1,605 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libnogo/nogo.h"
+
+#include "bot.h"
+#include "bytes.h"
+#include "journal.h"
+#include "log.h"
+
+#define MAGIC "NOGOJNL1"
+#define MAGIC_SIZE 8
+#define BUFFER_START 4096
+
+#define HEADER_SIZE 5 // Record type followed by a 32-bit lobby id.
+#define MAX_RECORD_SIZE (HEADER_SIZE + 1 + PLAYER_NAME_SIZE + PLAYER_KEY_SIZE)
+#define MAX_BOARD_SIZE 255 // Rows, cols and positions are stored in one byte.
+#define NAME_LEN_MASK 0x7f
+#define NAME_BOT_FLAG 0x80 // Set in the name length when the player is the server's bot.
+
+struct Journal {
+	int fd;
+
+	pthread_mutex_t lock; // Records may be added from worker threads. See executor.h.
+	pthread_mutex_t flush_lock; // Held by the one flush writing flushing, so batches reach the file in order.
+
+	unsigned char *buffer; // Records that have not been flushed yet.
+	size_t len;
+	size_t size;
+
+	unsigned char *flushing; // Records swapped out of buffer by a flush, written outside of lock.
+	size_t flushing_len; // Still set if writing them failed, so they go out first next time.
+	size_t flushing_size;
+};
+
+/**
+ * @brief A lobby that is being rebuilt during recovery along with the raw
+ * records that belong to it, which are written back out when compacting.
+ *
+ */
+typedef struct Slot {
+	Lobby *l;
+	unsigned char *records;
+	size_t records_len;
+	size_t records_size;
+} Slot;
+
+/**
+ * @brief Writes the whole buffer, retrying on short writes and interrupts.
+ *
+ * @return int -1 on error. 0 otherwise.
+ */
+static int write_all(int fd, const unsigned char *buf, size_t len) {
+	while (len > 0) {
+		ssize_t wrote = write(fd, buf, len);
+		if (wrote < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		buf += wrote;
+		len -= (size_t)wrote;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Makes sure the pending buffer can hold another record of at most
+ * MAX_RECORD_SIZE bytes.
+ *
+ * @return int -1 if the function failed to allocate extra space. 0 otherwise.
+ */
+static int reserve(Journal *j) {
+	if (j->len + MAX_RECORD_SIZE > j->size) {
+		unsigned char *buffer = realloc(j->buffer, j->size * 2);
+		if (!buffer) {
+			return -1;
+		}
+		j->buffer = buffer;
+		j->size *= 2;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Starts a new record in the pending buffer.
+ *
+ * @return unsigned char* Where the record's payload should be written. NULL on error.
+ */
+static unsigned char *begin_record(Journal *j, JournalRecordType type, const Lobby *l) {
+	if (reserve(j) < 0) {
+		LOG_ERROR("failed to grow journal buffer\n");
+		return NULL;
+	}
+
+	unsigned char *record = j->buffer + j->len;
+	record[0] = (unsigned char)type;
+	put_u32(record + 1, l->id);
+	j->len += HEADER_SIZE;
+
+	return j->buffer + j->len;
+}
+
+static int append_name(Journal *j, JournalRecordType type, const Lobby *l, const Player *player) {
+	unsigned char *payload = begin_record(j, type, l);
+	if (!payload) {
+		return -1;
+	}
+
+	const size_t name_len = strnlen(player->name, PLAYER_NAME_SIZE);
+	payload[0] = (unsigned char)(name_len | (player->is_bot ? NAME_BOT_FLAG : 0));
+	memcpy(payload + 1, player->name, name_len);
+	j->len += 1 + name_len;
+
+	return 0;
+}
+
+Journal *journal_open(const char *path) {
+	Journal *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+
+	result->buffer = malloc(BUFFER_START);
+	result->size = BUFFER_START;
+	result->flushing = malloc(BUFFER_START);
+	result->flushing_size = BUFFER_START;
+	result->fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (!result->buffer || !result->flushing || result->fd < 0) {
+		perror("journal: open");
+		if (result->fd >= 0) {
+			close(result->fd);
+		}
+		free(result->buffer);
+		free(result->flushing);
+		free(result);
+		return NULL;
+	}
+
+	if (lseek(result->fd, 0, SEEK_END) == 0) {
+		memcpy(result->buffer, MAGIC, MAGIC_SIZE);
+		result->len = MAGIC_SIZE;
+	}
+
+	pthread_mutex_init(&result->lock, NULL);
+	pthread_mutex_init(&result->flush_lock, NULL);
+
+	return result;
+}
+
+void journal_close(Journal *j) {
+	journal_flush(j);
+	close(j->fd);
+	pthread_mutex_destroy(&j->lock);
+	pthread_mutex_destroy(&j->flush_lock);
+	free(j->buffer);
+	free(j->flushing);
+	free(j);
+}
+
+static int append_create(Journal *j, const Lobby *l) {
+	if (l->board.rows > MAX_BOARD_SIZE || l->board.cols > MAX_BOARD_SIZE) {
+		LOG_ERROR("board is too large to journal\n");
+		return -1;
+	}
+
+	unsigned char *payload = begin_record(j, JOURNAL_CREATE, l);
+	if (!payload) {
+		return -1;
+	}
+
+	payload[0] = (unsigned char)l->board.rows;
+	payload[1] = (unsigned char)l->board.cols;
+	j->len += 2;
+
+	return 0;
+}
+
+static int append_move(Journal *j, const Lobby *l, char team, size_t row, size_t col) {
+	unsigned char *payload = begin_record(j, JOURNAL_MOVE, l);
+	if (!payload) {
+		return -1;
+	}
+
+	payload[0] = (unsigned char)team;
+	payload[1] = (unsigned char)row;
+	payload[2] = (unsigned char)col;
+	j->len += 3;
+
+	return 0;
+}
+
+int journal_create(Journal *j, const Lobby *l) {
+	pthread_mutex_lock(&j->lock);
+	const int result = append_create(j, l);
+	pthread_mutex_unlock(&j->lock);
+	return result;
+}
+
+/**
+ * @brief Records a seat being taken or left along with its key, which follows
+ * the name.
+ *
+ */
+static int append_seat(Journal *j, JournalRecordType type, const Lobby *l, const Player *player) {
+	if (append_name(j, type, l, player) < 0) {
+		return -1;
+	}
+
+	memcpy(j->buffer + j->len, player->key, PLAYER_KEY_SIZE);
+	j->len += PLAYER_KEY_SIZE;
+
+	return 0;
+}
+
+static bool has_key(const Player *player) {
+	static const uint8_t none[PLAYER_KEY_SIZE] = { 0 };
+	return memcmp(player->key, none, PLAYER_KEY_SIZE) != 0;
+}
+
+int journal_join(Journal *j, const Lobby *l, const Player *player) {
+	pthread_mutex_lock(&j->lock);
+	const int result = has_key(player) ? append_seat(j, JOURNAL_SEAT, l, player) : append_name(j, JOURNAL_JOIN, l, player);
+	pthread_mutex_unlock(&j->lock);
+	return result;
+}
+
+int journal_leave(Journal *j, const Lobby *l, const Player *player) {
+	pthread_mutex_lock(&j->lock);
+	const int result = has_key(player) ? append_seat(j, JOURNAL_UNSEAT, l, player) : append_name(j, JOURNAL_LEAVE, l, player);
+	pthread_mutex_unlock(&j->lock);
+	return result;
+}
+
+int journal_move(Journal *j, const Lobby *l, char team, size_t row, size_t col) {
+	pthread_mutex_lock(&j->lock);
+	const int result = append_move(j, l, team, row, col);
+	pthread_mutex_unlock(&j->lock);
+	return result;
+}
+
+int journal_end(Journal *j, const Lobby *l) {
+	pthread_mutex_lock(&j->lock);
+	const int result = begin_record(j, JOURNAL_END, l) ? 0 : -1;
+	pthread_mutex_unlock(&j->lock);
+	return result;
+}
+
+/**
+ * @brief Writes and fsyncs the records in flushing. Called with flush_lock
+ * held and lock not held.
+ *
+ * @return int -1 on error, in which case the records are kept. 0 otherwise.
+ */
+static int write_flushing(Journal *j) {
+	if (j->flushing_len == 0) {
+		return 0;
+	}
+
+	if (write_all(j->fd, j->flushing, j->flushing_len) < 0 || fsync(j->fd) < 0) {
+		perror("journal: flush");
+		return -1;
+	}
+
+	j->flushing_len = 0;
+	return 0;
+}
+
+int journal_flush(Journal *j) {
+	pthread_mutex_lock(&j->flush_lock);
+
+	int result = write_flushing(j);
+	if (result == 0) {
+		// Swap the buffers, so records can be added while these are written.
+		pthread_mutex_lock(&j->lock);
+		unsigned char *buffer = j->flushing;
+		const size_t size = j->flushing_size;
+		j->flushing = j->buffer;
+		j->flushing_len = j->len;
+		j->flushing_size = j->size;
+		j->buffer = buffer;
+		j->len = 0;
+		j->size = size;
+		pthread_mutex_unlock(&j->lock);
+
+		result = write_flushing(j);
+	}
+
+	pthread_mutex_unlock(&j->flush_lock);
+	return result;
+}
+
+/**
+ * @brief Returns the size of the record at the start of buf, or 0 if the
+ * record is incomplete or not a valid record.
+ *
+ */
+static size_t record_size(const unsigned char *buf, size_t len) {
+	if (len < HEADER_SIZE) {
+		return 0;
+	}
+
+	size_t size;
+	switch ((JournalRecordType)buf[0]) {
+	case JOURNAL_CREATE:
+		size = HEADER_SIZE + 2;
+		break;
+	case JOURNAL_JOIN:
+	case JOURNAL_LEAVE:
+		if (len < HEADER_SIZE + 1 || (buf[HEADER_SIZE] & NAME_LEN_MASK) >= PLAYER_NAME_SIZE) {
+			return 0;
+		}
+		size = HEADER_SIZE + 1 + (buf[HEADER_SIZE] & NAME_LEN_MASK);
+		break;
+	case JOURNAL_SEAT:
+	case JOURNAL_UNSEAT:
+		if (len < HEADER_SIZE + 1 || (buf[HEADER_SIZE] & NAME_LEN_MASK) >= PLAYER_NAME_SIZE) {
+			return 0;
+		}
+		size = HEADER_SIZE + 1 + (buf[HEADER_SIZE] & NAME_LEN_MASK) + PLAYER_KEY_SIZE;
+		break;
+	case JOURNAL_MOVE:
+		size = HEADER_SIZE + 3;
+		break;
+	case JOURNAL_END:
+		size = HEADER_SIZE;
+		break;
+	default:
+		return 0;
+	}
+
+	return size <= len ? size : 0;
+}
+
+static Slot *find_slot(Slot *slots, size_t slots_len, uint32_t id) {
+	for (size_t i = 0; i < slots_len; i++) {
+		if (slots[i].l && slots[i].l->id == id) {
+			return &slots[i];
+		}
+	}
+
+	return NULL;
+}
+
+static int slot_append(Slot *slot, const unsigned char *record, size_t size) {
+	if (slot->records_len + size > slot->records_size) {
+		size_t new_size = slot->records_size ? slot->records_size * 2 : 256;
+		while (new_size < slot->records_len + size) {
+			new_size *= 2;
+		}
+
+		unsigned char *records = realloc(slot->records, new_size);
+		if (!records) {
+			return -1;
+		}
+		slot->records = records;
+		slot->records_size = new_size;
+	}
+
+	memcpy(slot->records + slot->records_len, record, size);
+	slot->records_len += size;
+	return 0;
+}
+
+static void slot_free(Slot *slot) {
+	if (slot->l) {
+		lobby_free(slot->l);
+	}
+	free(slot->records);
+	memset(slot, 0, sizeof *slot);
+}
+
+/**
+ * @brief Applies a single record to the lobby it belongs to.
+ *
+ * @param detached Counter used to hand out unique negative fds to restored players.
+ */
+static void replay(Slot *slot, const unsigned char *record, int *detached) {
+	const unsigned char *payload = record + HEADER_SIZE;
+	Lobby *l = slot->l;
+
+	switch ((JournalRecordType)record[0]) {
+	case JOURNAL_JOIN:
+	case JOURNAL_SEAT: {
+		Player player;
+		if (payload[0] & NAME_BOT_FLAG) {
+			player = bot_player();
+		} else {
+			memset(&player, 0, sizeof player);
+			memcpy(player.name, payload + 1, payload[0] & NAME_LEN_MASK);
+			player.is_login = true;
+			player.fd = --(*detached);
+		}
+		if (record[0] == JOURNAL_SEAT) {
+			memcpy(player.key, payload + 1 + (payload[0] & NAME_LEN_MASK), PLAYER_KEY_SIZE);
+		}
+
+		if (lobby_join(l, &player) < 0) {
+			LOG_ERROR("journal: failed to replay join of %s\n", player.name);
+		}
+		break;
+	}
+	case JOURNAL_LEAVE:
+	case JOURNAL_UNSEAT: {
+		Player seat = { 0 };
+		memcpy(seat.name, payload + 1, payload[0] & NAME_LEN_MASK);
+		if (record[0] == JOURNAL_UNSEAT) {
+			memcpy(seat.key, payload + 1 + (payload[0] & NAME_LEN_MASK), PLAYER_KEY_SIZE);
+		}
+
+		// Players may share a name, but not a key. Seats without one are told
+		// apart by name only.
+		for (int i = 0; i < l->players_len; i++) {
+			if (memcmp(l->players[i].key, seat.key, PLAYER_KEY_SIZE) == 0 &&
+				strncmp(l->players[i].name, seat.name, PLAYER_NAME_SIZE) == 0) {
+				lobby_leave(l, &l->players[i]);
+				break;
+			}
+		}
+		break;
+	}
+	case JOURNAL_MOVE:
+		if (lobby_place(l, (char)payload[0], payload[1], payload[2]) < 0) {
+			LOG_ERROR("journal: failed to replay move %d %d\n", payload[1], payload[2]);
+		}
+		break;
+	case JOURNAL_CREATE:
+	case JOURNAL_END:
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief Rewrites the journal so it only holds the records of the given
+ * slots. The new file is written beside the old one and renamed over it so a
+ * crash during compaction leaves the old journal intact.
+ *
+ * @return int -1 on error. 0 otherwise.
+ */
+static int compact(const char *path, const Slot *slots, size_t slots_len) {
+	const size_t path_len = strlen(path);
+	char *tmp_path = malloc(path_len + sizeof ".tmp");
+	if (!tmp_path) {
+		return -1;
+	}
+	memcpy(tmp_path, path, path_len);
+	memcpy(tmp_path + path_len, ".tmp", sizeof ".tmp");
+
+	int result = -1;
+	int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd >= 0) {
+		result = write_all(fd, (const unsigned char *)MAGIC, MAGIC_SIZE);
+		for (size_t i = 0; i < slots_len && result == 0; i++) {
+			if (slots[i].l) {
+				result = write_all(fd, slots[i].records, slots[i].records_len);
+			}
+		}
+
+		if (result == 0) {
+			result = fsync(fd);
+		}
+		close(fd);
+
+		if (result == 0) {
+			result = rename(tmp_path, path);
+		}
+	}
+
+	if (result < 0) {
+		perror("journal: compact");
+	}
+
+	free(tmp_path);
+	return result;
+}
+
+int journal_recover(const char *path, Lobby ***lobbies, size_t *lobbies_len) {
+	*lobbies = NULL;
+	*lobbies_len = 0;
+
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		return errno == ENOENT ? 0 : -1;
+	}
+
+	unsigned char *data = NULL;
+	size_t data_len = 0;
+	size_t data_size = 0;
+	for (;;) {
+		if (data_len == data_size) {
+			data_size = data_size ? data_size * 2 : BUFFER_START;
+			unsigned char *grown = realloc(data, data_size);
+			if (!grown) {
+				free(data);
+				fclose(f);
+				return -1;
+			}
+			data = grown;
+		}
+
+		size_t got = fread(data + data_len, 1, data_size - data_len, f);
+		if (got == 0) {
+			break;
+		}
+		data_len += got;
+	}
+	fclose(f);
+
+	if (data_len < MAGIC_SIZE || memcmp(data, MAGIC, MAGIC_SIZE) != 0) {
+		LOG_ERROR("journal: %s is not a journal\n", path);
+		free(data);
+		return -1;
+	}
+
+	Slot *slots = NULL;
+	size_t slots_len = 0;
+	int detached = 0;
+	int result = 0;
+
+	size_t offset = MAGIC_SIZE;
+	while (offset < data_len && result == 0) {
+		const unsigned char *record = data + offset;
+		const size_t size = record_size(record, data_len - offset);
+		if (size == 0) {
+			LOG_ERROR("journal: discarding %zu bytes of torn record\n", data_len - offset);
+			break;
+		}
+		offset += size;
+
+		const uint32_t id = get_u32(record + 1);
+		Slot *slot = find_slot(slots, slots_len, id);
+
+		if (record[0] == JOURNAL_CREATE) {
+			if (slot) {
+				slot_free(slot);
+			} else {
+				Slot *grown = realloc(slots, sizeof *slots * (slots_len + 1));
+				if (!grown) {
+					result = -1;
+					break;
+				}
+				slots = grown;
+				slot = &slots[slots_len++];
+				memset(slot, 0, sizeof *slot);
+			}
+
+			slot->l = lobby_create(record[HEADER_SIZE], record[HEADER_SIZE + 1]);
+			if (!slot->l) {
+				result = -1;
+				break;
+			}
+			slot->l->id = id;
+		} else if (!slot) {
+			continue; // Belongs to a lobby that already ended.
+		} else if (record[0] == JOURNAL_END) {
+			slot_free(slot);
+			continue;
+		} else {
+			replay(slot, record, &detached);
+		}
+
+		if (slot_append(slot, record, size) < 0) {
+			result = -1;
+		}
+	}
+
+	size_t live = 0;
+	for (size_t i = 0; i < slots_len; i++) {
+		if (slots[i].l) {
+			live++;
+		}
+	}
+
+	if (result == 0) {
+		result = compact(path, slots, slots_len);
+	}
+
+	if (result == 0 && live > 0) {
+		*lobbies = malloc(sizeof **lobbies * live);
+		if (!*lobbies) {
+			result = -1;
+		}
+	}
+
+	for (size_t i = 0; i < slots_len; i++) {
+		if (result == 0 && slots[i].l) {
+			(*lobbies)[(*lobbies_len)++] = slots[i].l;
+			slots[i].l = NULL;
+		}
+		slot_free(&slots[i]);
+	}
+
+	free(slots);
+	free(data);
+	return result;
+}
@@ -0,0 +1,128 @@
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lobby.h"
+#include "player.h"
+
+/**
+ * @brief Append-only log of everything that changes a lobby. Records are
+ * encoded into an in-memory buffer and only reach the file when
+ * journal_flush() is called, which writes and fsyncs every pending record at
+ * once. The server flushes once per event loop iteration, before any replies
+ * are sent, so an acknowledged move is always durable.
+ *
+ * Records may be added from any thread while another thread flushes.
+ *
+ * Players restored from the journal have no connection. They are given a
+ * negative fd and take their seat back with the key it was journaled with.
+ * See lobby_reclaim(). Seats journaled without a key can't be taken back.
+ *
+ */
+typedef struct Journal Journal;
+
+typedef enum JournalRecordType {
+	JOURNAL_CREATE = 1, // A lobby was created. Holds the board size.
+	JOURNAL_JOIN, // A player joined a lobby. Holds the player name.
+	JOURNAL_LEAVE, // A player left a lobby. Holds the player name.
+	JOURNAL_MOVE, // A piece was placed. Holds the team and position.
+	JOURNAL_END, // The game is over and the lobby no longer needs recovering.
+	JOURNAL_SEAT, // A player joined a lobby and was given a key to their seat. Holds the player name and the key.
+	JOURNAL_UNSEAT, // A player left a seat that had a key. Holds the player name and the key.
+} JournalRecordType;
+
+/**
+ * @brief Opens the journal at the given path for appending, creating it if it
+ * does not exist. Should be closed with journal_close().
+ *
+ * @param path The file the journal is stored in.
+ * @return Journal* The opened journal. NULL if an error occurred.
+ */
+Journal *journal_open(const char *path);
+
+/**
+ * @brief Flushes any pending records and frees the journal.
+ *
+ * @param j The journal to close.
+ */
+void journal_close(Journal *j);
+
+/**
+ * @brief Records that a lobby was created.
+ *
+ * @param j The journal to append to.
+ * @param l The created lobby.
+ * @return int -1 on error. 0 otherwise.
+ */
+int journal_create(Journal *j, const Lobby *l);
+
+/**
+ * @brief Records that a player joined a lobby, along with the key of their
+ * seat unless it is all zero.
+ *
+ * @param j The journal to append to.
+ * @param l The lobby that was joined.
+ * @param player The player that joined.
+ * @return int -1 on error. 0 otherwise.
+ */
+int journal_join(Journal *j, const Lobby *l, const Player *player);
+
+/**
+ * @brief Records that a player left a lobby.
+ *
+ * @param j The journal to append to.
+ * @param l The lobby that was left.
+ * @param player The player that left.
+ * @return int -1 on error. 0 otherwise.
+ */
+int journal_leave(Journal *j, const Lobby *l, const Player *player);
+
+/**
+ * @brief Records a move that was played in a lobby.
+ *
+ * @param j The journal to append to.
+ * @param l The lobby the move was played in.
+ * @param team The team that played the move.
+ * @param row The row of the move.
+ * @param col The col of the move.
+ * @return int -1 on error. 0 otherwise.
+ */
+int journal_move(Journal *j, const Lobby *l, char team, size_t row, size_t col);
+
+/**
+ * @brief Records that the game in a lobby is over. Records of ended lobbies
+ * are dropped the next time the journal is recovered.
+ *
+ * @param j The journal to append to.
+ * @param l The lobby whose game ended.
+ * @return int -1 on error. 0 otherwise.
+ */
+int journal_end(Journal *j, const Lobby *l);
+
+/**
+ * @brief Writes all pending records with a single write(2) and a single
+ * fsync(2). Does nothing when there are no pending records. Records can be
+ * added while the file is written; they wait for the next flush.
+ *
+ * @param j The journal to flush.
+ * @return int -1 on error. 0 otherwise.
+ */
+int journal_flush(Journal *j);
+
+/**
+ * @brief Rebuilds all lobbies that were still in progress by replaying the
+ * journal at the given path, then compacts the file so it only holds records
+ * of those lobbies. A torn record at the end of the file, left by a crash in
+ * the middle of a flush, is discarded. A missing file recovers no lobbies.
+ *
+ * @param path The file the journal is stored in.
+ * @param lobbies Set to an allocated array of recovered lobbies. Each lobby and
+ * the array itself should be freed by the caller.
+ * @param lobbies_len Set to the number of recovered lobbies.
+ * @return int -1 on error. 0 otherwise.
+ */
+int journal_recover(const char *path, Lobby ***lobbies, size_t *lobbies_len);
+
+#endif
@@ -0,0 +1,276 @@
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "limiter.h"
+
+#define CONNECTIONS_START 64
+#define ADDRESSES_START 64 // Always a power of two.
+#define ADDRESS_SIZE 16
+
+#define MILLI 1000 // Buckets count thousandths of a token, which a rate per second refills one of per millisecond.
+
+typedef struct Bucket {
+	uint64_t tokens; // In thousandths.
+	uint64_t last_ms; // When tokens was last refilled.
+} Bucket;
+
+typedef struct Connection {
+	Bucket bucket;
+	uint8_t addr[ADDRESS_SIZE];
+	bool has_addr;
+	bool is_open; // Set by limiter_connect(), or on the first command otherwise.
+} Connection;
+
+typedef struct Address {
+	uint8_t addr[ADDRESS_SIZE];
+	Bucket bucket;
+	bool is_used;
+} Address;
+
+struct Limiter {
+	LimiterConfig config;
+
+	Connection *conns; // Indexed by fd.
+	size_t conns_len;
+
+	Address *addrs;
+	size_t addrs_len; // Slots in addrs.
+	size_t addrs_used;
+};
+
+Limiter *limiter_create(const LimiterConfig *config) {
+	if (config->rate == 0 || config->burst == 0 || config->ip_rate == 0 || config->ip_burst == 0) {
+		return NULL;
+	}
+
+	Limiter *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+
+	result->config = *config;
+	result->conns = calloc(CONNECTIONS_START, sizeof *result->conns);
+	result->conns_len = CONNECTIONS_START;
+	result->addrs = calloc(ADDRESSES_START, sizeof *result->addrs);
+	result->addrs_len = ADDRESSES_START;
+	if (!result->conns || !result->addrs) {
+		limiter_free(result);
+		return NULL;
+	}
+
+	return result;
+}
+
+void limiter_free(Limiter *lim) {
+	free(lim->conns);
+	free(lim->addrs);
+	free(lim);
+}
+
+/**
+ * @brief Adds what the bucket earned since it was last refilled.
+ *
+ * @return bool true if the bucket is full.
+ */
+static bool refill(Bucket *b, uint64_t rate, uint64_t burst, uint64_t now_ms) {
+	const uint64_t full = burst * MILLI;
+	if (now_ms > b->last_ms) {
+		// Checked against what is missing first so a long wait can't overflow.
+		const uint64_t elapsed = now_ms - b->last_ms;
+		const uint64_t missing = full - b->tokens;
+		b->tokens = elapsed >= (missing + rate - 1) / rate ? full : b->tokens + elapsed * rate;
+		b->last_ms = now_ms;
+	}
+
+	return b->tokens == full;
+}
+
+static bool take(Bucket *b, uint64_t rate, uint64_t burst, uint64_t now_ms) {
+	refill(b, rate, burst, now_ms);
+	if (b->tokens < MILLI) {
+		return false;
+	}
+
+	b->tokens -= MILLI;
+	return true;
+}
+
+static size_t hash(const uint8_t addr[ADDRESS_SIZE]) {
+	uint64_t hi;
+	uint64_t lo;
+	memcpy(&hi, addr, sizeof hi);
+	memcpy(&lo, &addr[sizeof hi], sizeof lo);
+
+	uint64_t h = (hi ^ (lo << 29 | lo >> 35)) * 0x9e3779b97f4a7c15ull;
+	h ^= h >> 32;
+	return (size_t)h;
+}
+
+static Address *probe(Address *addrs, size_t addrs_len, const uint8_t addr[ADDRESS_SIZE]) {
+	size_t i = hash(addr) & (addrs_len - 1);
+	while (addrs[i].is_used && memcmp(addrs[i].addr, addr, ADDRESS_SIZE) != 0) {
+		i = (i + 1) & (addrs_len - 1);
+	}
+
+	return &addrs[i];
+}
+
+/**
+ * @brief Moves the addresses to a new table with room for as many again,
+ * leaving out the ones whose bucket filled up.
+ *
+ * @return int -1 if the function failed to allocate the new table, which
+ * leaves the old one as it was. 0 otherwise.
+ */
+static int rebuild(Limiter *lim, uint64_t now_ms) {
+	size_t kept = 0;
+	for (size_t i = 0; i < lim->addrs_len; i++) {
+		Address *a = &lim->addrs[i];
+		if (a->is_used && !refill(&a->bucket, lim->config.ip_rate, lim->config.ip_burst, now_ms)) {
+			kept++;
+		}
+	}
+
+	size_t len = ADDRESSES_START;
+	while (len < (kept + 1) * 4) {
+		len *= 2;
+	}
+
+	Address *addrs = calloc(len, sizeof *addrs);
+	if (!addrs) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < lim->addrs_len; i++) {
+		const Address *a = &lim->addrs[i];
+		if (a->is_used && a->bucket.tokens < lim->config.ip_burst * MILLI) {
+			*probe(addrs, len, a->addr) = *a;
+		}
+	}
+	free(lim->addrs);
+	lim->addrs = addrs;
+	lim->addrs_len = len;
+	lim->addrs_used = kept;
+
+	return 0;
+}
+
+/**
+ * @brief Gets the address's entry, adding one with a full bucket if there is
+ * none.
+ *
+ * @return Address* The entry. NULL if memory ran out.
+ */
+static Address *find(Limiter *lim, const uint8_t addr[ADDRESS_SIZE], uint64_t now_ms) {
+	Address *result = probe(lim->addrs, lim->addrs_len, addr);
+	if (result->is_used) {
+		return result;
+	}
+
+	// Kept at most half full so probes stay short.
+	if ((lim->addrs_used + 1) * 2 > lim->addrs_len) {
+		if (rebuild(lim, now_ms) < 0) {
+			return NULL;
+		}
+		result = probe(lim->addrs, lim->addrs_len, addr);
+	}
+
+	memcpy(result->addr, addr, ADDRESS_SIZE);
+	result->bucket = (Bucket){ .tokens = lim->config.ip_burst * MILLI, .last_ms = now_ms };
+	result->is_used = true;
+	lim->addrs_used++;
+
+	return result;
+}
+
+/**
+ * @brief Gets the address as an IPv6 address.
+ *
+ * @return bool false if it is neither IPv4 nor IPv6.
+ */
+static bool address_of(const struct sockaddr *sa, uint8_t addr[ADDRESS_SIZE]) {
+	if (sa->sa_family == AF_INET6) {
+		memcpy(addr, &((const struct sockaddr_in6*)(const void*)sa)->sin6_addr, ADDRESS_SIZE);
+		return true;
+	} else if (sa->sa_family == AF_INET) {
+		memset(addr, 0, 10);
+		memset(&addr[10], 0xff, 2);
+		memcpy(&addr[12], &((const struct sockaddr_in*)(const void*)sa)->sin_addr, 4);
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Makes sure there is an entry for the connection.
+ *
+ * @return int -1 if the function failed to allocate extra space. 0 otherwise.
+ */
+static int reserve(Limiter *lim, int fd) {
+	if ((size_t)fd < lim->conns_len) {
+		return 0;
+	}
+
+	size_t len = lim->conns_len;
+	while ((size_t)fd >= len) {
+		len *= 2;
+	}
+
+	Connection *conns = realloc(lim->conns, sizeof *conns * len);
+	if (!conns) {
+		return -1;
+	}
+	memset(&conns[lim->conns_len], 0, sizeof *conns * (len - lim->conns_len));
+	lim->conns = conns;
+	lim->conns_len = len;
+
+	return 0;
+}
+
+int limiter_connect(Limiter *lim, int fd, const struct sockaddr *addr, uint64_t now_ms) {
+	if (fd < 0 || reserve(lim, fd) < 0) {
+		return -1;
+	}
+
+	Connection *c = &lim->conns[fd];
+	c->has_addr = address_of(addr, c->addr);
+	if (c->has_addr) {
+		Address *a = find(lim, c->addr, now_ms);
+		if (!a || !take(&a->bucket, lim->config.ip_rate, lim->config.ip_burst, now_ms)) {
+			c->is_open = false;
+			return -1;
+		}
+	}
+
+	c->bucket = (Bucket){ .tokens = lim->config.burst * MILLI, .last_ms = now_ms };
+	c->is_open = true;
+
+	return 0;
+}
+
+bool limiter_allow(Limiter *lim, int fd, uint64_t now_ms) {
+	if (fd < 0 || reserve(lim, fd) < 0) {
+		return true; // Better to serve than to drop everyone's commands.
+	}
+
+	Connection *c = &lim->conns[fd];
+	if (!c->is_open) {
+		c->bucket = (Bucket){ .tokens = lim->config.burst * MILLI, .last_ms = now_ms };
+		c->has_addr = false;
+		c->is_open = true;
+	}
+
+	if (!take(&c->bucket, lim->config.rate, lim->config.burst, now_ms)) {
+		return false;
+	}
+
+	// Only the connection's token is spent when its address can't be tracked.
+	Address *a = c->has_addr ? find(lim, c->addr, now_ms) : NULL;
+	return !a || take(&a->bucket, lim->config.ip_rate, lim->config.ip_burst, now_ms);
+}
+
+size_t limiter_addresses(const Limiter *lim) {
+	return lim->addrs_used;
+}
@@ -0,0 +1,84 @@
+#ifndef LIMITER_H_
+#define LIMITER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+/**
+ * @brief Limits how fast connections may send commands and how fast an
+ * address may connect, so one abusive client cannot take up the event loop.
+ * Meant to be owned by the thread that owns the connections.
+ *
+ * Every connection and every address has a token bucket that refills at a
+ * fixed rate up to its burst. A new connection takes a token from its
+ * address. A command takes a token from its connection and one from its
+ * connection's address, so opening more connections does not raise the limit.
+ *
+ * Connections are indexed by file descriptor. Addresses are kept in an open
+ * addressing table that only holds addresses whose bucket is not full, since
+ * a full bucket is the same as none. IPv4 addresses are kept as IPv4 mapped
+ * IPv6 addresses. Time is passed in by the caller in milliseconds from any
+ * fixed point.
+ *
+ */
+typedef struct Limiter Limiter;
+
+typedef struct LimiterConfig {
+	uint64_t rate; // Commands a connection may send per second.
+	uint64_t burst; // Commands a connection may send at once.
+	uint64_t ip_rate; // Connections plus commands an address may make per second.
+	uint64_t ip_burst; // Connections plus commands an address may make at once.
+} LimiterConfig;
+
+/**
+ * @brief Creates a limiter.
+ *
+ * @param config The limits. Every field must be positive.
+ * @return Limiter* The created limiter. NULL if an error occurred.
+ */
+Limiter *limiter_create(const LimiterConfig *config);
+
+/**
+ * @brief Frees the limiter.
+ *
+ * @param lim The limiter to free.
+ */
+void limiter_free(Limiter *lim);
+
+/**
+ * @brief Decides whether to let in a new connection and starts limiting it.
+ * The connection's bucket starts out full.
+ *
+ * @param lim The limiter to check.
+ * @param fd The connection.
+ * @param addr The address the connection came from. Addresses other than
+ * IPv4 and IPv6 are not limited.
+ * @param now_ms The current time.
+ * @return int -1 if the address is over its limit or memory ran out, in
+ * which case the connection should be closed. 0 otherwise.
+ */
+int limiter_connect(Limiter *lim, int fd, const struct sockaddr *addr, uint64_t now_ms);
+
+/**
+ * @brief Decides whether to serve a command from a connection. Connections
+ * that were never passed to limiter_connect(), such as ones handed over by
+ * another server, are only limited by their own bucket.
+ *
+ * @param lim The limiter to check.
+ * @param fd The connection.
+ * @param now_ms The current time.
+ * @return bool false if the command should be dropped. true otherwise.
+ */
+bool limiter_allow(Limiter *lim, int fd, uint64_t now_ms);
+
+/**
+ * @brief Gets the number of addresses being tracked.
+ *
+ * @param lim The limiter to check.
+ * @return size_t The number of addresses whose bucket is not known to be full.
+ */
+size_t limiter_addresses(const Limiter *lim);
+
+#endif
@@ -1,4 +1,5 @@
 #include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -9,7 +10,12 @@
 #include "log.h"
 #include "queue.h"
 
-#define VISITED 1
+// History entries pack the position as row * cols + col with the team in the top bit.
+#define HISTORY_TEAM_X 0x8000
+#define HISTORY_MAX_SPACES HISTORY_TEAM_X
+#define HISTORY_START 16 // Moves there is room for before the history grows.
+
+#define SNAPSHOT_HEADER_SIZE 64 // GOTBOARD and the numbers before the cells.
 
 /**
  * @brief Stores the current game's state. 
@@ -19,92 +25,256 @@ typedef struct State {
 	char turn; // The player who's turn it is.
 	char winner; // If game_over is set then this will be set to the winning team.
 	bool game_over; // Is the game over or not.
-	NogoBoard *visted; // Used to help determine a winner.
+	uint16_t *history; // Every move played so far, oldest first. See HISTORY_TEAM_X.
+	size_t history_len;
+	size_t history_size;
+	uint64_t hash; // Zobrist hash of the board. See lobby_hash().
+	int (*place)(Lobby *l, char team, size_t row, size_t col); // The kernel for the board's size. See LOBBY_KERNEL.
+
+	// Only allocated once a snapshot is asked for, which most games never are.
+	char *snapshot; // See lobby_snapshot(). Sized for the board.
+	size_t snapshot_len; // 0 until encoded after the last move.
+	uint8_t *snapshot_scratch; // Packed cells, then the same cells run-length encoded, each after a format byte.
 } State;
 
+// Used while checking liberties, which is done within one move. Kept per
+// thread instead of per lobby since lobbies are played on any thread but only
+// by one at a time.
+static __thread uint64_t visited[HISTORY_MAX_SPACES / 64]; // A bit per space, all clear between moves.
+static __thread uint16_t stack[HISTORY_MAX_SPACES]; // Pieces left to check for liberties.
+
+static size_t history_space(uint16_t entry) {
+	return entry & (HISTORY_TEAM_X - 1);
+}
+
+static char history_team(uint16_t entry) {
+	return entry & HISTORY_TEAM_X ? 'X' : 'O';
+}
+
+static uint8_t cell_of(char team) {
+	return team == 'O' ? LOBBY_CELL_O : team == 'X' ? LOBBY_CELL_X : LOBBY_CELL_EMPTY;
+}
+
+static inline uint8_t cell_get(const uint8_t *cells, size_t space) {
+	return (uint8_t)(cells[space / 4] >> (space % 4 * 2) & 3);
+}
+
+static inline void cell_set(uint8_t *cells, size_t space, uint8_t cell) {
+	const unsigned int shift = (unsigned int)(space % 4 * 2);
+	cells[space / 4] = (uint8_t)((cells[space / 4] & ~(3u << shift)) | (unsigned int)cell << shift);
+}
+
+static uint64_t splitmix64(uint64_t x) {
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+/**
+ * @brief Returns the Zobrist key of a history entry, that is of a piece of a
+ * team on a space. Keys are derived from a fixed sequence rather than drawn at
+ * random so hashes stay the same across runs and can be stored.
+ * 
+ */
+static uint64_t piece_key(uint16_t entry) {
+	return splitmix64((uint64_t)(entry & (HISTORY_TEAM_X - 1)) * 2 + (entry & HISTORY_TEAM_X ? 1 : 0));
+}
+
+/**
+ * @brief Returns the hash of an empty board. The size is part of it so empty
+ * looking positions on different boards differ.
+ * 
+ */
+static uint64_t board_key(size_t rows, size_t cols) {
+	return splitmix64((uint64_t)1 << 40 | (uint64_t)rows << 16 | cols);
+}
+
+/**
+ * @brief Marks a neighbour of a piece that is being checked for liberties.
+ * Pieces of the same team that were not visited yet are pushed to be checked
+ * next.
+ * 
+ * @return true if the neighbour is a liberty.
+ * @return false 
+ */
+static inline bool visit(const uint8_t *cells, size_t *stack_len, uint8_t team, size_t space) {
+	const uint8_t cell = cell_get(cells, space);
+	if (cell == LOBBY_CELL_EMPTY) {
+		return true;
+	}
+
+	const uint64_t bit = (uint64_t)1 << (space % 64);
+	if (cell == team && !(visited[space / 64] & bit)) {
+		visited[space / 64] |= bit;
+		stack[(*stack_len)++] = (uint16_t)space;
+	}
+
+	return false;
+}
+
 /**
  * @brief Checks all connected pieces of the given piece and return if it has
  * any liberties. A liberty is when a piece is adjacent to an empty board space
- * or if it's connected to a piece of the same team that has a liberty.
+ * or if it's connected to a piece of the same team that has a liberty. Every
+ * piece of the group is visited, so none of them has to be checked again.
  * 
- * @param b The board to check.
- * @param team The team the check liberties for.
- * @param pos The position that will be checked.
+ * Inlined in to every kernel so rows and cols are constants in the ones for
+ * standard sizes.
+ * 
+ * @param cells The board to check.
+ * @param space The piece to check, as row * cols + col.
  * @return true 
  * @return false 
  */
-static bool has_liberty(NogoBoard *b, NogoBoard *visited, char team, NogoBoardPos pos) {
+static inline __attribute__((always_inline)) bool has_liberty(const uint8_t *cells, size_t rows, size_t cols, size_t space) {
+	const uint8_t team = cell_get(cells, space);
+
 	bool result = false;
+	size_t stack_len = 0;
+	visited[space / 64] |= (uint64_t)1 << (space % 64);
+	stack[stack_len++] = (uint16_t)space;
 
-	if (nogo_board_get(b, pos) == NOGO_BOARD_EMPTY_SPACE) {
-		return true;
+	while (stack_len > 0) {
+		const size_t at = stack[--stack_len];
+		const size_t col = at % cols;
+
+		if (at >= cols) {
+			result = visit(cells, &stack_len, team, at - cols) || result; // up
+		}
+		if (at < (rows - 1) * cols) {
+			result = visit(cells, &stack_len, team, at + cols) || result; // down
+		}
+		if (col > 0) {
+			result = visit(cells, &stack_len, team, at - 1) || result; // left
+		}
+		if (col < cols - 1) {
+			result = visit(cells, &stack_len, team, at + 1) || result; // right
+		}
 	}
 
-	if (nogo_board_get(b, pos) != team || nogo_board_get(visited, pos) == VISITED) {
-		return false;
+	return result;
+}
+
+static inline bool is_visited(size_t space) {
+	return visited[space / 64] & (uint64_t)1 << (space % 64);
+}
+
+/**
+ * @brief Clears every visited space, which only takes a few words for boards
+ * of standard sizes.
+ * 
+ */
+static inline void reset_visited(size_t spaces) {
+	memset(visited, 0, (spaces + 63) / 64 * sizeof *visited);
+}
+
+/**
+ * @brief Checks every piece that has been played to find if any team has no
+ * liberties. If so then that means the game is over.
+ * 
+ * @param l The lobby that will be searched.
+ * @return char The team that has lost.
+ */
+static inline __attribute__((always_inline)) char find_loser(Lobby *l, size_t rows, size_t cols) {
+	const uint8_t *cells = l->board.cells;
+	bool game_over = false;
+
+	for (size_t i = 0; i < l->state->history_len && !game_over; i++) {
+		const size_t space = history_space(l->state->history[i]);
+		if (!is_visited(space)) {
+			game_over = !has_liberty(cells, rows, cols, space);
+		}
 	}
 
-	nogo_board_set(visited, VISITED, pos);
+	reset_visited(rows * cols);
 
-	const NogoBoardPos adjacents[] = {
-		{ .row = pos.row - 1, .col = pos.col }, // up
-		{ .row = pos.row + 1, .col = pos.col }, // down
-		{ .row = pos.row, .col = pos.col - 1 }, // left
-		{ .row = pos.row, .col = pos.col + 1 }, // right
-	};
+	if (!game_over) {
+		return '\0';
+	}
 
-	for (size_t i = 0; i < sizeof adjacents / sizeof adjacents[0]; i++) {
-		// No need to check if they're negative since they are unsigned and will wrap.
-		if (adjacents[i].row < b->rows && adjacents[i].col < b->cols) {
-			result = has_liberty(b, visited, team, adjacents[i]) || result;
+	// A move can leave both teams without liberties. Search in board order so
+	// the team that loses does not depend on the order the pieces were played.
+	uint8_t loser = LOBBY_CELL_EMPTY;
+
+	for (size_t space = 0; space < rows * cols && loser == LOBBY_CELL_EMPTY; space++) {
+		if (cell_get(cells, space) != LOBBY_CELL_EMPTY && !is_visited(space) && !has_liberty(cells, rows, cols, space)) {
+			loser = cell_get(cells, space);
 		}
 	}
 
-	return result;
+	reset_visited(rows * cols);
+
+	return loser == LOBBY_CELL_O ? 'O' : 'X';
 }
 
 /**
- * @brief Replaces all the visited spaces to their original unvisited state.
+ * @brief Places a piece and ends the game if that left a team without
+ * liberties. Inlined in to every kernel like has_liberty().
  * 
- * @param visited The board used to keep track of what spaces were visited
- * when checking for a winner.
+ * @return int -1 if the move was unable to be played. 0 if the move was played successfully.
  */
-static void reset_visited(NogoBoard *visited) {
-	// TODO: When the move history is implemented use that instead to reset all positions.
-	for (size_t col = 0; col < visited->cols; col++) {
-		for (size_t row = 0; row < visited->rows; row++) {
-			const NogoBoardPos pos = (NogoBoardPos){ .row = row, .col = col };
-			nogo_board_set(visited, !VISITED, pos);
+static inline __attribute__((always_inline)) int place(Lobby *l, char team, size_t row, size_t col, size_t rows, size_t cols) {
+	if (row >= rows || col >= cols) {
+		LOG_ERROR("move is out of bounds\n");
+		return -1;
+	}
+
+	const size_t space = row * cols + col;
+	if (cell_get(l->board.cells, space) != LOBBY_CELL_EMPTY) {
+		LOG_ERROR("space is occupied\n");
+		return -1;
+	}
+
+	// Pieces are never removed so a game can't have more moves than spaces.
+	State *s = l->state;
+	if (s->history_len == s->history_size) {
+		const size_t size = s->history_size * 2 < rows * cols ? s->history_size * 2 : rows * cols;
+		uint16_t *history = realloc(s->history, sizeof *history * size);
+		if (!history) {
+			LOG_ERROR("out of memory\n");
+			return -1;
 		}
+		s->history = history;
+		s->history_size = size;
+	}
+
+	cell_set(l->board.cells, space, cell_of(team));
+	l->state->turn = team == 'O' ? 'X' : 'O';
+	const uint16_t entry = team == 'X' ? (uint16_t)(space | HISTORY_TEAM_X) : (uint16_t)space;
+	l->state->history[l->state->history_len++] = entry;
+	l->state->hash ^= piece_key(entry);
+	l->state->snapshot_len = 0;
+
+	char loser;
+	if ((loser = find_loser(l, rows, cols)) != '\0') {
+		l->state->game_over = true;
+		l->state->winner = loser == 'O' ? 'X' : 'O';
 	}
+
+	return 0;
 }
 
 /**
- * @brief Searches the entire board to find if any team has no liberties. If so
- * then that means the game is over.
+ * @brief Defines the kernel of a standard board size, with the size a
+ * constant so that bounds, neighbours and positions fold in to the code.
  * 
- * @param l The lobby that will be searched.
- * @return char The team that has lost.
  */
-static char find_loser(Lobby *l) {
-	char loser = '\0';
-
-	for (size_t row = 0; row < l->board->rows && loser == '\0'; row++) {
-		for (size_t col = 0; col < l->board->cols && loser == '\0'; col++) {
-			const NogoBoardPos pos = (NogoBoardPos){ .row = row, .col = col };
-			char team;
-			if ((team = nogo_board_get(l->board, pos)) != NOGO_BOARD_EMPTY_SPACE && nogo_board_get(l->state->visted, pos) != VISITED) {
-				const bool game_over = !has_liberty(l->board, l->state->visted, team, pos);
-				if (game_over) {
-					loser = nogo_board_get(l->board, pos);
-				}
-			}
-		}
+#define LOBBY_KERNEL(size) \
+	static int place_##size##x##size(Lobby *l, char team, size_t row, size_t col) { \
+		return place(l, team, row, col, size, size); \
 	}
 
-	reset_visited(l->state->visted);
+LOBBY_KERNEL(9)
+LOBBY_KERNEL(13)
+LOBBY_KERNEL(19)
 
-	return loser;
+/**
+ * @brief The kernel of every other board size.
+ * 
+ */
+static int place_any(Lobby *l, char team, size_t row, size_t col) {
+	return place(l, team, row, col, l->board.rows, l->board.cols);
 }
 
 /**
@@ -132,32 +302,144 @@ static bool lobby_full(Lobby *l) {
 	return l->players_len == LOBBY_MAX_PLAYERS;
 }
 
-static char next_team_turn(State *s) {
-	if (s->turn == 'O') {
-		return 'X';
+/**
+ * @brief Gives the lobby an empty board and a new game state with room for
+ * the given number of moves.
+ * 
+ * @return int -1 if memory ran out, which leaves the lobby as it was. 0 otherwise.
+ */
+static int new_game(Lobby *l, size_t history_size) {
+	const size_t rows = l->board.rows;
+	const size_t cols = l->board.cols;
+
+	uint8_t *cells = calloc((rows * cols + 3) / 4 > 0 ? (rows * cols + 3) / 4 : 1, 1);
+	State *s = calloc(1, sizeof *s);
+	uint16_t *history = malloc(sizeof *history * (history_size > 0 ? history_size : 1));
+	if (!cells || !s || !history) {
+		free(cells);
+		free(s);
+		free(history);
+		return -1;
 	}
-	return 'O';
+
+	s->turn = 'O';
+	s->game_over = false;
+	s->history = history;
+	s->history_size = history_size;
+	s->history_len = 0;
+	s->hash = board_key(rows, cols);
+	s->place = rows == 9 && cols == 9 ? place_9x9 :
+		rows == 13 && cols == 13 ? place_13x13 :
+		rows == 19 && cols == 19 ? place_19x19 : place_any;
+
+	l->board.cells = cells;
+	l->state = s;
+
+	return 0;
 }
 
 Lobby *lobby_create(size_t rows, size_t cols) {
+	if (rows * cols > HISTORY_MAX_SPACES) {
+		LOG_ERROR("board is too large\n");
+		return NULL;
+	}
+
 	Lobby *l = calloc(1, sizeof *l);
+	if (!l) {
+		return NULL;
+	}
 
-	l->board = nogo_board_create(rows, cols);
-	l->state = malloc(sizeof *l->state);
-	l->state->turn = 'O';
-	l->state->game_over = false;
-	l->state->visted = nogo_board_create(rows, cols);
+	l->board.rows = rows;
+	l->board.cols = cols;
+	if (new_game(l, rows * cols < HISTORY_START ? rows * cols : HISTORY_START) < 0) {
+		free(l);
+		return NULL;
+	}
 
 	return l;
 }
 
+Lobby *lobby_clone(const Lobby *l) {
+	Lobby *result = lobby_create(l->board.rows, l->board.cols);
+	if (!result) {
+		return NULL;
+	}
+
+	uint16_t *history = realloc(result->state->history, sizeof *history * (l->state->history_size > 0 ? l->state->history_size : 1));
+	if (!history) {
+		lobby_free(result);
+		return NULL;
+	}
+	memcpy(history, l->state->history, sizeof *history * l->state->history_len);
+
+	result->id = l->id;
+	memcpy(result->players, l->players, sizeof result->players);
+	result->players_len = l->players_len;
+	memcpy(result->board.cells, l->board.cells, (l->board.rows * l->board.cols + 3) / 4);
+
+	*result->state = *l->state;
+	result->state->history = history;
+	result->state->snapshot = NULL;
+	result->state->snapshot_len = 0;
+	result->state->snapshot_scratch = NULL;
+
+	return result;
+}
+
 void lobby_free(Lobby *l) {
-	nogo_board_free(l->board);
-	nogo_board_free(l->state->visted);
-	free(l->state);
+	if (!lobby_is_asleep(l)) {
+		lobby_sleep(l);
+	}
 	free(l);
 }
 
+void lobby_sleep(Lobby *l) {
+	free(l->board.cells);
+	free(l->state->history);
+	free(l->state->snapshot);
+	free(l->state->snapshot_scratch);
+	free(l->state);
+	l->board.cells = NULL;
+	l->state = NULL;
+}
+
+int lobby_wake(Lobby *l, const uint16_t *spaces, size_t spaces_len) {
+	const size_t rows = l->board.rows;
+	const size_t cols = l->board.cols;
+	const size_t history_start = rows * cols < HISTORY_START ? rows * cols : HISTORY_START;
+	if (spaces_len > rows * cols || new_game(l, spaces_len > history_start ? spaces_len : history_start) < 0) {
+		return -1;
+	}
+
+	State *s = l->state;
+	for (size_t i = 0; i < spaces_len; i++) {
+		if (spaces[i] >= rows * cols || cell_get(l->board.cells, spaces[i]) != LOBBY_CELL_EMPTY) {
+			lobby_sleep(l);
+			return -1;
+		}
+
+		const uint16_t entry = s->turn == 'X' ? (uint16_t)(spaces[i] | HISTORY_TEAM_X) : spaces[i];
+		cell_set(l->board.cells, spaces[i], cell_of(s->turn));
+		s->history[s->history_len++] = entry;
+		s->hash ^= piece_key(entry);
+		s->turn = s->turn == 'O' ? 'X' : 'O';
+	}
+
+	// No move is played once the game is over, so if it is over it ended on
+	// this position.
+	const char loser = find_loser(l, rows, cols);
+	if (loser != '\0') {
+		s->game_over = true;
+		s->winner = loser == 'O' ? 'X' : 'O';
+	}
+
+	return 0;
+}
+
+bool lobby_is_asleep(const Lobby *l) {
+	return l->state == NULL;
+}
+
 int lobby_join(Lobby *l, const Player *player) {
 	// Don't let the same player join twice.
 	for (int i = 0; i < l->players_len; i++) {
@@ -179,7 +461,42 @@ int lobby_join(Lobby *l, const Player *player) {
 	return 0;
 }
 
-void lobby_leave(Lobby *l, const Player *player) {
+int lobby_reconnect(Lobby *l, int fd, const Player *player) {
+	for (int i = 0; i < l->players_len; i++) {
+		if (l->players[i].fd == fd && !l->players[i].is_bot) {
+			Player *seat = &l->players[i];
+			const char team = seat->team;
+			uint8_t key[PLAYER_KEY_SIZE];
+			memcpy(key, seat->key, PLAYER_KEY_SIZE);
+
+			*seat = *player;
+			seat->team = team;
+			memcpy(seat->key, key, PLAYER_KEY_SIZE);
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+int lobby_reclaim(Lobby *l, const uint8_t key[PLAYER_KEY_SIZE], const Player *player) {
+	static const uint8_t none[PLAYER_KEY_SIZE] = { 0 };
+	if (player->fd < 0 || memcmp(key, none, PLAYER_KEY_SIZE) == 0) {
+		return -1;
+	}
+
+	for (int i = 0; i < l->players_len; i++) {
+		const Player *seat = &l->players[i];
+		if (seat->fd < 0 && !seat->is_bot && strncmp(seat->name, player->name, PLAYER_NAME_SIZE) == 0 &&
+			memcmp(seat->key, key, PLAYER_KEY_SIZE) == 0) {
+			return lobby_reconnect(l, seat->fd, player);
+		}
+	}
+
+	return -1;
+}
+
+int lobby_leave(Lobby *l, const Player *player) {
 	int player_index = -1;
 	for (int i = 0; i < l->players_len; i++) {
 		if (l->players[i].fd == player->fd) {
@@ -192,7 +509,10 @@ void lobby_leave(Lobby *l, const Player *player) {
 		l->players[player_index] = l->players[l->players_len - 1];
 		l->players_len--;
 		update_player_team(l);
+		return 0;
 	}
+
+	return -1;
 }
 
 int lobby_play_move(Lobby *l, const Player *player, const char *row_str, const char *col_str) {
@@ -227,33 +547,208 @@ int lobby_play_move(Lobby *l, const Player *player, const char *row_str, const c
 	long col = strtol(col_str, NULL, 10);
 	is_overflow = is_overflow || col == LONG_MAX || col == LONG_MIN;
 
-	if (is_overflow || row > (long)l->board->rows || col > (long)l->board->cols) {
+	if (is_overflow || row < 0 || col < 0) {
 		LOG_ERROR("move is out of bounds\n");
 		return -1;
 	}
 
-	const NogoBoardPos pos = { .row = (size_t)row, .col = (size_t)col };
-	const bool is_free = nogo_board_get(l->board, pos) == NOGO_BOARD_EMPTY_SPACE;
-	if (!is_free) {
-		LOG_ERROR("space is occupied\n");
+	return lobby_place(l, found->team, (size_t)row, (size_t)col);
+}
+
+int lobby_place(Lobby *l, char team, size_t row, size_t col) {
+	if (l->state->game_over) {
+		LOG_ERROR("game is over\n");
+		return -1;
+	} else if (team != l->state->turn) {
+		LOG_ERROR("not player's turn\n");
 		return -1;
 	}
 
-	nogo_board_set(l->board, found->team, pos);
-	l->state->turn = next_team_turn(l->state);
+	return l->state->place(l, team, row, col);
+}
 
-	char loser;
-	if((loser = find_loser(l)) != '\0') {
-		l->state->game_over = true;
-		l->state->winner = loser == 'O' ? 'X' : 'O';
+int lobby_undo(Lobby *l) {
+	if (l->state->history_len == 0) {
+		return -1;
+	}
+
+	const uint16_t entry = l->state->history[--l->state->history_len];
+	cell_set(l->board.cells, history_space(entry), LOBBY_CELL_EMPTY);
+	l->state->hash ^= piece_key(entry);
+	l->state->snapshot_len = 0;
+
+	// No move can be played once the game is over so the undone move is the
+	// only one that could have ended it.
+	l->state->turn = history_team(entry);
+	l->state->game_over = false;
+
+	return 0;
+}
+
+int lobby_last_move(const Lobby *l, LobbyMove *move) {
+	if (l->state->history_len == 0) {
+		return -1;
 	}
 
+	*move = lobby_move_at(l, l->state->history_len - 1);
 	return 0;
 }
 
-int lobby_winner(Lobby *l) {
+size_t lobby_moves_len(const Lobby *l) {
+	return l->state->history_len;
+}
+
+LobbyMove lobby_move_at(const Lobby *l, size_t i) {
+	const uint16_t entry = l->state->history[i];
+	const size_t space = history_space(entry);
+
+	return (LobbyMove){ .team = history_team(entry), .row = space / l->board.cols, .col = space % l->board.cols };
+}
+
+char lobby_get(const Lobby *l, size_t row, size_t col) {
+	switch (cell_get(l->board.cells, row * l->board.cols + col)) {
+	case LOBBY_CELL_O:
+		return 'O';
+	case LOBBY_CELL_X:
+		return 'X';
+	default:
+		return NOGO_BOARD_EMPTY_SPACE;
+	}
+}
+
+size_t lobby_empty(const Lobby *l, uint16_t *spaces) {
+	const size_t cells = l->board.rows * l->board.cols;
+
+	size_t len = 0;
+	for (size_t i = 0; i < (cells + 3) / 4; i++) {
+		// A byte of 4 pieces has every cell's high or low bit set.
+		const uint8_t byte = l->board.cells[i];
+		if (((byte | byte >> 1) & 0x55) == 0x55) {
+			continue;
+		}
+
+		for (size_t space = i * 4; space < i * 4 + 4 && space < cells; space++) {
+			if ((byte >> (space % 4 * 2) & 3) == LOBBY_CELL_EMPTY) {
+				spaces[len++] = (uint16_t)space;
+			}
+		}
+	}
+
+	return len;
+}
+
+uint64_t lobby_hash(const Lobby *l) {
+	return l->state->hash;
+}
+
+char lobby_turn(const Lobby *l) {
+	return l->state->turn;
+}
+
+int lobby_winner(const Lobby *l) {
 	if (l->state->game_over) {
 		return l->state->winner;
 	}
 	return -1;
 }
+
+/**
+ * @brief Writes every run of zero bytes as a zero followed by the length of
+ * the run, at most 255. Other bytes are copied.
+ * 
+ * @return size_t The number of encoded bytes.
+ */
+static size_t encode_runs(const uint8_t *packed, size_t packed_len, uint8_t *runs) {
+	size_t len = 0;
+	for (size_t i = 0; i < packed_len;) {
+		if (packed[i] != 0) {
+			runs[len++] = packed[i++];
+			continue;
+		}
+
+		uint8_t run = 0;
+		while (i < packed_len && packed[i] == 0 && run < UINT8_MAX) {
+			run++;
+			i++;
+		}
+		runs[len++] = 0;
+		runs[len++] = run;
+	}
+
+	return len;
+}
+
+static size_t encode_base64(const uint8_t *bytes, size_t len, char *out) {
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	size_t result = 0;
+	for (size_t i = 0; i < len; i += 3) {
+		const uint32_t b0 = bytes[i];
+		const uint32_t b1 = i + 1 < len ? bytes[i + 1] : 0;
+		const uint32_t b2 = i + 2 < len ? bytes[i + 2] : 0;
+		const uint32_t triple = b0 << 16 | b1 << 8 | b2;
+
+		out[result++] = alphabet[triple >> 18 & 0x3f];
+		out[result++] = alphabet[triple >> 12 & 0x3f];
+		out[result++] = i + 1 < len ? alphabet[triple >> 6 & 0x3f] : '=';
+		out[result++] = i + 2 < len ? alphabet[triple & 0x3f] : '=';
+	}
+
+	return result;
+}
+
+const char *lobby_snapshot(Lobby *l, size_t *len) {
+	State *s = l->state;
+	if (s->snapshot_len > 0) {
+		*len = s->snapshot_len;
+		return s->snapshot;
+	}
+
+	// Run-length encoding is only used when shorter, so the cells never take
+	// more than the packed cells and a format byte.
+	const size_t packed_len = (l->board.rows * l->board.cols + 3) / 4;
+	if (!s->snapshot) {
+		s->snapshot = malloc(SNAPSHOT_HEADER_SIZE + (packed_len + 1 + 2) / 3 * 4 + 3);
+		s->snapshot_scratch = malloc(packed_len * 3 + 2);
+		if (!s->snapshot || !s->snapshot_scratch) {
+			free(s->snapshot);
+			free(s->snapshot_scratch);
+			s->snapshot = NULL;
+			s->snapshot_scratch = NULL;
+			*len = 0;
+			return NULL;
+		}
+	}
+
+	const int winner = lobby_winner(l);
+	int header_len = snprintf(s->snapshot, SNAPSHOT_HEADER_SIZE, "GOTBOARD %zu %zu %c %c %zu ",
+		l->board.rows, l->board.cols, s->turn, winner == -1 ? '-' : (char)winner, s->history_len);
+	if (header_len <= 0 || header_len >= SNAPSHOT_HEADER_SIZE) {
+		*len = 0;
+		return NULL;
+	}
+
+	// The format byte goes in front of the cells so both are encoded together.
+	// The board is already packed the way snapshots are.
+	uint8_t *packed = s->snapshot_scratch;
+	memcpy(packed + 1, l->board.cells, packed_len);
+	uint8_t *runs = packed + packed_len + 1;
+	const size_t runs_len = encode_runs(packed + 1, packed_len, runs + 1);
+
+	const uint8_t *cells = packed;
+	size_t cells_len = packed_len + 1;
+	packed[0] = LOBBY_SNAPSHOT_PACKED;
+	if (runs_len < packed_len) {
+		cells = runs;
+		cells_len = runs_len + 1;
+		runs[0] = LOBBY_SNAPSHOT_RUNS;
+	}
+
+	size_t result = (size_t)header_len + encode_base64(cells, cells_len, s->snapshot + header_len);
+	s->snapshot[result++] = '\r';
+	s->snapshot[result++] = '\n';
+	s->snapshot_len = result;
+
+	*len = result;
+	return s->snapshot;
+}
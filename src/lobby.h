@@ -1,10 +1,44 @@
 #ifndef LOBBY_H_
 #define LOBBY_H_
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include "player.h"
 
 #define LOBBY_MAX_PLAYERS 2
 
+// Formats of the cells in a snapshot. See lobby_snapshot().
+#define LOBBY_SNAPSHOT_PACKED 0
+#define LOBBY_SNAPSHOT_RUNS 1
+
+// Cells of a LobbyBoard.
+#define LOBBY_CELL_EMPTY 0
+#define LOBBY_CELL_O 1
+#define LOBBY_CELL_X 2
+
+/**
+ * @brief A board packed 2 bits a cell and 4 cells a byte, row by row, with
+ * the first cell in the low bits. A 19x19 board takes 91 bytes.
+ * 
+ */
+typedef struct LobbyBoard {
+	size_t rows;
+	size_t cols;
+	uint8_t *cells; // See LOBBY_CELL_EMPTY. Bits past the last cell are clear.
+} LobbyBoard;
+
+/**
+ * @brief A single move that was played in a lobby.
+ * 
+ */
+typedef struct LobbyMove {
+	char team;
+	size_t row;
+	size_t col;
+} LobbyMove;
+
 /**
  * @brief Implements a lobby where a single game of Atari Go can be played. The
  * game will start when there are 2 players in the lobby and will end when a
@@ -13,24 +47,45 @@
  * 
  */
 typedef struct Lobby {
+	uint32_t id; // Identifies the lobby in the journal.
+
 	Player players[LOBBY_MAX_PLAYERS]; // List of all players.
 	int players_len; // Current number of players in the lobby.
 
-	struct NogoBoard *board; // The board that the game will be played on.
+	LobbyBoard board; // The board that the game will be played on.
+
+	struct State *state; // Keeps track of the game state. NULL while the lobby is asleep.
+	uint64_t record; // Where the store keeps the moves while the lobby is asleep. See store.h.
 
-	struct State *state; // Keeps track of the game state.
+	int routed; // Connections the server sends to this lobby. Only touched by the server's I/O thread.
+	uint64_t routed_ms; // When the server last sent the lobby a job. Only touched by the server's I/O thread.
+	bool is_idle; // Put to sleep since the last job. Only touched by the server's I/O thread.
+	int watchers; // Spectators of the lobby. Set by the server's I/O thread, read with __atomic builtins.
+	bool is_bot_due; // The server asked for the bot's next move. Only touched by the thread running the lobby.
 } Lobby;
 
 /**
  * @brief Create and initializes lobby struct. The passed in Queue should
  * outlive the lobby.
  * 
+ * Moves on 9x9, 13x13 and 19x19 boards are played by code compiled for that
+ * size. Other sizes work the same, only slower.
+ * 
  * @param rows The number of rows the game board should have.
  * @param cols The number of cols the game board should have.
- * @return Lobby The intialized lobby struct.
+ * @return Lobby The intialized lobby struct. NULL if the board is too large.
  */
 Lobby *lobby_create(size_t rows, size_t cols);
 
+/**
+ * @brief Creates a copy of the lobby, its board and its move history. Moves
+ * played in the copy do not affect the original.
+ * 
+ * @param l The lobby instance to copy.
+ * @return Lobby* The copy. NULL if an error occurred.
+ */
+Lobby *lobby_clone(const Lobby *l);
+
 /**
  * @brief Free the space allocated by create.
  * 
@@ -38,6 +93,39 @@ Lobby *lobby_create(size_t rows, size_t cols);
  */
 void lobby_free(Lobby *l);
 
+/**
+ * @brief Frees the board and the game state of the lobby, keeping its id,
+ * players and size, so a game nobody is playing takes little memory. Until it
+ * is woken only lobby_join(), lobby_reconnect(), lobby_reclaim(),
+ * lobby_leave() and lobby_free() may be called on the lobby.
+ * 
+ * @param l The lobby instance to put to sleep. Must be awake.
+ */
+void lobby_sleep(Lobby *l);
+
+/**
+ * @brief Gives a lobby that was put to sleep its board and game state back,
+ * with the given moves played on it. Takes one pass over the moves, not a
+ * replay of each.
+ * 
+ * @param l The lobby instance to wake. Must be asleep.
+ * @param spaces The moves, oldest first, as row * cols + col. The teams
+ * alternate starting with 'O', as they always do.
+ * @param spaces_len The number of moves.
+ * @return int -1 if the moves can't have been played on the board or memory
+ * ran out, which leaves the lobby asleep. 0 otherwise.
+ */
+int lobby_wake(Lobby *l, const uint16_t *spaces, size_t spaces_len);
+
+/**
+ * @brief Returns whether the lobby was put to sleep and not woken since.
+ * 
+ * @param l The lobby instance to check.
+ * @return true 
+ * @return false 
+ */
+bool lobby_is_asleep(const Lobby *l);
+
 /**
  * @brief Inserts a player into the lobby.
  * 
@@ -47,13 +135,38 @@ void lobby_free(Lobby *l);
  */
 int lobby_join(Lobby *l, const Player *player);
 
+/**
+ * @brief Hands a player's seat to a new connection of theirs. The seat keeps
+ * its team and key.
+ * 
+ * @param l The lobby instance to update.
+ * @param fd The file descriptor the seat was taken with.
+ * @param player The player with their new file descriptor.
+ * @return int -1 if no seat was taken with fd. 0 otherwise.
+ */
+int lobby_reconnect(Lobby *l, int fd, const Player *player);
+
+/**
+ * @brief Hands a seat that was restored without a connection (negative fd)
+ * back to the player it belongs to, who proves it with the seat's key. A
+ * name alone takes no seat, as anyone may log in under any name. The seat
+ * keeps its team and key.
+ * 
+ * @param l The lobby instance to update.
+ * @param key The key of the seat. All zero never matches.
+ * @param player The player taking the seat back, under the seat's name.
+ * @return int -1 if no restored seat has the name and key. 0 otherwise.
+ */
+int lobby_reclaim(Lobby *l, const uint8_t key[PLAYER_KEY_SIZE], const Player *player);
+
 /**
  * @brief Removes a player from the lobby.
  * 
  * @param l The lobby instance to leave.
  * @param player The player leaving.
+ * @return int -1 if the player was not in the lobby. 0 otherwise.
  */
-void lobby_leave(Lobby *l, const Player *player);
+int lobby_leave(Lobby *l, const Player *player);
 
 /**
  * @brief Places a piece of the given player at the given coordinates. Advances
@@ -67,12 +180,124 @@ void lobby_leave(Lobby *l, const Player *player);
  */
 int lobby_play_move(Lobby *l, const Player *player, const char *row_str, const char *col_str);
 
+/**
+ * @brief Places a piece for the given team at the given coordinates without
+ * looking up a player. Advances the board state 1 turn. Used when replaying
+ * moves that were already validated against a player.
+ * 
+ * @param l The lobby instance the move will be played on.
+ * @param team The team placing the piece. Must be the team whose turn it is.
+ * @param row The row to place the piece.
+ * @param col The col to place the piece.
+ * @return int -1 if the move was unable to be played. 0 if the move was played successfully.
+ */
+int lobby_place(Lobby *l, char team, size_t row, size_t col);
+
+/**
+ * @brief Takes back the most recent move in constant time. The board, the turn
+ * and the game over state are restored to what they were before the move.
+ * 
+ * @param l The lobby instance to undo the move in.
+ * @return int -1 if there is no move to undo. 0 otherwise.
+ */
+int lobby_undo(Lobby *l);
+
+/**
+ * @brief Gets the most recent move that was played in the lobby.
+ * 
+ * @param l The lobby instance to get the move from.
+ * @param move Set to the most recent move.
+ * @return int -1 if no move has been played yet. 0 otherwise.
+ */
+int lobby_last_move(const Lobby *l, LobbyMove *move);
+
+/**
+ * @brief Returns the number of moves that have been played in the lobby.
+ * 
+ * @param l The lobby instance to check.
+ * @return size_t The number of moves played.
+ */
+size_t lobby_moves_len(const Lobby *l);
+
+/**
+ * @brief Gets a move that was played in the lobby. Move 0 is the first move of
+ * the game.
+ * 
+ * @param l The lobby instance to get the move from.
+ * @param i The index of the move. Must be less than lobby_moves_len().
+ * @return LobbyMove The move at the given index.
+ */
+LobbyMove lobby_move_at(const Lobby *l, size_t i);
+
+/**
+ * @brief Gets what is on a space of the board.
+ * 
+ * @param l The lobby instance to check.
+ * @param row The row of the space. Must be on the board.
+ * @param col The col of the space. Must be on the board.
+ * @return char The team whose piece is on the space. NOGO_BOARD_EMPTY_SPACE if there is none.
+ */
+char lobby_get(const Lobby *l, size_t row, size_t col);
+
+/**
+ * @brief Finds every empty space of the board, skipping 4 full spaces at a
+ * time.
+ * 
+ * @param l The lobby instance to check.
+ * @param spaces Set to every empty space as row * cols + col, in board order.
+ * Must fit one per space of the board.
+ * @return size_t The number of empty spaces.
+ */
+size_t lobby_empty(const Lobby *l, uint16_t *spaces);
+
+/**
+ * @brief Returns the Zobrist hash of the position on the board. The hash is
+ * kept up to date as moves are played and undone so this is O(1). Equal
+ * positions on equal sized boards have equal hashes no matter the order the
+ * moves were played in, and hashes are stable across runs so they can be
+ * stored. The team to move follows from the number of pieces and is not part
+ * of the hash.
+ * 
+ * @param l The lobby instance to check.
+ * @return uint64_t The hash of the position.
+ */
+uint64_t lobby_hash(const Lobby *l);
+
+/**
+ * @brief Returns the team whose turn it is to move.
+ * 
+ * @param l The lobby instance to check.
+ * @return char The team to move.
+ */
+char lobby_turn(const Lobby *l);
+
 /**
  * @brief Returns the team that won the game. Returns -1 if the game is still in progress.
  * 
  * @param l The lobby instance to get the winner from.
  * @return int -1 if the game is still in progress, otherwise returns the char team that won.
  */
-int lobby_winner(Lobby *l);
+int lobby_winner(const Lobby *l);
+
+/**
+ * @brief Encodes the position for clients that did not see every move:
+ * 
+ *     GOTBOARD rows cols turn winner moves cells\r\n
+ * 
+ * winner is '-' while the game goes on and moves is the number of moves
+ * played. cells is base64 of a format byte followed by the board, row by row,
+ * 2 bits a cell (0 empty, 1 O, 2 X) and 4 cells a byte with the first cell in
+ * the low bits. With LOBBY_SNAPSHOT_RUNS every run of zero bytes is written as
+ * a zero followed by the length of the run, which is used when shorter than
+ * LOBBY_SNAPSHOT_PACKED.
+ * 
+ * The snapshot is cached until the next move is played or undone, so asking
+ * again in between does not encode it again.
+ * 
+ * @param l The lobby instance to encode.
+ * @param len Set to the length of the snapshot.
+ * @return const char* The snapshot. Valid until the next move is played or undone.
+ */
+const char *lobby_snapshot(Lobby *l, size_t *len);
 
 #endif
@@ -0,0 +1,84 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mailbox.h"
+#include "queue.h"
+
+struct Mailbox {
+	pthread_mutex_t lock;
+	Queue *elems;
+	size_t elem_size;
+
+	// A byte sits in the pipe while the mailbox is not empty. It is written by
+	// the put that fills an empty mailbox and read by the get that empties it.
+	int wake[2];
+};
+
+Mailbox *mailbox_create(size_t elem_size) {
+	Mailbox *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+
+	result->elems = queue_create(elem_size);
+	result->elem_size = elem_size;
+	if (!result->elems || pipe(result->wake) < 0) {
+		if (result->elems) {
+			queue_free(result->elems);
+		}
+		free(result);
+		return NULL;
+	}
+
+	fcntl(result->wake[0], F_SETFD, FD_CLOEXEC);
+	fcntl(result->wake[1], F_SETFD, FD_CLOEXEC);
+	pthread_mutex_init(&result->lock, NULL);
+
+	return result;
+}
+
+void mailbox_free(Mailbox *mb) {
+	pthread_mutex_destroy(&mb->lock);
+	close(mb->wake[0]);
+	close(mb->wake[1]);
+	queue_free(mb->elems);
+	free(mb);
+}
+
+int mailbox_put(Mailbox *mb, const void *elem) {
+	pthread_mutex_lock(&mb->lock);
+
+	const bool was_empty = queue_isempty(mb->elems);
+	int result = queue_put(mb->elems, elem);
+	if (result == 0 && was_empty && write(mb->wake[1], "", 1) != 1) {
+		result = -1;
+	}
+
+	pthread_mutex_unlock(&mb->lock);
+	return result;
+}
+
+bool mailbox_get(Mailbox *mb, void *elem) {
+	pthread_mutex_lock(&mb->lock);
+
+	const bool result = !queue_isempty(mb->elems);
+	if (result) {
+		memcpy(elem, queue_get(mb->elems), mb->elem_size);
+
+		if (queue_isempty(mb->elems)) {
+			char byte;
+			const ssize_t drained = read(mb->wake[0], &byte, 1);
+			(void)drained; // On failure the next poll just wakes up for nothing.
+		}
+	}
+
+	pthread_mutex_unlock(&mb->lock);
+	return result;
+}
+
+int mailbox_fd(const Mailbox *mb) {
+	return mb->wake[0];
+}
@@ -0,0 +1,60 @@
+#ifndef MAILBOX_H_
+#define MAILBOX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief A queue that any thread may put elements in while another thread
+ * takes them out. Elements are copied in and out, so nothing points in to the
+ * mailbox once a call returns.
+ *
+ * The mailbox also has a file descriptor that is readable whenever the mailbox
+ * is not empty, so a thread that waits in poll(2) can be woken by a put.
+ *
+ */
+typedef struct Mailbox Mailbox;
+
+/**
+ * @brief Creates a mailbox.
+ *
+ * @param elem_size The size of the elements that will be put in the mailbox.
+ * @return Mailbox* The created mailbox. NULL if an error occurred.
+ */
+Mailbox *mailbox_create(size_t elem_size);
+
+/**
+ * @brief Frees the mailbox and any elements left in it.
+ *
+ * @param mb The mailbox to free.
+ */
+void mailbox_free(Mailbox *mb);
+
+/**
+ * @brief Copies an element in to the mailbox.
+ *
+ * @param mb The mailbox to put in to.
+ * @param elem The element to copy. Assumed to be the mailbox's element size.
+ * @return int -1 if the mailbox could not grow. 0 otherwise.
+ */
+int mailbox_put(Mailbox *mb, const void *elem);
+
+/**
+ * @brief Takes the oldest element out of the mailbox without waiting.
+ *
+ * @param mb The mailbox to take from.
+ * @param elem Set to the element taken.
+ * @return bool false if the mailbox was empty.
+ */
+bool mailbox_get(Mailbox *mb, void *elem);
+
+/**
+ * @brief Returns a file descriptor that polls readable while the mailbox is
+ * not empty. It must only be polled, never read.
+ *
+ * @param mb The mailbox to watch.
+ * @return int The file descriptor.
+ */
+int mailbox_fd(const Mailbox *mb);
+
+#endif
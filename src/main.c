@@ -1,30 +1,127 @@
+#define _GNU_SOURCE // accept4(2).
+
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/random.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "libnogo/nogo.h"
 
+#include "archive.h"
+#include "audience.h"
+#include "bot.h"
+#include "channels.h"
+#include "cluster.h"
+#include "coalescer.h"
+#include "command.h"
 #include "context.h"
+#include "executor.h"
+#include "handoff.h"
+#include "journal.h"
+#include "limiter.h"
 #include "lobby.h"
 #include "log.h"
+#include "mailbox.h"
+#include "matchmaker.h"
 #include "message.h"
 #include "player.h"
 #include "queue.h"
+#include "session.h"
+#include "solver.h"
+#include "store.h"
+#include "tournament.h"
 
-#define BACKLOG 10
+#define BACKLOG SOMAXCONN // Connections the kernel queues before they are accepted. See -l.
+#define ACCEPT_BATCH 512 // Connections accepted per event loop iteration, so a storm does not starve everyone else.
 
 #define RESPONSE_SIZE 512
 
+typedef enum JobType {
+	JOB_MESSAGE, // Serve a message the player sent.
+	JOB_DISCONNECT, // The connection was lost. Nothing was read.
+	JOB_SEAT, // Seat a player the matchmaker or the tournament paired. Replies to their JOIN.
+	JOB_CLOSE, // Nobody is sent to the lobby anymore. Frees it.
+	JOB_RESUME, // The player took over their session from a new connection. Replies to their RESUME.
+	JOB_SLEEP, // Nothing was sent to the lobby for a while. Puts it to sleep in the store.
+	JOB_BOT, // A bot is to move again in a game between bots. Plays its move.
+	JOB_LEAVE, // The player was sent to another lobby by the tournament. Takes them out of this one.
+} JobType;
+
+/**
+ * @brief Work for a lobby, handed from the I/O thread to whichever thread runs
+ * the lobby.
+ * 
+ */
+typedef struct Job {
+	JobType type;
+	Context *ctx;
+	Lobby *l; // The lobby the job runs on. NULL if the player is in none.
+	Player player; // Copy of the sender as of when the message was read.
+	bool with_bot; // JOB_SEAT only. Also seat the bot, which the player asked for.
+	size_t round; // JOB_SEAT only. Tournament round the player is seated for, counting from 1. 0 for matches.
+	Command cmd;
+	NogoProtocol pro; // Only set when cmd is COMMAND_NONE.
+	char token[SESSION_TOKEN_SIZE]; // Issued to the player. Sent after the reply. Empty if none was.
+	int old_fd; // JOB_RESUME only. The connection the session was taken over from.
+} Job;
+
+#define SOLVER_TABLE_BITS 22
+#define SOLVER_BUDGET_MS 200 // How long a move may be searched for a forced win.
+
+#define MATCH_WINDOW_BASE 50
+#define MATCH_WINDOW_PER_SEC 50
+#define MATCH_WINDOW_MAX 500
+#define MATCH_BATCH 256 // Pairs taken from the matchmaker at a time.
+#define MATCH_STATS_MS 60000 // How often matchmaking statistics are printed.
+
+#define SESSION_CHECK_MS 1000 // How often detached sessions are checked for expiry.
+#define SESSION_EXPIRE_BATCH 64 // Expired sessions taken at a time.
+
+#define OUTPUT_DROP_MS 10000 // How long a connection may take nothing sent to it before being dropped.
+#define OUTPUT_RETRY_MS 20 // How often connections that fell behind are sent to again.
+#define OUTPUT_DROP_BATCH 64 // Connections dropped at a time.
+
+#define AUDIENCE_DROP_BATCH 64 // Spectators dropped at a time.
+
+#define CHANNELS_DROP_BATCH 64 // Subscribers dropped at a time.
+#define CHANNELS_FLUSH_SENDS 512 // Subscribers sent to per event loop iteration, so that an announcement does not hold up the game.
+#define ANNOUNCE_TOPIC ((uint64_t)1 << 32) // Above every lobby id, which are the topics of lobby chat.
+
+#define IDLE_MS 600000 // How long a lobby may go without a job before it is put to sleep. See -i.
+#define IDLE_CHECK_MS 1000 // How often lobbies are checked for going idle.
+
+#define CLUSTER_REPORT_MS 1000 // How often the load is reported to the router. See -c.
+
+#define TOURNAMENT_LOBBY_BIT 0x80000000u // Set in the ids of tournament lobbies. The rest is the game id.
+#define TOURNAMENT_BATCH 256 // Games taken from the tournament at a time.
+#define TOURNAMENT_STANDINGS 10 // Standings printed when the tournament is over.
+
+/**
+ * @brief The end of a tournament game, handed from the thread that ran the
+ * lobby to the I/O thread.
+ * 
+ */
+typedef struct GameResult {
+	Lobby *l; // Only valid while the game is still running in the tournament.
+	uint32_t lobby_id;
+	int winner_fd;
+} GameResult;
+
 /**
  * @brief Sends a message to all players in the current lobby.
  * 
@@ -38,6 +135,10 @@ static int broadcast_all(Lobby *l, const char *str, size_t slen) {
 	int result = 0;
 
 	for (int i = 0; i < l->players_len; i++) {
+		if (l->players[i].fd < 0) {
+			continue; // Restored from the journal and not reconnected yet.
+		}
+
 		long wrote = l->players[i].write(&l->players[i], str, slen);
 		if (wrote <= 0) {
 			result = -1;
@@ -62,7 +163,7 @@ static int broadcast_from(Lobby *l, const char *str, size_t slen, int playerfd)
 	int result = 0;
 
 	for (int i = 0; i < l->players_len; i++) {
-		if (l->players[i].fd != playerfd) {
+		if (l->players[i].fd != playerfd && l->players[i].fd >= 0) {
 			long wrote = l->players[i].write(&l->players[i], str, slen);
 			if (wrote <= 0) {
 				result = -1;
@@ -100,6 +201,29 @@ static long write_error(const Player *player, const void *msg) {
 	return player->write(player, error_msg, strlen(error_msg));
 }
 
+static long write_token(const Player *player, const char *token) {
+	char buf[RESPONSE_SIZE];
+	const int buf_size = snprintf(buf, RESPONSE_SIZE, "GOTTOKEN %s\r\n", token);
+	if (buf_size <= 0) {
+		return -1;
+	}
+	return player->write(player, buf, (size_t)buf_size);
+}
+
+static long write_key(const Player *player, const uint8_t key[PLAYER_KEY_SIZE]) {
+	char hex[PLAYER_KEY_SIZE * 2 + 1];
+	for (size_t i = 0; i < PLAYER_KEY_SIZE; i++) {
+		snprintf(&hex[i * 2], 3, "%02x", key[i]);
+	}
+
+	char buf[RESPONSE_SIZE];
+	const int buf_size = snprintf(buf, RESPONSE_SIZE, "GOTSEAT %s\r\n", hex);
+	if (buf_size <= 0) {
+		return -1;
+	}
+	return player->write(player, buf, (size_t)buf_size);
+}
+
 static void *get_in_addr(struct sockaddr_storage* ss) {
 	if (ss->ss_family == AF_INET) {
 		return &(((struct sockaddr_in*)ss)->sin_addr);
@@ -108,14 +232,117 @@ static void *get_in_addr(struct sockaddr_storage* ss) {
 	return &(((struct sockaddr_in6*)ss)->sin6_addr);
 }
 
-static int serve_pro_join(Context *ctx, NogoProtocol *pro, Player *player) {
-	(void)pro;
+/**
+ * @brief Closes the connection once every message queued for it so far has
+ * been sent.
+ * 
+ * @param ctx The context the connection belongs to.
+ * @param fd The connection to close.
+ */
+static void close_later(Context *ctx, int fd) {
+	if (ctx->closebox) {
+		mailbox_put(ctx->closebox, &fd);
+	} else {
+		queue_put(ctx->closeq, &fd);
+	}
+}
 
-	int result;
-	if ((result = lobby_join(ctx->l, player)) < 0 ) {
-		return result;
+/**
+ * @brief Hands what happened in a lobby to the I/O thread for its spectators,
+ * along with a snapshot of the lobby. Does nothing if nobody watches, or if the
+ * lobby is asleep: a spectator who just came is sent the snapshot by their
+ * WATCH, which wakes it.
+ * 
+ * @param ctx The context holding the audience.
+ * @param l The lobby.
+ * @param str The message the players were sent. Empty to only send a snapshot.
+ * @param slen The length of str.
+ */
+static void publish(Context *ctx, Lobby *l, const char *str, size_t slen) {
+	if (__atomic_load_n(&l->watchers, __ATOMIC_ACQUIRE) == 0 || lobby_is_asleep(l) || slen > AUDIENCE_FRAME_SIZE) {
+		return;
+	}
+
+	AudienceFrame frame = { .lobby = l->id, .data_len = slen };
+	memcpy(frame.data, str, slen);
+
+	size_t snapshot_len;
+	const char *snapshot = lobby_snapshot(l, &snapshot_len);
+	if (snapshot_len <= AUDIENCE_SNAPSHOT_SIZE) {
+		memcpy(frame.snapshot, snapshot, snapshot_len);
+		frame.snapshot_len = snapshot_len;
+	}
+
+	if (ctx->framebox) {
+		mailbox_put(ctx->framebox, &frame);
+	} else {
+		queue_put(ctx->frameq, &frame);
+	}
+}
+
+/**
+ * @brief Hands the winner of a tournament game to the I/O thread. Does nothing
+ * for lobbies outside of the tournament.
+ * 
+ * @param ctx The context playing the tournament.
+ * @param l The lobby the game was won in.
+ * @param team The winning team.
+ */
+static void report_result(Context *ctx, Lobby *l, int team) {
+	if (!ctx->tournament || !(l->id & TOURNAMENT_LOBBY_BIT)) {
+		return;
+	}
+
+	GameResult result = { .l = l, .lobby_id = l->id, .winner_fd = -1 };
+	for (int i = 0; i < l->players_len; i++) {
+		if (l->players[i].team == team) {
+			result.winner_fd = l->players[i].fd;
+		}
+	}
+
+	if (ctx->resultbox) {
+		mailbox_put(ctx->resultbox, &result);
+	} else {
+		queue_put(ctx->resultq, &result);
+	}
+}
+
+/**
+ * @brief Removes the player from the lobby and records it in the journal.
+ * 
+ * @param ctx The context holding the journal.
+ * @param l The lobby to leave. NULL if the player is in none.
+ * @param player The player leaving.
+ * @return int -1 if the player was not in the lobby. 0 otherwise.
+ */
+static int leave_lobby(Context *ctx, Lobby *l, const Player *player) {
+	// The seat is journaled rather than the connection, as only the seat has
+	// its key.
+	Player seat = *player;
+	for (int i = 0; l && i < l->players_len; i++) {
+		if (l->players[i].fd == player->fd) {
+			seat = l->players[i];
+			break;
+		}
+	}
+
+	if (!l || lobby_leave(l, player) < 0) {
+		return -1;
+	}
+
+	if (ctx->journal && journal_leave(ctx->journal, l, &seat) < 0) {
+		LOG_ERROR("failed to journal leave\n");
 	}
 
+	return 0;
+}
+
+/**
+ * @brief Lets the lobby and its spectators know that the player joined.
+ * 
+ * @return int -1 on error. 0 otherwise.
+ */
+static int announce_join(Context *ctx, Lobby *l, const Player *player) {
 	char buf[RESPONSE_SIZE];
 	int buf_size = snprintf(buf, RESPONSE_SIZE, "GOTJOIN %s\r\n", player->name);
 	if (buf_size <= 0) {
@@ -123,44 +350,130 @@ static int serve_pro_join(Context *ctx, NogoProtocol *pro, Player *player) {
 		return -1;
 	}
 
-	if (broadcast_from(ctx->l, buf, (size_t)buf_size, player->fd) < 0) {
+	publish(ctx, l, buf, (size_t)buf_size);
+	if (broadcast_from(l, buf, (size_t)buf_size, player->fd) < 0) {
 		LOG_ERROR("failed to broadcast gotjoin from player\n");
 		return -1;
 	}
 
-	return result;
+	return 0;
 }
 
-static int serve_pro_move(Context *ctx, NogoProtocol *pro, Player *player) {
-	if (lobby_play_move(ctx->l, player, pro->arg1, pro->arg2) < 0) {
+/**
+ * @brief Seats the player in the lobby, records it in the journal and lets the
+ * other players know.
+ * 
+ * @param ctx The context holding the journal.
+ * @param l The lobby to join.
+ * @param player The player joining.
+ * @return int -1 if the player could not join. 0 otherwise.
+ */
+static int join_lobby(Context *ctx, Lobby *l, const Player *player) {
+	// Only the server lobby is recovered after a restart, so only its seats
+	// get a key to be taken back with. See recover().
+	Player seated = *player;
+	const bool is_keyed = ctx->journal && l == ctx->l && !player->is_bot;
+	if (is_keyed && getrandom(seated.key, PLAYER_KEY_SIZE, 0) != PLAYER_KEY_SIZE) {
+		LOG_ERROR("failed to make seat key\n");
 		return -1;
 	}
 
-	LOG_DEBUG("[%s<%d>] played move %s %s\n", player->name, player->fd, pro->arg1, pro->arg2);
+	int result;
+	if ((result = lobby_join(l, &seated)) < 0 ) {
+		return result;
+	}
 
-	write_ok(player);
+	if (ctx->journal && journal_join(ctx->journal, l, &seated) < 0) {
+		LOG_ERROR("failed to journal join\n");
+	}
+	if (is_keyed && write_key(player, seated.key) <= 0) {
+		LOG_ERROR("failed to send seat key\n");
+	}
+
+	return announce_join(ctx, l, player) < 0 ? -1 : result;
+}
+
+/**
+ * @brief Hands a seat restored from the journal back to the player who holds
+ * its key and lets the other players know.
+ * 
+ * @param l The lobby the seat is in.
+ * @param hex The key of the seat in hex.
+ * @param player The player taking their seat back.
+ * @return int -1 if the key is malformed or takes no seat. 0 otherwise.
+ */
+static int reclaim_seat(Context *ctx, Lobby *l, const char *hex, const Player *player) {
+	uint8_t key[PLAYER_KEY_SIZE];
+	if (strlen(hex) != PLAYER_KEY_SIZE * 2) {
+		return -1;
+	}
+	for (size_t i = 0; i < PLAYER_KEY_SIZE; i++) {
+		if (sscanf(&hex[i * 2], "%2hhx", &key[i]) != 1) {
+			return -1;
+		}
+	}
+
+	if (lobby_reclaim(l, key, player) < 0) {
+		return -1;
+	}
+
+	LOG_DEBUG("[%s<%d>] reclaimed their seat\n", player->name, player->fd);
+	return announce_join(ctx, l, player);
+}
+
+/**
+ * @brief Records a move that was just played and lets the other players know
+ * about it and about the winner if the move ended the game.
+ * 
+ * @param ctx The context holding the journal and the archive.
+ * @param l The lobby the move was played in.
+ * @param player The player who played the move.
+ * @param row_str The row of the move as sent by the player.
+ * @param col_str The col of the move as sent by the player.
+ * @return int -1 if a message failed to send. 0 otherwise.
+ */
+static int announce_move(Context *ctx, Lobby *l, const Player *player, const char *row_str, const char *col_str) {
+	LobbyMove move;
+	if (ctx->journal && lobby_last_move(l, &move) == 0 && journal_move(ctx->journal, l, move.team, move.row, move.col) < 0) {
+		LOG_ERROR("failed to journal move\n");
+	}
 
 	char buf[RESPONSE_SIZE];
-	int buf_size = snprintf(buf, RESPONSE_SIZE, "GOTMOVE %s %s\r\n", pro->arg1, pro->arg2);
+	int buf_size = snprintf(buf, RESPONSE_SIZE, "GOTMOVE %s %s\r\n", row_str, col_str);
 	if (buf_size <= 0) {
 		LOG_ERROR("failed to create gotmove message\n");
 		return -1;
 	}
 
-	if (broadcast_from(ctx->l, buf, (size_t)buf_size, player->fd) < 0) {
+	publish(ctx, l, buf, (size_t)buf_size);
+	if (broadcast_from(l, buf, (size_t)buf_size, player->fd) < 0) {
 		LOG_ERROR("failed to broadcast gotmove from player\n");
 		return -1;
 	}
 
 	int team;
-	if ((team = lobby_winner(ctx->l)) != -1) {
+	if ((team = lobby_winner(l)) != -1) {
+		if (ctx->journal && journal_end(ctx->journal, l) < 0) {
+			LOG_ERROR("failed to journal end of game\n");
+		}
+
+		uint64_t id;
+		if (ctx->archive && archive_append(ctx->archive, l, (int64_t)time(NULL), &id) == 0) {
+			LOG_DEBUG("archived game %llu\n", (unsigned long long)id);
+		}
+
+		// Before the players hear of it, so the result is recorded by the
+		// time they can answer.
+		report_result(ctx, l, team);
+
 		buf_size = snprintf(buf, RESPONSE_SIZE, "GOTWINNER %c\r\n", team);
 		if (buf_size <= 0) {
 			LOG_ERROR("failed to create gotwinner message\n");
 			return -1;
 		}
 
-		if (broadcast_all(ctx->l, buf, (size_t)buf_size) < 0) {
+		publish(ctx, l, buf, (size_t)buf_size);
+		if (broadcast_all(l, buf, (size_t)buf_size) < 0) {
 			LOG_ERROR("failed to broadcast gotwinner to all\n");
 			return -1;
 		}
@@ -169,48 +482,309 @@ static int serve_pro_move(Context *ctx, NogoProtocol *pro, Player *player) {
 	return 0;
 }
 
-static void serve(Context *ctx, NogoProtocol *pro, Player *player) {
-	if (!player->is_login && pro->type != NOGO_PRO_LOGIN && pro->type != NOGO_PRO_LOGOUT) {
-		pro->type = NOGO_PRO_ERROR;
+/**
+ * @brief Finds the bot seat whose turn it is.
+ * 
+ * @return const Player* The seat. NULL if it is nobody's turn or a player's.
+ */
+static const Player *bot_to_move(const Context *ctx, const Lobby *l) {
+	if (!ctx->bot || !l || l->players_len != LOBBY_MAX_PLAYERS || lobby_winner(l) != -1) {
+		return NULL;
 	}
 
-	int status;
-	switch (pro->type) {
-	case NOGO_PRO_JOIN:
-		LOG_DEBUG("[%s<%d>] joined a lobby\n", player->name, player->fd);
+	for (int i = 0; i < l->players_len; i++) {
+		if (l->players[i].team == lobby_turn(l)) {
+			return l->players[i].is_bot ? &l->players[i] : NULL;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Lets the bot play if it is a bot seat's turn. A game between bots is
+ * played a move per job, so the worker serves the other lobbies in between.
+ * The next move is asked for through the bot mailbox, as only the I/O thread
+ * knows whether the lobby was closed meanwhile. Until it is played, other
+ * jobs leave the move to it.
+ * 
+ * @param ctx The context holding the bot.
+ * @param l The lobby to play in. NULL if there is none.
+ */
+static void play_bots(Context *ctx, Lobby *l) {
+	const Player *seat = bot_to_move(ctx, l);
+	if (!seat || l->is_bot_due) {
+		return;
+	}
+
+	// Small boards are played perfectly when the solver finds a win in
+	// time. Otherwise the bot searches as usual.
+	LobbyMove move;
+	BotStats stats = { 0 };
+	const bool is_solved = ctx->solver && l->board.rows * l->board.cols <= SOLVER_MAX_SPACES &&
+		solver_solve(ctx->solver, l, SOLVER_BUDGET_MS, &move, NULL) == SOLVER_WIN;
+	if (!is_solved && bot_choose(ctx->bot, l, &move, &stats) < 0) {
+		return;
+	}
+
+	char row_str[16];
+	char col_str[16];
+	snprintf(row_str, sizeof row_str, "%zu", move.row);
+	snprintf(col_str, sizeof col_str, "%zu", move.col);
+
+	if (lobby_play_move(l, seat, row_str, col_str) < 0) {
+		LOG_ERROR("bot played an invalid move\n");
+		return;
+	}
+
+	LOG_DEBUG("[%s] played move %s %s after %lu playouts\n", seat->name, row_str, col_str, stats.playouts);
+
+	announce_move(ctx, l, seat, row_str, col_str);
+
+	if (bot_to_move(ctx, l)) {
+		l->is_bot_due = true;
+		mailbox_put(ctx->botbox, &l->id);
+	}
+}
+
+static int serve_pro_join(Context *ctx, Lobby *l, NogoProtocol *pro, const Player *player) {
+	(void)pro;
+
+	if (!l) {
+		return -1;
+	}
+
+	return join_lobby(ctx, l, player);
+}
+
+static int serve_pro_move(Context *ctx, Lobby *l, NogoProtocol *pro, const Player *player) {
+	if (!l || lobby_play_move(l, player, pro->arg1, pro->arg2) < 0) {
+		return -1;
+	}
+
+	LOG_DEBUG("[%s<%d>] played move %s %s\n", player->name, player->fd, pro->arg1, pro->arg2);
+
+	write_ok(player);
+
+	return announce_move(ctx, l, player, pro->arg1, pro->arg2);
+}
+
+/**
+ * @brief Replies with whether the team to move in the player's lobby can force
+ * a win, and with a winning move if it can. Solving takes up to
+ * SOLVER_BUDGET_MS, so this only runs on a worker.
+ * 
+ * @param ctx The context holding the solver.
+ * @param l The player's lobby. NULL if the player is in none.
+ * @param player The player who asked.
+ * @return int -1 if the position can't be analyzed. 0 otherwise.
+ */
+static int analyze(Context *ctx, Lobby *l, const Player *player) {
+	if (!ctx->solver || !l || lobby_winner(l) != -1) {
+		return -1;
+	}
+
+	LobbyMove move;
+	SolverResult result = solver_probe(ctx->solver, l, &move);
+	if (result == SOLVER_UNKNOWN && l->board.rows * l->board.cols <= SOLVER_MAX_SPACES) {
+		result = solver_solve(ctx->solver, l, SOLVER_BUDGET_MS, &move, NULL);
+	}
 
-		status = serve_pro_join(ctx, pro, player);
+	char buf[RESPONSE_SIZE];
+	int buf_size;
+	switch (result) {
+	case SOLVER_WIN:
+		buf_size = snprintf(buf, RESPONSE_SIZE, "ANALYSIS WIN %zu %zu\r\n", move.row, move.col);
 		break;
-	case NOGO_PRO_LEAVE:
-		LOG_DEBUG("[%s<%d>] left a lobby\n", player->name, player->fd);
+	case SOLVER_LOSS:
+		buf_size = snprintf(buf, RESPONSE_SIZE, "ANALYSIS LOSS\r\n");
+		break;
+	case SOLVER_UNKNOWN:
+	default:
+		buf_size = snprintf(buf, RESPONSE_SIZE, "ANALYSIS UNKNOWN\r\n");
+		break;
+	}
+
+	if (buf_size <= 0 || player->write(player, buf, (size_t)buf_size) <= 0) {
+		LOG_ERROR("failed to send analysis\n");
+	}
+
+	return 0;
+}
 
-		lobby_leave(ctx->l, player);
+/**
+ * @brief Returns whether the command only touches the channels, which route()
+ * runs on the I/O thread.
+ * 
+ */
+static bool is_channel_command(const Command *cmd) {
+	return cmd->type == COMMAND_SAY || cmd->type == COMMAND_ANNOUNCE || cmd->type == COMMAND_SUBSCRIBE ||
+		cmd->type == COMMAND_UNSUBSCRIBE;
+}
+
+/**
+ * @brief Handles commands that are not part of the nogo protocol.
+ * 
+ * @param ctx The context the command is run in.
+ * @param l The sender's lobby. NULL if the sender is in none.
+ * @param cmd The parsed command.
+ * @param player The player who sent the command.
+ */
+static void serve_command(Context *ctx, Lobby *l, const Command *cmd, const Player *player) {
+	int status = -1;
+	bool is_replied = false; // Whether the command sent its own reply instead of OK.
 
-		const char left[] = "GOTLEAVE\r\n";
-		broadcast_from(ctx->l, left, (sizeof left / sizeof left[0]) - 1, player->fd);
+	switch (cmd->type) {
+	case COMMAND_BOT:
+		if (player->is_login && ctx->bot && l) {
+			LOG_DEBUG("[%s<%d>] added a bot\n", player->name, player->fd);
 
+			const Player bot = bot_player();
+			status = join_lobby(ctx, l, &bot);
+		}
+		break;
+	case COMMAND_ANALYZE:
+		if (player->is_login) {
+			status = analyze(ctx, l, player);
+			is_replied = status == 0;
+		}
+		break;
+	case COMMAND_RATING:
+		// Already applied to the connection by serve_connection().
+		status = player->is_login ? 0 : -1;
+		break;
+	case COMMAND_ENTER:
+		// Already entered by route(), which turns the command in to an error otherwise.
+		status = 0;
+		break;
+	case COMMAND_WATCH:
+		// Added to the audience by route(), which sends the command to the
+		// watched lobby. The spectator starts with a snapshot.
+		status = l ? 0 : -1;
+		if (l) {
+			publish(ctx, l, "", 0);
+		}
+		break;
+	case COMMAND_UNWATCH:
+		status = 0;
+		break;
+	case COMMAND_RESUME:
+		// Taken over by route(), which turns the command in to an error otherwise.
+		break;
+	case COMMAND_RECLAIM:
+		if (player->is_login && l) {
+			status = reclaim_seat(ctx, l, cmd->token, player);
+		}
+		break;
+	case COMMAND_SAY:
+	case COMMAND_ANNOUNCE:
+	case COMMAND_SUBSCRIBE:
+	case COMMAND_UNSUBSCRIBE:
+		// Already run by route(), which turns the command in to an error otherwise.
 		status = 0;
 		break;
+	case COMMAND_BOARD:
+		if (player->is_login && l) {
+			size_t snapshot_len;
+			const char *snapshot = lobby_snapshot(l, &snapshot_len);
+			status = snapshot_len > 0 && player->write(player, snapshot, snapshot_len) > 0 ? 0 : -1;
+			is_replied = status == 0;
+		}
+		break;
+	case COMMAND_NONE:
+	default:
+		break;
+	}
+
+	if (status == -1) {
+		write_error(player, NULL);
+	} else if (!is_replied) {
+		write_ok(player);
+		play_bots(ctx, l);
+	}
+}
+
+/**
+ * @brief Applies the parts of a message that change the connection itself.
+ * Runs on the I/O thread, which owns the connections, before the message is
+ * passed on to serve().
+ * 
+ * @param cmd The parsed command.
+ * @param pro The parsed message. Turned in to an error if the player may not send it.
+ * @param player The player who sent the message.
+ */
+static void serve_connection(const Command *cmd, NogoProtocol *pro, Player *player) {
+	if (cmd->type == COMMAND_RATING && player->is_login) {
+		player->rating = cmd->rating;
+		return;
+	} else if (cmd->type != COMMAND_NONE) {
+		return;
+	}
+
+	if (!player->is_login && pro->type != NOGO_PRO_LOGIN && pro->type != NOGO_PRO_LOGOUT) {
+		pro->type = NOGO_PRO_ERROR;
+	}
+
+	switch (pro->type) {
 	case NOGO_PRO_LOGIN:
 		memset(player->name, '\0', PLAYER_NAME_SIZE);
 		memcpy(player->name, pro->arg1, PLAYER_NAME_SIZE - 1);
 		player->is_login = true;
 
 		LOG_DEBUG("[%s<%d>] login\n", player->name, player->fd);
-
-		status = 0;
 		break;
 	case NOGO_PRO_LOGOUT:
 		LOG_DEBUG("[%s<%d>] logout\n", player->name, player->fd);
 
 		player->is_login = false;
-		queue_put(ctx->closeq, &player->fd);
-		lobby_leave(ctx->l, player);
-		ctx_remove_player(ctx, player->fd);
+		break;
+	case NOGO_PRO_JOIN:
+	case NOGO_PRO_LEAVE:
+	case NOGO_PRO_MOVE:
+	case NOGO_PRO_ERROR:
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief Lets the lobby and its spectators know that the player left.
+ * 
+ * @param l The lobby that was left. NULL if the player was in none.
+ */
+static void announce_leave(Context *ctx, Lobby *l, const Player *player) {
+	const char left[] = "GOTLEAVE\r\n";
+	if (l) {
+		publish(ctx, l, left, (sizeof left / sizeof left[0]) - 1);
+		broadcast_from(l, left, (sizeof left / sizeof left[0]) - 1, player->fd);
+	}
+}
+
+static void serve(Context *ctx, Lobby *l, NogoProtocol *pro, const Player *player) {
+	int status;
+	switch (pro->type) {
+	case NOGO_PRO_JOIN:
+		LOG_DEBUG("[%s<%d>] joined a lobby\n", player->name, player->fd);
+
+		status = serve_pro_join(ctx, l, pro, player);
+		break;
+	case NOGO_PRO_LEAVE:
+		LOG_DEBUG("[%s<%d>] left a lobby\n", player->name, player->fd);
+
+		leave_lobby(ctx, l, player);
+		announce_leave(ctx, l, player);
+
+		status = 0;
+		break;
+	case NOGO_PRO_LOGIN:
+		status = 0;
+		break;
+	case NOGO_PRO_LOGOUT:
+		leave_lobby(ctx, l, player);
 		status = 0;
 		break;
 	case NOGO_PRO_MOVE:
-		status = serve_pro_move(ctx, pro, player);
+		status = serve_pro_move(ctx, l, pro, player);
 		break;
 	case NOGO_PRO_ERROR:
 	default:
@@ -222,13 +796,1297 @@ static void serve(Context *ctx, NogoProtocol *pro, Player *player) {
 	} else if (pro->type != NOGO_PRO_MOVE) {
 		write_ok(player);
 	}
-}
 
-int main(int argc, char **argv) {
-	if (argc < 2) {
-		printf("usage: nogos [port]\n");
+	if (pro->type == NOGO_PRO_LOGOUT) {
+		close_later(ctx, player->fd); // After the reply so the reply is sent first.
+	} else if (status == 0 && (pro->type == NOGO_PRO_JOIN || pro->type == NOGO_PRO_MOVE)) {
+		play_bots(ctx, l);
 	}
+}
+
+/**
+ * @brief Seats a player the matchmaker paired and replies to their JOIN. The
+ * first player seated is told about the second like any JOIN. Tournament
+ * entrants sent no JOIN and are sent GOTROUND instead.
+ * 
+ * @param ctx The context holding the journal and the bot.
+ * @param l The lobby made for the match.
+ * @param player The player to seat.
+ * @param with_bot Whether to seat the bot next to the player, who sent BOT
+ * while queued. The BOT is replied to as well.
+ * @param round The tournament round the player is seated for. 0 for matches.
+ */
+static void seat(Context *ctx, Lobby *l, const Player *player, bool with_bot, size_t round) {
+	if (join_lobby(ctx, l, player) < 0) {
+		write_error(player, NULL);
+		return;
+	}
+
+	if (round > 0) {
+		char buf[RESPONSE_SIZE];
+		const int buf_size = snprintf(buf, RESPONSE_SIZE, "GOTROUND %zu\r\n", round);
+		if (buf_size <= 0 || player->write(player, buf, (size_t)buf_size) <= 0) {
+			LOG_ERROR("failed to send gotround\n");
+		}
+	} else {
+		write_ok(player);
+	}
+
+	if (with_bot) {
+		const Player bot = bot_player();
+		if (join_lobby(ctx, l, &bot) < 0) {
+			write_error(player, NULL);
+			return;
+		}
+		write_ok(player);
+	}
+
+	play_bots(ctx, l);
+}
+
+static void run_job(void *arg) {
+	Job *job = arg;
+
+	// A lobby that was put to sleep is woken by the next job that may need its
+	// board, which includes a leave since it is published to the audience. Chat
+	// can come and go without it.
+	if (job->l && lobby_is_asleep(job->l) && ((job->type == JOB_MESSAGE && !is_channel_command(&job->cmd)) || job->type == JOB_SEAT ||
+		job->type == JOB_BOT || job->type == JOB_LEAVE)) {
+		if (store_take(job->ctx->store, job->l) < 0) {
+			LOG_ERROR("failed to wake lobby %u\n", job->l->id);
+			write_error(&job->player, NULL);
+			return;
+		}
+		LOG_DEBUG("lobby %u woken\n", job->l->id);
+	}
+
+	switch (job->type) {
+	case JOB_MESSAGE:
+		if (job->cmd.type != COMMAND_NONE) {
+			serve_command(job->ctx, job->l, &job->cmd, &job->player);
+		} else {
+			serve(job->ctx, job->l, &job->pro, &job->player);
+		}
+		if (job->token[0] != '\0') {
+			write_token(&job->player, job->token);
+		}
+		break;
+	case JOB_DISCONNECT:
+		leave_lobby(job->ctx, job->l, &job->player);
+		close_later(job->ctx, job->player.fd);
+		break;
+	case JOB_SEAT:
+		seat(job->ctx, job->l, &job->player, job->with_bot, job->round);
+		break;
+	case JOB_RESUME:
+		// Nothing is sent to the old connection from here on, so it can go.
+		if (job->l && lobby_reconnect(job->l, job->old_fd, &job->player) == 0) {
+			LOG_DEBUG("[%s<%d>] took back their seat from <%d>\n", job->player.name, job->player.fd, job->old_fd);
+		}
+		write_ok(&job->player);
+		write_token(&job->player, job->token);
+		close_later(job->ctx, job->old_fd);
+		break;
+	case JOB_CLOSE:
+		// Abandoned games are not worth recovering.
+		if (job->ctx->journal && journal_end(job->ctx->journal, job->l) < 0) {
+			LOG_ERROR("failed to journal end of lobby\n");
+		}
+		if (lobby_is_asleep(job->l)) {
+			store_drop(job->ctx->store, job->l);
+		}
+		lobby_free(job->l);
+		break;
+	case JOB_SLEEP:
+		// Stays awake if it can't be stored, or if it was played in since.
+		if (lobby_is_asleep(job->l)) {
+			break;
+		} else if (store_put(job->ctx->store, job->l) < 0) {
+			LOG_ERROR("failed to put lobby %u to sleep\n", job->l->id);
+		} else {
+			LOG_DEBUG("lobby %u asleep\n", job->l->id);
+		}
+		break;
+	case JOB_BOT:
+		job->l->is_bot_due = false;
+		play_bots(job->ctx, job->l);
+		break;
+	case JOB_LEAVE:
+		if (leave_lobby(job->ctx, job->l, &job->player) == 0) {
+			announce_leave(job->ctx, job->l, &job->player);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static uint64_t now_ms(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Runs the job on the executor if there is one, in order with the other
+ * jobs of the same key. Runs it right away otherwise. Runs on the I/O thread.
+ * 
+ */
+static void dispatch(Context *ctx, Job *job, uint32_t key) {
+	if (ctx->store && job->l && job->type != JOB_SLEEP) {
+		job->l->routed_ms = now_ms();
+		job->l->is_idle = false;
+	}
+
+	if (!ctx->executor) {
+		run_job(job);
+	} else if (executor_submit(ctx->executor, key, run_job, job, sizeof *job) < 0) {
+		LOG_ERROR("failed to submit job\n");
+		if (job->type == JOB_MESSAGE) {
+			write_error(&job->player, NULL);
+		}
+	}
+}
+
+/**
+ * @brief Creates a lobby that the server sends players to and records it in
+ * the journal. Runs on the I/O thread.
+ * 
+ * @param ctx The context to create the lobby in.
+ * @param id The id of the lobby.
+ * @return Lobby* The created lobby. NULL if an error occurred.
+ */
+static Lobby *create_lobby(Context *ctx, uint32_t id) {
+	Lobby *l = lobby_create(9, 9);
+	if (!l || ctx_add_lobby(ctx, l) < 0) {
+		if (l) {
+			lobby_free(l);
+		}
+		return NULL;
+	}
+
+	l->id = id;
+	if (ctx->journal && journal_create(ctx->journal, l) < 0) {
+		LOG_ERROR("failed to journal lobby\n");
+	}
+
+	return l;
+}
+
+/**
+ * @brief Frees a lobby nobody is sent to anymore, after the jobs already sent
+ * to it.
+ * 
+ */
+static void close_lobby(Context *ctx, Lobby *l) {
+	audience_close_lobby(ctx->audience, l->id);
+	channels_close_topic(ctx->channels, l->id);
+	ctx_remove_lobby(ctx, l);
+
+	Job job = { .type = JOB_CLOSE, .ctx = ctx, .l = l };
+	dispatch(ctx, &job, l->id);
+}
+
+/**
+ * @brief Sends the player to a lobby the server created. Runs on the I/O
+ * thread.
+ * 
+ * @param ctx The context holding the lobby.
+ * @param l The lobby.
+ * @param player The player to seat.
+ * @param with_bot Whether to seat the bot next to the player.
+ * @param round The tournament round the player is seated for. 0 for matches.
+ */
+static void send_to_lobby(Context *ctx, Lobby *l, Player *player, bool with_bot, size_t round) {
+	Job job = { .type = JOB_SEAT, .ctx = ctx, .l = l, .player = *player, .with_bot = with_bot, .round = round };
+	dispatch(ctx, &job, l->id);
+
+	player->lobby = l;
+	player->route = l->id;
+	l->routed++;
+
+	// Players hear the chat of the lobby they play in.
+	channels_subscribe(ctx->channels, player->fd, l->id);
+}
+
+/**
+ * @brief Creates a lobby for a match and sends the players to it. Runs on the
+ * I/O thread.
+ * 
+ * @param ctx The context to create the lobby in.
+ * @param first The player who waited longer. Joins first.
+ * @param second The other player. NULL to seat the bot instead.
+ */
+static void start_match(Context *ctx, Player *first, Player *second) {
+	Lobby *l = create_lobby(ctx, ctx->next_lobby_id++);
+	if (!l) {
+		LOG_ERROR("failed to create lobby for match\n");
+		write_error(first, NULL);
+		if (second) {
+			write_error(second, NULL);
+		}
+		return;
+	}
+
+	send_to_lobby(ctx, l, first, !second, 0);
+	if (second) {
+		send_to_lobby(ctx, l, second, false, 0);
+	}
+
+	LOG_DEBUG("matched [%s<%d>] in lobby %u\n", first->name, first->fd, l->id);
+}
+
+/**
+ * @brief Stops sending the player to their lobby. The lobby is freed once
+ * nobody is sent to it anymore.
+ * 
+ */
+static void release_lobby(Context *ctx, Player *player) {
+	Lobby *l = player->lobby;
+	player->lobby = NULL;
+	channels_unsubscribe(ctx->channels, player->fd, l->id);
+
+	if (--l->routed == 0) {
+		close_lobby(ctx, l);
+	}
+}
+
+/**
+ * @brief Enters the sender, or the bot for ENTER BOT, in to the tournament and
+ * begins it once it is full. Runs on the I/O thread.
+ * 
+ * @param ctx The context playing the tournament.
+ * @param cmd The ENTER command.
+ * @param player The player who sent it.
+ * @return int -1 if the entrant may not enter. 0 otherwise.
+ */
+static int enter_tournament(Context *ctx, const Command *cmd, const Player *player) {
+	if (!ctx->tournament || !player->is_login || (cmd->is_bot && !ctx->bot)) {
+		return -1;
+	}
+
+	// Bots get a handle of their own so that two of them can share a lobby.
+	uint32_t entrant;
+	const int handle = cmd->is_bot ? BOT_FD + 1 + (int)tournament_entrants(ctx->tournament) : player->fd;
+	if ((!cmd->is_bot && tournament_find(ctx->tournament, handle, &entrant) == 0) ||
+		tournament_enter(ctx->tournament, handle) < 0) {
+		return -1;
+	}
+
+	LOG_DEBUG("[%s<%d>] entered %s\n", player->name, player->fd, cmd->is_bot ? "a bot" : "the tournament");
+
+	if (tournament_entrants(ctx->tournament) == ctx->tournament_size) {
+		if (tournament_begin(ctx->tournament) < 0) {
+			LOG_ERROR("failed to begin tournament\n");
+		} else {
+			printf("Tournament of %zu entrants begins\n", ctx->tournament_size);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Records the result of a running tournament game and stops sending its
+ * players to its lobby.
+ * 
+ * @param ctx The context playing the tournament.
+ * @param l The lobby of the game. Not touched if the game is not running.
+ * @param lobby_id The id of the lobby.
+ * @param winner The winner's index in the game's entrants. -1 if both lose.
+ */
+static void end_game(Context *ctx, Lobby *l, uint32_t lobby_id, int winner) {
+	const uint32_t id = lobby_id & ~TOURNAMENT_LOBBY_BIT;
+	TournamentGame game;
+	if (tournament_game(ctx->tournament, id, &game) < 0) {
+		return; // Already decided, such as by a player leaving.
+	}
+	tournament_finish(ctx->tournament, id, winner);
+
+	// Nobody but bots means nobody will release the lobby.
+	if (l->routed == 0) {
+		close_lobby(ctx, l);
+		return;
+	}
+
+	for (int i = 0; i < 2; i++) {
+		Player *player = ctx_get_player(ctx, tournament_handle(ctx->tournament, game.entrants[i]));
+		if (player && player->lobby == l) {
+			release_lobby(ctx, player);
+		}
+	}
+}
+
+/**
+ * @brief Records a result reported by report_result().
+ * 
+ */
+static void record_result(Context *ctx, const GameResult *result) {
+	TournamentGame game;
+	if (tournament_game(ctx->tournament, result->lobby_id & ~TOURNAMENT_LOBBY_BIT, &game) < 0) {
+		return;
+	}
+
+	const int winner = tournament_handle(ctx->tournament, game.entrants[0]) == result->winner_fd ? 0 : 1;
+	end_game(ctx, result->l, result->lobby_id, winner);
+}
+
+/**
+ * @brief Forfeits the tournament game of a player who leaves its lobby.
+ * 
+ */
+static void forfeit_game(Context *ctx, Player *player) {
+	Lobby *l = player->lobby;
+	TournamentGame game;
+	if (tournament_game(ctx->tournament, l->id & ~TOURNAMENT_LOBBY_BIT, &game) < 0) {
+		release_lobby(ctx, player);
+		return;
+	}
+
+	LOG_DEBUG("[%s<%d>] forfeited lobby %u\n", player->name, player->fd, l->id);
+
+	const int winner = tournament_handle(ctx->tournament, game.entrants[0]) == player->fd ? 1 : 0;
+	end_game(ctx, l, l->id, winner);
+}
+
+/**
+ * @brief Creates the lobby of a tournament game and sends its entrants to it.
+ * Entrants who are playing elsewhere lose the game without it being played.
+ * 
+ */
+static void start_game(Context *ctx, const TournamentGame *game) {
+	Player bots[2];
+	Player *players[2] = { NULL, NULL };
+	for (int i = 0; i < 2; i++) {
+		const int handle = tournament_handle(ctx->tournament, game->entrants[i]);
+		if (handle < 0) {
+			bots[i] = bot_player();
+			bots[i].fd = handle;
+			players[i] = &bots[i];
+			continue;
+		}
+
+		Player *player = ctx_get_player(ctx, handle);
+		if (ctx->matchmaker && player && matchmaker_cancel(ctx->matchmaker, handle) == 0) {
+			write_error(player, NULL); // Their JOIN.
+		}
+		if (player && !player->lobby) {
+			players[i] = player;
+		}
+	}
+
+	Lobby *l = NULL;
+	if (players[0] && players[1] && (l = create_lobby(ctx, TOURNAMENT_LOBBY_BIT | game->id)) == NULL) {
+		LOG_ERROR("failed to create lobby for tournament game\n");
+	}
+	if (!l) {
+		tournament_finish(ctx->tournament, game->id, players[0] ? (players[1] ? -1 : 0) : (players[1] ? 1 : -1));
+		return;
+	}
+
+	const size_t round = tournament_round(ctx->tournament) + 1;
+	for (int i = 0; i < 2; i++) {
+		if (players[i]->is_bot) {
+			Job job = { .type = JOB_SEAT, .ctx = ctx, .l = l, .player = *players[i], .round = round };
+			dispatch(ctx, &job, l->id);
+			continue;
+		}
+
+		// Without a matchmaker everyone not in a lobby of their own plays in
+		// the server lobby, where they may have a seat. It is given up so that
+		// nobody there waits on a player who is seated elsewhere.
+		if (!ctx->matchmaker) {
+			Job job = { .type = JOB_LEAVE, .ctx = ctx, .l = ctx->l, .player = *players[i] };
+			dispatch(ctx, &job, ctx->l->id);
+		}
+		send_to_lobby(ctx, l, players[i], false, round);
+	}
+}
+
+/**
+ * @brief Records finished tournament games and starts as many new ones as the
+ * tournament allows. Prints the standings once it is over.
+ * 
+ */
+static void run_tournament(Context *ctx, bool *is_reported) {
+	GameResult result;
+	if (ctx->resultbox) {
+		while (mailbox_get(ctx->resultbox, &result)) {
+			queue_put(ctx->resultq, &result);
+		}
+	}
+
+	while (!queue_isempty(ctx->resultq)) {
+		result = *(GameResult*)queue_get(ctx->resultq);
+		record_result(ctx, &result);
+	}
+
+	TournamentGame games[TOURNAMENT_BATCH];
+	size_t made;
+	while ((made = tournament_start_games(ctx->tournament, games, TOURNAMENT_BATCH)) > 0) {
+		for (size_t i = 0; i < made; i++) {
+			start_game(ctx, &games[i]);
+		}
+	}
+
+	if (tournament_is_over(ctx->tournament) && !*is_reported) {
+		TournamentStanding standings[TOURNAMENT_STANDINGS];
+		const size_t len = tournament_standings(ctx->tournament, standings, TOURNAMENT_STANDINGS);
+
+		printf("Tournament over after %zu rounds\n", tournament_round(ctx->tournament));
+		for (size_t i = 0; i < len; i++) {
+			const Player *player = ctx_get_player(ctx, standings[i].handle);
+			printf("%2zu. %-*s %u points, %u-%u, opponents %u\n", i + 1, PLAYER_NAME_SIZE,
+				standings[i].handle < 0 ? BOT_NAME : (player ? player->name : "(left)"),
+				standings[i].score, standings[i].wins, standings[i].losses, standings[i].opponents_score);
+		}
+		*is_reported = true;
+	}
+}
+
+/**
+ * @brief Pairs queued players in to new lobbies.
+ * 
+ */
+static void match(Context *ctx, uint64_t now) {
+	MatchmakerPair pairs[MATCH_BATCH];
+	size_t made;
+	do {
+		made = matchmaker_tick(ctx->matchmaker, now, pairs, MATCH_BATCH);
+		for (size_t i = 0; i < made; i++) {
+			Player *first = ctx_get_player(ctx, pairs[i].fds[0]);
+			Player *second = ctx_get_player(ctx, pairs[i].fds[1]);
+			if (first && second) {
+				start_match(ctx, first, second);
+			}
+		}
+	} while (made == MATCH_BATCH);
+}
+
+/**
+ * @brief Finds an open lobby by its id. Runs on the I/O thread.
+ * 
+ * @return Lobby* The lobby. NULL if no open lobby has the id.
+ */
+static Lobby *find_lobby(Context *ctx, uint32_t id) {
+	if (ctx->l->id == id) {
+		return ctx->l;
+	}
+
+	for (size_t i = 0; i < ctx->lobbies_len; i++) {
+		if (ctx->lobbies[i]->id == id) {
+			return ctx->lobbies[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Stops sending the player the lobby they watch. Runs on the I/O thread.
+ * 
+ * @return int -1 if the player watched no lobby. 0 otherwise.
+ */
+static int unwatch(Context *ctx, const Player *player) {
+	uint32_t id;
+	if (audience_unwatch(ctx->audience, player->fd, &id) < 0) {
+		return -1;
+	}
+
+	Lobby *l = find_lobby(ctx, id);
+	if (l) {
+		__atomic_sub_fetch(&l->watchers, 1, __ATOMIC_RELEASE);
+	}
+
+	LOG_DEBUG("[%s<%d>] stopped watching lobby %u\n", player->name, player->fd, id);
+	return 0;
+}
+
+/**
+ * @brief Starts sending the player a lobby, instead of the lobby they watched
+ * before if any. Runs on the I/O thread.
+ * 
+ * @return Lobby* The watched lobby. NULL if it is not open or an error occurred.
+ */
+static Lobby *watch(Context *ctx, const Command *cmd, const Player *player) {
+	Lobby *l = find_lobby(ctx, cmd->lobby);
+	if (!player->is_login || !l) {
+		return NULL;
+	}
+
+	unwatch(ctx, player);
+	if (audience_watch(ctx->audience, player->fd, l->id) < 0) {
+		return NULL;
+	}
+	__atomic_add_fetch(&l->watchers, 1, __ATOMIC_RELEASE);
+
+	LOG_DEBUG("[%s<%d>] watching lobby %u\n", player->name, player->fd, l->id);
+	return l;
+}
+
+/**
+ * @brief Returns the lobby whose chat the player talks in: the lobby they are
+ * sent to, or the server's lobby without matchmaking. NULL if there is none.
+ * 
+ */
+static const Lobby *chat_lobby(const Context *ctx, const Player *player) {
+	return player->lobby ? player->lobby : ctx->matchmaker ? NULL : ctx->l;
+}
+
+/**
+ * @brief Subscribes a logged in connection to what it hears without asking:
+ * the announcements and the chat of its lobby. Runs on the I/O thread.
+ * 
+ */
+static void subscribe_player(Context *ctx, const Player *player) {
+	if (!player->is_login) {
+		return;
+	}
+
+	// Fails for what it is subscribed to already, which is fine.
+	channels_subscribe(ctx->channels, player->fd, ANNOUNCE_TOPIC);
+	const Lobby *l = chat_lobby(ctx, player);
+	if (l) {
+		channels_subscribe(ctx->channels, player->fd, l->id);
+	}
+}
+
+/**
+ * @brief Returns whether the connection came in on the local socket. See -U.
+ * 
+ */
+static bool is_local(int fd) {
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof addr;
+	return getsockname(fd, (struct sockaddr*)&addr, &addrlen) == 0 && addr.ss_family == AF_UNIX;
+}
+
+/**
+ * @brief Runs SAY, ANNOUNCE, SUBSCRIBE and UNSUBSCRIBE. Runs on the I/O
+ * thread, which owns the channels. What is said is sent with the next flush.
+ * 
+ * @return int -1 if the player may not send the command or it failed. 0 otherwise.
+ */
+static int serve_channels(Context *ctx, const Command *cmd, const Player *player) {
+	if (cmd->type == COMMAND_SUBSCRIBE) {
+		return player->is_login && find_lobby(ctx, cmd->lobby) ? channels_subscribe(ctx->channels, player->fd, cmd->lobby) : -1;
+	} else if (cmd->type == COMMAND_UNSUBSCRIBE) {
+		return channels_unsubscribe(ctx->channels, player->fd, cmd->lobby);
+	}
+
+	// Only operators on the server's host may talk to everyone.
+	const bool is_announce = cmd->type == COMMAND_ANNOUNCE;
+	const Lobby *l = chat_lobby(ctx, player);
+	if (is_announce ? !is_local(player->fd) : !player->is_login || !l) {
+		return -1;
+	}
+
+	char buf[RESPONSE_SIZE];
+	const int len = is_announce ? snprintf(buf, sizeof buf, "GOTANNOUNCE %s\r\n", cmd->text) :
+		snprintf(buf, sizeof buf, "GOTSAY %s %s\r\n", player->name, cmd->text);
+	const uint64_t topic = is_announce ? ANNOUNCE_TOPIC : l->id;
+	if (len <= 0 || (size_t)len >= sizeof buf || channels_publish(ctx->channels, topic, buf, (size_t)len) < 0) {
+		return -1;
+	}
+
+	if (is_announce) {
+		printf("Announced to %zu connections: %s\n", channels_subscribers(ctx->channels, topic), cmd->text);
+	} else {
+		LOG_DEBUG("[%s<%d>] said in lobby %u\n", player->name, player->fd, l->id);
+	}
+	return 0;
+}
+
+/**
+ * @brief Keeps the seat of a player whose connection was lost for their
+ * session to be taken over, instead of disconnecting them. Runs on the I/O
+ * thread.
+ * 
+ * The connection stays open and among the players, so lobbies and the
+ * tournament carry on with it and whatever is sent to it is held. It is no
+ * longer read from. Spectating, chat and a place in the matchmaking queue
+ * are not kept.
+ * 
+ */
+static void detach(Context *ctx, Player *player) {
+	unwatch(ctx, player);
+	channels_remove(ctx->channels, player->fd);
+	if (ctx->matchmaker) {
+		matchmaker_cancel(ctx->matchmaker, player->fd);
+	}
+	ctx_unpoll(ctx, player->fd);
+
+	LOG_DEBUG("[%s<%d>] detached\n", player->name, player->fd);
+}
+
+/**
+ * @brief Hands the session named by a RESUME to the connection that sent it.
+ * Runs on the I/O thread.
+ * 
+ * What was held for the old connection is queued for the new one first. The new connection
+ * takes over the old one's place among the players and in the tournament,
+ * and the job is turned in to a JOB_RESUME, which moves the seat over.
+ * 
+ * @param ctx The context holding the sessions.
+ * @param job The RESUME. Turned in to a JOB_RESUME.
+ * @param player The player who sent the RESUME.
+ * @return Player* The player who took over. NULL if the token named no session.
+ */
+static Player *resume(Context *ctx, Job *job, Player *player) {
+	int old_fd;
+	const char *pending;
+	size_t pending_len;
+	if (!ctx->sessions || player->is_login ||
+		sessions_resume(ctx->sessions, job->cmd.token, player->fd, job->token, &old_fd, &pending, &pending_len) < 0) {
+		return NULL;
+	}
+
+	// Sessions are released when their players are removed, so this only
+	// finds nobody if that was missed.
+	Player *old = ctx_get_player(ctx, old_fd);
+	if (!old) {
+		LOG_ERROR("session of %d has no player\n", old_fd);
+		sessions_release(ctx->sessions, old_fd);
+		sessions_release(ctx->sessions, player->fd);
+		return NULL;
+	}
+	detach(ctx, old);
+	shutdown(old_fd, SHUT_RDWR); // In case the loss was not noticed.
+
+	// Queued like anything else sent to the new connection, so it neither
+	// blocks nor overtakes what was queued for the connection already.
+	for (size_t sent = 0; sent < pending_len; sent += MSG_MAX_SIZE) {
+		const size_t len = pending_len - sent < MSG_MAX_SIZE ? pending_len - sent : MSG_MAX_SIZE;
+		if (player->write(player, &pending[sent], len) < 0) {
+			LOG_ERROR("failed to queue held output for %d\n", player->fd);
+			break;
+		}
+	}
+
+	uint32_t entrant;
+	if (ctx->tournament && tournament_find(ctx->tournament, old_fd, &entrant) == 0 &&
+		tournament_set_handle(ctx->tournament, entrant, player->fd) < 0) {
+		LOG_ERROR("failed to move entrant %u to %d\n", entrant, player->fd);
+	}
+
+	const int fd = player->fd;
+	*player = *old;
+	player->fd = fd;
+	ctx_remove_player(ctx, old_fd);
+
+	player = ctx_get_player(ctx, fd); // Removing may have moved it.
+	subscribe_player(ctx, player);
+	job->type = JOB_RESUME;
+	job->player = *player;
+	job->old_fd = old_fd;
+
+	LOG_DEBUG("[%s<%d>] resumed from <%d>\n", player->name, player->fd, old_fd);
+	return player;
+}
+
+/**
+ * @brief Sends a job to the lobby the player is in. Runs on the I/O thread,
+ * which owns the matchmaker and the tournament and knows which lobby every
+ * connection is in.
+ * 
+ * With matchmaking a JOIN from a player outside of a lobby only queues them.
+ * They are replied to once seated. A player's jobs run in order while they
+ * stay in one lobby. The first reply from a new lobby may overtake replies
+ * still queued on the player's previous lobby, which can only be replies to
+ * the player's own commands outside of a lobby.
+ * 
+ * Leaving a tournament game forfeits it. Disconnecting withdraws from the
+ * tournament.
+ * 
+ * WATCH is sent to the watched lobby instead, which replies and sends the
+ * first snapshot. Everything after comes from the audience.
+ * 
+ * RESUME takes over the session first and is then sent on as the player who
+ * took it over.
+ * 
+ * SAY, ANNOUNCE, SUBSCRIBE and UNSUBSCRIBE are run here and sent on only to be
+ * replied to in order.
+ * 
+ * @param ctx The context holding the lobbies.
+ * @param job The job to send. Its lobby is filled in.
+ * @param player The player the job is for.
+ */
+static void route(Context *ctx, Job *job, Player *player) {
+	const bool is_message = job->type == JOB_MESSAGE;
+	const bool is_quitting = job->type == JOB_DISCONNECT ||
+		(is_message && job->cmd.type == COMMAND_NONE && job->pro.type == NOGO_PRO_LOGOUT);
+	const bool is_leaving = is_quitting || (is_message && job->cmd.type == COMMAND_NONE && job->pro.type == NOGO_PRO_LEAVE);
+
+	if (is_message && job->cmd.type == COMMAND_ENTER && enter_tournament(ctx, &job->cmd, player) < 0) {
+		job->cmd.type = COMMAND_NONE;
+		job->pro.type = NOGO_PRO_ERROR;
+	}
+
+	if (is_message && job->cmd.type == COMMAND_RESUME) {
+		Player *resumed = resume(ctx, job, player);
+		if (resumed) {
+			player = resumed;
+		} else {
+			job->cmd.type = COMMAND_NONE;
+			job->pro.type = NOGO_PRO_ERROR;
+		}
+	}
+
+	if (is_message && is_channel_command(&job->cmd) && serve_channels(ctx, &job->cmd, player) < 0) {
+		job->cmd.type = COMMAND_NONE;
+		job->pro.type = NOGO_PRO_ERROR;
+	}
+
+	if (is_message && job->cmd.type == COMMAND_WATCH) {
+		Lobby *watched = watch(ctx, &job->cmd, player);
+		if (watched) {
+			job->l = watched;
+			dispatch(ctx, job, watched->id);
+			return;
+		}
+		job->cmd.type = COMMAND_NONE;
+		job->pro.type = NOGO_PRO_ERROR;
+	} else if (is_message && job->cmd.type == COMMAND_UNWATCH && unwatch(ctx, player) < 0) {
+		job->cmd.type = COMMAND_NONE;
+		job->pro.type = NOGO_PRO_ERROR;
+	} else if (is_quitting) {
+		unwatch(ctx, player);
+		channels_remove(ctx->channels, player->fd);
+	}
+
+	if (ctx->matchmaker && is_message && !player->lobby) {
+		if (job->cmd.type == COMMAND_NONE && job->pro.type == NOGO_PRO_JOIN) {
+			if (matchmaker_enqueue(ctx->matchmaker, player->fd, player->rating, now_ms()) == 0) {
+				LOG_DEBUG("[%s<%d>] queued with rating %d\n", player->name, player->fd, player->rating);
+				return;
+			}
+			job->pro.type = NOGO_PRO_ERROR; // Already queued.
+		} else if (job->cmd.type == COMMAND_BOT && ctx->bot && matchmaker_cancel(ctx->matchmaker, player->fd) == 0) {
+			start_match(ctx, player, NULL);
+			return;
+		}
+	}
+
+	if (ctx->matchmaker && is_leaving) {
+		matchmaker_cancel(ctx->matchmaker, player->fd);
+	}
+
+	// Seats are only restored in the server lobby, which is where a RECLAIM
+	// goes even with a matchmaker.
+	if (player->lobby) {
+		job->l = player->lobby;
+		dispatch(ctx, job, player->lobby->id);
+	} else if (ctx->matchmaker && !(is_message && job->cmd.type == COMMAND_RECLAIM)) {
+		job->l = NULL;
+		dispatch(ctx, job, player->route);
+	} else {
+		job->l = ctx->l;
+		dispatch(ctx, job, ctx->l->id);
+	}
+
+	if (is_leaving && player->lobby) {
+		if (ctx->tournament && player->lobby->id & TOURNAMENT_LOBBY_BIT) {
+			forfeit_game(ctx, player);
+		} else {
+			release_lobby(ctx, player);
+		}
+	}
+
+	uint32_t entrant;
+	if (is_quitting && ctx->tournament && tournament_find(ctx->tournament, player->fd, &entrant) == 0) {
+		tournament_withdraw(ctx->tournament, entrant);
+	}
+}
+
+/**
+ * @brief Removes a connection's player and gives up its session, so a RESUME
+ * can't take over a player that is gone. Runs on the I/O thread.
+ * 
+ */
+static void remove_player(Context *ctx, int fd) {
+	if (ctx->sessions) {
+		sessions_release(ctx->sessions, fd);
+	}
+	ctx_remove_player(ctx, fd);
+}
+
+/**
+ * @brief Gives a connection's player the queues and functions the server
+ * talks to it with. Only connections are given a read function.
+ * 
+ */
+static void connect_player(Context *ctx, Player *player) {
+	player->msgq = ctx->msgq;
+	player->outbox = ctx->outbox;
+	player->write = player_write;
+	player->read = player_read;
+}
+
+/**
+ * @brief Serves a message read from a connection. Runs on the I/O thread.
+ * 
+ * @param ctx The context holding the player.
+ * @param player The connection's player. Removed if the message was LOGOUT.
+ * @param buf The message, null terminated.
+ * @param buf_len The length of the message.
+ */
+static void serve_message(Context *ctx, Player *player, const char *buf, size_t buf_len) {
+	const int sender_fd = player->fd;
+
+	Job job = { .type = JOB_MESSAGE, .ctx = ctx, .cmd = command_parse(buf, buf_len) };
+	if (job.cmd.type == COMMAND_NONE) {
+		job.pro = nogo_parse(buf, buf_len);
+		LOG_DEBUG("[%d] parse: %d '%s' '%s'\n", sender_fd, job.pro.type, job.pro.arg1, job.pro.arg2);
+	}
+	serve_connection(&job.cmd, &job.pro, player);
+
+	// Fails for a connection that already has a session, which leaves the
+	// token empty.
+	if (ctx->sessions && job.cmd.type == COMMAND_NONE && job.pro.type == NOGO_PRO_LOGIN) {
+		sessions_open(ctx->sessions, sender_fd, job.token);
+	}
+	if (job.cmd.type == COMMAND_NONE && job.pro.type == NOGO_PRO_LOGIN) {
+		subscribe_player(ctx, player);
+	}
+
+	job.player = *player;
+	route(ctx, &job, player);
+	if (job.cmd.type == COMMAND_NONE && job.pro.type == NOGO_PRO_LOGOUT) {
+		remove_player(ctx, sender_fd);
+	}
+}
+
+/**
+ * @brief Takes in a connection the router handed over and serves the message
+ * the router read from it. The router greeted it already. Runs on the I/O
+ * thread.
+ * 
+ * @param ctx The context to add the connection to.
+ * @param cluster The socket connected to the router.
+ * @return int -1 if the router went away. 0 otherwise.
+ */
+static int take_connection(Context *ctx, int cluster) {
+	ClusterMessage m;
+	if (cluster_recv(cluster, &m) < 0) {
+		return -1;
+	} else if (m.type != CLUSTER_CONN) {
+		return 0;
+	}
+
+	struct sockaddr_storage remoteaddr;
+	socklen_t addrlen = sizeof remoteaddr;
+	if (ctx->limiter && (getpeername(m.fd, (struct sockaddr*)&remoteaddr, &addrlen) < 0 ||
+		limiter_connect(ctx->limiter, m.fd, (struct sockaddr*)&remoteaddr, now_ms()) < 0)) {
+		LOG_DEBUG("refused connection on socket: %d\n", m.fd);
+		close(m.fd);
+		return 0;
+	}
+
+	// Sends to it must not block the I/O thread, like for those accepted here.
+	if (fcntl(m.fd, F_SETFL, O_NONBLOCK) == -1) {
+		perror("fcntl");
+		close(m.fd);
+		return 0;
+	}
+
+	Player new_player;
+	memset(&new_player, 0, sizeof new_player);
+
+	new_player.fd = m.fd;
+	new_player.rating = MATCHMAKER_RATING_START;
+	new_player.route = ctx->l->id;
+	connect_player(ctx, &new_player);
+
+	if (ctx_add_player(ctx, &new_player) < 0) {
+		LOG_ERROR("failed to add connection %d\n", m.fd);
+		close(m.fd);
+		return 0;
+	}
+	LOG_DEBUG("new connection from the router on socket: %d\n", m.fd);
+
+	if (m.data_len > 0) {
+		char buf[MSG_MAX_SIZE + 1];
+		memcpy(buf, m.data, m.data_len);
+		buf[m.data_len] = '\0';
+		serve_message(ctx, ctx_get_player(ctx, m.fd), buf, m.data_len);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Tells the router how many players and lobbies there are, so it can
+ * send new players to whichever worker has the fewest. Runs on the I/O thread.
+ * 
+ * @param ctx The context to report on.
+ * @param cluster The socket connected to the router.
+ * @param internal_len Players that are the server's own sockets, not connections.
+ * @return int -1 if the router went away. 0 otherwise.
+ */
+static int report_load(Context *ctx, int cluster, size_t internal_len) {
+	const ClusterMessage m = {
+		.type = CLUSTER_LOAD,
+		.players = (uint32_t)(ctx->players_len - internal_len),
+		.lobbies = (uint32_t)(ctx->lobbies_len + 1),
+	};
+	return cluster_send(cluster, &m);
+}
+
+/**
+ * @brief Disconnects the players whose sessions expired. Runs on the I/O
+ * thread.
+ * 
+ * @param ctx The context holding the sessions.
+ * @param now The current time in milliseconds. UINT64_MAX to disconnect every
+ * detached player.
+ */
+static void expire_sessions(Context *ctx, uint64_t now) {
+	int expired[SESSION_EXPIRE_BATCH];
+	size_t expired_len;
+	do {
+		expired_len = sessions_expire(ctx->sessions, now, expired, SESSION_EXPIRE_BATCH);
+		for (size_t i = 0; i < expired_len; i++) {
+			Player *player = ctx_get_player(ctx, expired[i]);
+			if (!player) {
+				continue; // Removed some other way already.
+			}
+			LOG_DEBUG("[%s<%d>] session expired\n", player->name, player->fd);
+
+			Job job = { .type = JOB_DISCONNECT, .ctx = ctx, .player = *player };
+			route(ctx, &job, player);
+			ctx_remove_player(ctx, expired[i]);
+		}
+	} while (expired_len == SESSION_EXPIRE_BATCH);
+}
+
+/**
+ * @brief Puts the lobbies that were sent no job for ctx->idle_ms to sleep,
+ * which frees their boards until the next job wakes them. Watched lobbies stay
+ * awake for their spectators. Runs on the I/O thread.
+ * 
+ * @param ctx The context holding the lobbies and the store.
+ * @param now The current time in milliseconds.
+ */
+static void sleep_idle(Context *ctx, uint64_t now) {
+	for (size_t i = 0; i <= ctx->lobbies_len; i++) {
+		Lobby *l = i < ctx->lobbies_len ? ctx->lobbies[i] : ctx->l;
+		if (!l->is_idle && l->routed_ms + ctx->idle_ms <= now && __atomic_load_n(&l->watchers, __ATOMIC_ACQUIRE) == 0) {
+			Job job = { .type = JOB_SLEEP, .ctx = ctx, .l = l };
+			dispatch(ctx, &job, l->id);
+			l->is_idle = true;
+		}
+	}
+}
+
+/**
+ * @brief Wakes every lobby that is asleep. Runs on the I/O thread once nothing
+ * is running on the workers.
+ * 
+ * @return int -1 if a lobby could not be woken. 0 otherwise.
+ */
+static int wake_all(Context *ctx) {
+	for (size_t i = 0; i <= ctx->lobbies_len; i++) {
+		Lobby *l = i < ctx->lobbies_len ? ctx->lobbies[i] : ctx->l;
+		if (lobby_is_asleep(l) && store_take(ctx->store, l) < 0) {
+			LOG_ERROR("failed to wake lobby %u\n", l->id);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Puts a handed over connection back in to the matchmaking queue and
+ * the audience it was in. Runs on the I/O thread.
+ * 
+ */
+static void requeue(Context *ctx, const HandoffConnection *c) {
+	if (c->is_queued && ctx->matchmaker && matchmaker_enqueue(ctx->matchmaker, c->player.fd, c->player.rating, now_ms()) < 0) {
+		LOG_ERROR("failed to queue handed over player\n");
+	}
+
+	Lobby *l = c->is_watching ? find_lobby(ctx, c->watched) : NULL;
+	if (l && audience_watch(ctx->audience, c->player.fd, l->id) == 0) {
+		__atomic_add_fetch(&l->watchers, 1, __ATOMIC_RELEASE);
+		publish(ctx, l, "", 0); // Watchers start out with a snapshot.
+	}
+}
+
+/**
+ * @brief Takes in the lobbies and connections an old server handed over.
+ * Runs on the I/O thread before anything is served.
+ * 
+ * @param ctx The context to add to. Its lobby is already the handed over one.
+ * @param h What was handed over. Cleared.
+ * @return int -1 if an error occurred. 0 otherwise.
+ */
+static int adopt(Context *ctx, Handoff *h) {
+	for (size_t i = 0; i < h->lobbies_len; i++) {
+		if (ctx_add_lobby(ctx, h->lobbies[i]) < 0) {
+			return -1;
+		}
+	}
+	h->lobbies_len = 0;
+
+	for (size_t i = 0; i <= ctx->lobbies_len; i++) {
+		Lobby *l = i < ctx->lobbies_len ? ctx->lobbies[i] : ctx->l;
+		for (int j = 0; j < l->players_len; j++) {
+			if (!l->players[j].is_bot && l->players[j].fd >= 0) {
+				connect_player(ctx, &l->players[j]);
+			}
+		}
+	}
+
+	if (h->next_lobby_id > ctx->next_lobby_id) {
+		ctx->next_lobby_id = h->next_lobby_id;
+	}
+
+	for (size_t i = 0; i < h->conns_len; i++) {
+		const HandoffConnection *c = &h->conns[i];
+		Player player = c->player;
+		connect_player(ctx, &player);
+		if (fcntl(player.fd, F_SETFL, O_NONBLOCK) == -1) {
+			perror("fcntl");
+		}
+		if (c->in_lobby && (player.lobby = find_lobby(ctx, c->lobby_id)) != NULL) {
+			player.lobby->routed++;
+		}
+
+		if (ctx_add_player(ctx, &player) < 0 ||
+			(c->pending_len > 0 && coalescer_add(ctx->coalescer, player.fd, c->pending, c->pending_len) < 0)) {
+			return -1;
+		}
+		subscribe_player(ctx, &player);
+		if (c->token[0] != '\0' && ctx->sessions && sessions_restore(ctx->sessions, c->token) < 0) {
+			LOG_ERROR("failed to restore session of [%s<%d>]\n", player.name, player.fd);
+		}
+		requeue(ctx, c);
+	}
+
+	handoff_clear(h);
+	return 0;
+}
+
+/**
+ * @brief Hands the listener, the connections and the lobbies to the new server
+ * connected to the upgrade socket. Runs on the I/O thread once nothing is
+ * running on the workers and everything queued was sent.
+ * 
+ * Output still waiting for a connection, like a spectator's frame it only took
+ * part of, is handed over with it. Connections that were dropped are shut down
+ * first, so the new server closes them like any other connection. If anything
+ * goes wrong the server carries on as before.
+ * 
+ * @param ctx The context to hand over.
+ * @param listener The listener.
+ * @param sock The socket of the new server. Closed.
+ * @return int -1 if the handoff failed. 0 otherwise, after which the server
+ * should exit without touching any connection.
+ */
+static int hand_off(Context *ctx, int listener, int sock) {
+	HandoffConnection *conns = malloc(sizeof *conns * (ctx->players_len > 0 ? ctx->players_len : 1));
+	if (!conns) {
+		close(sock);
+		return -1;
+	}
+
+	size_t conns_len = 0;
+	int result = 0;
+	for (size_t i = 0; i < ctx->players_len && result == 0; i++) {
+		const Player *player = &ctx->players[i];
+		if (!player->read) {
+			continue;
+		}
+
+		HandoffConnection *c = &conns[conns_len++];
+		memset(c, 0, sizeof *c);
+		size_t pending_len;
+		const char *pending = coalescer_pending(ctx->coalescer, player->fd, &pending_len);
+		if (pending && (c->pending = malloc(pending_len)) == NULL) {
+			result = -1;
+		} else if (pending) {
+			memcpy(c->pending, pending, pending_len);
+			c->pending_len = pending_len;
+		} else if (coalescer_is_pending(ctx->coalescer, player->fd)) {
+			shutdown(player->fd, SHUT_RDWR);
+		}
+
+		c->player = *player;
+		c->in_lobby = player->lobby != NULL;
+		c->lobby_id = player->lobby ? player->lobby->id : 0;
+		c->is_queued = ctx->matchmaker && matchmaker_cancel(ctx->matchmaker, player->fd) == 0;
+		c->is_watching = audience_unwatch(ctx->audience, player->fd, &c->watched) == 0;
+		Lobby *watched = c->is_watching ? find_lobby(ctx, c->watched) : NULL;
+		if (watched) {
+			__atomic_sub_fetch(&watched->watchers, 1, __ATOMIC_RELEASE);
+		}
+		if (ctx->sessions) {
+			sessions_token(ctx->sessions, player->fd, c->token);
+		}
+	}
+
+	const Handoff h = {
+		.listener = listener,
+		.next_lobby_id = ctx->next_lobby_id,
+		.l = ctx->l,
+		.lobbies = ctx->lobbies,
+		.lobbies_len = ctx->lobbies_len,
+		.conns = conns,
+		.conns_len = conns_len,
+	};
+	if (result == 0) {
+		result = handoff_send(sock, &h);
+	}
+	close(sock);
+
+	if (result < 0) {
+		LOG_ERROR("failed to hand over to the new server\n");
+		for (size_t i = 0; i < conns_len; i++) {
+			requeue(ctx, &conns[i]);
+		}
+	} else {
+		printf("Handed over %zu connections\n", conns_len);
+	}
+
+	for (size_t i = 0; i < conns_len; i++) {
+		free(conns[i].pending);
+	}
+	free(conns);
+	return result;
+}
+
+static void usage(void) {
+	printf("usage: nogos [-a archive_dir] [-b bot_budget_ms] [-c cluster_socket] [-g grace_ms] [-i idle_ms] [-j journal]\n"
+		"             [-l backlog] [-m match_tick_ms] [-r rate:burst:ip_rate:ip_burst] [-s store_dir] [-t solver_table]\n"
+		"             [-T rr|swiss:entrants:parallel[:rounds]] [-u upgrade_socket] [-U local_socket] [-w workers] port\n");
+}
+
+/**
+ * @brief Rebuilds the server lobby from the journal and opens the journal for
+ * appending. If there is nothing to recover a new lobby is created.
+ * 
+ * @param ctx The context to recover in to.
+ * @param path The file the journal is stored in.
+ * @return int -1 on error. 0 otherwise.
+ */
+static int recover(Context *ctx, const char *path) {
+	Lobby **lobbies;
+	size_t lobbies_len;
+	if (journal_recover(path, &lobbies, &lobbies_len) < 0) {
+		LOG_ERROR("failed to recover journal %s\n", path);
+		return -1;
+	}
+
+	for (size_t i = 0; i < lobbies_len; i++) {
+		if (!ctx->l && lobbies[i]->id == 0) {
+			ctx->l = lobbies[i];
+			printf("Recovered lobby with %d players\n", ctx->l->players_len);
+		} else {
+			lobby_free(lobbies[i]);
+		}
+	}
+	free(lobbies);
+
+	if ((ctx->journal = journal_open(path)) == NULL) {
+		return -1;
+	}
+
+	if (!ctx->l) {
+		ctx->l = lobby_create(9, 9);
+		if (journal_create(ctx->journal, ctx->l) < 0 || journal_flush(ctx->journal) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Accepts the connections waiting on the listener, up to ACCEPT_BATCH.
+ * Whatever is left is accepted on the next iteration. Runs on the I/O thread.
+ * 
+ * Connections are made non-blocking, and what a send leaves behind is kept in
+ * the coalescer until the connection takes it. Connections the limiter turns
+ * away are closed right away.
+ * 
+ * @param ctx The context to add the connections to.
+ * @param listener The TCP or the local listener. Should not block.
+ * @return size_t The number of connections accepted, not counting the ones
+ * turned away.
+ */
+static size_t accept_connections(Context *ctx, int listener) {
+	size_t result = 0;
+
+	for (size_t accepts = 0; accepts < ACCEPT_BATCH; accepts++) {
+		struct sockaddr_storage remoteaddr;
+		socklen_t addrlen = sizeof remoteaddr;
+
+		const int newfd = accept4(listener, (struct sockaddr*)&remoteaddr, &addrlen, SOCK_CLOEXEC | SOCK_NONBLOCK);
+		if (newfd == -1) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			} else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				perror("accept");
+			}
+			break;
+		}
+
+		// Turned away before anything is spent on them, not even the OK.
+		if (ctx->limiter && limiter_connect(ctx->limiter, newfd, (struct sockaddr*)&remoteaddr, now_ms()) < 0) {
+			LOG_DEBUG("refused connection on socket: %d\n", newfd);
+			close(newfd);
+			continue;
+		}
+
+		// Replies go out in one send per iteration, so waiting for more to
+		// send would only add latency.
+		const bool is_local = remoteaddr.ss_family == AF_UNIX;
+		if (!is_local) {
+			const int yes = 1;
+			setsockopt(newfd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof yes);
+		}
+
+		Player new_player;
+		memset(&new_player, 0, sizeof new_player);
+
+		new_player.fd = newfd;
+		new_player.rating = MATCHMAKER_RATING_START;
+		new_player.route = ctx->l->id;
+		connect_player(ctx, &new_player);
 
+		if (ctx_add_player(ctx, &new_player) < 0) {
+			LOG_ERROR("failed to add connection %d\n", newfd);
+			close(newfd);
+			continue;
+		}
+		result++;
+
+		write_ok(&new_player);
+
+		if (is_local) {
+			LOG_DEBUG("new local connection on socket: %d\n", newfd);
+			continue;
+		}
+
+		char remote_ip[INET6_ADDRSTRLEN];
+		LOG_DEBUG("new connection: %s %d on socket: %d\n",
+			inet_ntop(remoteaddr.ss_family, get_in_addr(&remoteaddr),
+			remote_ip,
+			INET6_ADDRSTRLEN),
+			newfd,
+			newfd);
+	}
+
+	return result;
+}
+
+/**
+ * @brief Binds a socket to the given port.
+ * 
+ * @return int The bound socket. -1 if an error occurred.
+ */
+static int bind_to(const char *port) {
 	struct addrinfo hints;
 	memset(&hints, 0, sizeof hints);
 	hints.ai_family = AF_UNSPEC;
@@ -237,9 +2095,9 @@ int main(int argc, char **argv) {
 
 	int status;
 	struct addrinfo *servinfo;
-	if ((status = getaddrinfo(NULL, argv[1], &hints, &servinfo)) != 0) {
+	if ((status = getaddrinfo(NULL, port, &hints, &servinfo)) != 0) {
 		LOG_ERROR("getaddrinfo error: %s\n", gai_strerror(status));
-		exit(71);
+		return -1;
 	}
 
 	int listener = -1;
@@ -252,7 +2110,7 @@ int main(int argc, char **argv) {
 		int yes = 1;
 		if (setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes)) {
 			perror("setsockopt");
-			exit(71);
+			return -1;
 		}
 
 		if (bind(listener, p->ai_addr, p->ai_addrlen) == -1) {
@@ -265,13 +2123,191 @@ int main(int argc, char **argv) {
 	}
 
 	freeaddrinfo(servinfo);
+	return listener;
+}
+
+/**
+ * @brief Binds a UNIX socket to the given path, replacing whatever was left
+ * there.
+ * 
+ * @return int The bound socket. -1 if an error occurred.
+ */
+static int bind_local(const char *path) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof addr.sun_path) {
+		LOG_ERROR("local socket path too long: %s\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listener == -1) {
+		perror("server: socket");
+		return -1;
+	}
+
+	unlink(path);
+	if (bind(listener, (struct sockaddr *)&addr, sizeof addr) == -1) {
+		perror("server: bind");
+		close(listener);
+		return -1;
+	}
 
-	if (listen(listener, BACKLOG) == -1) {
+	return listener;
+}
+
+int main(int argc, char **argv) {
+	const char *archive_dir = NULL;
+	const char *cluster_path = NULL;
+	const char *store_dir = NULL;
+	const char *journal_path = NULL;
+	const char *table_path = NULL;
+	const char *upgrade_path = NULL;
+	const char *local_path = NULL;
+	long workers = 0;
+	long bot_budget_ms = 0;
+	long match_tick_ms = 0;
+	long grace_ms = 0;
+	long backlog = BACKLOG;
+	long idle_ms = IDLE_MS;
+	LimiterConfig limiter_config = { 0 };
+	TournamentConfig tournament_config = { .format = TOURNAMENT_SWISS };
+	size_t tournament_size = 0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "a:b:c:g:i:j:l:m:r:s:t:T:u:U:w:")) != -1) {
+		switch (opt) {
+		case 'a':
+			archive_dir = optarg;
+			break;
+		case 'b':
+			bot_budget_ms = strtol(optarg, NULL, 10);
+			break;
+		case 'c':
+			cluster_path = optarg;
+			break;
+		case 'g':
+			grace_ms = strtol(optarg, NULL, 10);
+			break;
+		case 'i':
+			idle_ms = strtol(optarg, NULL, 10);
+			if (idle_ms <= 0) {
+				usage();
+				exit(64);
+			}
+			break;
+		case 'j':
+			journal_path = optarg;
+			break;
+		case 'l':
+			backlog = strtol(optarg, NULL, 10);
+			if (backlog <= 0 || backlog > INT_MAX) {
+				usage();
+				exit(64);
+			}
+			break;
+		case 'm':
+			match_tick_ms = strtol(optarg, NULL, 10);
+			break;
+		case 'r': {
+			unsigned long long limits[4];
+			if (sscanf(optarg, "%llu:%llu:%llu:%llu", &limits[0], &limits[1], &limits[2], &limits[3]) != 4 ||
+				limits[0] == 0 || limits[1] == 0 || limits[2] == 0 || limits[3] == 0) {
+				usage();
+				exit(64);
+			}
+			limiter_config = (LimiterConfig){ .rate = limits[0], .burst = limits[1], .ip_rate = limits[2], .ip_burst = limits[3] };
+			break;
+		}
+		case 's':
+			store_dir = optarg;
+			break;
+		case 't':
+			table_path = optarg;
+			break;
+		case 'T': {
+			char format[8];
+			if (sscanf(optarg, "%7[a-z]:%zu:%zu:%zu", format, &tournament_size, &tournament_config.parallel,
+				&tournament_config.rounds) < 3 || (strcmp(format, "rr") != 0 && strcmp(format, "swiss") != 0) ||
+				tournament_size < 2 || tournament_config.parallel == 0) {
+				usage();
+				exit(64);
+			}
+			tournament_config.format = strcmp(format, "rr") == 0 ? TOURNAMENT_ROUND_ROBIN : TOURNAMENT_SWISS;
+			break;
+		}
+		case 'u':
+			upgrade_path = optarg;
+			break;
+		case 'U':
+			local_path = optarg;
+			break;
+		case 'w':
+			workers = strtol(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+			exit(64);
+		}
+	}
+
+	// A server taking over would be a new node, which the tokens issued by
+	// the old one do not name.
+	if (optind >= argc || (cluster_path && upgrade_path)) {
+		usage();
+		exit(64);
+	}
+
+	const char *port = argv[optind];
+
+	// A bot's search takes its whole budget and so can solving a position for
+	// ANALYZE, which the event loop can't wait for. Both only ever run on a
+	// worker.
+	if ((bot_budget_ms > 0 || table_path) && workers <= 0) {
+		workers = 1;
+		printf("Searches run on a worker, starting 1\n");
+	}
+
+	// A peer can go away while messages for it are still queued. send(2)
+	// reports that as EPIPE instead of killing the server.
+	signal(SIGPIPE, SIG_IGN);
+
+	// Take over from the server running at the upgrade socket, if any. The
+	// connections it hands over keep their numbers, so this comes before
+	// anything else is opened.
+	Handoff handoff = { .listener = -1 };
+	if (upgrade_path) {
+		const int sock = handoff_connect(upgrade_path);
+		if (sock >= 0) {
+			if (handoff_recv(sock, &handoff) < 0) {
+				LOG_ERROR("failed to take over from %s\n", upgrade_path);
+				exit(71);
+			}
+			printf("Took over %zu connections\n", handoff.conns_len);
+		}
+	}
+
+	// Listening again applies the backlog to a listener that was handed over.
+	// Connections are accepted until there are none left, so it can't block.
+	const int listener = handoff.listener >= 0 ? handoff.listener : bind_to(port);
+	if (listener < 0 || listen(listener, (int)backlog) == -1 || fcntl(listener, F_SETFL, O_NONBLOCK) == -1) {
 		perror("server: listen");
 		exit(71);
 	}
 
-	printf("Listening on %s\n", argv[1]);
+	printf("Listening on %s\n", port);
+
+	// Clients on the same host, such as a gateway, skip the TCP stack. The
+	// connections are served like any other. A server taking over binds the
+	// path again rather than being handed the listener.
+	const int local_listener = local_path ? bind_local(local_path) : -1;
+	if (local_path) {
+		if (local_listener < 0 || listen(local_listener, (int)backlog) == -1 || fcntl(local_listener, F_SETFL, O_NONBLOCK) == -1) {
+			perror("server: listen");
+			exit(71);
+		}
+		printf("Listening on %s\n", local_path);
+	}
 
 	Queue *msgq = queue_create(sizeof(Message));
 	Queue *closeq = queue_create(sizeof(int));
@@ -279,22 +2315,225 @@ int main(int argc, char **argv) {
 	if (ctx) {
 		ctx->msgq = msgq;
 		ctx->closeq = closeq;
-		ctx->l = lobby_create(9, 9);
+		ctx->coalescer = coalescer_create(OUTPUT_DROP_MS);
+
+		if (archive_dir && (ctx->archive = archive_open(archive_dir)) == NULL) {
+			LOG_ERROR("failed to open archive %s\n", archive_dir);
+			exit(74);
+		}
+
+		if (bot_budget_ms > 0) {
+			const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+			if ((ctx->bot = bot_create(cpus > 0 ? (size_t)cpus : 1, bot_budget_ms)) == NULL) {
+				LOG_ERROR("failed to create bot\n");
+				exit(71);
+			}
+		}
+
+		if (table_path) {
+			const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+			if ((ctx->solver = solver_create(cpus > 0 ? (size_t)cpus : 1, SOLVER_TABLE_BITS)) == NULL) {
+				LOG_ERROR("failed to create solver\n");
+				exit(71);
+			}
+
+			if (access(table_path, F_OK) == 0 && solver_load(ctx->solver, table_path) < 0) {
+				LOG_ERROR("failed to load solver table %s\n", table_path);
+			}
+		}
+
+		if (handoff.l) {
+			// The old server journaled everything that was handed over.
+			ctx->l = handoff.l;
+			if (journal_path && (ctx->journal = journal_open(journal_path)) == NULL) {
+				exit(74);
+			}
+		} else if (journal_path && recover(ctx, journal_path) < 0) {
+			exit(74);
+		} else if (!ctx->l) {
+			ctx->l = lobby_create(9, 9);
+		}
+
+		if (match_tick_ms > 0) {
+			const MatchmakerConfig config = {
+				.window_base = MATCH_WINDOW_BASE,
+				.window_per_sec = MATCH_WINDOW_PER_SEC,
+				.window_max = MATCH_WINDOW_MAX,
+			};
+			if ((ctx->matchmaker = matchmaker_create(&config)) == NULL) {
+				LOG_ERROR("failed to create matchmaker\n");
+				exit(71);
+			}
+			ctx->next_lobby_id = ctx->l->id + 1;
+		}
+
+		if (tournament_size > 0) {
+			tournament_config.seed = (uint64_t)time(NULL);
+			ctx->tournament = tournament_create(&tournament_config);
+			ctx->tournament_size = tournament_size;
+			ctx->resultq = queue_create(sizeof(GameResult));
+			if (!ctx->tournament || !ctx->resultq) {
+				LOG_ERROR("failed to create tournament\n");
+				exit(71);
+			}
+		}
+
+		if (workers > 0) {
+			ctx->executor = executor_create((size_t)workers);
+			ctx->outbox = mailbox_create(sizeof(Message));
+			ctx->closebox = mailbox_create(sizeof(int));
+			if (ctx->tournament) {
+				ctx->resultbox = mailbox_create(sizeof(GameResult));
+			}
+			if (ctx->bot) {
+				ctx->botbox = mailbox_create(sizeof(uint32_t));
+			}
+			if (!ctx->executor || !ctx->outbox || !ctx->closebox || (ctx->tournament && !ctx->resultbox) ||
+				(ctx->bot && !ctx->botbox)) {
+				LOG_ERROR("failed to start workers\n");
+				exit(71);
+			}
+		}
+	}
+
+	if (ctx) {
+		ctx->audience = audience_create();
+		ctx->frameq = queue_create(sizeof(AudienceFrame));
+		if (ctx->executor) {
+			ctx->framebox = mailbox_create(sizeof(AudienceFrame));
+		}
+		if (!ctx->audience || !ctx->frameq || (ctx->executor && !ctx->framebox)) {
+			LOG_ERROR("failed to create audience\n");
+			exit(71);
+		}
+
+		if ((ctx->channels = channels_create(CHANNELS_FLUSH_SENDS)) == NULL) {
+			LOG_ERROR("failed to create channels\n");
+			exit(71);
+		}
+
+		if (grace_ms > 0 && (ctx->sessions = sessions_create((uint64_t)grace_ms)) == NULL) {
+			LOG_ERROR("failed to create sessions\n");
+			exit(71);
+		}
+
+		if (limiter_config.rate > 0 && (ctx->limiter = limiter_create(&limiter_config)) == NULL) {
+			LOG_ERROR("failed to create limiter\n");
+			exit(71);
+		}
+
+		if (store_dir && (ctx->store = store_open(store_dir)) == NULL) {
+			LOG_ERROR("failed to open store in %s\n", store_dir);
+			exit(74);
+		}
+		ctx->idle_ms = (uint64_t)idle_ms;
 	}
 
-	if (!msgq || !closeq || !ctx || !ctx->l) {
+	if (!msgq || !closeq || !ctx || !ctx->coalescer || !ctx->l) {
 		LOG_ERROR("failed to instantiate structs\n");
 		exit(71);
 	}
 
-	if (ctx_add_player(ctx, &(Player){ .fd = listener, .name = "HOST" }) < 0) {
+	// Room for a full backlog, so a storm of connections does not grow the
+	// players one reallocation at a time.
+	if (ctx_reserve(ctx, (size_t)backlog) < 0 || ctx_add_player(ctx, &(Player){ .fd = listener, .name = "HOST" }) < 0) {
 		LOG_ERROR("failed to add listener\n");
 		exit(70);
 	}
+	if (local_listener >= 0 && ctx_add_player(ctx, &(Player){ .fd = local_listener, .name = "LOCAL" }) < 0) {
+		LOG_ERROR("failed to add local listener\n");
+		exit(70);
+	}
+
+	// Polled so the loop wakes up when the workers have something to send or close.
+	if (ctx->executor && (ctx_add_player(ctx, &(Player){ .fd = mailbox_fd(ctx->outbox), .name = "OUTBOX" }) < 0 ||
+		ctx_add_player(ctx, &(Player){ .fd = mailbox_fd(ctx->closebox), .name = "CLOSEBOX" }) < 0)) {
+		LOG_ERROR("failed to add worker mailboxes\n");
+		exit(70);
+	}
+
+	// Spectators are sent frames from the workers without anything else to wake up for.
+	if (ctx->framebox && ctx_add_player(ctx, &(Player){ .fd = mailbox_fd(ctx->framebox), .name = "FRAMEBOX" }) < 0) {
+		LOG_ERROR("failed to add frame mailbox\n");
+		exit(70);
+	}
+
+	// Games between bots finish without anything else to wake up for.
+	if (ctx->resultbox && ctx_add_player(ctx, &(Player){ .fd = mailbox_fd(ctx->resultbox), .name = "RESULTBOX" }) < 0) {
+		LOG_ERROR("failed to add result mailbox\n");
+		exit(70);
+	}
+
+	// Nor does a game between bots between its moves.
+	if (ctx->botbox && ctx_add_player(ctx, &(Player){ .fd = mailbox_fd(ctx->botbox), .name = "BOTBOX" }) < 0) {
+		LOG_ERROR("failed to add bot mailbox\n");
+		exit(70);
+	}
+
+	if (handoff.l && adopt(ctx, &handoff) < 0) {
+		LOG_ERROR("failed to take in handed over connections\n");
+		exit(71);
+	}
+
+	// New servers connect here to take over. See handoff.h.
+	const int upgrade = upgrade_path ? handoff_listen(upgrade_path) : -1;
+	if (upgrade_path && (upgrade < 0 || ctx_add_player(ctx, &(Player){ .fd = upgrade, .name = "UPGRADE" }) < 0)) {
+		LOG_ERROR("failed to listen on %s\n", upgrade_path);
+		exit(71);
+	}
+	int upgrade_peer = -1; // The new server being handed over to.
+	bool is_handed_over = false;
+
+	// Join the router as a worker. Connections are handed over from it from
+	// then on, next to the ones accepted on the listener. See cluster.h.
+	int cluster = -1;
+	size_t internal_len = ctx->players_len; // The sockets above. Not counted as load.
+	if (cluster_path) {
+		ClusterMessage welcome;
+		if ((cluster = cluster_connect(cluster_path)) < 0 || cluster_recv(cluster, &welcome) < 0 || welcome.type != CLUSTER_WELCOME ||
+			ctx_add_player(ctx, &(Player){ .fd = cluster, .name = "CLUSTER" }) < 0 || report_load(ctx, cluster, ++internal_len) < 0) {
+			LOG_ERROR("failed to join the router at %s\n", cluster_path);
+			exit(71);
+		}
+		if (ctx->sessions) {
+			sessions_set_node(ctx->sessions, welcome.node);
+		}
+		printf("Joined the router as worker %u\n", welcome.node);
+	}
+
+	uint64_t next_match_ms = now_ms();
+	uint64_t next_stats_ms = next_match_ms + MATCH_STATS_MS;
+	unsigned long stats_matched = 0;
+	bool is_tournament_reported = false;
+	uint64_t next_session_check_ms = next_match_ms;
+	uint64_t next_idle_check_ms = next_match_ms + IDLE_CHECK_MS;
+	uint64_t next_report_ms = next_match_ms + CLUSTER_REPORT_MS;
 
 	for (;;) {
+		// Only wake up for the matchmaker while someone is waiting.
+		int timeout = -1;
+		if (ctx->matchmaker && matchmaker_queued(ctx->matchmaker) > 0) {
+			const uint64_t now = now_ms();
+			timeout = next_match_ms > now ? (int)(next_match_ms - now) : 0;
+		}
+		if (coalescer_is_behind(ctx->coalescer) && (timeout < 0 || timeout > OUTPUT_RETRY_MS)) {
+			timeout = OUTPUT_RETRY_MS;
+		}
+		if (channels_is_busy(ctx->channels)) {
+			timeout = 0; // Only polls for what came in meanwhile.
+		}
+		if (ctx->sessions && sessions_detached(ctx->sessions) > 0 && (timeout < 0 || timeout > SESSION_CHECK_MS)) {
+			timeout = SESSION_CHECK_MS;
+		}
+		if (ctx->store && (timeout < 0 || timeout > IDLE_CHECK_MS)) {
+			timeout = IDLE_CHECK_MS;
+		}
+		if (cluster >= 0 && (timeout < 0 || timeout > CLUSTER_REPORT_MS)) {
+			timeout = CLUSTER_REPORT_MS;
+		}
+
 		int poll_checked = 0;  // Number of current poll events handled.
-		int poll_len = poll(ctx->pfds, ctx->pfds_len, -1);
+		int poll_len = poll(ctx->pfds, ctx->pfds_len, timeout);
 		if (poll_len == -1) {
 			perror("poll");
 			break;
@@ -304,34 +2543,32 @@ int main(int argc, char **argv) {
 			if (ctx->pfds[i].revents & POLLIN) {
 				poll_checked++;
 
-				if (ctx->pfds[i].fd == listener) {
-					struct sockaddr_storage remoteaddr;
-					socklen_t addrlen = sizeof remoteaddr;
-
-					int newfd = accept(listener, (struct sockaddr*)&remoteaddr, &addrlen);
-					
-					if (newfd == -1) {
+				if (ctx->executor && (ctx->pfds[i].fd == mailbox_fd(ctx->outbox) || ctx->pfds[i].fd == mailbox_fd(ctx->closebox) ||
+					ctx->pfds[i].fd == mailbox_fd(ctx->framebox) ||
+					(ctx->resultbox && ctx->pfds[i].fd == mailbox_fd(ctx->resultbox)) ||
+					(ctx->botbox && ctx->pfds[i].fd == mailbox_fd(ctx->botbox)))) {
+					continue; // Emptied after every iteration below.
+				} else if (ctx->pfds[i].fd == upgrade) {
+					const int peer = accept(upgrade, NULL, NULL);
+					if (peer == -1) {
 						perror("accept");
+					} else if (ctx->tournament || upgrade_peer >= 0) {
+						LOG_ERROR("refusing to hand over %s\n", ctx->tournament ? "a tournament" : "twice");
+						close(peer);
 					} else {
-						Player new_player;
-						memset(&new_player, 0, sizeof new_player);
-
-	  					new_player.msgq = ctx->msgq;
-						new_player.fd = newfd;
-						new_player.write = player_write;
-						new_player.read = player_read;
-
-						ctx_add_player(ctx, &new_player);
-
-						write_ok(&new_player);
-
-						char remote_ip[INET6_ADDRSTRLEN];
-						LOG_DEBUG("new connection: %s %d on socket: %d\n",
-							inet_ntop(remoteaddr.ss_family, get_in_addr(&remoteaddr),
-							remote_ip,
-							INET6_ADDRSTRLEN),
-							newfd,
-							newfd);
+						printf("Handing over to a new server\n");
+						upgrade_peer = peer;
+					}
+				} else if (ctx->pfds[i].fd == listener || ctx->pfds[i].fd == local_listener) {
+					accept_connections(ctx, ctx->pfds[i].fd);
+				} else if (ctx->pfds[i].fd == cluster) {
+					// Without the router the connections already here are
+					// still served, and new ones can come in on the listener.
+					if (take_connection(ctx, cluster) < 0) {
+						LOG_ERROR("lost the router\n");
+						ctx_remove_player(ctx, cluster);
+						close(cluster);
+						cluster = -1;
 					}
 				} else {
 					int sender_fd = ctx->pfds[i].fd;
@@ -344,51 +2581,285 @@ int main(int argc, char **argv) {
 					char buf[MSG_MAX_SIZE + 1];
 					long buf_len = player->read(player, buf, MSG_MAX_SIZE);
 					
-					if (buf_len <= 0) {
+					if (buf_len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+						continue; // Nothing to read after all.
+					} else if (buf_len <= 0) {
 						if (buf_len == 0) {
 							printf("socket closed: %d\n", sender_fd);
 						} else {
 							perror("recv");
 						}
 
-						lobby_leave(ctx->l, ctx_get_player(ctx, sender_fd));
-						ctx_remove_player(ctx, sender_fd);
-						close(sender_fd);
+						if (ctx->sessions && sessions_detach(ctx->sessions, sender_fd, now_ms()) == 0) {
+							detach(ctx, player);
+						} else {
+							Job job = { .type = JOB_DISCONNECT, .ctx = ctx, .player = *player };
+							route(ctx, &job, player);
+							remove_player(ctx, sender_fd);
+						}
+					} else if (ctx->limiter && !limiter_allow(ctx->limiter, sender_fd, now_ms())) {
+						// Dropped before parsing and unanswered, as an error
+						// would cost the send the limit is there to save.
+						LOG_DEBUG("[%d] rate limited\n", sender_fd);
 					} else {
 						buf[buf_len] = '\0';
-						NogoProtocol pro = nogo_parse(buf, (size_t)buf_len);
-						LOG_DEBUG("[%d] parse: %d '%s' '%s'\n", sender_fd, pro.type, pro.arg1, pro.arg2);
-						serve(ctx, &pro, player);
+						serve_message(ctx, player, buf, (size_t)buf_len);
 					}
 				}
 			}
 		}
 
-		// Send all messages in queue.
+		if (ctx->matchmaker) {
+			const uint64_t now = now_ms();
+			if (now >= next_match_ms) {
+				match(ctx, now);
+				next_match_ms = now + (uint64_t)match_tick_ms;
+			}
+
+			if (now >= next_stats_ms) {
+				MatchmakerStats stats;
+				matchmaker_stats(ctx->matchmaker, &stats);
+				if (stats.matched != stats_matched) {
+					printf("Matchmaking: %lu matched, %zu queued, wait avg %llu ms p50 %llu ms p99 %llu ms max %llu ms\n",
+						stats.matched, stats.queued, (unsigned long long)stats.wait_avg_ms, (unsigned long long)stats.wait_p50_ms,
+						(unsigned long long)stats.wait_p99_ms, (unsigned long long)stats.wait_max_ms);
+					stats_matched = stats.matched;
+				}
+				next_stats_ms = now + MATCH_STATS_MS;
+			}
+		}
+
+		if (cluster >= 0 && now_ms() >= next_report_ms) {
+			if (report_load(ctx, cluster, internal_len) < 0) {
+				perror("cluster: report");
+			}
+			next_report_ms = now_ms() + CLUSTER_REPORT_MS;
+		}
+
+		if (ctx->store && upgrade_peer < 0 && now_ms() >= next_idle_check_ms) {
+			sleep_idle(ctx, now_ms());
+			next_idle_check_ms = now_ms() + IDLE_CHECK_MS;
+		}
+
+		// Before handing over, finish everything in flight so that it is sent
+		// below. Players who lost their connection are not handed over. The
+		// new server has a store of its own, so no lobby goes over asleep.
+		if (upgrade_peer >= 0) {
+			if (ctx->sessions) {
+				expire_sessions(ctx, UINT64_MAX);
+			}
+			if (ctx->executor) {
+				executor_wait(ctx->executor);
+			}
+			if (ctx->store && wake_all(ctx) < 0) {
+				LOG_ERROR("refusing to hand over asleep lobbies\n");
+				close(upgrade_peer);
+				upgrade_peer = -1;
+			}
+			if (table_path && solver_save(ctx->solver, table_path) < 0) {
+				LOG_ERROR("failed to save solver table %s\n", table_path);
+			}
+		}
+
+		// Collect what the workers finished. Closes are taken first: a worker
+		// queues a connection's last messages before closing it, so every
+		// message for a connection closed below is sent before the close.
+		if (ctx->executor) {
+			int fd;
+			while (mailbox_get(ctx->closebox, &fd)) {
+				queue_put(ctx->closeq, &fd);
+			}
+
+			Message msg;
+			while (mailbox_get(ctx->outbox, &msg)) {
+				queue_put(ctx->msgq, &msg);
+			}
+
+			AudienceFrame frame;
+			while (mailbox_get(ctx->framebox, &frame)) {
+				queue_put(ctx->frameq, &frame);
+			}
+
+			// A lobby closed since the move was played is not played in again.
+			uint32_t id;
+			Lobby *l;
+			while (ctx->botbox && mailbox_get(ctx->botbox, &id)) {
+				if ((l = find_lobby(ctx, id)) != NULL) {
+					Job job = { .type = JOB_BOT, .ctx = ctx, .l = l };
+					dispatch(ctx, &job, l->id);
+				}
+			}
+		}
+
+		while (!queue_isempty(ctx->frameq)) {
+			if (audience_publish(ctx->audience, queue_get(ctx->frameq)) < 0) {
+				LOG_ERROR("failed to publish frame\n");
+			}
+		}
+
+		// Disconnect the players who did not come back in time.
+		if (ctx->sessions && sessions_detached(ctx->sessions) > 0 && now_ms() >= next_session_check_ms) {
+			expire_sessions(ctx, now_ms());
+			next_session_check_ms = now_ms() + SESSION_CHECK_MS;
+		}
+
+		// After the outbox, so every result announced by a message collected
+		// above is recorded before the players can react to it.
+		if (ctx->tournament) {
+			run_tournament(ctx, &is_tournament_reported);
+		}
+
+		// Commit everything that happened this iteration before acknowledging
+		// it. Workers journal before queueing replies, so this covers every
+		// reply collected above.
+		if (ctx->journal && journal_flush(ctx->journal) < 0) {
+			LOG_ERROR("failed to flush journal\n");
+		}
+
+		// Send all messages in queue, everything for a connection at once.
 		while (!queue_isempty(ctx->msgq)) {
 			Message msg = *(Message*)queue_get(ctx->msgq);
 
 			for (int i = 0; i < msg.to_len; i++) {
-				if (send(msg.to[i], &msg.data, (size_t)msg.data_len, 0) == -1) {
-					perror("send");
+				// Held while the connection is detached and forwarded once taken over.
+				const int to = ctx->sessions ? sessions_deliver(ctx->sessions, msg.to[i], msg.data, (size_t)msg.data_len) : msg.to[i];
+				// Out of memory. Rather than skip a message in the middle
+				// of the stream, the connection is dropped.
+				if (to >= 0 && coalescer_add(ctx->coalescer, to, &msg.data, (size_t)msg.data_len) < 0) {
+					LOG_ERROR("failed to queue output for %d\n", to);
+					shutdown(to, SHUT_RDWR);
 				}
 			}
 		}
 
+		// Connections too slow to take what was sent to them are shut down
+		// and then closed like any other connection.
+		int behind[OUTPUT_DROP_BATCH];
+		const size_t behind_len = coalescer_flush(ctx->coalescer, now_ms(), behind, OUTPUT_DROP_BATCH);
+		for (size_t i = 0; i < behind_len; i++) {
+			Player *player = ctx_get_player(ctx, behind[i]);
+			if (player) {
+				LOG_DEBUG("[%s<%d>] dropped for not reading\n", player->name, player->fd);
+			}
+			shutdown(behind[i], SHUT_RDWR);
+		}
+
+		// Spectators are sent to after the players. What they do not take is
+		// left to the coalescer, which drops the ones too slow to keep up.
+		// Spectators whose connection failed are shut down and then closed
+		// like any other connection.
+		int dropped[AUDIENCE_DROP_BATCH];
+		const size_t dropped_len = audience_flush(ctx->audience, ctx->coalescer, dropped, AUDIENCE_DROP_BATCH);
+		for (size_t i = 0; i < dropped_len; i++) {
+			Player *player = ctx_get_player(ctx, dropped[i]);
+			if (player) {
+				LOG_DEBUG("[%s<%d>] dropped while watching\n", player->name, player->fd);
+			}
+			shutdown(dropped[i], SHUT_RDWR);
+		}
+
+		// Chat and announcements go last, a slice of the subscribers each
+		// iteration, so that the next iteration serves the game in between.
+		int unsubscribed[CHANNELS_DROP_BATCH];
+		const size_t unsubscribed_len = channels_flush(ctx->channels, ctx->coalescer, unsubscribed, CHANNELS_DROP_BATCH);
+		for (size_t i = 0; i < unsubscribed_len; i++) {
+			Player *player = ctx_get_player(ctx, unsubscribed[i]);
+			if (player) {
+				LOG_DEBUG("[%s<%d>] dropped while subscribed\n", player->name, player->fd);
+			}
+			shutdown(unsubscribed[i], SHUT_RDWR);
+		}
+
 		// Close all file descriptors in queue.
 		while (!queue_isempty(ctx->closeq)) {
 			int fd = *(int*)queue_get(ctx->closeq);
 
 			LOG_DEBUG("closing [%d]\n", fd);
+			if (ctx->sessions) {
+				sessions_release(ctx->sessions, fd);
+			}
+			coalescer_remove(ctx->coalescer, fd);
 			close(fd);
 		}
+
+		if (upgrade_peer >= 0) {
+			is_handed_over = hand_off(ctx, listener, upgrade_peer) == 0;
+			upgrade_peer = -1;
+			if (is_handed_over) {
+				break;
+			}
+		}
+	}
+
+	printf(is_handed_over ? "Exiting after the handover\n" : "Connection closed\n");
+
+	if (cluster >= 0) {
+		close(cluster);
+	}
+
+	// The new server bound the path again already.
+	if (local_listener >= 0) {
+		close(local_listener);
+		if (!is_handed_over) {
+			unlink(local_path);
+		}
 	}
 
-	printf("Connection closed\n");
+	if (ctx->executor) {
+		executor_free(ctx->executor);
+		mailbox_free(ctx->outbox);
+		mailbox_free(ctx->closebox);
+		mailbox_free(ctx->framebox);
+	}
 
+	if (ctx->journal) {
+		journal_close(ctx->journal);
+	}
+	if (ctx->archive) {
+		archive_close(ctx->archive);
+	}
+	if (ctx->bot) {
+		bot_free(ctx->bot);
+	}
+	if (ctx->solver) {
+		// Saved already for the new server to load.
+		if (!is_handed_over && solver_save(ctx->solver, table_path) < 0) {
+			LOG_ERROR("failed to save solver table %s\n", table_path);
+		}
+		solver_free(ctx->solver);
+	}
+	if (ctx->matchmaker) {
+		matchmaker_free(ctx->matchmaker);
+	}
+	if (ctx->tournament) {
+		tournament_free(ctx->tournament);
+		queue_free(ctx->resultq);
+		if (ctx->resultbox) {
+			mailbox_free(ctx->resultbox);
+		}
+	}
+	if (ctx->botbox) {
+		mailbox_free(ctx->botbox);
+	}
+	audience_free(ctx->audience);
+	queue_free(ctx->frameq);
+	channels_free(ctx->channels);
+	if (ctx->sessions) {
+		sessions_free(ctx->sessions);
+	}
+	if (ctx->limiter) {
+		limiter_free(ctx->limiter);
+	}
+	for (size_t i = 0; i < ctx->lobbies_len; i++) {
+		lobby_free(ctx->lobbies[i]);
+	}
 	queue_free(msgq);
 	queue_free(closeq);
+	coalescer_free(ctx->coalescer);
 	lobby_free(ctx->l);
+	if (ctx->store) {
+		store_close(ctx->store);
+	}
 	ctx_destory(ctx);
 
 	return 0;
@@ -0,0 +1,315 @@
+#include <stdlib.h>
+
+#include "matchmaker.h"
+
+#define NONE UINT32_MAX
+#define ENTRIES_START 64
+#define BY_FD_START 64
+#define WAIT_BUCKETS 1000 // Waits longer than this many resolutions share the last bucket.
+
+typedef struct Entry {
+	int fd;
+	int rating;
+	uint64_t since_ms;
+	uint32_t bucket;
+	uint32_t prev; // Older entry of the same bucket.
+	uint32_t next; // Newer entry of the same bucket, or the next free entry.
+} Entry;
+
+typedef struct Bucket {
+	uint32_t head; // Oldest entry.
+	uint32_t tail; // Newest entry.
+} Bucket;
+
+struct Matchmaker {
+	MatchmakerConfig config;
+
+	Bucket *buckets;
+	size_t buckets_len;
+
+	Entry *entries;
+	size_t entries_len;
+	size_t entries_size;
+	uint32_t free_head;
+
+	uint32_t *by_fd; // Entry of each queued fd. NONE for fds that are not queued.
+	size_t by_fd_len;
+
+	size_t queued;
+	unsigned long matched;
+	uint64_t wait_total_ms;
+	uint64_t wait_max_ms;
+	unsigned long waits[WAIT_BUCKETS]; // Histogram of waits in MATCHMAKER_WAIT_RESOLUTION_MS steps.
+};
+
+Matchmaker *matchmaker_create(const MatchmakerConfig *config) {
+	if (config->window_base <= 0) {
+		return NULL;
+	}
+
+	Matchmaker *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+
+	result->config = *config;
+	result->buckets_len = (size_t)((MATCHMAKER_RATING_MAX + config->window_base - 1) / config->window_base);
+	result->buckets = malloc(sizeof *result->buckets * result->buckets_len);
+	result->entries = malloc(sizeof *result->entries * ENTRIES_START);
+	result->entries_size = ENTRIES_START;
+	result->free_head = NONE;
+	result->by_fd = malloc(sizeof *result->by_fd * BY_FD_START);
+	result->by_fd_len = BY_FD_START;
+	if (!result->buckets || !result->entries || !result->by_fd) {
+		matchmaker_free(result);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < result->buckets_len; i++) {
+		result->buckets[i] = (Bucket){ .head = NONE, .tail = NONE };
+	}
+	for (size_t i = 0; i < result->by_fd_len; i++) {
+		result->by_fd[i] = NONE;
+	}
+
+	return result;
+}
+
+void matchmaker_free(Matchmaker *mm) {
+	free(mm->buckets);
+	free(mm->entries);
+	free(mm->by_fd);
+	free(mm);
+}
+
+static uint32_t find(const Matchmaker *mm, int fd) {
+	if (fd < 0 || (size_t)fd >= mm->by_fd_len) {
+		return NONE;
+	}
+
+	return mm->by_fd[fd];
+}
+
+static int grow_by_fd(Matchmaker *mm, int fd) {
+	size_t len = mm->by_fd_len;
+	while ((size_t)fd >= len) {
+		len *= 2;
+	}
+
+	uint32_t *by_fd = realloc(mm->by_fd, sizeof *by_fd * len);
+	if (!by_fd) {
+		return -1;
+	}
+
+	for (size_t i = mm->by_fd_len; i < len; i++) {
+		by_fd[i] = NONE;
+	}
+	mm->by_fd = by_fd;
+	mm->by_fd_len = len;
+
+	return 0;
+}
+
+static uint32_t alloc_entry(Matchmaker *mm) {
+	if (mm->free_head != NONE) {
+		const uint32_t result = mm->free_head;
+		mm->free_head = mm->entries[result].next;
+		return result;
+	}
+
+	if (mm->entries_len == mm->entries_size) {
+		Entry *entries = realloc(mm->entries, sizeof *entries * mm->entries_size * 2);
+		if (!entries) {
+			return NONE;
+		}
+		mm->entries = entries;
+		mm->entries_size *= 2;
+	}
+
+	return (uint32_t)mm->entries_len++;
+}
+
+/**
+ * @brief Takes an entry out of its bucket and frees it.
+ *
+ */
+static void unlink_entry(Matchmaker *mm, uint32_t i) {
+	Entry *e = &mm->entries[i];
+	Bucket *b = &mm->buckets[e->bucket];
+
+	if (e->prev != NONE) {
+		mm->entries[e->prev].next = e->next;
+	} else {
+		b->head = e->next;
+	}
+	if (e->next != NONE) {
+		mm->entries[e->next].prev = e->prev;
+	} else {
+		b->tail = e->prev;
+	}
+
+	mm->by_fd[e->fd] = NONE;
+	e->next = mm->free_head;
+	mm->free_head = i;
+	mm->queued--;
+}
+
+int matchmaker_enqueue(Matchmaker *mm, int fd, int rating, uint64_t now_ms) {
+	if (fd < 0 || find(mm, fd) != NONE) {
+		return -1;
+	}
+
+	if ((size_t)fd >= mm->by_fd_len && grow_by_fd(mm, fd) < 0) {
+		return -1;
+	}
+
+	const uint32_t i = alloc_entry(mm);
+	if (i == NONE) {
+		return -1;
+	}
+
+	if (rating < 0) {
+		rating = 0;
+	} else if (rating >= MATCHMAKER_RATING_MAX) {
+		rating = MATCHMAKER_RATING_MAX - 1;
+	}
+
+	Entry *e = &mm->entries[i];
+	e->fd = fd;
+	e->rating = rating;
+	e->since_ms = now_ms;
+	e->bucket = (uint32_t)(rating / mm->config.window_base);
+	e->next = NONE;
+
+	Bucket *b = &mm->buckets[e->bucket];
+	e->prev = b->tail;
+	if (b->tail != NONE) {
+		mm->entries[b->tail].next = i;
+	} else {
+		b->head = i;
+	}
+	b->tail = i;
+
+	mm->by_fd[fd] = i;
+	mm->queued++;
+
+	return 0;
+}
+
+int matchmaker_cancel(Matchmaker *mm, int fd) {
+	const uint32_t i = find(mm, fd);
+	if (i == NONE) {
+		return -1;
+	}
+
+	unlink_entry(mm, i);
+	return 0;
+}
+
+size_t matchmaker_queued(const Matchmaker *mm) {
+	return mm->queued;
+}
+
+static int window(const Matchmaker *mm, const Entry *e, uint64_t now_ms) {
+	const uint64_t waited_ms = now_ms > e->since_ms ? now_ms - e->since_ms : 0;
+	const uint64_t result = (uint64_t)mm->config.window_base + (uint64_t)mm->config.window_per_sec * waited_ms / 1000;
+	return result < (uint64_t)mm->config.window_max ? (int)result : mm->config.window_max;
+}
+
+static void record_wait(Matchmaker *mm, const Entry *e, uint64_t now_ms) {
+	const uint64_t waited_ms = now_ms > e->since_ms ? now_ms - e->since_ms : 0;
+	const uint64_t step = waited_ms / MATCHMAKER_WAIT_RESOLUTION_MS;
+
+	mm->waits[step < WAIT_BUCKETS ? step : WAIT_BUCKETS - 1]++;
+	mm->wait_total_ms += waited_ms;
+	if (waited_ms > mm->wait_max_ms) {
+		mm->wait_max_ms = waited_ms;
+	}
+	mm->matched++;
+}
+
+/**
+ * @brief Pairs two queued entries. The older one must be given first.
+ *
+ */
+static void pair(Matchmaker *mm, uint32_t older, uint32_t newer, uint64_t now_ms, MatchmakerPair *out) {
+	out->fds[0] = mm->entries[older].fd;
+	out->fds[1] = mm->entries[newer].fd;
+
+	record_wait(mm, &mm->entries[older], now_ms);
+	record_wait(mm, &mm->entries[newer], now_ms);
+
+	unlink_entry(mm, older);
+	unlink_entry(mm, newer);
+}
+
+size_t matchmaker_tick(Matchmaker *mm, uint64_t now_ms, MatchmakerPair *pairs, size_t pairs_size) {
+	size_t made = 0;
+
+	// Players of the same bucket are always within each other's window.
+	for (size_t b = 0; b < mm->buckets_len && made < pairs_size; b++) {
+		const Bucket *bucket = &mm->buckets[b];
+		while (made < pairs_size && bucket->head != NONE && mm->entries[bucket->head].next != NONE) {
+			pair(mm, bucket->head, mm->entries[bucket->head].next, now_ms, &pairs[made++]);
+		}
+	}
+
+	// Every bucket now holds at most one player. Neighbours in rating order
+	// are paired once both of their windows have grown wide enough.
+	uint32_t prev = NONE;
+	for (size_t b = 0; b < mm->buckets_len && made < pairs_size; b++) {
+		const uint32_t cur = mm->buckets[b].head;
+		if (cur == NONE) {
+			continue;
+		}
+
+		if (prev != NONE) {
+			const Entry *p = &mm->entries[prev];
+			const Entry *c = &mm->entries[cur];
+			const int diff = c->rating - p->rating;
+			const int w_prev = window(mm, p, now_ms);
+			const int w_cur = window(mm, c, now_ms);
+			if (diff <= (w_prev < w_cur ? w_prev : w_cur)) {
+				if (p->since_ms <= c->since_ms) {
+					pair(mm, prev, cur, now_ms, &pairs[made++]);
+				} else {
+					pair(mm, cur, prev, now_ms, &pairs[made++]);
+				}
+				prev = NONE;
+				continue;
+			}
+		}
+
+		prev = cur;
+	}
+
+	return made;
+}
+
+/**
+ * @brief Returns the wait that at least the given fraction of matched players
+ * waited no longer than, rounded up to the histogram resolution.
+ *
+ */
+static uint64_t wait_percentile(const Matchmaker *mm, double fraction) {
+	const unsigned long target = (unsigned long)((double)mm->matched * fraction + 0.5);
+
+	unsigned long seen = 0;
+	for (size_t i = 0; i < WAIT_BUCKETS; i++) {
+		seen += mm->waits[i];
+		if (seen >= target && seen > 0) {
+			return i + 1 < WAIT_BUCKETS ? (i + 1) * MATCHMAKER_WAIT_RESOLUTION_MS : mm->wait_max_ms;
+		}
+	}
+
+	return 0;
+}
+
+void matchmaker_stats(const Matchmaker *mm, MatchmakerStats *stats) {
+	stats->queued = mm->queued;
+	stats->matched = mm->matched;
+	stats->wait_avg_ms = mm->matched > 0 ? mm->wait_total_ms / mm->matched : 0;
+	stats->wait_p50_ms = wait_percentile(mm, 0.5);
+	stats->wait_p99_ms = wait_percentile(mm, 0.99);
+	stats->wait_max_ms = mm->wait_max_ms;
+}
@@ -0,0 +1,122 @@
+#ifndef MATCHMAKER_H_
+#define MATCHMAKER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MATCHMAKER_RATING_MAX 4000 // Ratings are clamped to [0, MATCHMAKER_RATING_MAX).
+#define MATCHMAKER_RATING_START 1500 // Rating of players that never set one.
+
+/**
+ * @brief Pairs waiting players of similar rating. Players are kept in buckets
+ * of window_base rating points, oldest first, so queueing and cancelling are
+ * constant time and a tick only visits the players it pairs plus one leftover
+ * per bucket.
+ *
+ * Every tick first pairs players within each bucket, which are always close
+ * enough, then pairs the leftovers of neighbouring buckets whose ratings are
+ * within both players' windows. A player's window starts at window_base and
+ * grows by window_per_sec for every second they have waited, up to
+ * window_max, so nobody waits forever because nobody of their exact rating
+ * shows up.
+ *
+ * Players are identified by their file descriptor. Time is passed in by the
+ * caller in milliseconds from any fixed point.
+ *
+ */
+typedef struct Matchmaker Matchmaker;
+
+typedef struct MatchmakerConfig {
+	int window_base; // Rating difference accepted right away. Also the width of a bucket.
+	int window_per_sec; // How much the window grows per second of waiting.
+	int window_max; // Largest rating difference that is ever accepted.
+} MatchmakerConfig;
+
+/**
+ * @brief Two players to seat in a new lobby.
+ *
+ */
+typedef struct MatchmakerPair {
+	int fds[2]; // The player who waited longer comes first.
+} MatchmakerPair;
+
+/**
+ * @brief Statistics of a matchmaker since it was created.
+ *
+ */
+typedef struct MatchmakerStats {
+	size_t queued; // Players waiting right now.
+	unsigned long matched; // Players that were paired.
+	uint64_t wait_avg_ms;
+	uint64_t wait_p50_ms; // Rounded up to MATCHMAKER_WAIT_RESOLUTION_MS.
+	uint64_t wait_p99_ms; // Rounded up to MATCHMAKER_WAIT_RESOLUTION_MS.
+	uint64_t wait_max_ms;
+} MatchmakerStats;
+
+#define MATCHMAKER_WAIT_RESOLUTION_MS 10
+
+/**
+ * @brief Creates a matchmaker.
+ *
+ * @param config How players are paired. window_base must be positive.
+ * @return Matchmaker* The created matchmaker. NULL if an error occurred.
+ */
+Matchmaker *matchmaker_create(const MatchmakerConfig *config);
+
+/**
+ * @brief Frees the matchmaker.
+ *
+ * @param mm The matchmaker to free.
+ */
+void matchmaker_free(Matchmaker *mm);
+
+/**
+ * @brief Adds a player to the queue.
+ *
+ * @param mm The matchmaker to queue in.
+ * @param fd The player's file descriptor.
+ * @param rating The player's rating.
+ * @param now_ms The current time.
+ * @return int -1 if the player is already queued or the queue could not grow.
+ * 0 otherwise.
+ */
+int matchmaker_enqueue(Matchmaker *mm, int fd, int rating, uint64_t now_ms);
+
+/**
+ * @brief Takes a player out of the queue without pairing them.
+ *
+ * @param mm The matchmaker to take from.
+ * @param fd The player's file descriptor.
+ * @return int -1 if the player was not queued. 0 otherwise.
+ */
+int matchmaker_cancel(Matchmaker *mm, int fd);
+
+/**
+ * @brief Returns the number of players waiting in the queue.
+ *
+ * @param mm The matchmaker to check.
+ * @return size_t The number of queued players.
+ */
+size_t matchmaker_queued(const Matchmaker *mm);
+
+/**
+ * @brief Pairs as many waiting players as possible. Paired players leave the
+ * queue. Should be called again while it fills pairs completely.
+ *
+ * @param mm The matchmaker to pair in.
+ * @param now_ms The current time.
+ * @param pairs Set to the pairs that were made.
+ * @param pairs_size The most pairs to make.
+ * @return size_t The number of pairs made.
+ */
+size_t matchmaker_tick(Matchmaker *mm, uint64_t now_ms, MatchmakerPair *pairs, size_t pairs_size);
+
+/**
+ * @brief Gets the statistics of the matchmaker.
+ *
+ * @param mm The matchmaker to check.
+ * @param stats Set to the statistics.
+ */
+void matchmaker_stats(const Matchmaker *mm, MatchmakerStats *stats);
+
+#endif
@@ -1,13 +1,14 @@
 #include <string.h>
 #include <sys/socket.h>
 
+#include "mailbox.h"
 #include "message.h"
 #include "player.h"
 #include "queue.h"
 
 
 long player_write(const struct Player *p, const void *buf, size_t size) {
-	if (!p->msgq) {
+	if (!p->msgq && !p->outbox) {
 		return (long)send(p->fd, buf, size, 0);
 	}
 
@@ -17,7 +18,11 @@ long player_write(const struct Player *p, const void *buf, size_t size) {
 
 	Message msg = { .to = { p->fd }, .to_len = 1, .data_len = (long)size };
 	memcpy(msg.data, buf, size);
-	queue_put(p->msgq, &msg);
+	if (p->outbox) {
+		mailbox_put(p->outbox, &msg);
+	} else {
+		queue_put(p->msgq, &msg);
+	}
 	return (long)size;
 }
 
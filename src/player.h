@@ -2,36 +2,50 @@
 #define PLAYER_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #define PLAYER_NAME_SIZE 32
+#define PLAYER_KEY_SIZE 16
 
 typedef struct Player {
 	char name[PLAYER_NAME_SIZE];
 	char team;
 	bool is_login;
+	bool is_bot; // Seat played by the server. See bot.h.
 
 	int fd; // accept(2)'d file descriptor.
+	int rating; // What the player is matched by. See matchmaker.h.
+	uint8_t key[PLAYER_KEY_SIZE]; // Takes back the seat once it is restored from the journal. All zero for none. See journal.h.
+
+	// Only kept up to date on the server's own copy of a connection.
+	struct Lobby *lobby; // The lobby the player was matched in to. NULL if none.
+	uint32_t route; // Executor key of the last lobby the player was sent to.
 
 	// Expected to be a queue where each element is the size of a Message. If
 	// the default 'player_write' is not used then this can be set to NULL.
 	struct Queue *msgq; 
 
+	// Used instead of msgq when set. Takes Messages like msgq but can be
+	// written to from any thread. See mailbox.h.
+	struct Mailbox *outbox;
+
 	// Register custom read/write functions.
 	long (*read)(const struct Player*, void*, size_t);
 	long (*write)(const struct Player*, const void*, size_t);
 } Player;
 
 /**
- * @brief Sends a message across a socket to the given player. If msgq is NULL
- * then this function acts the same as send(2). If msgq is not NULL then the
- * messages will be added to the queue instead of being sent immediately.
+ * @brief Sends a message across a socket to the given player. If msgq and
+ * outbox are NULL then this function acts the same as send(2). Otherwise the
+ * messages will be added to the outbox or queue instead of being sent
+ * immediately.
  * 
  * @param p The player to send the message to.
  * @param buf The message to send.
  * @param size The size of buf.
  * @return long The amount of bytes sent. Send send(2) for comprehensive
- * description. If msgq is not NULL then this function will return -1 if size is
- * too large to fit inside of a Message.
+ * description. If msgq or outbox is not NULL then this function will return -1
+ * if size is too large to fit inside of a Message.
  */
 long player_write(const struct Player *p, const void *buf, size_t size);
 
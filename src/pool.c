@@ -0,0 +1,150 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "log.h"
+#include "pool.h"
+#include "queue.h"
+
+typedef struct Task {
+	PoolTask run;
+	void *arg;
+	PoolGroup *group; // NULL if the task belongs to no group.
+} Task;
+
+struct Pool {
+	pthread_t *threads;
+	size_t threads_len;
+
+	pthread_mutex_t lock;
+	pthread_cond_t has_task; // Signaled when a task is queued or the pool stops.
+	pthread_cond_t is_idle; // Signaled when the last running task finishes, or the last of a group.
+
+	Queue *tasks;
+	size_t pending; // Tasks that are queued or running.
+	bool stop;
+};
+
+static void *worker(void *arg) {
+	Pool *p = arg;
+
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		while (queue_isempty(p->tasks) && !p->stop) {
+			pthread_cond_wait(&p->has_task, &p->lock);
+		}
+
+		if (queue_isempty(p->tasks)) {
+			break;
+		}
+
+		Task task = *(Task *)queue_get(p->tasks);
+		pthread_mutex_unlock(&p->lock);
+
+		task.run(task.arg);
+
+		pthread_mutex_lock(&p->lock);
+		const bool is_group_done = task.group && --task.group->pending == 0;
+		if (--p->pending == 0 || is_group_done) {
+			pthread_cond_broadcast(&p->is_idle);
+		}
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	return NULL;
+}
+
+Pool *pool_create(size_t threads) {
+	Pool *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+
+	result->threads = calloc(threads, sizeof *result->threads);
+	result->tasks = queue_create(sizeof(Task));
+	if (!result->threads || !result->tasks) {
+		free(result->threads);
+		if (result->tasks) {
+			queue_free(result->tasks);
+		}
+		free(result);
+		return NULL;
+	}
+
+	pthread_mutex_init(&result->lock, NULL);
+	pthread_cond_init(&result->has_task, NULL);
+	pthread_cond_init(&result->is_idle, NULL);
+
+	for (size_t i = 0; i < threads; i++) {
+		if (pthread_create(&result->threads[i], NULL, worker, result) != 0) {
+			LOG_ERROR("failed to start pool thread\n");
+			break;
+		}
+		result->threads_len++;
+	}
+
+	if (result->threads_len == 0) {
+		pool_free(result);
+		return NULL;
+	}
+
+	return result;
+}
+
+void pool_free(Pool *p) {
+	pthread_mutex_lock(&p->lock);
+	p->stop = true;
+	pthread_cond_broadcast(&p->has_task);
+	pthread_mutex_unlock(&p->lock);
+
+	for (size_t i = 0; i < p->threads_len; i++) {
+		pthread_join(p->threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&p->lock);
+	pthread_cond_destroy(&p->has_task);
+	pthread_cond_destroy(&p->is_idle);
+	queue_free(p->tasks);
+	free(p->threads);
+	free(p);
+}
+
+int pool_submit(Pool *p, PoolTask task, void *arg) {
+	return pool_submit_group(p, NULL, task, arg);
+}
+
+int pool_submit_group(Pool *p, PoolGroup *g, PoolTask task, void *arg) {
+	pthread_mutex_lock(&p->lock);
+
+	int result = queue_put(p->tasks, &(Task){ .run = task, .arg = arg, .group = g });
+	if (result == 0) {
+		p->pending++;
+		if (g) {
+			g->pending++;
+		}
+		pthread_cond_signal(&p->has_task);
+	}
+
+	pthread_mutex_unlock(&p->lock);
+	return result;
+}
+
+void pool_wait_group(Pool *p, PoolGroup *g) {
+	pthread_mutex_lock(&p->lock);
+	while (g->pending > 0) {
+		pthread_cond_wait(&p->is_idle, &p->lock);
+	}
+	pthread_mutex_unlock(&p->lock);
+}
+
+void pool_wait(Pool *p) {
+	pthread_mutex_lock(&p->lock);
+	while (p->pending > 0) {
+		pthread_cond_wait(&p->is_idle, &p->lock);
+	}
+	pthread_mutex_unlock(&p->lock);
+}
+
+size_t pool_threads(const Pool *p) {
+	return p->threads_len;
+}
@@ -0,0 +1,87 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <stddef.h>
+
+/**
+ * @brief A fixed number of worker threads that run submitted tasks in the
+ * order they were submitted.
+ *
+ */
+typedef struct Pool Pool;
+
+typedef void (*PoolTask)(void *arg);
+
+/**
+ * @brief Tasks submitted together, so that whoever submitted them can wait for
+ * them without waiting for the tasks of everyone else using the pool. Zero
+ * initialized before the first submit.
+ *
+ */
+typedef struct PoolGroup {
+	size_t pending; // Tasks of the group that are queued or running. Guarded by the pool.
+} PoolGroup;
+
+/**
+ * @brief Creates a pool and starts its threads. Should be freed with
+ * accompanying free function when done.
+ *
+ * @param threads The number of worker threads to start. Must be at least 1.
+ * @return Pool* Opaque pointer to a newly created Pool. NULL if an error occurred.
+ */
+Pool *pool_create(size_t threads);
+
+/**
+ * @brief Waits for all submitted tasks to finish, then stops the threads and
+ * frees the pool.
+ *
+ * @param p The Pool to free.
+ */
+void pool_free(Pool *p);
+
+/**
+ * @brief Queues a task to be run on one of the pool's threads.
+ *
+ * @param p The Pool instance to run the task.
+ * @param task The function to run.
+ * @param arg The argument passed to task.
+ * @return int -1 if the task could not be queued. 0 otherwise.
+ */
+int pool_submit(Pool *p, PoolTask task, void *arg);
+
+/**
+ * @brief Queues a task to be run on one of the pool's threads as part of a
+ * group.
+ *
+ * @param p The Pool instance to run the task.
+ * @param g The group the task belongs to.
+ * @param task The function to run.
+ * @param arg The argument passed to task.
+ * @return int -1 if the task could not be queued. 0 otherwise.
+ */
+int pool_submit_group(Pool *p, PoolGroup *g, PoolTask task, void *arg);
+
+/**
+ * @brief Blocks until every task of the group has finished.
+ *
+ * @param p The Pool instance the tasks were submitted to.
+ * @param g The group to wait on.
+ */
+void pool_wait_group(Pool *p, PoolGroup *g);
+
+/**
+ * @brief Blocks until every submitted task has finished.
+ *
+ * @param p The Pool instance to wait on.
+ */
+void pool_wait(Pool *p);
+
+/**
+ * @brief Returns the number of worker threads in the pool.
+ *
+ * @param p The Pool instance to check.
+ * @return size_t The number of threads.
+ */
+size_t pool_threads(const Pool *p);
+
+#endif
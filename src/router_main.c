@@ -0,0 +1,310 @@
+#define _GNU_SOURCE // accept4(2).
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "cluster.h"
+#include "command.h"
+#include "log.h"
+#include "message.h"
+#include "session.h"
+
+#define BACKLOG SOMAXCONN // Connections the kernel queues before they are accepted. See -l.
+#define ACCEPT_BATCH 512 // Connections accepted per event loop iteration, so a storm does not starve everyone else.
+#define POLL_START 64
+
+/**
+ * @brief Everything the router polls: the listeners, the workers and the
+ * connections that have not sent their first message yet.
+ *
+ */
+typedef struct Router {
+	int listener;
+	int cluster_listener;
+	Cluster *cluster;
+
+	struct pollfd *pfds;
+	size_t pfds_len;
+	size_t pfds_size;
+} Router;
+
+static void usage(void) {
+	printf("usage: nogos-router [-l backlog] cluster_socket port\n");
+}
+
+/**
+ * @brief Starts polling a socket.
+ *
+ * @return int -1 if the function failed to allocate extra space. 0 otherwise.
+ */
+static int watch(Router *r, int fd) {
+	if (r->pfds_len == r->pfds_size) {
+		const size_t size = r->pfds_size > 0 ? r->pfds_size * 2 : POLL_START;
+		struct pollfd *pfds = realloc(r->pfds, sizeof *pfds * size);
+		if (!pfds) {
+			return -1;
+		}
+		r->pfds = pfds;
+		r->pfds_size = size;
+	}
+
+	r->pfds[r->pfds_len++] = (struct pollfd){ .fd = fd, .events = POLLIN };
+	return 0;
+}
+
+/**
+ * @brief Stops polling the socket at i and closes it. The last socket takes
+ * its place.
+ *
+ */
+static void unwatch(Router *r, size_t i) {
+	close(r->pfds[i].fd);
+	r->pfds[i] = r->pfds[--r->pfds_len];
+}
+
+/**
+ * @brief Accepts the connections waiting on a listener, up to ACCEPT_BATCH.
+ * Clients are greeted like the workers would, since they only reach a worker
+ * once they said something.
+ *
+ */
+static void accept_all(Router *r, int listener) {
+	for (size_t accepts = 0; accepts < ACCEPT_BATCH; accepts++) {
+		const int newfd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+		if (newfd == -1) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			} else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				perror("accept");
+			}
+			break;
+		}
+
+		if (listener == r->cluster_listener) {
+			const int node = cluster_add(r->cluster, newfd);
+			if (node < 0 || cluster_send(newfd, &(ClusterMessage){ .type = CLUSTER_WELCOME, .node = (uint32_t)node }) < 0 ||
+				watch(r, newfd) < 0) {
+				LOG_ERROR("failed to add worker\n");
+				if (node >= 0) {
+					cluster_remove(r->cluster, (uint32_t)node);
+				}
+				close(newfd);
+				continue;
+			}
+			printf("Worker %d joined\n", node);
+			continue;
+		}
+
+		// Carried over to the worker with the connection.
+		const int yes = 1;
+		setsockopt(newfd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof yes);
+
+		if (send(newfd, "OK\r\n", 4, MSG_NOSIGNAL) == -1 || watch(r, newfd) < 0) {
+			close(newfd);
+		}
+	}
+}
+
+/**
+ * @brief Reads a connection's first message and hands the connection to the
+ * worker that should serve it. Nothing is done for a connection that went
+ * away. The caller closes the router's copy either way.
+ *
+ */
+static void hand_over(Router *r, int fd) {
+	ClusterMessage m = { .type = CLUSTER_CONN, .fd = fd };
+	const ssize_t len = recv(fd, m.data, MSG_MAX_SIZE, 0);
+	if (len <= 0) {
+		return;
+	}
+	m.data_len = (size_t)len;
+
+	// Sessions are only held by the node that issued them. Tokens that name
+	// no worker are sent on like anything else and refused there.
+	int node = -1;
+	const Command cmd = command_parse(m.data, m.data_len);
+	if (cmd.type == COMMAND_RESUME && (node = sessions_node(cmd.token)) >= 0 && cluster_sock(r->cluster, (uint32_t)node) >= 0) {
+		cluster_count(r->cluster, (uint32_t)node);
+	} else {
+		node = cluster_pick(r->cluster);
+	}
+
+	if (node < 0) {
+		send(fd, "ERROR\r\n", 7, MSG_NOSIGNAL);
+	} else if (cluster_send(cluster_sock(r->cluster, (uint32_t)node), &m) < 0) {
+		LOG_ERROR("failed to hand connection %d to worker %d\n", fd, node);
+	} else {
+		LOG_DEBUG("[%d] handed to worker %d\n", fd, node);
+	}
+}
+
+/**
+ * @brief Serves whatever a worker sent.
+ *
+ * @return int -1 if the worker went away. 0 otherwise.
+ */
+static int serve_worker(Router *r, int node) {
+	ClusterMessage m;
+	if (cluster_recv(cluster_sock(r->cluster, (uint32_t)node), &m) < 0 || m.type != CLUSTER_LOAD) {
+		return -1;
+	}
+
+	cluster_report(r->cluster, (uint32_t)node, m.players, m.lobbies);
+	return 0;
+}
+
+/**
+ * @brief Binds a socket to the given port.
+ *
+ * @return int The bound socket. -1 if an error occurred.
+ */
+static int bind_to(const char *port) {
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	int status;
+	struct addrinfo *servinfo;
+	if ((status = getaddrinfo(NULL, port, &hints, &servinfo)) != 0) {
+		LOG_ERROR("getaddrinfo error: %s\n", gai_strerror(status));
+		return -1;
+	}
+
+	int listener = -1;
+	for (struct addrinfo *p = servinfo; p != NULL; p = p->ai_next) {
+		if ((listener = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1) {
+			perror("router: socket");
+			continue;
+		}
+
+		int yes = 1;
+		if (setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes)) {
+			perror("setsockopt");
+			return -1;
+		}
+
+		if (bind(listener, p->ai_addr, p->ai_addrlen) == -1) {
+			close(listener);
+			perror("router: bind");
+			continue;
+		}
+
+		break;
+	}
+
+	freeaddrinfo(servinfo);
+	return listener;
+}
+
+int main(int argc, char **argv) {
+	long backlog = BACKLOG;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "l:")) != -1) {
+		switch (opt) {
+		case 'l':
+			backlog = strtol(optarg, NULL, 10);
+			if (backlog <= 0 || backlog > INT_MAX) {
+				usage();
+				exit(64);
+			}
+			break;
+		default:
+			usage();
+			exit(64);
+		}
+	}
+
+	if (optind + 2 > argc) {
+		usage();
+		exit(64);
+	}
+
+	const char *cluster_path = argv[optind];
+	const char *port = argv[optind + 1];
+
+	// A client or a worker can go away at any time. send(2) reports that as
+	// EPIPE instead of killing the router.
+	signal(SIGPIPE, SIG_IGN);
+
+	Router r = { .cluster = cluster_create() };
+	r.listener = bind_to(port);
+	r.cluster_listener = cluster_listen(cluster_path);
+	if (r.listener < 0 || listen(r.listener, (int)backlog) == -1 || fcntl(r.listener, F_SETFL, O_NONBLOCK) == -1 ||
+		r.cluster_listener < 0 || fcntl(r.cluster_listener, F_SETFL, O_NONBLOCK) == -1) {
+		perror("router: listen");
+		exit(71);
+	}
+
+	if (!r.cluster || watch(&r, r.listener) < 0 || watch(&r, r.cluster_listener) < 0) {
+		LOG_ERROR("failed to instantiate structs\n");
+		exit(71);
+	}
+
+	printf("Routing %s to workers on %s\n", port, cluster_path);
+
+	for (;;) {
+		const int poll_len = poll(r.pfds, r.pfds_len, -1);
+		if (poll_len == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("poll");
+			break;
+		}
+
+		// Sockets added while going through are polled next time. Removing one
+		// moves the last socket to i, which is then looked at in turn.
+		const size_t polled_len = r.pfds_len;
+		for (size_t i = 0; i < r.pfds_len && i < polled_len;) {
+			const int fd = r.pfds[i].fd;
+			if (!(r.pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+				i++;
+				continue;
+			}
+			r.pfds[i].revents = 0;
+
+			if (fd == r.listener || fd == r.cluster_listener) {
+				accept_all(&r, fd);
+				i++;
+				continue;
+			}
+
+			const int node = cluster_node(r.cluster, fd);
+			if (node >= 0) {
+				if (serve_worker(&r, node) < 0) {
+					printf("Worker %d left\n", node);
+					cluster_remove(r.cluster, (uint32_t)node);
+					unwatch(&r, i);
+				} else {
+					i++;
+				}
+			} else {
+				hand_over(&r, fd);
+				unwatch(&r, i);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < r.pfds_len; i++) {
+		close(r.pfds[i].fd);
+	}
+	free(r.pfds);
+	cluster_free(r.cluster);
+	unlink(cluster_path);
+
+	return 0;
+}
@@ -0,0 +1,390 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libnogo/nogo.h"
+
+#include "bot.h"
+#include "bytes.h"
+#include "lobby.h"
+#include "log.h"
+#include "pool.h"
+#include "selfplay.h"
+
+#define SELFPLAY_MAGIC "NOGOSPL1"
+#define SELFPLAY_MAGIC_SIZE 8
+
+#define RECORD_HEADER_SIZE 5
+#define OUT_BUFFER_SIZE (64 * 1024) // Games are written to the file once a worker has this many bytes.
+
+#define PROGRESS_POLL_NS 100000000 // How often the workers are checked on.
+#define PROGRESS_POLLS 10 // Progress is printed every this many polls.
+
+typedef struct Run Run;
+
+/**
+ * @brief A worker thread and the range of games it still has to play.
+ *
+ */
+typedef struct Worker {
+	Run *run;
+	size_t index;
+
+	pthread_mutex_t lock; // Guards next and end, which other workers steal from.
+	unsigned long next;
+	unsigned long end;
+
+	Lobby *l;
+	Bot *bot;
+	uint16_t *empty;
+
+	unsigned char *out;
+	size_t out_len;
+
+	SelfplayStats stats;
+} Worker;
+
+struct Run {
+	const SelfplayConfig *config;
+	Worker *workers;
+	size_t workers_len;
+
+	pthread_mutex_t out_lock;
+	FILE *out;
+	int error; // Set by any worker that fails. Stops the others.
+
+	unsigned long played; // Games finished across all workers. Read for progress.
+};
+
+static uint64_t next_random(uint64_t *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545f4914f6cdd1dULL;
+}
+
+/**
+ * @brief Derives the random state of a game from the run's seed and the game's
+ * number.
+ *
+ */
+static uint64_t game_seed(uint64_t seed, unsigned long game) {
+	uint64_t x = seed + (game + 1) * 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return (x ^ (x >> 31)) | 1;
+}
+
+/**
+ * @brief Takes the next game off the worker's own range, or failing that half
+ * of the games left in another worker's range.
+ *
+ * @return bool false once no worker has games left.
+ */
+static bool take_game(Worker *w, unsigned long *game) {
+	for (;;) {
+		pthread_mutex_lock(&w->lock);
+		if (w->next < w->end) {
+			*game = w->next++;
+			pthread_mutex_unlock(&w->lock);
+			return true;
+		}
+		pthread_mutex_unlock(&w->lock);
+
+		// Only one lock is held at a time so two workers stealing from each
+		// other can't deadlock. The worker's own range is empty meanwhile, so
+		// nobody can steal from it.
+		bool is_stolen = false;
+		unsigned long start = 0;
+		unsigned long end = 0;
+		for (size_t i = 1; i < w->run->workers_len && !is_stolen; i++) {
+			Worker *victim = &w->run->workers[(w->index + i) % w->run->workers_len];
+
+			pthread_mutex_lock(&victim->lock);
+			const unsigned long left = victim->end - victim->next;
+			if (left > 0) {
+				start = victim->end - (left + 1) / 2;
+				end = victim->end;
+				victim->end = start;
+				is_stolen = true;
+			}
+			pthread_mutex_unlock(&victim->lock);
+		}
+
+		if (!is_stolen) {
+			return false;
+		}
+
+		pthread_mutex_lock(&w->lock);
+		w->next = start;
+		w->end = end;
+		pthread_mutex_unlock(&w->lock);
+		w->stats.steals++;
+	}
+}
+
+static int flush_out(Worker *w) {
+	if (w->out_len == 0) {
+		return 0;
+	}
+
+	Run *run = w->run;
+	pthread_mutex_lock(&run->out_lock);
+	const bool wrote = fwrite(w->out, 1, w->out_len, run->out) == w->out_len;
+	if (!wrote) {
+		__atomic_store_n(&run->error, -1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&run->out_lock);
+
+	w->out_len = 0;
+	return wrote ? 0 : -1;
+}
+
+static int choose_move(Worker *w, uint64_t *rng, size_t *empty_len, uint16_t *space) {
+	if (w->bot) {
+		LobbyMove move;
+		if (bot_choose(w->bot, w->l, &move, NULL) < 0) {
+			return -1;
+		}
+		*space = (uint16_t)(move.row * w->l->board.cols + move.col);
+
+		for (size_t i = 0; i < *empty_len; i++) {
+			if (w->empty[i] == *space) {
+				w->empty[i] = w->empty[--*empty_len];
+				break;
+			}
+		}
+		return 0;
+	}
+
+	const size_t pick = (size_t)(next_random(rng) % *empty_len);
+	*space = w->empty[pick];
+	w->empty[pick] = w->empty[--*empty_len];
+	return 0;
+}
+
+/**
+ * @brief Plays a game from the empty board to the end, appends its record to
+ * the worker's buffer and leaves the board empty again.
+ *
+ */
+static int play_game(Worker *w, unsigned long game) {
+	Lobby *l = w->l;
+	const size_t cols = l->board.cols;
+	size_t empty_len = l->board.rows * cols;
+	for (size_t i = 0; i < empty_len; i++) {
+		w->empty[i] = (uint16_t)i;
+	}
+
+	uint64_t rng = game_seed(w->run->config->seed, game);
+	while (lobby_winner(l) == -1 && empty_len > 0) {
+		uint16_t space;
+		if (choose_move(w, &rng, &empty_len, &space) < 0 || lobby_place(l, lobby_turn(l), space / cols, space % cols) < 0) {
+			return -1;
+		}
+	}
+
+	const size_t moves_len = lobby_moves_len(l);
+	const int winner = lobby_winner(l);
+	if (w->out_len + RECORD_HEADER_SIZE + moves_len * 2 > OUT_BUFFER_SIZE && flush_out(w) < 0) {
+		return -1;
+	}
+
+	unsigned char *record = w->out + w->out_len;
+	record[0] = (unsigned char)l->board.rows;
+	record[1] = (unsigned char)cols;
+	record[2] = (unsigned char)(winner == -1 ? 0 : winner);
+	put_u16(record + 3, (uint16_t)moves_len);
+	for (size_t i = 0; i < moves_len; i++) {
+		const LobbyMove move = lobby_move_at(l, i);
+		put_u16(record + RECORD_HEADER_SIZE + i * 2, (uint16_t)(move.row * cols + move.col));
+	}
+	w->out_len += RECORD_HEADER_SIZE + moves_len * 2;
+
+	w->stats.games++;
+	w->stats.moves += moves_len;
+	if (winner == 'O') {
+		w->stats.o_wins++;
+	} else if (winner == 'X') {
+		w->stats.x_wins++;
+	}
+
+	while (lobby_undo(l) == 0) {
+	}
+
+	return 0;
+}
+
+static void worker_run(void *arg) {
+	Worker *w = arg;
+
+	unsigned long game;
+	while (!__atomic_load_n(&w->run->error, __ATOMIC_RELAXED) && take_game(w, &game)) {
+		if (play_game(w, game) < 0) {
+			__atomic_store_n(&w->run->error, -1, __ATOMIC_RELAXED);
+			break;
+		}
+		__atomic_add_fetch(&w->run->played, 1, __ATOMIC_RELAXED);
+	}
+
+	flush_out(w);
+}
+
+static void free_workers(Run *run) {
+	for (size_t i = 0; i < run->workers_len; i++) {
+		Worker *w = &run->workers[i];
+		if (w->l) {
+			lobby_free(w->l);
+		}
+		if (w->bot) {
+			bot_free(w->bot);
+		}
+		free(w->empty);
+		free(w->out);
+		pthread_mutex_destroy(&w->lock);
+	}
+	free(run->workers);
+}
+
+int selfplay_run(const SelfplayConfig *config, FILE *out, SelfplayStats *stats) {
+	if (config->rows == 0 || config->cols == 0 || config->rows > SELFPLAY_MAX_SIZE || config->cols > SELFPLAY_MAX_SIZE || config->threads == 0) {
+		LOG_ERROR("invalid self-play config\n");
+		return -1;
+	}
+
+	if (fwrite(SELFPLAY_MAGIC, 1, SELFPLAY_MAGIC_SIZE, out) != SELFPLAY_MAGIC_SIZE) {
+		return -1;
+	}
+
+	Run run = { .config = config, .out = out, .workers_len = config->threads };
+	run.workers = calloc(run.workers_len, sizeof *run.workers);
+	if (!run.workers) {
+		return -1;
+	}
+	pthread_mutex_init(&run.out_lock, NULL);
+
+	// Start every worker with an equal share of the games.
+	const size_t spaces = config->rows * config->cols;
+	for (size_t i = 0; i < run.workers_len; i++) {
+		Worker *w = &run.workers[i];
+		w->run = &run;
+		w->index = i;
+		w->next = config->games * i / run.workers_len;
+		w->end = config->games * (i + 1) / run.workers_len;
+		pthread_mutex_init(&w->lock, NULL);
+
+		w->l = lobby_create(config->rows, config->cols);
+		w->empty = malloc(sizeof *w->empty * spaces);
+		w->out = malloc(OUT_BUFFER_SIZE > RECORD_HEADER_SIZE + spaces * 2 ? OUT_BUFFER_SIZE : RECORD_HEADER_SIZE + spaces * 2);
+		if (config->bot_budget_ms > 0) {
+			w->bot = bot_create(1, config->bot_budget_ms);
+		}
+
+		if (!w->l || !w->empty || !w->out || (config->bot_budget_ms > 0 && !w->bot)) {
+			run.error = -1;
+		}
+	}
+
+	Pool *pool = run.error ? NULL : pool_create(run.workers_len);
+	if (!pool) {
+		free_workers(&run);
+		pthread_mutex_destroy(&run.out_lock);
+		return -1;
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (size_t i = 0; i < run.workers_len; i++) {
+		if (pool_submit(pool, worker_run, &run.workers[i]) < 0) {
+			__atomic_store_n(&run.error, -1, __ATOMIC_RELAXED);
+		}
+	}
+
+	// The workers could be waited on right away, but this thread has nothing
+	// else to do so it reports progress until they are done.
+	for (unsigned long polls = 1; config->show_progress; polls++) {
+		nanosleep(&(struct timespec){ .tv_nsec = PROGRESS_POLL_NS }, NULL);
+
+		const unsigned long played = __atomic_load_n(&run.played, __ATOMIC_RELAXED);
+		if (played >= config->games || __atomic_load_n(&run.error, __ATOMIC_RELAXED)) {
+			break;
+		} else if (polls % PROGRESS_POLLS == 0) {
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			const double seconds = (double)(now.tv_sec - start.tv_sec) + (double)(now.tv_nsec - start.tv_nsec) / 1e9;
+			fprintf(stderr, "games=%lu games/sec=%.0f\n", played, (double)played / seconds);
+		}
+	}
+	pool_wait(pool);
+	pool_free(pool);
+
+	if (stats) {
+		struct timespec end;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		memset(stats, 0, sizeof *stats);
+		stats->seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+		for (size_t i = 0; i < run.workers_len; i++) {
+			const SelfplayStats *s = &run.workers[i].stats;
+			stats->games += s->games;
+			stats->moves += s->moves;
+			stats->o_wins += s->o_wins;
+			stats->x_wins += s->x_wins;
+			stats->steals += s->steals;
+		}
+	}
+
+	free_workers(&run);
+	pthread_mutex_destroy(&run.out_lock);
+
+	if (run.error || fflush(out) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int selfplay_read_header(FILE *in) {
+	char magic[SELFPLAY_MAGIC_SIZE];
+	if (fread(magic, 1, SELFPLAY_MAGIC_SIZE, in) != SELFPLAY_MAGIC_SIZE || memcmp(magic, SELFPLAY_MAGIC, SELFPLAY_MAGIC_SIZE) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int selfplay_read(FILE *in, SelfplayGame *game) {
+	unsigned char header[RECORD_HEADER_SIZE];
+	const size_t header_len = fread(header, 1, RECORD_HEADER_SIZE, in);
+	if (header_len == 0 && feof(in)) {
+		return 0;
+	} else if (header_len != RECORD_HEADER_SIZE) {
+		return -1;
+	}
+
+	game->rows = header[0];
+	game->cols = header[1];
+	game->winner = (char)header[2];
+	game->moves_len = get_u16(header + 3);
+
+	if (game->moves_len > game->moves_size) {
+		uint16_t *moves = realloc(game->moves, sizeof *moves * game->moves_len);
+		if (!moves) {
+			return -1;
+		}
+		game->moves = moves;
+		game->moves_size = game->moves_len;
+	}
+
+	for (size_t i = 0; i < game->moves_len; i++) {
+		unsigned char move[2];
+		if (fread(move, 1, sizeof move, in) != sizeof move) {
+			return -1;
+		}
+		game->moves[i] = get_u16(move);
+	}
+
+	return 1;
+}
@@ -0,0 +1,96 @@
+#ifndef SELFPLAY_H_
+#define SELFPLAY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @brief Plays games between two computer players without a server, spread
+ * over worker threads, and writes every game to a file.
+ *
+ * Each worker owns a range of game numbers. A worker that runs out takes the
+ * upper half of another worker's remaining range, so threads stay busy until
+ * the last game even when games differ in length. Games are seeded by their
+ * number, so a game can be played again with the same seed no matter which
+ * thread played it.
+ *
+ * The file starts with the magic "NOGOSPL1" followed by one record per game
+ * in the order the games finished:
+ *
+ *     rows (u8) cols (u8) winner (u8) moves_len (u16) moves (u16 each)
+ *
+ * Integers are little-endian. A move is row * cols + col, and the teams take
+ * turns starting with O, so every position of the game can be rebuilt from the
+ * record.
+ *
+ */
+
+#define SELFPLAY_MAX_SIZE 255 // Rows and cols are stored in a byte.
+
+typedef struct SelfplayConfig {
+	size_t rows;
+	size_t cols;
+	unsigned long games; // Number of games to play.
+	size_t threads; // Number of threads to play on.
+	uint64_t seed;
+	long bot_budget_ms; // Moves are chosen by the bot when > 0. Played at random otherwise.
+	bool show_progress; // Print the number of games played every second to stderr.
+} SelfplayConfig;
+
+/**
+ * @brief Statistics of a run.
+ *
+ */
+typedef struct SelfplayStats {
+	unsigned long games;
+	unsigned long moves;
+	unsigned long o_wins;
+	unsigned long x_wins;
+	unsigned long steals; // Times a worker took games from another worker.
+	double seconds;
+} SelfplayStats;
+
+/**
+ * @brief A game read back from a self-play file.
+ *
+ */
+typedef struct SelfplayGame {
+	size_t rows;
+	size_t cols;
+	char winner;
+	size_t moves_len;
+	uint16_t *moves; // Grown by selfplay_read(). Must be freed by the caller.
+	size_t moves_size;
+} SelfplayGame;
+
+/**
+ * @brief Plays the configured games and writes them to out.
+ *
+ * @param config The games to play.
+ * @param out The file the games are written to. Written from the start.
+ * @param stats Set to the statistics of the run. May be NULL.
+ * @return int -1 on error. 0 otherwise.
+ */
+int selfplay_run(const SelfplayConfig *config, FILE *out, SelfplayStats *stats);
+
+/**
+ * @brief Checks that the file starts with a self-play header. Must be called
+ * before reading games.
+ *
+ * @param in The file to read.
+ * @return int -1 if the file is not a self-play file. 0 otherwise.
+ */
+int selfplay_read_header(FILE *in);
+
+/**
+ * @brief Reads the next game in the file.
+ *
+ * @param in The file to read.
+ * @param game Set to the game read. Zero it before the first call.
+ * @return int 1 if a game was read. 0 at the end of the file. -1 on error.
+ */
+int selfplay_read(FILE *in, SelfplayGame *game);
+
+#endif
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "selfplay.h"
+
+static void usage(void) {
+	printf("usage: nogos-selfplay [-b bot_budget_ms] [-g games] [-r seed] [-s size] [-t threads] output\n");
+}
+
+int main(int argc, char **argv) {
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	SelfplayConfig config = {
+		.rows = 9,
+		.cols = 9,
+		.games = 1000,
+		.threads = cpus > 0 ? (size_t)cpus : 1,
+		.seed = (uint64_t)time(NULL),
+		.show_progress = true,
+	};
+
+	int opt;
+	while ((opt = getopt(argc, argv, "b:g:r:s:t:")) != -1) {
+		switch (opt) {
+		case 'b':
+			config.bot_budget_ms = strtol(optarg, NULL, 10);
+			break;
+		case 'g':
+			config.games = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			config.seed = strtoull(optarg, NULL, 10);
+			break;
+		case 's':
+			config.rows = config.cols = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			config.threads = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+			exit(64);
+		}
+	}
+
+	if (optind >= argc) {
+		usage();
+		exit(64);
+	}
+
+	const char *path = argv[optind];
+	FILE *out = fopen(path, "wb");
+	if (!out) {
+		perror("selfplay: open");
+		exit(74);
+	}
+
+	printf("Playing %lu games of %zux%zu on %zu threads with seed %llu\n",
+		config.games, config.rows, config.cols, config.threads, (unsigned long long)config.seed);
+
+	SelfplayStats stats;
+	const int status = selfplay_run(&config, out, &stats);
+	if (fclose(out) != 0 || status < 0) {
+		LOG_ERROR("failed to write %s\n", path);
+		exit(74);
+	}
+
+	printf("games=%lu moves=%lu o_wins=%lu x_wins=%lu steals=%lu seconds=%.3f games/sec=%.0f games/hour=%.0f\n",
+		stats.games, stats.moves, stats.o_wins, stats.x_wins, stats.steals, stats.seconds,
+		(double)stats.games / stats.seconds, (double)stats.games / stats.seconds * 3600);
+
+	return 0;
+}
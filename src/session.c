@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+
+#include "session.h"
+
+#define SLOTS_START 64
+#define SECRET_SIZE 16
+#define FD_DIGITS 8
+#define NODE_SHIFT 24 // The top byte of the connection names the node. See sessions_set_node().
+#define FD_MASK ((1u << NODE_SHIFT) - 1)
+
+typedef enum SlotState {
+	SLOT_NONE,
+	SLOT_LIVE, // Issued a token and connected.
+	SLOT_DETACHED, // Lost. Output is held until taken over or expired.
+	SLOT_MOVED, // Taken over. Output is forwarded until released.
+	SLOT_EXPIRED, // Not taken over in time. Output is dropped until released.
+} SlotState;
+
+typedef struct Slot {
+	SlotState state;
+	unsigned char secret[SECRET_SIZE];
+
+	uint64_t detached_ms;
+	bool is_overflowed; // More output than SESSION_PENDING_MAX was held.
+	char *pending;
+	size_t pending_len;
+	size_t pending_size;
+
+	int moved_to;
+} Slot;
+
+struct Sessions {
+	uint64_t grace_ms;
+	uint32_t node;
+
+	Slot *slots; // Indexed by fd.
+	size_t slots_len;
+
+	size_t detached;
+	char *handed; // Output held for the last session taken over. See sessions_resume().
+};
+
+Sessions *sessions_create(uint64_t grace_ms) {
+	Sessions *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+
+	result->grace_ms = grace_ms;
+	result->slots = calloc(SLOTS_START, sizeof *result->slots);
+	result->slots_len = SLOTS_START;
+	if (!result->slots) {
+		free(result);
+		return NULL;
+	}
+
+	return result;
+}
+
+void sessions_free(Sessions *s) {
+	for (size_t i = 0; i < s->slots_len; i++) {
+		free(s->slots[i].pending);
+	}
+	free(s->slots);
+	free(s->handed);
+	free(s);
+}
+
+static Slot *get_slot(const Sessions *s, int fd) {
+	return fd >= 0 && (size_t)fd < s->slots_len ? &s->slots[fd] : NULL;
+}
+
+static void write_token(uint32_t node, int fd, const unsigned char *secret, char *token) {
+	snprintf(token, FD_DIGITS + 1, "%08x", (unsigned int)(node << NODE_SHIFT | (uint32_t)fd));
+	for (size_t i = 0; i < SECRET_SIZE; i++) {
+		snprintf(&token[FD_DIGITS + i * 2], 3, "%02x", secret[i]);
+	}
+}
+
+/**
+ * @brief Parses a hex digit. Returns -1 if c is not one.
+ *
+ */
+static int hex_value(char c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	} else if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+/**
+ * @brief Reads the node, the connection and the secret out of a token.
+ *
+ * @return int -1 if the token is malformed. 0 otherwise.
+ */
+static int read_token(const char *token, uint32_t *node, int *fd, unsigned char *secret) {
+	if (strlen(token) != SESSION_TOKEN_LEN) {
+		return -1;
+	}
+
+	uint32_t value = 0;
+	for (size_t i = 0; i < FD_DIGITS; i++) {
+		const int digit = hex_value(token[i]);
+		if (digit < 0) {
+			return -1;
+		}
+		value = value << 4 | (uint32_t)digit;
+	}
+	*node = value >> NODE_SHIFT;
+	*fd = (int)(value & FD_MASK);
+
+	for (size_t i = 0; i < SECRET_SIZE; i++) {
+		const int high = hex_value(token[FD_DIGITS + i * 2]);
+		const int low = hex_value(token[FD_DIGITS + i * 2 + 1]);
+		if (high < 0 || low < 0) {
+			return -1;
+		}
+		secret[i] = (unsigned char)(high << 4 | low);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Makes sure there is a slot for the connection.
+ *
+ * @return int -1 if the function failed to allocate extra space. 0 otherwise.
+ */
+static int reserve(Sessions *s, int fd) {
+	if ((size_t)fd >= s->slots_len) {
+		size_t len = s->slots_len;
+		while ((size_t)fd >= len) {
+			len *= 2;
+		}
+
+		Slot *slots = realloc(s->slots, sizeof *slots * len);
+		if (!slots) {
+			return -1;
+		}
+		memset(&slots[s->slots_len], 0, sizeof *slots * (len - s->slots_len));
+		s->slots = slots;
+		s->slots_len = len;
+	}
+
+	return 0;
+}
+
+void sessions_set_node(Sessions *s, uint32_t node) {
+	s->node = node;
+}
+
+int sessions_node(const char *token) {
+	uint32_t node;
+	int fd;
+	unsigned char secret[SECRET_SIZE];
+	return read_token(token, &node, &fd, secret) < 0 ? -1 : (int)node;
+}
+
+int sessions_open(Sessions *s, int fd, char token[SESSION_TOKEN_SIZE]) {
+	if (fd < 0 || (uint32_t)fd > FD_MASK || reserve(s, fd) < 0) {
+		return -1;
+	}
+
+	Slot *slot = &s->slots[fd];
+	if (slot->state != SLOT_NONE || getrandom(slot->secret, SECRET_SIZE, 0) != SECRET_SIZE) {
+		return -1;
+	}
+
+	slot->state = SLOT_LIVE;
+	write_token(s->node, fd, slot->secret, token);
+	return 0;
+}
+
+int sessions_token(const Sessions *s, int fd, char token[SESSION_TOKEN_SIZE]) {
+	const Slot *slot = get_slot(s, fd);
+	if (!slot || slot->state != SLOT_LIVE) {
+		return -1;
+	}
+
+	write_token(s->node, fd, slot->secret, token);
+	return 0;
+}
+
+int sessions_restore(Sessions *s, const char *token) {
+	uint32_t node;
+	int fd;
+	unsigned char secret[SECRET_SIZE];
+	if (read_token(token, &node, &fd, secret) < 0 || node != s->node || reserve(s, fd) < 0 || s->slots[fd].state != SLOT_NONE) {
+		return -1;
+	}
+
+	s->slots[fd].state = SLOT_LIVE;
+	memcpy(s->slots[fd].secret, secret, SECRET_SIZE);
+	return 0;
+}
+
+int sessions_detach(Sessions *s, int fd, uint64_t now_ms) {
+	Slot *slot = get_slot(s, fd);
+	if (!slot || slot->state != SLOT_LIVE) {
+		return -1;
+	}
+
+	slot->state = SLOT_DETACHED;
+	slot->detached_ms = now_ms;
+	slot->is_overflowed = false;
+	slot->pending_len = 0;
+	s->detached++;
+
+	return 0;
+}
+
+int sessions_resume(Sessions *s, const char *token, int fd, char new_token[SESSION_TOKEN_SIZE], int *old_fd,
+	const char **pending, size_t *pending_len) {
+	uint32_t node;
+	int from;
+	unsigned char secret[SECRET_SIZE];
+	if (read_token(token, &node, &from, secret) < 0 || node != s->node || from == fd) {
+		return -1;
+	}
+
+	// A session whose connection still looks alive may be taken over, as the
+	// loss may not have been noticed yet. Output that overflowed is
+	// incomplete, so that session can't be picked up.
+	Slot *old = get_slot(s, from);
+	if (!old || (old->state != SLOT_DETACHED && old->state != SLOT_LIVE) || old->is_overflowed) {
+		return -1;
+	}
+
+	// Every byte is compared so the time taken says nothing about the secret.
+	unsigned char diff = 0;
+	for (size_t i = 0; i < SECRET_SIZE; i++) {
+		diff |= (unsigned char)(old->secret[i] ^ secret[i]);
+	}
+	if (diff != 0 || sessions_open(s, fd, new_token) < 0) {
+		return -1;
+	}
+	old = &s->slots[from]; // Opening may have moved the slots.
+	if (old->state == SLOT_DETACHED) {
+		s->detached--;
+	}
+
+	free(s->handed);
+	s->handed = old->pending;
+	*pending = old->pending;
+	*pending_len = old->pending_len;
+	*old_fd = from;
+
+	old->state = SLOT_MOVED;
+	old->moved_to = fd;
+	old->pending = NULL;
+	old->pending_len = 0;
+	old->pending_size = 0;
+
+	return 0;
+}
+
+/**
+ * @brief Holds a message for a detached connection.
+ *
+ */
+static void hold(Slot *slot, const void *buf, size_t len) {
+	if (slot->is_overflowed) {
+		return;
+	} else if (slot->pending_len + len > SESSION_PENDING_MAX) {
+		slot->is_overflowed = true;
+		return;
+	}
+
+	if (slot->pending_len + len > slot->pending_size) {
+		size_t size = slot->pending_size > 0 ? slot->pending_size : 512;
+		while (slot->pending_len + len > size) {
+			size *= 2;
+		}
+
+		char *pending = realloc(slot->pending, size);
+		if (!pending) {
+			slot->is_overflowed = true;
+			return;
+		}
+		slot->pending = pending;
+		slot->pending_size = size;
+	}
+
+	memcpy(&slot->pending[slot->pending_len], buf, len);
+	slot->pending_len += len;
+}
+
+int sessions_deliver(Sessions *s, int fd, const void *buf, size_t len) {
+	// A session taken over may be taken over again before it is released.
+	for (size_t hops = 0; hops < s->slots_len; hops++) {
+		Slot *slot = get_slot(s, fd);
+		if (!slot) {
+			return fd;
+		}
+
+		switch (slot->state) {
+		case SLOT_MOVED:
+			fd = slot->moved_to;
+			continue;
+		case SLOT_DETACHED:
+			hold(slot, buf, len);
+			return -1;
+		case SLOT_EXPIRED:
+			return -1;
+		case SLOT_NONE:
+		case SLOT_LIVE:
+		default:
+			return fd;
+		}
+	}
+
+	return -1;
+}
+
+size_t sessions_expire(Sessions *s, uint64_t now_ms, int *expired, size_t expired_size) {
+	size_t result = 0;
+
+	for (size_t i = 0; i < s->slots_len && s->detached > 0 && result < expired_size; i++) {
+		Slot *slot = &s->slots[i];
+		if (slot->state != SLOT_DETACHED || (!slot->is_overflowed && now_ms - slot->detached_ms < s->grace_ms)) {
+			continue;
+		}
+
+		free(slot->pending);
+		slot->pending = NULL;
+		slot->pending_len = 0;
+		slot->pending_size = 0;
+		slot->state = SLOT_EXPIRED;
+		s->detached--;
+
+		expired[result++] = (int)i;
+	}
+
+	return result;
+}
+
+size_t sessions_detached(const Sessions *s) {
+	return s->detached;
+}
+
+void sessions_release(Sessions *s, int fd) {
+	Slot *slot = get_slot(s, fd);
+	if (!slot) {
+		return;
+	}
+
+	if (slot->state == SLOT_DETACHED) {
+		s->detached--;
+	}
+	free(slot->pending);
+	memset(slot, 0, sizeof *slot);
+}
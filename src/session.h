@@ -0,0 +1,168 @@
+#ifndef SESSION_H_
+#define SESSION_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SESSION_TOKEN_LEN 40 // Node and connection in 8 hex digits, then a 128 bit secret in 32.
+#define SESSION_TOKEN_SIZE (SESSION_TOKEN_LEN + 1)
+#define SESSION_PENDING_MAX 65536 // Output held for a detached session before it is given up on.
+
+/**
+ * @brief Lets a player who lost their connection pick up where they left off
+ * from a new one. Meant to be owned by the thread that owns the connections.
+ *
+ * A logged in connection is issued a token. When the connection is lost it is
+ * detached instead of closed: it is kept open so its number is not reused,
+ * and everything sent to it is held. A new connection that presents the token
+ * within the grace period takes over, is sent what was held, and is issued a
+ * new token. Whatever is still sent to the old connection is forwarded until
+ * it is released. Detached connections that are not taken over in time, or
+ * that are held more than SESSION_PENDING_MAX for, expire.
+ *
+ * Sessions are indexed by connection, which the token names, so nothing is
+ * searched. The token also names the node the server is in a cluster, so a
+ * router can send the new connection to the server holding the session. See
+ * cluster.h.
+ *
+ */
+typedef struct Sessions Sessions;
+
+/**
+ * @brief Creates sessions.
+ *
+ * @param grace_ms How long a detached connection may be taken over for.
+ * @return Sessions* The created sessions. NULL if an error occurred.
+ */
+Sessions *sessions_create(uint64_t grace_ms);
+
+/**
+ * @brief Frees the sessions. No connection is closed.
+ *
+ * @param s The sessions to free.
+ */
+void sessions_free(Sessions *s);
+
+/**
+ * @brief Sets the node named by the tokens issued from now on. Only tokens
+ * naming the node are taken. Sessions start at node 0.
+ *
+ * @param s The sessions to update.
+ * @param node The node, less than 256.
+ */
+void sessions_set_node(Sessions *s, uint32_t node);
+
+/**
+ * @brief Reads the node out of a token without checking anything else.
+ *
+ * @param token The token.
+ * @return int The node. -1 if the token is malformed.
+ */
+int sessions_node(const char *token);
+
+/**
+ * @brief Issues a token to a connection.
+ *
+ * @param s The sessions to add to.
+ * @param fd The connection.
+ * @param token Set to the token, null terminated.
+ * @return int -1 if the connection already has a session, does not fit in the
+ * token or no secret could be made. 0 otherwise.
+ */
+int sessions_open(Sessions *s, int fd, char token[SESSION_TOKEN_SIZE]);
+
+/**
+ * @brief Gets the token of a connection's live session, such as to hand the
+ * session to another server.
+ *
+ * @param s The sessions to check.
+ * @param fd The connection.
+ * @param token Set to the token, null terminated.
+ * @return int -1 if the connection has no live session. 0 otherwise.
+ */
+int sessions_token(const Sessions *s, int fd, char token[SESSION_TOKEN_SIZE]);
+
+/**
+ * @brief Issues a token that sessions_token() got from another server to the
+ * connection the token names, which the connection keeps.
+ *
+ * @param s The sessions to add to.
+ * @param token The token.
+ * @return int -1 if the token is malformed or its connection already has a session. 0 otherwise.
+ */
+int sessions_restore(Sessions *s, const char *token);
+
+/**
+ * @brief Starts holding what is sent to a connection that was lost.
+ *
+ * @param s The sessions to update.
+ * @param fd The connection. Should be left open until released.
+ * @param now_ms The current time in milliseconds.
+ * @return int -1 if the connection has no live session. 0 otherwise.
+ */
+int sessions_detach(Sessions *s, int fd, uint64_t now_ms);
+
+/**
+ * @brief Hands a session to a new connection, which is issued a new token.
+ * A session that was not detached yet may be taken over as well, since a lost
+ * connection may not have been noticed. Its connection should be shut down.
+ *
+ * @param s The sessions to update.
+ * @param token The token of the session.
+ * @param fd The new connection.
+ * @param new_token Set to the token of the new connection, null terminated.
+ * @param old_fd Set to the connection the session was taken from. The caller
+ * should have it released once nothing is sent to it anymore.
+ * @param pending Set to what was held for the old connection, to be sent
+ * before anything else. Valid until the next call.
+ * @param pending_len Set to the length of pending.
+ * @return int -1 if the token names no session or the new connection already
+ * has one. 0 otherwise.
+ */
+int sessions_resume(Sessions *s, const char *token, int fd, char new_token[SESSION_TOKEN_SIZE], int *old_fd,
+	const char **pending, size_t *pending_len);
+
+/**
+ * @brief Decides what to do with a message for a connection.
+ *
+ * @param s The sessions to check.
+ * @param fd The connection the message is for.
+ * @param buf The message.
+ * @param len The length of buf.
+ * @return int The connection to send the message to, which is fd unless the
+ * session was taken over. -1 if the message was held or dropped.
+ */
+int sessions_deliver(Sessions *s, int fd, const void *buf, size_t len);
+
+/**
+ * @brief Takes the detached connections that were not taken over in time. They
+ * no longer hold anything and should be disconnected and then released.
+ *
+ * @param s The sessions to check.
+ * @param now_ms The current time in milliseconds.
+ * @param expired Set to the expired connections.
+ * @param expired_size The most connections to take.
+ * @return size_t The number of expired connections.
+ */
+size_t sessions_expire(Sessions *s, uint64_t now_ms, int *expired, size_t expired_size);
+
+/**
+ * @brief Returns the number of detached connections, which need
+ * sessions_expire() called now and then.
+ *
+ * @param s The sessions to check.
+ * @return size_t The number of detached connections.
+ */
+size_t sessions_detached(const Sessions *s);
+
+/**
+ * @brief Forgets a connection, such as when it is closed. Does nothing if the
+ * connection has no session.
+ *
+ * @param s The sessions to update.
+ * @param fd The connection.
+ */
+void sessions_release(Sessions *s, int fd);
+
+#endif
@@ -0,0 +1,419 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "pool.h"
+#include "solver.h"
+
+#define TABLE_MAGIC "NOGOSOL1"
+#define TABLE_MAGIC_SIZE 8
+
+#define DEADLINE_CHECK_NODES 1023 // Check the clock every this many nodes.
+
+// Entry data holds the result in the low bits and the best move above it.
+#define DATA_RESULT_MASK 0x3
+#define DATA_HAS_BEST 0x4
+#define DATA_BEST_SHIFT 3
+
+/**
+ * @brief A transposition table entry. check is the position's key xor'd with
+ * data, so a reader can tell whether both halves were written together.
+ *
+ */
+typedef struct Entry {
+	uint64_t check;
+	uint64_t data;
+} Entry;
+
+/**
+ * @brief Layout of a saved table. The header is followed by count DiskEntry
+ * sorted by key, stored in the host's byte order so the file can be mapped
+ * and searched directly.
+ *
+ */
+typedef struct DiskHeader {
+	char magic[TABLE_MAGIC_SIZE];
+	uint64_t count;
+} DiskHeader;
+
+typedef struct DiskEntry {
+	uint64_t key;
+	uint64_t data;
+} DiskEntry;
+
+struct Solver {
+	Pool *pool;
+	size_t searching; // Solves running at once, which split the pool between them.
+
+	Entry *table;
+	size_t table_mask;
+
+	void *disk; // Mapped table loaded from disk. NULL if none was loaded.
+	size_t disk_size;
+	const DiskEntry *disk_entries;
+	size_t disk_len;
+};
+
+/**
+ * @brief The state of one thread's search.
+ *
+ */
+typedef struct Search {
+	Solver *solver;
+	int *stop; // Shared by the threads of one solve. Set once any of them finishes so the others give up.
+	Lobby *l; // Private copy of the position being searched.
+	size_t order; // Offsets the move order so threads search different moves first.
+
+	bool has_deadline;
+	struct timespec deadline;
+
+	uint16_t *moves; // SOLVER_MAX_SPACES moves for every depth.
+	unsigned long nodes;
+	SolverResult result;
+} Search;
+
+static bool is_stopped(const Search *s) {
+	return __atomic_load_n(s->stop, __ATOMIC_RELAXED) != 0;
+}
+
+static SolverResult lookup(const Solver *s, uint64_t hash, uint16_t *best, bool *has_best) {
+	const Entry *e = &s->table[hash & s->table_mask];
+	uint64_t data = __atomic_load_n(&e->data, __ATOMIC_RELAXED);
+	const uint64_t check = __atomic_load_n(&e->check, __ATOMIC_RELAXED);
+
+	if (data == 0 || (check ^ data) != hash) {
+		data = 0;
+
+		size_t lo = 0;
+		size_t hi = s->disk_len;
+		while (lo < hi) {
+			const size_t mid = lo + (hi - lo) / 2;
+			if (s->disk_entries[mid].key < hash) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+
+		if (lo < s->disk_len && s->disk_entries[lo].key == hash) {
+			data = s->disk_entries[lo].data;
+		}
+	}
+
+	*has_best = (data & DATA_HAS_BEST) != 0;
+	*best = (uint16_t)(data >> DATA_BEST_SHIFT);
+	return (SolverResult)(data & DATA_RESULT_MASK);
+}
+
+static void store(Solver *s, uint64_t hash, SolverResult result, uint16_t best, bool has_best) {
+	const uint64_t data = (uint64_t)result | (has_best ? DATA_HAS_BEST | (uint64_t)best << DATA_BEST_SHIFT : 0);
+
+	Entry *e = &s->table[hash & s->table_mask];
+	__atomic_store_n(&e->check, hash ^ data, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->data, data, __ATOMIC_RELAXED);
+}
+
+static bool past_deadline(const struct timespec *deadline) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+static SolverResult solve(Search *s, size_t depth) {
+	if (is_stopped(s)) {
+		return SOLVER_UNKNOWN;
+	}
+
+	s->nodes++;
+	if (s->has_deadline && (s->nodes & DEADLINE_CHECK_NODES) == 0 && past_deadline(&s->deadline)) {
+		__atomic_store_n(s->stop, 1, __ATOMIC_RELAXED);
+		return SOLVER_UNKNOWN;
+	}
+
+	const int winner = lobby_winner(s->l);
+	if (winner != -1) {
+		return winner == lobby_turn(s->l) ? SOLVER_WIN : SOLVER_LOSS;
+	}
+
+	uint16_t best;
+	bool has_best;
+	const SolverResult known = lookup(s->solver, lobby_hash(s->l), &best, &has_best);
+	if (known != SOLVER_UNKNOWN) {
+		return known;
+	}
+
+	uint16_t *moves = s->moves + depth * SOLVER_MAX_SPACES;
+	const size_t moves_len = lobby_empty(s->l, moves);
+
+	// Only the first few plies are reordered. Deeper down the threads meet in
+	// the shared table anyway.
+	const size_t offset = depth < 2 && moves_len > 0 ? (s->order * (depth + 1)) % moves_len : 0;
+	const char team = lobby_turn(s->l);
+
+	for (size_t i = 0; i < moves_len; i++) {
+		const uint16_t space = moves[(i + offset) % moves_len];
+
+		lobby_place(s->l, team, space / s->l->board.cols, space % s->l->board.cols);
+		const SolverResult child = solve(s, depth + 1);
+		lobby_undo(s->l);
+
+		if (child == SOLVER_UNKNOWN) {
+			return SOLVER_UNKNOWN;
+		} else if (child == SOLVER_LOSS) {
+			store(s->solver, lobby_hash(s->l), SOLVER_WIN, space, true);
+			return SOLVER_WIN;
+		}
+	}
+
+	store(s->solver, lobby_hash(s->l), SOLVER_LOSS, 0, false);
+	return SOLVER_LOSS;
+}
+
+static void search_run(void *arg) {
+	Search *s = arg;
+
+	s->result = solve(s, 0);
+	if (s->result != SOLVER_UNKNOWN) {
+		__atomic_store_n(s->stop, 1, __ATOMIC_RELAXED);
+	}
+}
+
+Solver *solver_create(size_t threads, size_t table_bits) {
+	Solver *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+
+	const size_t table_len = (size_t)1 << table_bits;
+	result->table = calloc(table_len, sizeof *result->table);
+	result->table_mask = table_len - 1;
+	result->pool = pool_create(threads);
+	if (!result->table || !result->pool) {
+		free(result->table);
+		if (result->pool) {
+			pool_free(result->pool);
+		}
+		free(result);
+		return NULL;
+	}
+
+	return result;
+}
+
+void solver_free(Solver *s) {
+	if (s->disk) {
+		munmap(s->disk, s->disk_size);
+	}
+	pool_free(s->pool);
+	free(s->table);
+	free(s);
+}
+
+static LobbyMove space_move(const Lobby *l, uint16_t space) {
+	return (LobbyMove){ .team = lobby_turn(l), .row = space / l->board.cols, .col = space % l->board.cols };
+}
+
+SolverResult solver_probe(Solver *s, const Lobby *l, LobbyMove *best) {
+	uint16_t space;
+	bool has_best;
+	const SolverResult result = lookup(s, lobby_hash(l), &space, &has_best);
+
+	if (best && has_best) {
+		*best = space_move(l, space);
+	}
+
+	return result;
+}
+
+SolverResult solver_solve(Solver *s, const Lobby *l, long budget_ms, LobbyMove *best, SolverStats *stats) {
+	if (l->board.rows * l->board.cols > SOLVER_MAX_SPACES) {
+		LOG_ERROR("board is too large to solve\n");
+		return SOLVER_UNKNOWN;
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	struct timespec deadline = start;
+	deadline.tv_sec += budget_ms / 1000;
+	deadline.tv_nsec += (budget_ms % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	// Solves running at once split the pool between them and meet in the
+	// shared table. The calling thread searches as well.
+	const size_t searching = __atomic_add_fetch(&s->searching, 1, __ATOMIC_RELAXED);
+	const size_t slice = pool_threads(s->pool) / searching;
+	const size_t threads = slice > 0 ? slice : 1;
+
+	Search *searches = calloc(threads, sizeof *searches);
+	if (!searches) {
+		__atomic_sub_fetch(&s->searching, 1, __ATOMIC_RELAXED);
+		return SOLVER_UNKNOWN;
+	}
+
+	int stop = 0;
+	const size_t depth_max = l->board.rows * l->board.cols + 1;
+
+	PoolGroup group = { 0 };
+	size_t started = 0;
+	for (size_t i = 0; i < threads; i++) {
+		Search *search = &searches[i];
+		search->solver = s;
+		search->stop = &stop;
+		search->l = lobby_clone(l);
+		search->order = i;
+		search->has_deadline = budget_ms > 0;
+		search->deadline = deadline;
+		search->moves = malloc(sizeof *search->moves * SOLVER_MAX_SPACES * depth_max);
+
+		if (!search->l || !search->moves || (i > 0 && pool_submit_group(s->pool, &group, search_run, search) < 0)) {
+			break;
+		}
+		started++;
+	}
+	if (started > 0) {
+		search_run(&searches[0]);
+	}
+	pool_wait_group(s->pool, &group);
+	__atomic_sub_fetch(&s->searching, 1, __ATOMIC_RELAXED);
+
+	SolverResult result = SOLVER_UNKNOWN;
+	unsigned long nodes = 0;
+	for (size_t i = 0; i < threads; i++) {
+		if (searches[i].result != SOLVER_UNKNOWN) {
+			result = searches[i].result;
+		}
+		nodes += searches[i].nodes;
+
+		if (searches[i].l) {
+			lobby_free(searches[i].l);
+		}
+		free(searches[i].moves);
+	}
+	free(searches);
+
+	if (best && result == SOLVER_WIN) {
+		solver_probe(s, l, best);
+	}
+
+	if (stats) {
+		struct timespec end;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		stats->nodes = nodes;
+		stats->seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+	}
+
+	return result;
+}
+
+int solver_load(Solver *s, const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+
+	struct stat st;
+	void *disk = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(DiskHeader)) {
+		disk = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+
+	if (disk == MAP_FAILED) {
+		return -1;
+	}
+
+	const DiskHeader *header = disk;
+	if (memcmp(header->magic, TABLE_MAGIC, TABLE_MAGIC_SIZE) != 0 || sizeof *header + header->count * sizeof(DiskEntry) != (size_t)st.st_size) {
+		LOG_ERROR("%s is not a solver table\n", path);
+		munmap(disk, (size_t)st.st_size);
+		return -1;
+	}
+
+	if (s->disk) {
+		munmap(s->disk, s->disk_size);
+	}
+
+	s->disk = disk;
+	s->disk_size = (size_t)st.st_size;
+	s->disk_entries = (const DiskEntry *)(const void *)((const unsigned char *)disk + sizeof *header);
+	s->disk_len = header->count;
+
+	return 0;
+}
+
+static int compare_keys(const void *a, const void *b) {
+	const uint64_t ka = ((const DiskEntry *)a)->key;
+	const uint64_t kb = ((const DiskEntry *)b)->key;
+	return ka < kb ? -1 : ka > kb;
+}
+
+int solver_save(Solver *s, const char *path) {
+	const size_t table_len = s->table_mask + 1;
+	DiskEntry *entries = malloc(sizeof *entries * (table_len + s->disk_len));
+	if (!entries) {
+		return -1;
+	}
+
+	size_t len = 0;
+	if (s->disk_len > 0) {
+		memcpy(entries, s->disk_entries, sizeof *entries * s->disk_len);
+		len = s->disk_len;
+	}
+	for (size_t i = 0; i < table_len; i++) {
+		if (s->table[i].data != 0) {
+			entries[len++] = (DiskEntry){ .key = s->table[i].check ^ s->table[i].data, .data = s->table[i].data };
+		}
+	}
+
+	// A position solved twice has the same result both times, so whichever
+	// duplicate sorts first is kept.
+	qsort(entries, len, sizeof *entries, compare_keys);
+	size_t unique = 0;
+	for (size_t i = 0; i < len; i++) {
+		if (unique == 0 || entries[unique - 1].key != entries[i].key) {
+			entries[unique++] = entries[i];
+		}
+	}
+
+	DiskHeader header;
+	memset(&header, 0, sizeof header);
+	memcpy(header.magic, TABLE_MAGIC, TABLE_MAGIC_SIZE);
+	header.count = unique;
+
+	const size_t path_len = strlen(path);
+	char *tmp_path = malloc(path_len + sizeof ".tmp");
+	if (!tmp_path) {
+		free(entries);
+		return -1;
+	}
+	memcpy(tmp_path, path, path_len);
+	memcpy(tmp_path + path_len, ".tmp", sizeof ".tmp");
+
+	int result = -1;
+	FILE *f = fopen(tmp_path, "wb");
+	if (f) {
+		const bool wrote = fwrite(&header, sizeof header, 1, f) == 1 && fwrite(entries, sizeof *entries, unique, f) == unique;
+		if (fclose(f) == 0 && wrote) {
+			result = rename(tmp_path, path);
+		}
+	}
+
+	if (result < 0) {
+		perror("solver: save");
+	}
+
+	free(tmp_path);
+	free(entries);
+	return result;
+}
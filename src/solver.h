@@ -0,0 +1,104 @@
+#ifndef SOLVER_H_
+#define SOLVER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lobby.h"
+
+// Largest board the solver will search. Bigger boards are out of reach of an
+// exact search anyway.
+#define SOLVER_MAX_SPACES 64
+
+/**
+ * @brief Solves small boards exactly. Positions are searched to the end of the
+ * game with alpha-beta, which for a game that can only be won or lost means a
+ * position is a win as soon as one move leads to a loss for the opponent.
+ *
+ * Solved positions are kept in a transposition table keyed by lobby_hash()
+ * that is shared by all search threads without locks: each entry stores its
+ * key xor'd with its data, so an entry torn by two threads writing at once
+ * fails the key check and is ignored. Solved positions can be saved to a
+ * sorted table on disk, which is mapped and searched on later runs, so a
+ * position solved once is answered with a single lookup.
+ *
+ */
+typedef struct Solver Solver;
+
+typedef enum SolverResult {
+	SOLVER_UNKNOWN, // Not solved, either because it was not searched or the search ran out of time.
+	SOLVER_WIN, // The team to move wins with perfect play.
+	SOLVER_LOSS, // The team to move loses against perfect play.
+} SolverResult;
+
+/**
+ * @brief Statistics of a single solve.
+ *
+ */
+typedef struct SolverStats {
+	unsigned long nodes; // Positions searched across all threads.
+	double seconds;
+} SolverStats;
+
+/**
+ * @brief Creates a solver.
+ *
+ * @param threads The number of threads to search with.
+ * @param table_bits The transposition table holds 2^table_bits positions.
+ * @return Solver* The created solver. NULL if an error occurred.
+ */
+Solver *solver_create(size_t threads, size_t table_bits);
+
+/**
+ * @brief Frees the solver and unmaps any loaded table.
+ *
+ * @param s The solver to free.
+ */
+void solver_free(Solver *s);
+
+/**
+ * @brief Searches the position in the lobby until it is solved or the time
+ * budget runs out. Solves called from several threads run at the same time,
+ * each on the calling thread and its share of the solver's threads.
+ *
+ * @param s The solver to search with.
+ * @param l The lobby holding the position. It is not modified.
+ * @param budget_ms How long the search may take in milliseconds. 0 for no limit.
+ * @param best Set to a winning move if the result is SOLVER_WIN. May be NULL.
+ * @param stats Set to the statistics of the search. May be NULL.
+ * @return SolverResult The result for the team to move.
+ */
+SolverResult solver_solve(Solver *s, const Lobby *l, long budget_ms, LobbyMove *best, SolverStats *stats);
+
+/**
+ * @brief Looks up the position in the lobby without searching.
+ *
+ * @param s The solver to look in.
+ * @param l The lobby holding the position.
+ * @param best Set to a winning move if the result is SOLVER_WIN. May be NULL.
+ * @return SolverResult The result for the team to move. SOLVER_UNKNOWN if the
+ * position has not been solved.
+ */
+SolverResult solver_probe(Solver *s, const Lobby *l, LobbyMove *best);
+
+/**
+ * @brief Maps a table written by solver_save() so its positions are found by
+ * solver_probe() and solver_solve(). Replaces any previously loaded table.
+ *
+ * @param s The solver to load in to.
+ * @param path The file the table is stored in.
+ * @return int -1 if the table could not be loaded. 0 otherwise.
+ */
+int solver_load(Solver *s, const char *path);
+
+/**
+ * @brief Writes every solved position, from the transposition table and the
+ * loaded table, to a sorted table on disk.
+ *
+ * @param s The solver to save.
+ * @param path The file to write the table to. Replaced atomically.
+ * @return int -1 on error. 0 otherwise.
+ */
+int solver_save(Solver *s, const char *path);
+
+#endif
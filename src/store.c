@@ -0,0 +1,198 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bytes.h"
+#include "log.h"
+#include "store.h"
+
+#define SLOT_MIN_BITS 6 // The smallest slot is 64 bytes. Slots start at multiples of it.
+#define SLOT_CLASSES 12 // Enough for a record of every move on the largest board.
+#define SLOT_CLASS_MASK (((uint64_t)1 << SLOT_MIN_BITS) - 1) // Bits of Lobby.record that hold the class, below the offset.
+
+#define RECORD_HEADER_SIZE 2
+
+#define PATH_SIZE 4096
+
+typedef struct FreeList {
+	uint64_t *offsets;
+	size_t len;
+	size_t size;
+} FreeList;
+
+struct Store {
+	pthread_mutex_t lock; // Held while slots are handed out and given back. Records are read and written without it.
+	int fd;
+	uint64_t end; // Where the next new slot starts.
+	FreeList free[SLOT_CLASSES]; // Slots to reuse, by class.
+	size_t lobbies;
+};
+
+Store *store_open(const char *dir) {
+	Store *s = calloc(1, sizeof *s);
+	if (!s) {
+		return NULL;
+	}
+
+	char path[PATH_SIZE];
+	snprintf(path, sizeof path, "%s/nogos-store-XXXXXX", dir);
+	if ((s->fd = mkstemp(path)) < 0) {
+		perror("store: open");
+		free(s);
+		return NULL;
+	}
+	unlink(path);
+
+	pthread_mutex_init(&s->lock, NULL);
+	return s;
+}
+
+void store_close(Store *s) {
+	for (size_t i = 0; i < SLOT_CLASSES; i++) {
+		free(s->free[i].offsets);
+	}
+	pthread_mutex_destroy(&s->lock);
+	close(s->fd);
+	free(s);
+}
+
+static size_t slot_size(size_t class) {
+	return (size_t)1 << (SLOT_MIN_BITS + class);
+}
+
+/**
+ * @brief Takes a free slot of the class, or a new one at the end of the file.
+ *
+ * @return uint64_t The offset of the slot.
+ */
+static uint64_t take_slot(Store *s, size_t class) {
+	pthread_mutex_lock(&s->lock);
+
+	uint64_t result;
+	FreeList *f = &s->free[class];
+	if (f->len > 0) {
+		result = f->offsets[--f->len];
+	} else {
+		result = s->end;
+		s->end += slot_size(class);
+	}
+	s->lobbies++;
+
+	pthread_mutex_unlock(&s->lock);
+	return result;
+}
+
+/**
+ * @brief Gives a slot back for reuse. The slot is never reused if there is no
+ * memory to remember it in, which only costs space in the file.
+ *
+ */
+static void give_slot(Store *s, uint64_t record) {
+	pthread_mutex_lock(&s->lock);
+
+	FreeList *f = &s->free[record & SLOT_CLASS_MASK];
+	if (f->len == f->size) {
+		const size_t size = f->size > 0 ? f->size * 2 : 64;
+		uint64_t *offsets = realloc(f->offsets, sizeof *offsets * size);
+		if (offsets) {
+			f->offsets = offsets;
+			f->size = size;
+		}
+	}
+	if (f->len < f->size) {
+		f->offsets[f->len++] = record & ~SLOT_CLASS_MASK;
+	}
+	s->lobbies--;
+
+	pthread_mutex_unlock(&s->lock);
+}
+
+int store_put(Store *s, Lobby *l) {
+	const size_t moves_len = lobby_moves_len(l);
+	const bool wide = l->board.rows * l->board.cols > 256;
+	const size_t len = RECORD_HEADER_SIZE + moves_len * (wide ? 2 : 1);
+
+	size_t class = 0;
+	while (slot_size(class) < len) {
+		class++;
+	}
+
+	unsigned char *buf = malloc(len);
+	if (!buf) {
+		return -1;
+	}
+
+	put_u16(buf, (uint16_t)moves_len);
+	unsigned char *p = buf + RECORD_HEADER_SIZE;
+	for (size_t i = 0; i < moves_len; i++) {
+		const LobbyMove move = lobby_move_at(l, i);
+		const size_t space = move.row * l->board.cols + move.col;
+		if (wide) {
+			put_u16(p, (uint16_t)space);
+			p += 2;
+		} else {
+			*p++ = (unsigned char)space;
+		}
+	}
+
+	const uint64_t record = take_slot(s, class) | class;
+	const ssize_t written = pwrite(s->fd, buf, len, (off_t)(record & ~SLOT_CLASS_MASK));
+	free(buf);
+	if (written != (ssize_t)len) {
+		perror("store: write");
+		give_slot(s, record);
+		return -1;
+	}
+
+	l->record = record;
+	lobby_sleep(l);
+	return 0;
+}
+
+int store_take(Store *s, Lobby *l) {
+	const bool wide = l->board.rows * l->board.cols > 256;
+	const size_t size = slot_size(l->record & SLOT_CLASS_MASK);
+
+	unsigned char *buf = malloc(size);
+	uint16_t *spaces = malloc(sizeof *spaces * (l->board.rows * l->board.cols > 0 ? l->board.rows * l->board.cols : 1));
+	if (!buf || !spaces) {
+		free(buf);
+		free(spaces);
+		return -1;
+	}
+
+	const ssize_t read_len = pread(s->fd, buf, size, (off_t)(l->record & ~SLOT_CLASS_MASK));
+	const size_t moves_len = read_len >= RECORD_HEADER_SIZE ? get_u16(buf) : 0;
+	int result = -1;
+	if (read_len < RECORD_HEADER_SIZE || RECORD_HEADER_SIZE + moves_len * (wide ? 2 : 1) > (size_t)read_len ||
+		moves_len > l->board.rows * l->board.cols) {
+		LOG_ERROR("store: bad record for lobby %u\n", l->id);
+	} else {
+		const unsigned char *p = buf + RECORD_HEADER_SIZE;
+		for (size_t i = 0; i < moves_len; i++) {
+			spaces[i] = wide ? get_u16(p + i * 2) : p[i];
+		}
+		result = lobby_wake(l, spaces, moves_len);
+	}
+	free(buf);
+	free(spaces);
+
+	if (result == 0) {
+		give_slot(s, l->record);
+	}
+
+	return result;
+}
+
+void store_drop(Store *s, const Lobby *l) {
+	give_slot(s, l->record);
+}
+
+size_t store_lobbies(Store *s) {
+	pthread_mutex_lock(&s->lock);
+	const size_t result = s->lobbies;
+	pthread_mutex_unlock(&s->lock);
+	return result;
+}
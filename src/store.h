@@ -0,0 +1,81 @@
+#ifndef STORE_H_
+#define STORE_H_
+
+#include <stddef.h>
+
+#include "lobby.h"
+
+/**
+ * @brief Keeps the moves of lobbies nobody is playing in on disk, so that
+ * their boards can be freed until they are played in again. Memory then grows
+ * with the games being played instead of every game that is open.
+ *
+ * A lobby is put to sleep by writing its moves as a compact record, a 2 byte
+ * count followed by one byte per move on boards of up to 256 spaces and two
+ * otherwise, to a slot of a scratch file. Slots come in power of two sizes
+ * and are reused once the lobby they held is woken. The slot is remembered
+ * by the lobby itself, so nothing is looked up. Waking reads the record back
+ * and rebuilds the board in one pass over the moves.
+ *
+ * The file is unlinked as soon as it is created, so it goes away with the
+ * server and servers never share one. It only holds lobbies while they are
+ * asleep: the journal is what games are recovered from.
+ *
+ * The functions below may be called from any thread, as long as every lobby
+ * is only touched by one thread at a time.
+ *
+ */
+typedef struct Store Store;
+
+/**
+ * @brief Creates a store in a new file in the given directory.
+ *
+ * @param dir The directory to keep the file in. Must exist.
+ * @return Store* The created store. NULL if an error occurred.
+ */
+Store *store_open(const char *dir);
+
+/**
+ * @brief Closes the store. Lobbies that are still asleep can only be freed.
+ *
+ * @param s The store to close.
+ */
+void store_close(Store *s);
+
+/**
+ * @brief Writes the moves of the lobby to the store and puts it to sleep.
+ *
+ * @param s The store to write to.
+ * @param l The lobby. Must be awake.
+ * @return int -1 if an error occurred, which leaves the lobby awake. 0 otherwise.
+ */
+int store_put(Store *s, Lobby *l);
+
+/**
+ * @brief Wakes the lobby with the moves it was put to sleep with and frees its
+ * slot.
+ *
+ * @param s The store the lobby was put to sleep in.
+ * @param l The lobby. Must be asleep.
+ * @return int -1 if an error occurred, which leaves the lobby asleep. 0 otherwise.
+ */
+int store_take(Store *s, Lobby *l);
+
+/**
+ * @brief Frees the slot of a lobby that is asleep, such as before freeing the
+ * lobby.
+ *
+ * @param s The store the lobby was put to sleep in.
+ * @param l The lobby. Must be asleep.
+ */
+void store_drop(Store *s, const Lobby *l);
+
+/**
+ * @brief Gets the number of lobbies asleep in the store.
+ *
+ * @param s The store to check.
+ * @return size_t The number of lobbies.
+ */
+size_t store_lobbies(Store *s);
+
+#endif
@@ -0,0 +1,587 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "tournament.h"
+
+#define NONE UINT32_MAX
+#define ENTRANTS_START 64
+#define AT_START 64
+#define SWISS_LOOKAHEAD 32 // Unpaired entrants looked at for an opponent not played yet.
+
+typedef enum GameState {
+	GAME_PENDING,
+	GAME_RUNNING,
+	GAME_DONE,
+} GameState;
+
+typedef struct Game {
+	uint32_t entrants[2];
+	GameState state;
+} Game;
+
+typedef struct Entrant {
+	int handle;
+	uint32_t wins;
+	uint32_t losses;
+	uint32_t byes;
+	uint32_t firsts; // Games joined first.
+	uint32_t played; // Opponents recorded in the entrant's row of opponents.
+	uint32_t game; // Running game. NONE if none.
+	bool is_withdrawn;
+} Entrant;
+
+struct Tournament {
+	TournamentConfig config;
+	bool is_begun;
+
+	Entrant *entrants;
+	size_t entrants_len;
+	size_t entrants_size;
+
+	// Handles from 0 are the callers' connections, which are small and dense,
+	// so they index the entrants directly. Others are searched for.
+	uint32_t *at; // Indexed by handle. One more than the entrant, 0 if none.
+	size_t at_len;
+
+	size_t rounds;
+	size_t round;
+
+	Game *games; // Games of the current round.
+	size_t games_len;
+	size_t next_pending;
+	size_t running;
+	size_t done;
+	uint32_t round_base; // Id of the first game of the round.
+
+	uint32_t *opponents; // Swiss only. A row of rounds opponents per entrant.
+	uint32_t *perm; // Swiss only. Entrants in random order, breaking ties in score.
+	uint32_t *order; // Swiss only. Scratch for the pairing order.
+	uint32_t *counts; // Swiss only. Scratch for the counting sort, one per score.
+	bool *paired; // Swiss only. Scratch for pairing.
+};
+
+static uint64_t next_random(uint64_t *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545f4914f6cdd1dULL;
+}
+
+Tournament *tournament_create(const TournamentConfig *config) {
+	if (config->parallel == 0) {
+		return NULL;
+	}
+
+	Tournament *result = calloc(1, sizeof *result);
+	if (!result) {
+		return NULL;
+	}
+
+	result->config = *config;
+	result->entrants = malloc(sizeof *result->entrants * ENTRANTS_START);
+	result->entrants_size = ENTRANTS_START;
+	result->at = calloc(AT_START, sizeof *result->at);
+	result->at_len = AT_START;
+	if (!result->entrants || !result->at) {
+		tournament_free(result);
+		return NULL;
+	}
+
+	return result;
+}
+
+void tournament_free(Tournament *t) {
+	free(t->entrants);
+	free(t->at);
+	free(t->games);
+	free(t->opponents);
+	free(t->perm);
+	free(t->order);
+	free(t->counts);
+	free(t->paired);
+	free(t);
+}
+
+/**
+ * @brief Makes sure the handle can be indexed, if it is one that is.
+ *
+ * @return int -1 if memory ran out. 0 otherwise.
+ */
+static int reserve(Tournament *t, int handle) {
+	if (handle < 0 || (size_t)handle < t->at_len) {
+		return 0;
+	}
+
+	size_t len = t->at_len;
+	while (len <= (size_t)handle) {
+		len *= 2;
+	}
+
+	uint32_t *at = realloc(t->at, sizeof *at * len);
+	if (!at) {
+		return -1;
+	}
+	memset(&at[t->at_len], 0, sizeof *at * (len - t->at_len));
+	t->at = at;
+	t->at_len = len;
+
+	return 0;
+}
+
+int tournament_enter(Tournament *t, int handle) {
+	if (t->is_begun || t->entrants_len >= NONE || reserve(t, handle) < 0) {
+		return -1;
+	}
+
+	if (t->entrants_len == t->entrants_size) {
+		Entrant *entrants = realloc(t->entrants, sizeof *entrants * t->entrants_size * 2);
+		if (!entrants) {
+			return -1;
+		}
+		t->entrants = entrants;
+		t->entrants_size *= 2;
+	}
+
+	// The first entrant with the handle is the one found.
+	if (handle >= 0 && t->at[handle] == 0) {
+		t->at[handle] = (uint32_t)t->entrants_len + 1;
+	}
+	t->entrants[t->entrants_len++] = (Entrant){ .handle = handle, .game = NONE };
+
+	return 0;
+}
+
+size_t tournament_entrants(const Tournament *t) {
+	return t->entrants_len;
+}
+
+int tournament_find(const Tournament *t, int handle, uint32_t *entrant) {
+	if (handle >= 0) {
+		if ((size_t)handle >= t->at_len || t->at[handle] == 0) {
+			return -1;
+		}
+		*entrant = t->at[handle] - 1;
+		return 0;
+	}
+
+	for (size_t i = 0; i < t->entrants_len; i++) {
+		if (t->entrants[i].handle == handle) {
+			*entrant = (uint32_t)i;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+int tournament_handle(const Tournament *t, uint32_t entrant) {
+	return t->entrants[entrant].handle;
+}
+
+int tournament_set_handle(Tournament *t, uint32_t entrant, int handle) {
+	if (reserve(t, handle) < 0) {
+		return -1;
+	}
+
+	// The old handle goes to the next entrant that has it, if any.
+	const int old = t->entrants[entrant].handle;
+	t->entrants[entrant].handle = handle;
+	if (old >= 0 && t->at[old] == entrant + 1) {
+		t->at[old] = 0;
+		for (size_t i = entrant + 1; i < t->entrants_len && t->at[old] == 0; i++) {
+			if (t->entrants[i].handle == old) {
+				t->at[old] = (uint32_t)i + 1;
+			}
+		}
+	}
+	if (handle >= 0) {
+		t->at[handle] = entrant + 1;
+	}
+
+	return 0;
+}
+
+static uint32_t score(const Tournament *t, const Entrant *e) {
+	return t->config.format == TOURNAMENT_SWISS ? e->wins + e->byes : e->wins;
+}
+
+static void add_game(Tournament *t, uint32_t first, uint32_t second) {
+	t->games[t->games_len++] = (Game){ .entrants = { first, second }, .state = GAME_PENDING };
+}
+
+/**
+ * @brief Pairs a round with the circle method. Entrant 0 stays put while
+ * everyone else rotates one seat per round. With an odd number of entrants a
+ * missing entrant takes the last seat and whoever faces it sits out.
+ *
+ */
+static void pair_round_robin(Tournament *t) {
+	const size_t n = t->entrants_len;
+	const size_t seats = n + n % 2;
+	const size_t r = t->round;
+
+	for (size_t i = 0; i < seats / 2; i++) {
+		const size_t j = seats - 1 - i;
+		const size_t a = i == 0 ? 0 : 1 + (i - 1 + r) % (seats - 1);
+		const size_t b = 1 + (j - 1 + r) % (seats - 1);
+
+		if (a == n || b == n) {
+			t->entrants[a == n ? b : a].byes++;
+			continue;
+		}
+
+		// Alternate who joins first so everyone does so about half the time.
+		if ((i + r) % 2 == 0) {
+			add_game(t, (uint32_t)a, (uint32_t)b);
+		} else {
+			add_game(t, (uint32_t)b, (uint32_t)a);
+		}
+	}
+}
+
+static bool has_played(const Tournament *t, uint32_t a, uint32_t b) {
+	const uint32_t *row = &t->opponents[(size_t)a * t->rounds];
+	for (uint32_t i = 0; i < t->entrants[a].played; i++) {
+		if (row[i] == b) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * @brief Pairs a round of the Swiss system. Entrants still in are ordered by
+ * score with a counting sort, then each is paired with the best placed entrant
+ * after it they have not played yet.
+ *
+ */
+static void pair_swiss(Tournament *t) {
+	const size_t max_score = t->round;
+
+	memset(t->counts, 0, sizeof *t->counts * (max_score + 1));
+	for (size_t i = 0; i < t->entrants_len; i++) {
+		const Entrant *e = &t->entrants[t->perm[i]];
+		if (!e->is_withdrawn) {
+			t->counts[score(t, e)]++;
+		}
+	}
+
+	// Turn counts into where each score starts, highest score first.
+	uint32_t at = 0;
+	for (size_t s = max_score + 1; s-- > 0;) {
+		const uint32_t count = t->counts[s];
+		t->counts[s] = at;
+		at += count;
+	}
+	const size_t active = at;
+
+	for (size_t i = 0; i < t->entrants_len; i++) {
+		const uint32_t entrant = t->perm[i];
+		const Entrant *e = &t->entrants[entrant];
+		if (!e->is_withdrawn) {
+			t->order[t->counts[score(t, e)]++] = entrant;
+		}
+	}
+
+	memset(t->paired, 0, sizeof *t->paired * t->entrants_len);
+
+	// The lowest placed entrant without a bye yet sits out.
+	if (active % 2 == 1) {
+		size_t bye = active - 1;
+		for (size_t i = active; i-- > 0;) {
+			if (t->entrants[t->order[i]].byes == 0) {
+				bye = i;
+				break;
+			}
+		}
+		t->entrants[t->order[bye]].byes++;
+		t->paired[t->order[bye]] = true;
+	}
+
+	for (size_t i = 0; i < active; i++) {
+		const uint32_t a = t->order[i];
+		if (t->paired[a]) {
+			continue;
+		}
+
+		uint32_t b = NONE;
+		uint32_t fallback = NONE;
+		size_t seen = 0;
+		for (size_t j = i + 1; j < active && seen < SWISS_LOOKAHEAD; j++) {
+			const uint32_t candidate = t->order[j];
+			if (t->paired[candidate]) {
+				continue;
+			}
+			if (fallback == NONE) {
+				fallback = candidate;
+			}
+			if (!has_played(t, a, candidate)) {
+				b = candidate;
+				break;
+			}
+			seen++;
+		}
+		if (b == NONE) {
+			b = fallback;
+		}
+		if (b == NONE) {
+			break;
+		}
+
+		t->paired[a] = true;
+		t->paired[b] = true;
+
+		const uint32_t fa = t->entrants[a].firsts;
+		const uint32_t fb = t->entrants[b].firsts;
+		if (fa < fb || (fa == fb && t->round % 2 == 0)) {
+			add_game(t, a, b);
+		} else {
+			add_game(t, b, a);
+		}
+	}
+}
+
+/**
+ * @brief Pairs the current round, moving past rounds with nothing to play.
+ *
+ */
+static void start_round(Tournament *t) {
+	for (; t->round < t->rounds; t->round++) {
+		t->round_base += (uint32_t)t->games_len;
+		t->games_len = 0;
+		t->next_pending = 0;
+		t->done = 0;
+
+		if (t->config.format == TOURNAMENT_SWISS) {
+			pair_swiss(t);
+		} else {
+			pair_round_robin(t);
+		}
+
+		if (t->games_len > 0) {
+			return;
+		}
+	}
+
+	t->games_len = 0;
+}
+
+static size_t swiss_rounds(size_t entrants) {
+	size_t result = 0;
+	while (((size_t)1 << result) < entrants) {
+		result++;
+	}
+
+	return result;
+}
+
+int tournament_begin(Tournament *t) {
+	const size_t n = t->entrants_len;
+	if (t->is_begun || n < 2) {
+		return -1;
+	}
+
+	if (t->config.format == TOURNAMENT_SWISS) {
+		t->rounds = t->config.rounds > 0 ? t->config.rounds : swiss_rounds(n);
+		t->opponents = malloc(sizeof *t->opponents * n * t->rounds);
+		t->perm = malloc(sizeof *t->perm * n);
+		t->order = malloc(sizeof *t->order * n);
+		t->counts = malloc(sizeof *t->counts * (t->rounds + 1));
+		t->paired = malloc(sizeof *t->paired * n);
+		if (!t->opponents || !t->perm || !t->order || !t->counts || !t->paired) {
+			return -1;
+		}
+
+		uint64_t rng = t->config.seed | 1;
+		for (size_t i = 0; i < n; i++) {
+			t->perm[i] = (uint32_t)i;
+		}
+		for (size_t i = n - 1; i > 0; i--) {
+			const size_t j = (size_t)(next_random(&rng) % (i + 1));
+			const uint32_t tmp = t->perm[i];
+			t->perm[i] = t->perm[j];
+			t->perm[j] = tmp;
+		}
+	} else {
+		t->rounds = n - 1 + n % 2;
+	}
+
+	t->games = malloc(sizeof *t->games * (n / 2));
+	if (!t->games) {
+		return -1;
+	}
+
+	t->is_begun = true;
+	start_round(t);
+
+	return 0;
+}
+
+static Game *running_game(const Tournament *t, uint32_t id) {
+	if (id < t->round_base || id - t->round_base >= t->games_len) {
+		return NULL;
+	}
+
+	Game *result = &t->games[id - t->round_base];
+	return result->state == GAME_RUNNING ? result : NULL;
+}
+
+static void record(Tournament *t, Game *g, int winner) {
+	for (int side = 0; side < 2; side++) {
+		Entrant *e = &t->entrants[g->entrants[side]];
+		if (side == winner) {
+			e->wins++;
+		} else {
+			e->losses++;
+		}
+		if (t->opponents && e->played < t->rounds) {
+			t->opponents[(size_t)g->entrants[side] * t->rounds + e->played] = g->entrants[1 - side];
+		}
+		e->played++;
+		e->game = NONE;
+	}
+	t->entrants[g->entrants[0]].firsts++;
+
+	if (g->state == GAME_RUNNING) {
+		t->running--;
+	}
+	g->state = GAME_DONE;
+	t->done++;
+
+	if (t->done == t->games_len) {
+		t->round++;
+		start_round(t);
+	}
+}
+
+/**
+ * @brief Returns who wins a game by default, if any of its entrants withdrew.
+ *
+ */
+static int forfeit_winner(const Tournament *t, const Game *g) {
+	const bool out0 = t->entrants[g->entrants[0]].is_withdrawn;
+	const bool out1 = t->entrants[g->entrants[1]].is_withdrawn;
+
+	return out0 ? (out1 ? -1 : 1) : 0;
+}
+
+size_t tournament_start_games(Tournament *t, TournamentGame *games, size_t games_size) {
+	size_t made = 0;
+
+	while (made < games_size && t->running < t->config.parallel && t->next_pending < t->games_len) {
+		const size_t i = t->next_pending++;
+		Game *g = &t->games[i];
+		const uint32_t id = t->round_base + (uint32_t)i;
+
+		if (t->entrants[g->entrants[0]].is_withdrawn || t->entrants[g->entrants[1]].is_withdrawn) {
+			record(t, g, forfeit_winner(t, g));
+			continue;
+		}
+
+		g->state = GAME_RUNNING;
+		t->running++;
+		t->entrants[g->entrants[0]].game = id;
+		t->entrants[g->entrants[1]].game = id;
+
+		games[made++] = (TournamentGame){ .id = id, .entrants = { g->entrants[0], g->entrants[1] } };
+	}
+
+	return made;
+}
+
+int tournament_game(const Tournament *t, uint32_t id, TournamentGame *game) {
+	const Game *g = running_game(t, id);
+	if (!g) {
+		return -1;
+	}
+
+	*game = (TournamentGame){ .id = id, .entrants = { g->entrants[0], g->entrants[1] } };
+	return 0;
+}
+
+int tournament_finish(Tournament *t, uint32_t id, int winner) {
+	Game *g = running_game(t, id);
+	if (!g) {
+		return -1;
+	}
+
+	record(t, g, winner);
+	return 0;
+}
+
+void tournament_withdraw(Tournament *t, uint32_t entrant) {
+	Entrant *e = &t->entrants[entrant];
+	e->is_withdrawn = true;
+
+	if (e->game != NONE) {
+		Game *g = running_game(t, e->game);
+		record(t, g, forfeit_winner(t, g));
+	}
+}
+
+size_t tournament_round(const Tournament *t) {
+	return t->round;
+}
+
+bool tournament_is_over(const Tournament *t) {
+	return t->is_begun && t->round >= t->rounds;
+}
+
+static int compare_standings(const void *a, const void *b) {
+	const TournamentStanding *sa = a;
+	const TournamentStanding *sb = b;
+
+	if (sa->score != sb->score) {
+		return sa->score > sb->score ? -1 : 1;
+	}
+	if (sa->opponents_score != sb->opponents_score) {
+		return sa->opponents_score > sb->opponents_score ? -1 : 1;
+	}
+	return sa->entrant < sb->entrant ? -1 : sa->entrant > sb->entrant;
+}
+
+size_t tournament_standings(const Tournament *t, TournamentStanding *standings, size_t standings_size) {
+	const size_t n = t->entrants_len;
+	TournamentStanding *all = malloc(sizeof *all * (n > 0 ? n : 1));
+	if (!all) {
+		return 0;
+	}
+
+	uint32_t total = 0;
+	for (size_t i = 0; i < n; i++) {
+		total += score(t, &t->entrants[i]);
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		const Entrant *e = &t->entrants[i];
+		TournamentStanding *s = &all[i];
+		*s = (TournamentStanding){
+			.entrant = (uint32_t)i,
+			.handle = e->handle,
+			.score = score(t, e),
+			.wins = e->wins,
+			.losses = e->losses,
+		};
+
+		// Everyone meets everyone in a round robin.
+		if (!t->opponents) {
+			s->opponents_score = total - s->score;
+			continue;
+		}
+
+		const uint32_t *row = &t->opponents[i * t->rounds];
+		const uint32_t played = e->played < t->rounds ? e->played : (uint32_t)t->rounds;
+		for (uint32_t k = 0; k < played; k++) {
+			s->opponents_score += score(t, &t->entrants[row[k]]);
+		}
+	}
+
+	qsort(all, n, sizeof *all, compare_standings);
+
+	const size_t result = n < standings_size ? n : standings_size;
+	memcpy(standings, all, sizeof *standings * result);
+	free(all);
+
+	return result;
+}
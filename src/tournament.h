@@ -0,0 +1,202 @@
+#ifndef TOURNAMENT_H_
+#define TOURNAMENT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Schedules the games of a tournament. Entrants are identified by the
+ * order they entered in and carry a handle chosen by the caller, such as a
+ * file descriptor.
+ *
+ * Games are played in rounds. All games of a round are paired when the round
+ * starts and handed out by tournament_start_games() as long as fewer than the
+ * configured number of games are running, so a round is played in waves. The
+ * next round starts once every game of the current one has finished.
+ *
+ * Round robin pairs every entrant with every other once using the circle
+ * method, so a round is paired in linear time. Swiss pairs entrants of equal
+ * score, looked up with a counting sort on score, avoiding rematches within a
+ * short lookahead. Pairing a round of 10,000 entrants takes well under a
+ * millisecond either way, see bench_tournament.
+ *
+ * Nogo has no draws. A win and a Swiss bye are worth a point. Entrants who
+ * withdraw lose their running game and every game they are paired in later.
+ *
+ */
+typedef struct Tournament Tournament;
+
+typedef enum TournamentFormat {
+	TOURNAMENT_ROUND_ROBIN,
+	TOURNAMENT_SWISS,
+} TournamentFormat;
+
+typedef struct TournamentConfig {
+	TournamentFormat format;
+	size_t rounds; // Swiss only. 0 for enough rounds to find a single winner.
+	size_t parallel; // Most games running at once.
+	uint64_t seed; // Orders entrants of equal score.
+} TournamentConfig;
+
+/**
+ * @brief A game to play. entrants[0] should join the game first.
+ *
+ */
+typedef struct TournamentGame {
+	uint32_t id;
+	uint32_t entrants[2];
+} TournamentGame;
+
+/**
+ * @brief Where an entrant stands. Ordered by score, then by the sum of their
+ * opponents' scores.
+ *
+ */
+typedef struct TournamentStanding {
+	uint32_t entrant;
+	int handle;
+	uint32_t score;
+	uint32_t wins;
+	uint32_t losses;
+	uint32_t opponents_score;
+} TournamentStanding;
+
+/**
+ * @brief Creates a tournament that takes entrants until it is begun.
+ *
+ * @param config How the tournament is played.
+ * @return Tournament* The created tournament. NULL if an error occurred.
+ */
+Tournament *tournament_create(const TournamentConfig *config);
+
+/**
+ * @brief Frees the tournament.
+ *
+ * @param t The tournament to free.
+ */
+void tournament_free(Tournament *t);
+
+/**
+ * @brief Adds an entrant.
+ *
+ * @param t The tournament to enter.
+ * @param handle Identifies the entrant to the caller.
+ * @return int -1 if the tournament has begun or could not grow. 0 otherwise.
+ */
+int tournament_enter(Tournament *t, int handle);
+
+/**
+ * @brief Returns the number of entrants.
+ *
+ * @param t The tournament to check.
+ * @return size_t The number of entrants.
+ */
+size_t tournament_entrants(const Tournament *t);
+
+/**
+ * @brief Finds the entrant with the given handle.
+ *
+ * @param t The tournament to search.
+ * @param handle The handle to find.
+ * @param entrant Set to the entrant.
+ * @return int -1 if no entrant has the handle. 0 otherwise.
+ */
+int tournament_find(const Tournament *t, int handle, uint32_t *entrant);
+
+/**
+ * @brief Returns the handle of an entrant.
+ *
+ * @param t The tournament to check.
+ * @param entrant The entrant.
+ * @return int The handle the entrant entered with.
+ */
+int tournament_handle(const Tournament *t, uint32_t entrant);
+
+/**
+ * @brief Changes the handle of an entrant, such as when the caller's
+ * identifier for them changes.
+ *
+ * @param t The tournament to update.
+ * @param entrant The entrant.
+ * @param handle The new handle.
+ * @return int -1 if memory ran out, which leaves the handle as it was. 0 otherwise.
+ */
+int tournament_set_handle(Tournament *t, uint32_t entrant, int handle);
+
+/**
+ * @brief Closes entries and pairs the first round.
+ *
+ * @param t The tournament to begin.
+ * @return int -1 if there are fewer than 2 entrants or memory ran out. 0 otherwise.
+ */
+int tournament_begin(Tournament *t);
+
+/**
+ * @brief Hands out games of the current round to start now, until the number
+ * of running games reaches the configured limit.
+ *
+ * @param t The tournament to start games in.
+ * @param games Set to the games to start.
+ * @param games_size The most games to hand out.
+ * @return size_t The number of games handed out.
+ */
+size_t tournament_start_games(Tournament *t, TournamentGame *games, size_t games_size);
+
+/**
+ * @brief Gets a running game.
+ *
+ * @param t The tournament to check.
+ * @param id The id of the game.
+ * @param game Set to the game.
+ * @return int -1 if the game is not running. 0 otherwise.
+ */
+int tournament_game(const Tournament *t, uint32_t id, TournamentGame *game);
+
+/**
+ * @brief Records the result of a running game.
+ *
+ * @param t The tournament the game belongs to.
+ * @param id The id of the game.
+ * @param winner 0 or 1 for the winner's index in the game's entrants. -1 if
+ * both entrants lose, such as when both left.
+ * @return int -1 if the game is not running. 0 otherwise.
+ */
+int tournament_finish(Tournament *t, uint32_t id, int winner);
+
+/**
+ * @brief Takes an entrant out of the tournament. Their running game and every
+ * later game they are paired in is lost.
+ *
+ * @param t The tournament to withdraw from.
+ * @param entrant The entrant.
+ */
+void tournament_withdraw(Tournament *t, uint32_t entrant);
+
+/**
+ * @brief Returns the current round, starting from 0.
+ *
+ * @param t The tournament to check.
+ * @return size_t The current round.
+ */
+size_t tournament_round(const Tournament *t);
+
+/**
+ * @brief Returns whether every round has been played.
+ *
+ * @param t The tournament to check.
+ * @return bool true if the tournament is over.
+ */
+bool tournament_is_over(const Tournament *t);
+
+/**
+ * @brief Gets the best standings.
+ *
+ * @param t The tournament to rank.
+ * @param standings Set to the standings, best first.
+ * @param standings_size The most standings to get.
+ * @return size_t The number of standings set. 0 if memory ran out.
+ */
+size_t tournament_standings(const Tournament *t, TournamentStanding *standings, size_t standings_size);
+
+#endif
@@ -0,0 +1,196 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "lobby.h"
+#include "task.h"
+
+typedef struct T {
+	char dir[32];
+	Archive *a;
+} T;
+
+static void test_setup(T *t) {
+	strcpy(t->dir, "test_archive_XXXXXX");
+	ASSERT(mkdtemp(t->dir) != NULL);
+
+	t->a = archive_open(t->dir);
+	ASSERT(t->a != NULL);
+}
+
+static void test_teardown(T *t) {
+	if (t->a) {
+		archive_close(t->a);
+	}
+
+	DIR *d = opendir(t->dir);
+	struct dirent *ent;
+	while ((ent = readdir(d)) != NULL) {
+		char path[300];
+		snprintf(path, sizeof path, "%s/%s", t->dir, ent->d_name);
+		if (ent->d_name[0] != '.') {
+			unlink(path);
+		}
+	}
+	closedir(d);
+	rmdir(t->dir);
+}
+
+static void reopen(T *t) {
+	archive_close(t->a);
+	t->a = archive_open(t->dir);
+	ASSERT(t->a != NULL);
+}
+
+/**
+ * @brief Plays a short game that 'O' wins and archives it.
+ *
+ */
+static uint64_t archive_game_e(T *t, const char *name1, const char *name2, int64_t date) {
+	Lobby *l = lobby_create(7, 5);
+
+	Player player1 = { .fd = 1 };
+	Player player2 = { .fd = 2 };
+	strcpy(player1.name, name1);
+	strcpy(player2.name, name2);
+
+	lobby_join(l, &player1);
+	lobby_join(l, &player2);
+	lobby_play_move(l, &player1, "0", "1");
+	lobby_play_move(l, &player2, "0", "0");
+	lobby_play_move(l, &player1, "1", "0");
+	ASSERT(lobby_winner(l) == 'O');
+
+	uint64_t id;
+	int actual = archive_append(t->a, l, date, &id);
+	ASSERT(actual == 0);
+
+	lobby_free(l);
+	return id;
+}
+
+static void assert_game(T *t, uint64_t id, const char *name1, const char *name2, int64_t date) {
+	ArchiveGame game;
+	int actual = archive_get(t->a, id, &game);
+	ASSERT(actual == 0);
+
+	ASSERT(game.id == id);
+	ASSERT(game.date == date);
+	ASSERT(game.rows == 7 && game.cols == 5);
+	ASSERT(game.winner == 'O');
+	ASSERT(strcmp(game.players[0], name1) == 0);
+	ASSERT(strcmp(game.players[1], name2) == 0);
+	ASSERT(game.moves_len == 3);
+
+	const LobbyMove expect[] = {
+		{ .team = 'O', .row = 0, .col = 1 },
+		{ .team = 'X', .row = 0, .col = 0 },
+		{ .team = 'O', .row = 1, .col = 0 },
+	};
+	for (size_t i = 0; i < game.moves_len; i++) {
+		const LobbyMove move = archive_game_move(&game, i);
+		ASSERT(move.team == expect[i].team);
+		ASSERT(move.row == expect[i].row);
+		ASSERT(move.col == expect[i].col);
+	}
+}
+
+static void test_archive_get(void) {
+	T t;
+	test_setup(&t);
+
+	const uint64_t id1 = archive_game_e(&t, "alice", "bob", 100);
+	const uint64_t id2 = archive_game_e(&t, "carol", "alice", 200);
+	ASSERT(id1 != id2);
+
+	assert_game(&t, id1, "alice", "bob", 100);
+	assert_game(&t, id2, "carol", "alice", 200);
+
+	ArchiveGame game;
+	ASSERT(archive_get(t.a, id2 + 1, &game) == -1);
+
+	// Sealed segments are read back through their index.
+	reopen(&t);
+	assert_game(&t, id1, "alice", "bob", 100);
+	assert_game(&t, id2, "carol", "alice", 200);
+
+	const uint64_t id3 = archive_game_e(&t, "dave", "bob", 300);
+	ASSERT(id3 > id2);
+	assert_game(&t, id3, "dave", "bob", 300);
+	assert_game(&t, id1, "alice", "bob", 100);
+
+	test_teardown(&t);
+}
+
+static void test_archive_find_player(void) {
+	T t;
+	test_setup(&t);
+
+	const uint64_t id1 = archive_game_e(&t, "alice", "bob", 100);
+	archive_game_e(&t, "carol", "dave", 200);
+	reopen(&t);
+	const uint64_t id3 = archive_game_e(&t, "bob", "alice", 300);
+
+	uint64_t ids[4];
+	size_t actual = archive_find_player(t.a, "alice", ids, 4);
+	ASSERT(actual == 2);
+	ASSERT(ids[0] == id1);
+	ASSERT(ids[1] == id3);
+
+	actual = archive_find_player(t.a, "alice", ids, 1);
+	ASSERT(actual == 2);
+	ASSERT(ids[0] == id1);
+
+	actual = archive_find_player(t.a, "eve", ids, 4);
+	ASSERT(actual == 0);
+
+	test_teardown(&t);
+}
+
+static void test_archive_find_date(void) {
+	T t;
+	test_setup(&t);
+
+	archive_game_e(&t, "alice", "bob", 100);
+	const uint64_t id2 = archive_game_e(&t, "alice", "bob", 200);
+	reopen(&t);
+	const uint64_t id3 = archive_game_e(&t, "alice", "bob", 300);
+	archive_game_e(&t, "alice", "bob", 400);
+
+	uint64_t ids[4];
+	size_t actual = archive_find_date(t.a, 150, 350, ids, 4);
+	ASSERT(actual == 2);
+	ASSERT(ids[0] == id2);
+	ASSERT(ids[1] == id3);
+
+	actual = archive_find_date(t.a, 500, 600, ids, 4);
+	ASSERT(actual == 0);
+
+	test_teardown(&t);
+}
+
+static void test_archive_reopen_empty(void) {
+	T t;
+	test_setup(&t);
+
+	reopen(&t);
+	reopen(&t);
+
+	uint64_t ids[1];
+	ASSERT(archive_find_date(t.a, 0, 1000, ids, 1) == 0);
+
+	const uint64_t id = archive_game_e(&t, "alice", "bob", 100);
+	assert_game(&t, id, "alice", "bob", 100);
+
+	test_teardown(&t);
+}
+
+int main(void) {
+	test_archive_get();
+	test_archive_find_player();
+	test_archive_find_date();
+	test_archive_reopen_empty();
+}
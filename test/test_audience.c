@@ -0,0 +1,184 @@
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "audience.h"
+#include "task.h"
+
+#define DROP_MS 1000
+
+static AudienceFrame frame(uint32_t lobby, const char *data, const char *snapshot) {
+	AudienceFrame result = { .lobby = lobby, .data_len = strlen(data), .snapshot_len = strlen(snapshot) };
+	memcpy(result.data, data, result.data_len);
+	memcpy(result.snapshot, snapshot, result.snapshot_len);
+	return result;
+}
+
+/**
+ * @brief Reads whatever is waiting on fd without blocking. Returns the number
+ * of bytes read.
+ *
+ */
+static size_t read_all(int fd, char *buf, size_t size) {
+	size_t result = 0;
+	long got;
+	while (result < size && (got = (long)recv(fd, buf + result, size - result, MSG_DONTWAIT)) > 0) {
+		result += (size_t)got;
+	}
+	buf[result < size ? result : size - 1] = '\0';
+	return result;
+}
+
+static void test_audience_snapshot_then_frames(void) {
+	Audience *a = audience_create();
+	Coalescer *out = coalescer_create(DROP_MS);
+	ASSERT(a != NULL);
+
+	int sv[2][2];
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv[0]) == 0);
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv[1]) == 0);
+
+	ASSERT(audience_watch(a, sv[0][0], 7) == 0);
+	ASSERT(audience_watch(a, sv[0][0], 7) < 0);
+	ASSERT(audience_watch(a, sv[1][0], 7) == 0);
+	ASSERT(audience_watchers(a, 7) == 2);
+
+	// Nobody watches lobby 8.
+	AudienceFrame f = frame(8, "GOTMOVE 1 1\r\n", "B1");
+	ASSERT(audience_publish(a, &f) == 0);
+
+	// New watchers are sent the latest snapshot, then every frame.
+	f = frame(7, "GOTMOVE 0 0\r\n", "A1");
+	audience_publish(a, &f);
+	f = frame(7, "GOTMOVE 0 1\r\n", "A2");
+	audience_publish(a, &f);
+	int dropped[2];
+	ASSERT(audience_flush(a, out, dropped, 2) == 0);
+
+	f = frame(7, "GOTMOVE 0 2\r\n", "A3");
+	audience_publish(a, &f);
+	f = frame(7, "GOTWINNER O\r\n", "A4");
+	audience_publish(a, &f);
+	ASSERT(audience_flush(a, out, dropped, 2) == 0);
+
+	char buf[256];
+	for (int i = 0; i < 2; i++) {
+		read_all(sv[i][1], buf, sizeof buf);
+		ASSERT(strcmp(buf, "A2GOTMOVE 0 2\r\nGOTWINNER O\r\n") == 0);
+	}
+
+	uint32_t lobby;
+	ASSERT(audience_unwatch(a, sv[0][0], &lobby) == 0);
+	ASSERT(lobby == 7);
+	ASSERT(audience_unwatch(a, sv[0][0], &lobby) < 0);
+
+	audience_close_lobby(a, 7);
+	ASSERT(audience_watchers(a, 7) == 0);
+	f = frame(7, "GOTLEAVE\r\n", "A5");
+	audience_publish(a, &f);
+	ASSERT(audience_flush(a, out, dropped, 2) == 0);
+	ASSERT(read_all(sv[1][1], buf, sizeof buf) == 0);
+
+	for (int i = 0; i < 2; i++) {
+		close(sv[i][0]);
+		close(sv[i][1]);
+	}
+	audience_free(a);
+	coalescer_free(out);
+}
+
+/**
+ * @brief Flushes the way the event loop does: first what was left waiting
+ * for the connections, then the audience.
+ *
+ */
+static size_t flush(Audience *a, Coalescer *out, uint64_t now_ms, int *dropped) {
+	const size_t result = coalescer_flush(out, now_ms, dropped, 2);
+	ASSERT(audience_flush(a, out, dropped, 2) == 0);
+	return result;
+}
+
+static void test_audience_sheds_slow_watchers(void) {
+	Audience *a = audience_create();
+	Coalescer *out = coalescer_create(DROP_MS);
+
+	int fast[2];
+	int slow[2];
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fast) == 0);
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, slow) == 0);
+	ASSERT(audience_watch(a, fast[0], 1) == 0);
+	ASSERT(audience_watch(a, slow[0], 1) == 0);
+
+	AudienceFrame f = frame(1, "", "S0");
+	audience_publish(a, &f);
+	int dropped[2];
+	flush(a, out, 0, dropped);
+
+	// Keep publishing until the watcher that never reads is full.
+	char buf[AUDIENCE_FRAME_SIZE];
+	memset(buf, 'x', sizeof buf - 3);
+	memcpy(&buf[sizeof buf - 3], "\r\n", 3);
+	f = frame(1, buf, "S1");
+
+	size_t flushes = 0;
+	while (!coalescer_is_pending(out, slow[0])) {
+		ASSERT(audience_publish(a, &f) == 0);
+		ASSERT(flush(a, out, 10, dropped) == 0);
+
+		char sink[AUDIENCE_FRAME_SIZE * 2];
+		while (read_all(fast[1], sink, sizeof sink) > 0) {
+		}
+		ASSERT(++flushes < 100000);
+	}
+
+	// Frames published while it is full are shed for a snapshot, and what
+	// the connection is sent otherwise stays in order behind the rest.
+	ASSERT(coalescer_add(out, slow[0], "OK\r\n", 4) == 0);
+	f = frame(1, "GOTMOVE 1 2\r\n", "S2");
+	audience_publish(a, &f);
+	ASSERT(flush(a, out, 20, dropped) == 0);
+	ASSERT(coalescer_is_pending(out, slow[0]));
+	ASSERT(!coalescer_is_pending(out, fast[0]));
+
+	static char drain[1 << 22];
+	size_t got = read_all(slow[1], drain, sizeof drain);
+	while (coalescer_is_pending(out, slow[0])) {
+		ASSERT(flush(a, out, 30, dropped) == 0);
+		got += read_all(slow[1], &drain[got], sizeof drain - got);
+	}
+	ASSERT(got >= 6);
+	ASSERT(memcmp(&drain[got - 6], "OK\r\nS2", 6) == 0);
+
+	// The fast watcher kept every frame.
+	char sink[64];
+	read_all(fast[1], sink, sizeof sink);
+	ASSERT(strcmp(sink, "GOTMOVE 1 2\r\n") == 0);
+
+	// A watcher that takes nothing for too long is dropped by the coalescer,
+	// and is sent nothing until it is unwatched.
+	while (!coalescer_is_pending(out, slow[0])) {
+		audience_publish(a, &f);
+		ASSERT(flush(a, out, 40, dropped) == 0);
+		while (read_all(fast[1], sink, sizeof sink) > 0) {
+		}
+	}
+	ASSERT(flush(a, out, 40, dropped) == 0);
+	ASSERT(flush(a, out, 40 + DROP_MS, dropped) == 1);
+	ASSERT(dropped[0] == slow[0]);
+	ASSERT(coalescer_is_pending(out, slow[0]));
+	uint32_t lobby;
+	ASSERT(audience_unwatch(a, slow[0], &lobby) == 0);
+	ASSERT(audience_watchers(a, 1) == 1);
+
+	close(fast[0]);
+	close(fast[1]);
+	close(slow[0]);
+	close(slow[1]);
+	audience_free(a);
+	coalescer_free(out);
+}
+
+int main(void) {
+	test_audience_snapshot_then_frames();
+	test_audience_sheds_slow_watchers();
+}
@@ -0,0 +1,198 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bot.h"
+#include "lobby.h"
+#include "task.h"
+
+#define BUDGET_MS 100
+
+typedef struct T {
+	Lobby *l;
+	Bot *bot;
+} T;
+
+static void test_setup(T *t) {
+	t->l = lobby_create(7, 5);
+	t->bot = bot_create(2, BUDGET_MS);
+	ASSERT(t->bot != NULL);
+}
+
+static void test_teardown(T *t) {
+	bot_free(t->bot);
+	lobby_free(t->l);
+}
+
+static void test_bot_finds_winning_move(void) {
+	T t;
+	test_setup(&t);
+
+	// 	"X O . . .\n"
+	// 	". . . . .\n"
+	// 	...
+	// O to move wins by playing 1 0.
+	lobby_place(t.l, 'O', 0, 1);
+	lobby_place(t.l, 'X', 0, 0);
+
+	LobbyMove move;
+	BotStats stats;
+	int actual = bot_choose(t.bot, t.l, &move, &stats);
+	ASSERT(actual == 0);
+	ASSERT(move.team == 'O');
+	ASSERT(move.row == 1 && move.col == 0);
+
+	ASSERT(stats.threads == 2);
+	ASSERT(stats.playouts > 0);
+
+	// The searched lobby is left untouched.
+	ASSERT(lobby_moves_len(t.l) == 2);
+	ASSERT(lobby_turn(t.l) == 'O');
+
+	test_teardown(&t);
+}
+
+static void test_bot_avoids_losing_move(void) {
+	T t;
+	test_setup(&t);
+
+	// 	". O . . .\n"
+	// 	"O . . . .\n"
+	// 	...
+	// X to move loses by playing 0 0.
+	lobby_place(t.l, 'O', 0, 1);
+	lobby_place(t.l, 'X', 4, 4);
+	lobby_place(t.l, 'O', 1, 0);
+
+	LobbyMove move;
+	int actual = bot_choose(t.bot, t.l, &move, NULL);
+	ASSERT(actual == 0);
+	ASSERT(move.team == 'X');
+	ASSERT(!(move.row == 0 && move.col == 0));
+
+	test_teardown(&t);
+}
+
+static void test_bot_fills_last_liberty_of_group(void) {
+	T t;
+	test_setup(&t);
+
+	// 	"X X . . .\n"
+	// 	"O O . . .\n"
+	// 	...
+	// O to move wins by playing 0 2, the last liberty of both X pieces.
+	lobby_place(t.l, 'O', 1, 0);
+	lobby_place(t.l, 'X', 0, 0);
+	lobby_place(t.l, 'O', 1, 1);
+	lobby_place(t.l, 'X', 0, 1);
+
+	LobbyMove move;
+	ASSERT(bot_choose(t.bot, t.l, &move, NULL) == 0);
+	ASSERT(move.team == 'O');
+	ASSERT(move.row == 0 && move.col == 2);
+
+	test_teardown(&t);
+}
+
+static void test_bot_game_over(void) {
+	T t;
+	test_setup(&t);
+
+	lobby_place(t.l, 'O', 0, 1);
+	lobby_place(t.l, 'X', 0, 0);
+	lobby_place(t.l, 'O', 1, 0);
+	ASSERT(lobby_winner(t.l) == 'O');
+
+	LobbyMove move;
+	ASSERT(bot_choose(t.bot, t.l, &move, NULL) == -1);
+
+	test_teardown(&t);
+}
+
+static void test_bot_takes_seat(void) {
+	T t;
+	test_setup(&t);
+
+	const Player human = { .fd = 1, .name = "human" };
+	const Player bot = bot_player();
+
+	ASSERT(lobby_join(t.l, &human) == 0);
+	ASSERT(lobby_join(t.l, &bot) == 0);
+	ASSERT(t.l->players[1].is_bot);
+	ASSERT(t.l->players[1].team == 'X');
+
+	// A human with the bot's name can't take over the bot's seat.
+	const Player impostor = { .fd = 2, .name = BOT_NAME };
+	ASSERT(lobby_join(t.l, &impostor) == -1);
+
+	lobby_play_move(t.l, &human, "3", "3");
+
+	LobbyMove move;
+	ASSERT(bot_choose(t.bot, t.l, &move, NULL) == 0);
+	ASSERT(lobby_place(t.l, move.team, move.row, move.col) == 0);
+
+	test_teardown(&t);
+}
+
+typedef struct Choice {
+	Bot *bot;
+	Lobby *l;
+	LobbyMove move;
+	BotStats stats;
+	int result;
+} Choice;
+
+static void *choose(void *arg) {
+	Choice *c = arg;
+	c->result = bot_choose(c->bot, c->l, &c->move, &c->stats);
+	return NULL;
+}
+
+static void test_bot_searches_at_once(void) {
+	T t;
+	test_setup(&t);
+
+	Lobby *other = lobby_create(9, 5);
+	lobby_place(other, 'O', 4, 4);
+	lobby_place(t.l, 'O', 0, 1);
+	lobby_place(t.l, 'X', 0, 0);
+
+	// Two lobbies asking for a move at the same time both get it after one
+	// budget, instead of one waiting for the other.
+	Choice choices[2] = { { .bot = t.bot, .l = t.l }, { .bot = t.bot, .l = other } };
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pthread_t threads[2];
+	for (int i = 0; i < 2; i++) {
+		ASSERT(pthread_create(&threads[i], NULL, choose, &choices[i]) == 0);
+	}
+	for (int i = 0; i < 2; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	const double took_ms = (double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) / 1e6;
+	ASSERT(took_ms < BUDGET_MS * 1.5);
+
+	for (int i = 0; i < 2; i++) {
+		ASSERT(choices[i].result == 0);
+		ASSERT(choices[i].stats.playouts > 0);
+		ASSERT(choices[i].stats.threads >= 1);
+	}
+	ASSERT(choices[0].move.team == 'O' && choices[0].move.row == 1 && choices[0].move.col == 0);
+	ASSERT(choices[1].move.team == 'X');
+
+	lobby_free(other);
+	test_teardown(&t);
+}
+
+int main(void) {
+	test_bot_finds_winning_move();
+	test_bot_avoids_losing_move();
+	test_bot_fills_last_liberty_of_group();
+	test_bot_game_over();
+	test_bot_takes_seat();
+	test_bot_searches_at_once();
+}
@@ -0,0 +1,268 @@
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "channels.h"
+#include "task.h"
+
+#define DROP_MS 1000
+#define SENDS 1024
+
+/**
+ * @brief Reads whatever is waiting on fd without blocking. Returns the number
+ * of bytes read.
+ *
+ */
+static size_t read_all(int fd, char *buf, size_t size) {
+	size_t result = 0;
+	long got;
+	while (result < size && (got = (long)recv(fd, buf + result, size - result, MSG_DONTWAIT)) > 0) {
+		result += (size_t)got;
+	}
+	buf[result < size ? result : size - 1] = '\0';
+	return result;
+}
+
+static void publish(Channels *c, uint64_t topic, const char *message) {
+	ASSERT(channels_publish(c, topic, message, strlen(message)) == 0);
+}
+
+static void test_channels_subscribe(void) {
+	Channels *c = channels_create(SENDS);
+	Coalescer *out = coalescer_create(DROP_MS);
+	ASSERT(c != NULL);
+
+	int sv[2][2];
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv[0]) == 0);
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv[1]) == 0);
+
+	ASSERT(channels_subscribe(c, sv[0][0], 7) == 0);
+	ASSERT(channels_subscribe(c, sv[0][0], 7) < 0);
+	ASSERT(channels_subscribe(c, sv[1][0], 7) == 0);
+	ASSERT(channels_subscribe(c, sv[1][0], 8) == 0);
+	ASSERT(channels_subscribers(c, 7) == 2);
+	ASSERT(channels_subscribers(c, 8) == 1);
+
+	// Nobody listens to 9.
+	publish(c, 9, "GOTSAY x\r\n");
+	ASSERT(!channels_is_busy(c));
+
+	// Everything published to a topic goes out in one send.
+	publish(c, 7, "GOTSAY a hi\r\n");
+	publish(c, 7, "GOTSAY b hello\r\n");
+	publish(c, 8, "GOTANNOUNCE up\r\n");
+	ASSERT(channels_is_busy(c));
+	int dropped[2];
+	ASSERT(channels_flush(c, out, dropped, 2) == 0);
+	ASSERT(!channels_is_busy(c));
+
+	char buf[256];
+	ASSERT(recv(sv[0][1], buf, sizeof buf, MSG_DONTWAIT) == (long)strlen("GOTSAY a hi\r\nGOTSAY b hello\r\n"));
+	read_all(sv[1][1], buf, sizeof buf);
+	ASSERT(strcmp(buf, "GOTSAY a hi\r\nGOTSAY b hello\r\nGOTANNOUNCE up\r\n") == 0);
+
+	ASSERT(channels_unsubscribe(c, sv[0][0], 7) == 0);
+	ASSERT(channels_unsubscribe(c, sv[0][0], 7) < 0);
+	ASSERT(channels_subscribers(c, 7) == 1);
+
+	// A connection may only be subscribed to so many topics.
+	for (uint64_t i = 0; i < CHANNELS_TOPICS_MAX; i++) {
+		ASSERT(channels_subscribe(c, sv[0][0], 100 + i) == 0);
+	}
+	ASSERT(channels_subscribe(c, sv[0][0], 99) < 0);
+	channels_remove(c, sv[0][0]);
+	ASSERT(channels_subscribers(c, 100) == 0);
+	ASSERT(channels_subscribe(c, sv[0][0], 99) == 0);
+
+	channels_close_topic(c, 7);
+	ASSERT(channels_subscribers(c, 7) == 0);
+	ASSERT(channels_subscribers(c, 8) == 1);
+	publish(c, 7, "GOTSAY a bye\r\n");
+	ASSERT(channels_flush(c, out, dropped, 2) == 0);
+	ASSERT(read_all(sv[1][1], buf, sizeof buf) == 0);
+
+	for (int i = 0; i < 2; i++) {
+		close(sv[i][0]);
+		close(sv[i][1]);
+	}
+	channels_free(c);
+	coalescer_free(out);
+}
+
+static void test_channels_many_topics(void) {
+	Channels *c = channels_create(SENDS);
+
+	// Nothing is sent, so the connections need not exist.
+	for (int fd = 0; fd < 250; fd++) {
+		for (uint64_t i = 0; i < CHANNELS_TOPICS_MAX; i++) {
+			ASSERT(channels_subscribe(c, fd, ((uint64_t)fd << 32) | i) == 0);
+		}
+	}
+	for (int fd = 0; fd < 250; fd += 2) {
+		channels_remove(c, fd);
+	}
+	for (int fd = 0; fd < 250; fd++) {
+		for (uint64_t i = 0; i < CHANNELS_TOPICS_MAX; i++) {
+			ASSERT(channels_subscribers(c, ((uint64_t)fd << 32) | i) == (size_t)(fd % 2));
+		}
+	}
+
+	channels_free(c);
+}
+
+static void test_channels_flush_in_slices(void) {
+	Channels *c = channels_create(2);
+	Coalescer *out = coalescer_create(DROP_MS);
+
+	enum { LEN = 6 };
+	int sv[LEN][2];
+	for (int i = 0; i < LEN; i++) {
+		ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv[i]) == 0);
+	}
+	for (int i = 0; i < LEN - 1; i++) {
+		ASSERT(channels_subscribe(c, sv[i][0], 1) == 0);
+	}
+
+	publish(c, 1, "GOTANNOUNCE a\r\n");
+	int dropped[2];
+	ASSERT(channels_flush(c, out, dropped, 2) == 0);
+	ASSERT(channels_is_busy(c));
+
+	// Joining or leaving halfway through, and publishing before it is done.
+	char buf[256];
+	bool is_sent[LEN] = { false };
+	int sent_to = -1;
+	int not_sent_to = -1;
+	for (int i = 0; i < LEN - 1; i++) {
+		is_sent[i] = read_all(sv[i][1], buf, sizeof buf) > 0;
+		if (is_sent[i]) {
+			ASSERT(strcmp(buf, "GOTANNOUNCE a\r\n") == 0);
+			sent_to = i;
+		} else {
+			not_sent_to = i;
+		}
+	}
+	ASSERT(sent_to >= 0 && not_sent_to >= 0);
+	ASSERT(channels_unsubscribe(c, sv[sent_to][0], 1) == 0);
+	ASSERT(channels_unsubscribe(c, sv[not_sent_to][0], 1) == 0);
+	ASSERT(channels_subscribe(c, sv[LEN - 1][0], 1) == 0);
+	publish(c, 1, "GOTANNOUNCE b\r\n");
+
+	size_t flushes = 0;
+	while (channels_is_busy(c)) {
+		ASSERT(channels_flush(c, out, dropped, 2) == 0);
+		ASSERT(++flushes < 10);
+	}
+
+	for (int i = 0; i < LEN; i++) {
+		read_all(sv[i][1], buf, sizeof buf);
+		if (i == sent_to || i == not_sent_to) {
+			ASSERT(buf[0] == '\0');
+		} else if (i == LEN - 1) {
+			ASSERT(strcmp(buf, "GOTANNOUNCE b\r\n") == 0);
+		} else if (is_sent[i]) {
+			ASSERT(strcmp(buf, "GOTANNOUNCE b\r\n") == 0);
+		} else {
+			ASSERT(strcmp(buf, "GOTANNOUNCE a\r\nGOTANNOUNCE b\r\n") == 0);
+		}
+	}
+
+	for (int i = 0; i < LEN; i++) {
+		close(sv[i][0]);
+		close(sv[i][1]);
+	}
+	channels_free(c);
+	coalescer_free(out);
+}
+
+/**
+ * @brief Flushes the way the event loop does: first what was left waiting
+ * for the connections, then the channels.
+ *
+ */
+static size_t flush(Channels *c, Coalescer *out, uint64_t now_ms, int *dropped) {
+	const size_t result = coalescer_flush(out, now_ms, dropped, 2);
+	return result + channels_flush(c, out, &dropped[result], 2 - result);
+}
+
+static void test_channels_sheds_slow_subscribers(void) {
+	Channels *c = channels_create(SENDS);
+	Coalescer *out = coalescer_create(DROP_MS);
+
+	int fast[2];
+	int slow[2];
+	int gone[2];
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fast) == 0);
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, slow) == 0);
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, gone) == 0);
+	ASSERT(channels_subscribe(c, fast[0], 1) == 0);
+	ASSERT(channels_subscribe(c, slow[0], 1) == 0);
+	ASSERT(channels_subscribe(c, gone[0], 1) == 0);
+
+	// A connection that went away is dropped on the next send.
+	close(gone[1]);
+	publish(c, 1, "GOTSAY a hi\r\n");
+	int dropped[2];
+	ASSERT(flush(c, out, 0, dropped) == 1);
+	ASSERT(dropped[0] == gone[0]);
+	ASSERT(channels_subscribers(c, 1) == 2);
+
+	// Keep publishing until the subscriber that never reads is full.
+	char line[4096];
+	memset(line, 'x', sizeof line - 3);
+	memcpy(&line[sizeof line - 3], "\r\n", 3);
+	static char sink[1 << 22];
+
+	size_t flushes = 0;
+	while (!coalescer_is_pending(out, slow[0])) {
+		publish(c, 1, line);
+		ASSERT(flush(c, out, 10, dropped) == 0);
+		read_all(fast[1], sink, sizeof sink);
+		ASSERT(++flushes < 100000);
+	}
+	ASSERT(!coalescer_is_pending(out, fast[0]));
+
+	// What is published meanwhile is shed for the slow subscriber only. A
+	// reply to it goes out after the rest of the line it is in the middle of.
+	ASSERT(coalescer_add(out, slow[0], "OK\r\n", 4) == 0);
+	publish(c, 1, "GOTSAY b hello\r\n");
+	ASSERT(flush(c, out, 20, dropped) == 0);
+	read_all(fast[1], sink, sizeof sink);
+	ASSERT(strcmp(sink, "GOTSAY b hello\r\n") == 0);
+
+	size_t got = 0;
+	while (coalescer_is_pending(out, slow[0])) {
+		got += read_all(slow[1], &sink[got], sizeof sink - got);
+		ASSERT(flush(c, out, 30, dropped) == 0);
+	}
+	got += read_all(slow[1], &sink[got], sizeof sink - got);
+	ASSERT(got >= 6 && memcmp(&sink[got - 6], "\r\nOK\r\n", 6) == 0);
+	ASSERT(strstr(sink, "GOTSAY b") == NULL);
+
+	// A subscriber that takes nothing for too long is dropped by the coalescer.
+	while (!coalescer_is_pending(out, slow[0])) {
+		publish(c, 1, line);
+		ASSERT(flush(c, out, 40, dropped) == 0);
+		read_all(fast[1], sink, sizeof sink);
+	}
+	ASSERT(flush(c, out, 40, dropped) == 0);
+	ASSERT(flush(c, out, 40 + DROP_MS, dropped) == 1);
+	ASSERT(dropped[0] == slow[0]);
+	channels_remove(c, slow[0]);
+	ASSERT(channels_subscribers(c, 1) == 1);
+
+	close(fast[0]);
+	close(fast[1]);
+	close(slow[0]);
+	close(slow[1]);
+	close(gone[0]);
+	channels_free(c);
+	coalescer_free(out);
+}
+
+int main(void) {
+	test_channels_subscribe();
+	test_channels_many_topics();
+	test_channels_flush_in_slices();
+	test_channels_sheds_slow_subscribers();
+}
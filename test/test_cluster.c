@@ -0,0 +1,94 @@
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "cluster.h"
+#include "task.h"
+
+static void test_cluster_messages(void) {
+	int socks[2];
+	ASSERT(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, socks) == 0);
+
+	ClusterMessage m;
+	ASSERT(cluster_send(socks[0], &(ClusterMessage){ .type = CLUSTER_WELCOME, .node = 7 }) == 0);
+	ASSERT(cluster_recv(socks[1], &m) == 0);
+	ASSERT(m.type == CLUSTER_WELCOME && m.node == 7 && m.fd == -1);
+
+	ASSERT(cluster_send(socks[1], &(ClusterMessage){ .type = CLUSTER_LOAD, .players = 1000, .lobbies = 300 }) == 0);
+	ASSERT(cluster_recv(socks[0], &m) == 0);
+	ASSERT(m.type == CLUSTER_LOAD && m.players == 1000 && m.lobbies == 300);
+
+	// The connection arrives as a new descriptor together with what was read from it.
+	int pipefds[2];
+	ASSERT(pipe(pipefds) == 0);
+	ClusterMessage conn = { .type = CLUSTER_CONN, .fd = pipefds[0], .data_len = 13 };
+	memcpy(conn.data, "LOGIN Player1", 13);
+	ASSERT(cluster_send(socks[0], &conn) == 0);
+	close(pipefds[0]);
+	ASSERT(cluster_recv(socks[1], &m) == 0);
+	ASSERT(m.type == CLUSTER_CONN && m.fd >= 0 && m.data_len == 13 && memcmp(m.data, "LOGIN Player1", 13) == 0);
+	ASSERT(write(pipefds[1], "x", 1) == 1);
+	char byte;
+	ASSERT(read(m.fd, &byte, 1) == 1 && byte == 'x');
+	close(m.fd);
+	close(pipefds[1]);
+
+	// Malformed packets are refused.
+	ASSERT(send(socks[0], "\x01\x02", 2, 0) == 2);
+	ASSERT(cluster_recv(socks[1], &m) < 0);
+	ASSERT(send(socks[0], "\x09", 1, 0) == 1);
+	ASSERT(cluster_recv(socks[1], &m) < 0);
+	ASSERT(send(socks[0], "\x02" "LOGIN", 6, 0) == 6);
+	ASSERT(cluster_recv(socks[1], &m) < 0);
+
+	// So is a peer that went away.
+	close(socks[0]);
+	ASSERT(cluster_recv(socks[1], &m) < 0);
+	close(socks[1]);
+}
+
+static void test_cluster_pick(void) {
+	Cluster *c = cluster_create();
+	ASSERT(c != NULL);
+	ASSERT(cluster_pick(c) == -1);
+
+	ASSERT(cluster_add(c, 10) == 0);
+	ASSERT(cluster_add(c, 11) == 1);
+	ASSERT(cluster_add(c, 12) == 2);
+	ASSERT(cluster_workers(c) == 3);
+	ASSERT(cluster_node(c, 11) == 1 && cluster_node(c, 13) == -1);
+	ASSERT(cluster_sock(c, 2) == 12 && cluster_sock(c, 3) == -1);
+
+	// The least loaded worker is picked, and what it was handed counts until it reports.
+	cluster_report(c, 0, 10, 5);
+	cluster_report(c, 1, 7, 3);
+	cluster_report(c, 2, 8, 4);
+	ASSERT(cluster_pick(c) == 1);
+	ASSERT(cluster_pick(c) == 1); // 8 players each, but fewer lobbies.
+	ASSERT(cluster_pick(c) == 2);
+
+	// A report replaces what was counted.
+	cluster_report(c, 1, 20, 10);
+	cluster_count(c, 2);
+	ASSERT(cluster_pick(c) == 2);
+	ASSERT(cluster_pick(c) == 0);
+
+	// Nodes of workers that went away are given to the next worker.
+	cluster_remove(c, 1);
+	ASSERT(cluster_workers(c) == 2 && cluster_sock(c, 1) == -1);
+	cluster_report(c, 1, 0, 0);
+	ASSERT(cluster_add(c, 20) == 1);
+	ASSERT(cluster_pick(c) == 1);
+
+	for (int i = 3; i < CLUSTER_MAX_WORKERS; i++) {
+		ASSERT(cluster_add(c, 100 + i) == i);
+	}
+	ASSERT(cluster_add(c, 1000) == -1);
+
+	cluster_free(c);
+}
+
+int main(void) {
+	test_cluster_messages();
+	test_cluster_pick();
+}
@@ -0,0 +1,193 @@
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "coalescer.h"
+#include "task.h"
+
+#define DROP_MS 1000
+
+static void test_coalescer_one_send_per_connection(void) {
+	Coalescer *c = coalescer_create(DROP_MS);
+	ASSERT(c != NULL);
+
+	int a[2];
+	int b[2];
+	ASSERT(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, a) == 0);
+	ASSERT(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, b) == 0);
+
+	// What a move sends: a reply to the mover and the move to both players.
+	ASSERT(coalescer_add(c, a[0], "OK\r\n", 4) == 0);
+	ASSERT(coalescer_add(c, b[0], "GOTMOVE 4 4\r\n", 13) == 0);
+	ASSERT(coalescer_add(c, a[0], "GOTMOVE 4 4\r\n", 13) == 0);
+	ASSERT(coalescer_add(c, a[0], "", 0) == 0);
+	ASSERT(coalescer_add(c, -1, "OK\r\n", 4) < 0);
+	ASSERT(coalescer_is_pending(c, a[0]));
+	size_t pending_len;
+	const char *pending = coalescer_pending(c, a[0], &pending_len);
+	ASSERT(pending_len == 17 && memcmp(pending, "OK\r\nGOTMOVE 4 4\r\n", 17) == 0);
+	int dropped[2];
+	ASSERT(coalescer_flush(c, 0, dropped, 2) == 0);
+	ASSERT(!coalescer_is_pending(c, a[0]));
+	ASSERT(coalescer_pending(c, a[0], &pending_len) == NULL && pending_len == 0);
+	ASSERT(!coalescer_is_behind(c));
+
+	// Packets keep the boundaries of every send.
+	char buf[64];
+	ASSERT(recv(a[1], buf, sizeof buf, MSG_DONTWAIT) == 17);
+	ASSERT(memcmp(buf, "OK\r\nGOTMOVE 4 4\r\n", 17) == 0);
+	ASSERT(recv(a[1], buf, sizeof buf, MSG_DONTWAIT) < 0);
+	ASSERT(recv(b[1], buf, sizeof buf, MSG_DONTWAIT) == 13);
+
+	// With nothing waiting, a send goes out right away.
+	ASSERT(coalescer_send(c, b[0], "GOTMOVE 0 1\r\n", 13) == 0);
+	ASSERT(!coalescer_is_pending(c, b[0]));
+	ASSERT(recv(b[1], buf, sizeof buf, MSG_DONTWAIT) == 13);
+	ASSERT(coalescer_send(c, -1, "OK\r\n", 4) < 0);
+
+	close(a[0]);
+	close(a[1]);
+	close(b[0]);
+	close(b[1]);
+	coalescer_free(c);
+}
+
+static void test_coalescer_grows(void) {
+	Coalescer *c = coalescer_create(DROP_MS);
+
+	// Connections far past the first buffers, with more than is kept.
+	int fds[2];
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	const int high = 300;
+	ASSERT(dup2(fds[0], high) == high);
+
+	static char big[COALESCER_KEEP_SIZE * 2];
+	memset(big, 'x', sizeof big);
+	for (size_t i = 0; i < 4; i++) {
+		ASSERT(coalescer_add(c, high, big, sizeof big / 4) == 0);
+	}
+	int dropped[1];
+	ASSERT(coalescer_flush(c, 0, dropped, 1) == 0);
+
+	static char got[sizeof big];
+	size_t got_len = 0;
+	while (got_len < sizeof got) {
+		const ssize_t n = recv(fds[1], &got[got_len], sizeof got - got_len, 0);
+		ASSERT(n > 0);
+		got_len += (size_t)n;
+	}
+	ASSERT(memcmp(got, big, sizeof big) == 0);
+
+	// Still usable after the buffer was given back.
+	ASSERT(coalescer_add(c, high, "OK\r\n", 4) == 0);
+	ASSERT(coalescer_flush(c, 0, dropped, 1) == 0);
+	ASSERT(recv(fds[1], got, sizeof got, 0) == 4);
+
+	close(high);
+	close(fds[0]);
+	close(fds[1]);
+	coalescer_free(c);
+}
+
+/**
+ * @brief Reads whatever is waiting on fd without blocking. Returns the number
+ * of bytes read.
+ *
+ */
+static size_t read_all(int fd, char *buf, size_t size) {
+	size_t result = 0;
+	long got;
+	while (result < size && (got = (long)recv(fd, buf + result, size - result, MSG_DONTWAIT)) > 0) {
+		result += (size_t)got;
+	}
+	return result;
+}
+
+static void test_coalescer_keeps_what_is_not_taken(void) {
+	Coalescer *c = coalescer_create(DROP_MS);
+
+	int slow[2];
+	int gone[2];
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, slow) == 0);
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, gone) == 0);
+
+	// A connection that went away is dropped and sent nothing more.
+	close(gone[1]);
+	ASSERT(coalescer_add(c, gone[0], "OK\r\n", 4) == 0);
+	int dropped[2];
+	ASSERT(coalescer_flush(c, 0, dropped, 2) == 1);
+	ASSERT(dropped[0] == gone[0]);
+	ASSERT(coalescer_is_pending(c, gone[0]));
+	size_t pending_len;
+	ASSERT(coalescer_pending(c, gone[0], &pending_len) == NULL && pending_len == 0);
+	ASSERT(coalescer_add(c, gone[0], "OK\r\n", 4) == 0);
+	ASSERT(coalescer_flush(c, 0, dropped, 2) == 0);
+
+	// Fill the connection that never reads. The flush returns instead of
+	// waiting for it, and the rest stays in order ahead of what comes next.
+	static char line[1024];
+	static char sink[1 << 22];
+	static char expect[sizeof sink];
+	size_t expect_len = 0;
+	char next = 'a';
+	while (!coalescer_is_behind(c)) {
+		memset(line, next, sizeof line - 2);
+		memcpy(&line[sizeof line - 2], "\r\n", 2);
+		next = next == 'z' ? 'a' : (char)(next + 1);
+
+		ASSERT(coalescer_add(c, slow[0], line, sizeof line) == 0);
+		memcpy(&expect[expect_len], line, sizeof line);
+		expect_len += sizeof line;
+		ASSERT(coalescer_flush(c, 10, dropped, 2) == 0);
+		ASSERT(expect_len < sizeof expect);
+	}
+	ASSERT(coalescer_is_pending(c, slow[0]));
+	ASSERT(coalescer_add(c, slow[0], "GOTMOVE 1 1\r\n", 13) == 0);
+	memcpy(&expect[expect_len], "GOTMOVE 1 1\r\n", 13);
+	expect_len += 13;
+
+	// What is waiting is whatever the connection has not taken, in order.
+	const char *pending = coalescer_pending(c, slow[0], &pending_len);
+	ASSERT(pending_len > 0 && pending_len < expect_len);
+	ASSERT(memcmp(pending, &expect[expect_len - pending_len], pending_len) == 0);
+
+	size_t got = 0;
+	while (coalescer_is_behind(c)) {
+		got += read_all(slow[1], &sink[got], sizeof sink - got);
+		ASSERT(coalescer_flush(c, 20, dropped, 2) == 0);
+	}
+	got += read_all(slow[1], &sink[got], sizeof sink - got);
+	ASSERT(got == expect_len);
+	ASSERT(memcmp(sink, expect, expect_len) == 0);
+	ASSERT(!coalescer_is_pending(c, slow[0]));
+
+	// Taking nothing for too long gets the connection dropped.
+	while (!coalescer_is_behind(c)) {
+		ASSERT(coalescer_add(c, slow[0], line, sizeof line) == 0);
+		ASSERT(coalescer_flush(c, 30, dropped, 2) == 0);
+	}
+	ASSERT(coalescer_flush(c, 30 + DROP_MS - 1, dropped, 2) == 0);
+	ASSERT(coalescer_flush(c, 30 + DROP_MS, dropped, 2) == 1);
+	ASSERT(dropped[0] == slow[0]);
+	ASSERT(!coalescer_is_behind(c));
+
+	// Until removed, after which the number can be used again.
+	coalescer_remove(c, slow[0]);
+	coalescer_remove(c, gone[0]);
+	ASSERT(!coalescer_is_pending(c, slow[0]));
+	read_all(slow[1], sink, sizeof sink);
+	ASSERT(coalescer_add(c, slow[0], "OK\r\n", 4) == 0);
+	ASSERT(coalescer_flush(c, 40, dropped, 2) == 0);
+	ASSERT(read_all(slow[1], sink, sizeof sink) == 4);
+
+	close(slow[0]);
+	close(slow[1]);
+	close(gone[0]);
+	coalescer_free(c);
+}
+
+int main(void) {
+	test_coalescer_one_send_per_connection();
+	test_coalescer_grows();
+	test_coalescer_keeps_what_is_not_taken();
+}
@@ -2,6 +2,7 @@
 #include <string.h>
 
 #include "context.h"
+#include "lobby.h"
 #include "player.h"
 #include "task.h"
 
@@ -13,17 +14,17 @@ static void ctx_add_player_e(Context *ctx, const Player *p) {
 static void test_ctx_add_player(void) {
 	Context *ctx = ctx_create();
 
-	ctx_add_player_e(ctx, &(Player){ .fd = 1, .name = "Player1" });
-	ctx_add_player_e(ctx, &(Player){ .fd = 2, .name = "Player2" });
-	ctx_add_player_e(ctx, &(Player){ .fd = 3, .name = "Player3" });
-	ctx_add_player_e(ctx, &(Player){ .fd = 4, .name = "Player4" });
+	// Enough players to grow the arrays more than once.
+	for (int fd = 1; fd <= 9; fd++) {
+		ctx_add_player_e(ctx, &(Player){ .fd = fd, .name = "Player" });
+	}
 
-	ASSERT(ctx->players_len == 4);
+	ASSERT(ctx->players_len == 9);
 	for (size_t i = 0; i < ctx->players_len; i++) {
 		ASSERT(ctx->players[i].fd == (int)i + 1);
 	}
 
-	ASSERT(ctx->pfds_len == 4);
+	ASSERT(ctx->pfds_len == 9);
 	for (size_t i = 0; i < ctx->pfds_len; i++) {
 		ASSERT(ctx->pfds[i].fd == (int)i + 1);
 	}
@@ -31,6 +32,29 @@ static void test_ctx_add_player(void) {
 	ctx_destory(ctx);
 }
 
+static void test_ctx_reserve(void) {
+	Context *ctx = ctx_create();
+	ctx_add_player_e(ctx, &(Player){ .fd = 1, .name = "Player1" });
+
+	ASSERT(ctx_reserve(ctx, 100) == 0);
+	ASSERT(ctx->players_size >= 100 && ctx->pfds_size >= 100);
+	const Player *players = ctx->players;
+	const struct pollfd *pfds = ctx->pfds;
+
+	// Nothing moves while adding what was reserved for.
+	for (int fd = 2; fd <= 100; fd++) {
+		ctx_add_player_e(ctx, &(Player){ .fd = fd, .name = "Player" });
+	}
+	ASSERT(ctx->players == players && ctx->pfds == pfds);
+	ASSERT(ctx->players[0].fd == 1 && ctx->pfds[99].fd == 100);
+
+	// Reserving less than there is room for does nothing.
+	ASSERT(ctx_reserve(ctx, 10) == 0);
+	ASSERT(ctx->players_len == 100);
+
+	ctx_destory(ctx);
+}
+
 static void test_ctx_add_player_fail_when_adding_same_player(void) {
 	Context *ctx = ctx_create();
 
@@ -75,6 +99,25 @@ static void test_ctx_remove_player(void) {
 	ctx_destory(ctx);
 }
 
+static void test_ctx_unpoll(void) {
+	Context *ctx = ctx_create();
+
+	ctx_add_player_e(ctx, &(Player){ .fd = 1, .name = "Player1" });
+	ctx_add_player_e(ctx, &(Player){ .fd = 2, .name = "Player2" });
+
+	ctx_unpoll(ctx, 1);
+	ASSERT(ctx->players_len == 2);
+	ASSERT(ctx->pfds_len == 1);
+	ASSERT(ctx->pfds[0].fd == 2);
+	ASSERT(ctx_get_player(ctx, 1) != NULL);
+
+	ctx_remove_player(ctx, 1);
+	ASSERT(ctx->players_len == 1);
+	ASSERT(ctx->pfds_len == 1);
+
+	ctx_destory(ctx);
+}
+
 static void test_ctx_get_player(void) {
 	Context *ctx = ctx_create();
 
@@ -89,9 +132,66 @@ static void test_ctx_get_player(void) {
 	ctx_destory(ctx);
 }
 
+static void test_ctx_get_player_after_moves(void) {
+	Context *ctx = ctx_create();
+
+	// Numbers past the first index, removed from all over.
+	for (int fd = 0; fd < 600; fd += 3) {
+		ctx_add_player_e(ctx, &(Player){ .fd = fd, .name = "Player" });
+	}
+	for (int fd = 0; fd < 600; fd += 9) {
+		ctx_remove_player(ctx, fd);
+	}
+	for (int fd = 3; fd < 600; fd += 9) {
+		ctx_unpoll(ctx, fd);
+	}
+
+	for (int fd = 0; fd < 600; fd++) {
+		const Player *player = ctx_get_player(ctx, fd);
+		if (fd % 3 != 0 || fd % 9 == 0) {
+			ASSERT(player == NULL);
+		} else {
+			ASSERT(player != NULL && player->fd == fd);
+		}
+	}
+	for (size_t i = 0; i < ctx->pfds_len; i++) {
+		ASSERT(ctx->pfds[i].fd % 9 == 6);
+	}
+	ASSERT(ctx->players_len == 133 && ctx->pfds_len == 66);
+
+	ASSERT(ctx_get_player(ctx, -1) == NULL);
+	ASSERT(ctx_get_player(ctx, 100000) == NULL);
+	ASSERT(ctx_add_player(ctx, &(Player){ .fd = -1 }) < 0);
+
+	ctx_destory(ctx);
+}
+
+static void test_ctx_add_remove_lobby(void) {
+	Context *ctx = ctx_create();
+
+	Lobby lobbies[5];
+	for (size_t i = 0; i < 5; i++) {
+		ASSERT(ctx_add_lobby(ctx, &lobbies[i]) == 0);
+	}
+	ASSERT(ctx->lobbies_len == 5);
+
+	ctx_remove_lobby(ctx, &lobbies[1]);
+	ctx_remove_lobby(ctx, &lobbies[1]);
+	ASSERT(ctx->lobbies_len == 4);
+	for (size_t i = 0; i < ctx->lobbies_len; i++) {
+		ASSERT(ctx->lobbies[i] != &lobbies[1]);
+	}
+
+	ctx_destory(ctx);
+}
+
 int main(void) {
 	test_ctx_add_player();
+	test_ctx_reserve();
 	test_ctx_add_player_fail_when_adding_same_player();
 	test_ctx_remove_player();
+	test_ctx_unpoll();
 	test_ctx_get_player();
+	test_ctx_get_player_after_moves();
+	test_ctx_add_remove_lobby();
 }
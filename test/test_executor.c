@@ -0,0 +1,124 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "executor.h"
+#include "task.h"
+
+#define KEYS 4
+#define TASKS_PER_KEY 500
+
+typedef struct Log {
+	pthread_mutex_t lock;
+	int next[KEYS]; // The sequence number each key expects next.
+	int out_of_order;
+	int running[KEYS]; // Tasks of each key running right now.
+	int overlapped;
+} Log;
+
+typedef struct Step {
+	Log *log;
+	uint32_t key;
+	int seq;
+} Step;
+
+static void record(void *arg) {
+	const Step *step = arg;
+	Log *log = step->log;
+
+	pthread_mutex_lock(&log->lock);
+	if (log->running[step->key]++ > 0) {
+		log->overlapped++;
+	}
+	if (log->next[step->key] != step->seq) {
+		log->out_of_order++;
+	}
+	log->next[step->key] = step->seq + 1;
+	pthread_mutex_unlock(&log->lock);
+
+	pthread_mutex_lock(&log->lock);
+	log->running[step->key]--;
+	pthread_mutex_unlock(&log->lock);
+}
+
+static void test_executor_keeps_key_order(void) {
+	Executor *e = executor_create(4);
+	ASSERT(e != NULL);
+
+	Log log = { .lock = PTHREAD_MUTEX_INITIALIZER };
+	for (int seq = 0; seq < TASKS_PER_KEY; seq++) {
+		for (uint32_t key = 0; key < KEYS; key++) {
+			const Step step = { .log = &log, .key = key, .seq = seq };
+			ASSERT(executor_submit(e, key, record, &step, sizeof step) == 0);
+		}
+	}
+
+	executor_wait(e);
+	ASSERT(log.out_of_order == 0);
+	ASSERT(log.overlapped == 0);
+	for (uint32_t key = 0; key < KEYS; key++) {
+		ASSERT(log.next[key] == TASKS_PER_KEY);
+	}
+
+	// A key can be used again once its tasks are done.
+	const Step step = { .log = &log, .key = 0, .seq = TASKS_PER_KEY };
+	ASSERT(executor_submit(e, 0, record, &step, sizeof step) == 0);
+	executor_wait(e);
+	ASSERT(log.next[0] == TASKS_PER_KEY + 1);
+
+	executor_free(e);
+}
+
+static void test_executor_free_finishes_tasks(void) {
+	Executor *e = executor_create(2);
+
+	Log log = { .lock = PTHREAD_MUTEX_INITIALIZER };
+	for (int seq = 0; seq < 100; seq++) {
+		const Step step = { .log = &log, .key = 1, .seq = seq };
+		executor_submit(e, 1, record, &step, sizeof step);
+	}
+
+	executor_free(e);
+	ASSERT(log.next[1] == 100);
+	ASSERT(log.out_of_order == 0);
+}
+
+static void spin(void *arg) {
+	(void)arg;
+	nanosleep(&(struct timespec){ .tv_nsec = 100000 }, NULL);
+}
+
+static void test_executor_balances_load(void) {
+	Executor *e = executor_create(2);
+
+	// Actors are spread by count, so keys 0 and 2 end up on the same thread.
+	for (uint32_t key = 0; key < 4; key++) {
+		ASSERT(executor_submit(e, key, spin, &e, sizeof e) == 0);
+	}
+	executor_wait(e);
+
+	struct timespec start, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		for (int i = 0; i < 50; i++) {
+			ASSERT(executor_submit(e, 0, spin, &e, sizeof e) == 0);
+			ASSERT(executor_submit(e, 2, spin, &e, sizeof e) == 0);
+		}
+		executor_wait(e);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 < EXECUTOR_BALANCE_MS * 4);
+
+	ExecutorStats stats;
+	executor_stats(e, &stats);
+	ASSERT(stats.migrations >= 1);
+	ASSERT(stats.retired == 2); // Keys 1 and 3 went quiet.
+	ASSERT(stats.actors == 2);
+
+	executor_free(e);
+}
+
+int main(void) {
+	test_executor_keeps_key_order();
+	test_executor_free_finishes_tasks();
+	test_executor_balances_load();
+}
@@ -0,0 +1,218 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bot.h"
+#include "handoff.h"
+#include "lobby.h"
+#include "task.h"
+
+#define MANY_CONNECTIONS (HANDOFF_FDS_BATCH + 10)
+
+/**
+ * @brief Sends from a child process, which has its own numbers for every file
+ * descriptor like the server that is upgraded.
+ *
+ * @return pid_t The child.
+ */
+static pid_t send_from_child(int sv[2], const Handoff *h) {
+	const pid_t pid = fork();
+	ASSERT(pid >= 0);
+	if (pid == 0) {
+		close(sv[1]);
+		_exit(handoff_send(sv[0], h) == 0 ? 0 : 1);
+	}
+
+	close(sv[0]);
+	return pid;
+}
+
+static void wait_child(pid_t pid) {
+	int status;
+	ASSERT(waitpid(pid, &status, 0) == pid);
+	ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+static void test_handoff_state(void) {
+	int listener[2];
+	int alice[2];
+	int bob[2];
+	int watcher[2];
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, listener) == 0);
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, alice) == 0);
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, bob) == 0);
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, watcher) == 0);
+
+	Lobby *l = lobby_create(9, 9);
+	ASSERT(lobby_join(l, &(Player){ .fd = alice[0], .name = "alice", .is_login = true }) == 0);
+	ASSERT(lobby_join(l, &(Player){ .fd = bob[0], .name = "bob", .is_login = true }) == 0);
+	const char first = lobby_turn(l);
+	ASSERT(lobby_place(l, first, 4, 4) == 0);
+	ASSERT(lobby_place(l, lobby_turn(l), 3, 4) == 0);
+	ASSERT(lobby_place(l, first, 0, 8) == 0);
+
+	// A seat restored from the journal and the bot.
+	Lobby *match = lobby_create(7, 5);
+	match->id = 7;
+	ASSERT(lobby_join(match, &(Player){ .fd = -1, .name = "carol", .is_login = true }) == 0);
+	const Player bot = bot_player();
+	ASSERT(lobby_join(match, &bot) == 0);
+
+	HandoffConnection conns[3] = {
+		{ .player = { .fd = alice[0], .name = "alice", .is_login = true, .rating = 1600, .route = 0 }, .in_lobby = true,
+			.token = "0000000500112233445566778899aabbccddeeff" },
+		{ .player = { .fd = bob[0], .name = "bob", .is_login = true, .rating = 900, .route = 3 }, .is_queued = true },
+		{ .player = { .fd = watcher[0], .name = "dave", .is_login = true }, .is_watching = true, .watched = 7,
+			.pending = (char[]){ "GOTMOVE 1 1\r\nGOTM" }, .pending_len = 17 },
+	};
+	Lobby *lobbies[] = { match };
+	const Handoff h = {
+		.listener = listener[0],
+		.next_lobby_id = 8,
+		.l = l,
+		.lobbies = lobbies,
+		.lobbies_len = 1,
+		.conns = conns,
+		.conns_len = 3,
+	};
+
+	int sv[2];
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	const pid_t pid = send_from_child(sv, &h);
+
+	// Only the child keeps the numbers open, like a new server would find them.
+	close(listener[0]);
+	close(alice[0]);
+	close(bob[0]);
+	close(watcher[0]);
+
+	Handoff got;
+	ASSERT(handoff_recv(sv[1], &got) == 0);
+	wait_child(pid);
+
+	ASSERT(got.listener == listener[0]);
+	ASSERT(got.next_lobby_id == 8);
+	ASSERT(got.conns_len == 3);
+	for (size_t i = 0; i < 3; i++) {
+		ASSERT(got.conns[i].player.fd == conns[i].player.fd);
+		ASSERT(strcmp(got.conns[i].player.name, conns[i].player.name) == 0);
+		ASSERT(got.conns[i].player.rating == conns[i].player.rating);
+		ASSERT(got.conns[i].player.route == conns[i].player.route);
+		ASSERT(got.conns[i].in_lobby == conns[i].in_lobby);
+		ASSERT(got.conns[i].is_queued == conns[i].is_queued);
+		ASSERT(got.conns[i].is_watching == conns[i].is_watching);
+		ASSERT(strcmp(got.conns[i].token, conns[i].token) == 0);
+	}
+	ASSERT(got.conns[2].watched == 7);
+	ASSERT(got.conns[0].pending == NULL && got.conns[0].pending_len == 0);
+	ASSERT(got.conns[2].pending_len == 17 && memcmp(got.conns[2].pending, "GOTMOVE 1 1\r\nGOTM", 17) == 0);
+
+	// The connections stay the same under their old numbers.
+	char buf[8] = { 0 };
+	ASSERT(send(alice[1], "MOVE", 4, 0) == 4);
+	ASSERT(recv(alice[0], buf, sizeof buf, 0) == 4);
+	ASSERT(memcmp(buf, "MOVE", 4) == 0);
+	ASSERT(send(listener[0], "OK", 2, 0) == 2);
+	ASSERT(recv(listener[1], buf, sizeof buf, 0) == 2);
+
+	// The game goes on where it was.
+	ASSERT(got.l->id == 0);
+	ASSERT(lobby_hash(got.l) == lobby_hash(l));
+	ASSERT(lobby_moves_len(got.l) == 3);
+	ASSERT(lobby_turn(got.l) == lobby_turn(l));
+	ASSERT(got.l->players_len == 2);
+	ASSERT(got.l->players[0].fd == alice[0] && got.l->players[0].team == l->players[0].team);
+	ASSERT(got.l->players[1].fd == bob[0] && got.l->players[1].team == l->players[1].team);
+
+	ASSERT(got.lobbies_len == 1);
+	Lobby *got_match = got.lobbies[0];
+	ASSERT(got_match->id == 7);
+	ASSERT(got_match->players[0].fd == -1 && strcmp(got_match->players[0].name, "carol") == 0);
+	ASSERT(got_match->players[1].is_bot && got_match->players[1].write == bot.write);
+
+	lobby_free(got.l);
+	lobby_free(got_match);
+	handoff_clear(&got);
+	lobby_free(l);
+	lobby_free(match);
+
+	const int fds[] = { listener[0], listener[1], alice[0], alice[1], bob[0], bob[1], watcher[0], watcher[1] };
+	for (size_t i = 0; i < sizeof fds / sizeof *fds; i++) {
+		close(fds[i]);
+	}
+}
+
+static void test_handoff_many(void) {
+	static int pairs[MANY_CONNECTIONS][2];
+	static HandoffConnection conns[MANY_CONNECTIONS];
+	for (size_t i = 0; i < MANY_CONNECTIONS; i++) {
+		ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, pairs[i]) == 0);
+		conns[i] = (HandoffConnection){ .player = { .fd = pairs[i][0] } };
+	}
+
+	Lobby *l = lobby_create(9, 9);
+	const Handoff h = { .listener = pairs[0][1], .l = l, .conns = &conns[1], .conns_len = MANY_CONNECTIONS - 1 };
+
+	int sv[2];
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	const pid_t pid = send_from_child(sv, &h);
+	close(pairs[0][1]);
+	for (size_t i = 1; i < MANY_CONNECTIONS; i++) {
+		close(pairs[i][0]);
+	}
+
+	// More than fit in one batch.
+	Handoff got;
+	ASSERT(handoff_recv(sv[1], &got) == 0);
+	wait_child(pid);
+	ASSERT(got.conns_len == MANY_CONNECTIONS - 1);
+	for (size_t i = 1; i < MANY_CONNECTIONS; i++) {
+		char c;
+		ASSERT(send(pairs[i][1], "x", 1, 0) == 1);
+		ASSERT(recv(pairs[i][0], &c, 1, 0) == 1 && c == 'x');
+	}
+
+	lobby_free(got.l);
+	handoff_clear(&got);
+	lobby_free(l);
+	for (size_t i = 0; i < MANY_CONNECTIONS; i++) {
+		close(pairs[i][0]);
+		close(pairs[i][1]);
+	}
+}
+
+static void test_handoff_taken(void) {
+	int pair[2];
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+
+	Lobby *l = lobby_create(9, 9);
+	HandoffConnection conn = { .player = { .fd = pair[0] } };
+	const Handoff h = { .listener = pair[1], .l = l, .conns = &conn, .conns_len = 1 };
+
+	int sv[2];
+	ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	const pid_t pid = send_from_child(sv, &h);
+
+	// Still open here, so nothing can be placed.
+	Handoff got;
+	ASSERT(handoff_recv(sv[1], &got) < 0);
+	ASSERT(got.l == NULL && got.conns_len == 0);
+	wait_child(pid);
+
+	// Nothing is left behind either.
+	ASSERT(send(pair[1], "x", 1, 0) == 1);
+	char c;
+	ASSERT(recv(pair[0], &c, 1, 0) == 1);
+
+	lobby_free(l);
+	close(pair[0]);
+	close(pair[1]);
+}
+
+int main(void) {
+	test_handoff_state();
+	test_handoff_many();
+	test_handoff_taken();
+}
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "journal.h"
+#include "lobby.h"
+#include "task.h"
+
+#define JOURNAL_PATH "test_journal.bin"
+
+typedef struct T {
+	Journal *j;
+	Lobby *l;
+	Player player1;
+	Player player2;
+} T;
+
+static void test_setup(T *t) {
+	remove(JOURNAL_PATH);
+
+	t->j = journal_open(JOURNAL_PATH);
+	ASSERT(t->j != NULL);
+
+	t->l = lobby_create(7, 5);
+	t->player1 = (Player){ .fd = 1, .name = "Player1", .key = { 1 } };
+	t->player2 = (Player){ .fd = 2, .name = "Player2", .key = { 2 } };
+
+	lobby_join(t->l, &t->player1);
+	lobby_join(t->l, &t->player2);
+
+	journal_create(t->j, t->l);
+	journal_join(t->j, t->l, &t->player1);
+	journal_join(t->j, t->l, &t->player2);
+}
+
+static void test_teardown(T *t) {
+	if (t->j) {
+		journal_close(t->j);
+	}
+	lobby_free(t->l);
+	remove(JOURNAL_PATH);
+}
+
+static void play_e(T *t, const Player *player, size_t row, size_t col) {
+	char row_str[8];
+	char col_str[8];
+	snprintf(row_str, sizeof row_str, "%zu", row);
+	snprintf(col_str, sizeof col_str, "%zu", col);
+
+	int actual = lobby_play_move(t->l, player, row_str, col_str);
+	ASSERT(actual == 0);
+
+	LobbyMove move;
+	ASSERT(lobby_last_move(t->l, &move) == 0);
+	journal_move(t->j, t->l, move.team, move.row, move.col);
+}
+
+static Lobby *recover_one(void) {
+	Lobby **lobbies;
+	size_t lobbies_len;
+
+	int actual = journal_recover(JOURNAL_PATH, &lobbies, &lobbies_len);
+	ASSERT(actual == 0);
+	ASSERT(lobbies_len == 1);
+
+	Lobby *result = lobbies[0];
+	free(lobbies);
+	return result;
+}
+
+static void test_journal_recover_moves(void) {
+	T t;
+	test_setup(&t);
+
+	play_e(&t, &t.player1, 1, 3);
+	play_e(&t, &t.player2, 6, 0);
+	play_e(&t, &t.player1, 2, 2);
+	journal_flush(t.j);
+
+	Lobby *recovered = recover_one();
+
+	for (size_t row = 0; row < t.l->board.rows; row++) {
+		for (size_t col = 0; col < t.l->board.cols; col++) {
+			ASSERT(lobby_get(recovered, row, col) == lobby_get(t.l, row, col));
+		}
+	}
+
+	ASSERT(recovered->players_len == 2);
+	ASSERT(strcmp(recovered->players[0].name, "Player1") == 0);
+	ASSERT(recovered->players[0].team == 'O');
+	ASSERT(recovered->players[0].fd < 0);
+	ASSERT(strcmp(recovered->players[1].name, "Player2") == 0);
+	ASSERT(recovered->players[1].team == 'X');
+	ASSERT(recovered->players[1].fd < 0);
+
+	// A seat is only taken back with its key, not with the name alone.
+	const uint8_t wrong[PLAYER_KEY_SIZE] = { 3 };
+	ASSERT(lobby_join(recovered, &(Player){ .fd = 7, .name = "Player2" }) == -1);
+	ASSERT(lobby_reclaim(recovered, wrong, &(Player){ .fd = 7, .name = "Player2" }) == -1);
+	ASSERT(lobby_reclaim(recovered, t.player1.key, &(Player){ .fd = 7, .name = "Player2" }) == -1);
+
+	// The game continues with X to move once both players reclaim their seats.
+	ASSERT(lobby_reclaim(recovered, t.player2.key, &(Player){ .fd = 8, .name = "Player2" }) == 0);
+	ASSERT(lobby_reclaim(recovered, t.player1.key, &(Player){ .fd = 9, .name = "Player1" }) == 0);
+	ASSERT(lobby_reclaim(recovered, t.player1.key, &(Player){ .fd = 7, .name = "Player1" }) == -1);
+	ASSERT(recovered->players_len == 2);
+	ASSERT(lobby_play_move(recovered, &(Player){ .fd = 9 }, "0", "0") == -1);
+	ASSERT(lobby_play_move(recovered, &(Player){ .fd = 8 }, "0", "0") == 0);
+
+	lobby_free(recovered);
+	test_teardown(&t);
+}
+
+static void test_journal_unflushed_records_are_lost(void) {
+	T t;
+	test_setup(&t);
+
+	play_e(&t, &t.player1, 1, 3);
+	journal_flush(t.j);
+	play_e(&t, &t.player2, 6, 0);
+
+	// Simulate a crash by dropping the journal without flushing.
+	Lobby *recovered = recover_one();
+
+	LobbyMove move;
+	ASSERT(lobby_last_move(recovered, &move) == 0);
+	ASSERT(move.team == 'O' && move.row == 1 && move.col == 3);
+
+	lobby_free(recovered);
+	journal_close(t.j);
+	t.j = NULL;
+	test_teardown(&t);
+}
+
+static void test_journal_discards_torn_record(void) {
+	T t;
+	test_setup(&t);
+
+	play_e(&t, &t.player1, 1, 3);
+	journal_flush(t.j);
+
+	// Half of a move record, as if the process died in the middle of a write.
+	FILE *f = fopen(JOURNAL_PATH, "ab");
+	ASSERT(f != NULL);
+	const unsigned char torn[] = { JOURNAL_MOVE, 0, 0, 0 };
+	fwrite(torn, 1, sizeof torn, f);
+	fclose(f);
+
+	Lobby *recovered = recover_one();
+
+	LobbyMove move;
+	ASSERT(lobby_last_move(recovered, &move) == 0);
+	ASSERT(move.team == 'O' && move.row == 1 && move.col == 3);
+
+	lobby_free(recovered);
+
+	// Compaction dropped the torn record so recovering again gives the same lobby.
+	recovered = recover_one();
+	ASSERT(lobby_last_move(recovered, &move) == 0);
+	ASSERT(move.row == 1 && move.col == 3);
+
+	lobby_free(recovered);
+	test_teardown(&t);
+}
+
+static void test_journal_drops_ended_lobbies(void) {
+	T t;
+	test_setup(&t);
+
+	play_e(&t, &t.player1, 0, 1);
+	play_e(&t, &t.player2, 0, 0);
+	play_e(&t, &t.player1, 1, 0);
+	ASSERT(lobby_winner(t.l) == 'O');
+	journal_end(t.j, t.l);
+	journal_flush(t.j);
+
+	Lobby **lobbies;
+	size_t lobbies_len;
+	int actual = journal_recover(JOURNAL_PATH, &lobbies, &lobbies_len);
+	ASSERT(actual == 0);
+	ASSERT(lobbies_len == 0);
+
+	test_teardown(&t);
+}
+
+static void test_journal_recover_leave(void) {
+	T t;
+	test_setup(&t);
+
+	lobby_leave(t.l, &t.player1);
+	journal_leave(t.j, t.l, &t.player1);
+	journal_flush(t.j);
+
+	Lobby *recovered = recover_one();
+
+	ASSERT(recovered->players_len == 1);
+	ASSERT(strcmp(recovered->players[0].name, "Player2") == 0);
+	ASSERT(recovered->players[0].team == 'O');
+
+	lobby_free(recovered);
+	test_teardown(&t);
+}
+
+static void test_journal_recover_leave_by_key(void) {
+	T t;
+	test_setup(&t);
+
+	// Two players under one name. The second one leaves.
+	Lobby *l = lobby_create(7, 5);
+	Player first = { .fd = 1, .name = "Player1", .key = { 1 } };
+	Player second = { .fd = 2, .name = "Player1", .key = { 2 } };
+	ASSERT(lobby_join(l, &first) == 0);
+	ASSERT(lobby_join(l, &second) == 0);
+	l->id = 1;
+	journal_create(t.j, l);
+	journal_join(t.j, l, &first);
+	journal_join(t.j, l, &second);
+	journal_end(t.j, t.l);
+	lobby_leave(l, &second);
+	journal_leave(t.j, l, &second);
+	journal_flush(t.j);
+
+	Lobby *recovered = recover_one();
+
+	ASSERT(recovered->players_len == 1);
+	ASSERT(lobby_reclaim(recovered, second.key, &(Player){ .fd = 3, .name = "Player1" }) < 0);
+	ASSERT(lobby_reclaim(recovered, first.key, &(Player){ .fd = 3, .name = "Player1" }) == 0);
+
+	lobby_free(recovered);
+	lobby_free(l);
+	test_teardown(&t);
+}
+
+static void test_journal_recover_missing_file(void) {
+	remove(JOURNAL_PATH);
+
+	Lobby **lobbies;
+	size_t lobbies_len;
+	int actual = journal_recover(JOURNAL_PATH, &lobbies, &lobbies_len);
+	ASSERT(actual == 0);
+	ASSERT(lobbies_len == 0);
+}
+
+int main(void) {
+	test_journal_recover_moves();
+	test_journal_unflushed_records_are_lost();
+	test_journal_discards_torn_record();
+	test_journal_drops_ended_lobbies();
+	test_journal_recover_leave();
+	test_journal_recover_leave_by_key();
+	test_journal_recover_missing_file();
+}
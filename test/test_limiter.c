@@ -0,0 +1,140 @@
+#include <arpa/inet.h>
+#include <string.h>
+#include <sys/un.h>
+
+#include "limiter.h"
+#include "task.h"
+
+static const LimiterConfig CONFIG = { .rate = 10, .burst = 3, .ip_rate = 100, .ip_burst = 5 };
+
+static struct sockaddr_storage ipv4(const char *ip) {
+	struct sockaddr_storage result;
+	memset(&result, 0, sizeof result);
+	struct sockaddr_in *sin = (struct sockaddr_in*)&result;
+	sin->sin_family = AF_INET;
+	ASSERT(inet_pton(AF_INET, ip, &sin->sin_addr) == 1);
+	return result;
+}
+
+static struct sockaddr_storage ipv6(const char *ip) {
+	struct sockaddr_storage result;
+	memset(&result, 0, sizeof result);
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6*)&result;
+	sin6->sin6_family = AF_INET6;
+	ASSERT(inet_pton(AF_INET6, ip, &sin6->sin6_addr) == 1);
+	return result;
+}
+
+static void test_limiter_connection(void) {
+	ASSERT(limiter_create(&(LimiterConfig){ .rate = 0, .burst = 1, .ip_rate = 1, .ip_burst = 1 }) == NULL);
+
+	Limiter *lim = limiter_create(&(LimiterConfig){ .rate = 10, .burst = 3, .ip_rate = 1000, .ip_burst = 1000 });
+	ASSERT(lim != NULL);
+
+	const struct sockaddr_storage addr = ipv4("10.0.0.1");
+	ASSERT(limiter_connect(lim, 5, (const struct sockaddr*)&addr, 1000) == 0);
+
+	// A burst, then one command every 100 ms.
+	ASSERT(limiter_allow(lim, 5, 1000));
+	ASSERT(limiter_allow(lim, 5, 1000));
+	ASSERT(limiter_allow(lim, 5, 1000));
+	ASSERT(!limiter_allow(lim, 5, 1000));
+	ASSERT(!limiter_allow(lim, 5, 1099));
+	ASSERT(limiter_allow(lim, 5, 1100));
+	ASSERT(!limiter_allow(lim, 5, 1100));
+
+	// Waiting never earns more than the burst.
+	for (int i = 0; i < 3; i++) {
+		ASSERT(limiter_allow(lim, 5, UINT64_MAX / 2));
+	}
+	ASSERT(!limiter_allow(lim, 5, UINT64_MAX / 2));
+
+	// Other connections have their own bucket, and a new connection under an
+	// old number starts out full.
+	ASSERT(limiter_connect(lim, 300, (const struct sockaddr*)&addr, UINT64_MAX / 2) == 0);
+	ASSERT(limiter_allow(lim, 300, UINT64_MAX / 2));
+	ASSERT(limiter_connect(lim, 5, (const struct sockaddr*)&addr, UINT64_MAX / 2) == 0);
+	ASSERT(limiter_allow(lim, 5, UINT64_MAX / 2));
+
+	// Connections that were never let in, like ones handed over.
+	for (int i = 0; i < 3; i++) {
+		ASSERT(limiter_allow(lim, 7, 0));
+	}
+	ASSERT(!limiter_allow(lim, 7, 0));
+
+	limiter_free(lim);
+}
+
+static void test_limiter_address(void) {
+	Limiter *lim = limiter_create(&CONFIG);
+
+	const struct sockaddr_storage v4 = ipv4("192.168.1.2");
+	const struct sockaddr_storage mapped = ipv6("::ffff:192.168.1.2");
+	const struct sockaddr_storage other = ipv6("2001:db8::1");
+
+	// Connections share their address's bucket, however it is written.
+	ASSERT(limiter_connect(lim, 3, (const struct sockaddr*)&v4, 0) == 0);
+	ASSERT(limiter_connect(lim, 4, (const struct sockaddr*)&mapped, 0) == 0);
+	ASSERT(limiter_allow(lim, 3, 0));
+	ASSERT(limiter_allow(lim, 4, 0));
+	ASSERT(limiter_allow(lim, 4, 0));
+	ASSERT(!limiter_allow(lim, 3, 0));
+	ASSERT(limiter_connect(lim, 5, (const struct sockaddr*)&v4, 0) < 0);
+
+	// Other addresses are not affected.
+	ASSERT(limiter_connect(lim, 6, (const struct sockaddr*)&other, 0) == 0);
+	ASSERT(limiter_allow(lim, 6, 0));
+	ASSERT(limiter_addresses(lim) == 2);
+
+	// The address earns a token every 10 ms.
+	ASSERT(limiter_connect(lim, 5, (const struct sockaddr*)&v4, 10) == 0);
+	ASSERT(!limiter_allow(lim, 5, 10));
+	ASSERT(limiter_allow(lim, 5, 20));
+
+	// Addresses of other families are only limited per connection.
+	struct sockaddr_un sun = { .sun_family = AF_UNIX };
+	ASSERT(limiter_connect(lim, 8, (const struct sockaddr*)&sun, 20) == 0);
+	for (int i = 0; i < 3; i++) {
+		ASSERT(limiter_allow(lim, 8, 20));
+	}
+	ASSERT(limiter_addresses(lim) == 2);
+
+	limiter_free(lim);
+}
+
+static void test_limiter_forgets(void) {
+	Limiter *lim = limiter_create(&CONFIG);
+
+	// Far more addresses than the table starts with.
+	const size_t addresses = 10000;
+	for (size_t i = 0; i < addresses; i++) {
+		struct sockaddr_storage addr = ipv4("10.0.0.0");
+		((struct sockaddr_in*)&addr)->sin_addr.s_addr = htonl(0x0a000000u + (uint32_t)i);
+		ASSERT(limiter_connect(lim, (int)(i % 100), (const struct sockaddr*)&addr, 0) == 0);
+	}
+	ASSERT(limiter_addresses(lim) == addresses);
+
+	// Once their buckets fill up the addresses are dropped when the table
+	// would otherwise grow.
+	for (size_t i = 0; i < addresses * 4; i++) {
+		struct sockaddr_storage addr = ipv4("10.0.0.0");
+		((struct sockaddr_in*)&addr)->sin_addr.s_addr = htonl(0x0b000000u + (uint32_t)i);
+		ASSERT(limiter_connect(lim, (int)(i % 100), (const struct sockaddr*)&addr, 1000) == 0);
+	}
+	ASSERT(limiter_addresses(lim) < addresses * 5);
+
+	// An address that was dropped starts over with a full bucket.
+	const struct sockaddr_storage first = ipv4("10.0.0.0");
+	for (int i = 0; i < 5; i++) {
+		ASSERT(limiter_connect(lim, 1, (const struct sockaddr*)&first, 1000) == 0);
+	}
+	ASSERT(limiter_connect(lim, 1, (const struct sockaddr*)&first, 1000) < 0);
+
+	limiter_free(lim);
+}
+
+int main(void) {
+	test_limiter_connection();
+	test_limiter_address();
+	test_limiter_forgets();
+}
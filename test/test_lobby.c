@@ -1,8 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "libnogo/nogo.h"
-
 #include "lobby.h"
 #include "task.h"
 
@@ -10,6 +8,24 @@ typedef struct T {
 	Lobby *l;
 } T;
 
+/**
+ * @brief Draws the board a row a line with the cells apart.
+ *
+ */
+static char *board_str(const Lobby *l) {
+	char *result = malloc(l->board.rows * l->board.cols * 2);
+	size_t len = 0;
+	for (size_t row = 0; row < l->board.rows; row++) {
+		for (size_t col = 0; col < l->board.cols; col++) {
+			result[len++] = lobby_get(l, row, col);
+			result[len++] = col + 1 < l->board.cols ? ' ' : '\n';
+		}
+	}
+	result[len - 1] = '\0';
+
+	return result;
+}
+
 static void test_setup(T *t) {
 	t->l = lobby_create(7, 5);
 }
@@ -130,7 +146,7 @@ static void test_lobby_play_move(void) {
 		". . . . .\n"
 		"X . . . ."
 	);
-	char *actual = nogo_board_str(t.l->board);
+	char *actual = board_str(t.l);
 
 	ASSERT(strcmp(expect, actual) == 0);
 
@@ -377,11 +393,275 @@ static void test_lobby_declares_winner_o_big_group(void) {
 	test_teardown(&t);
 }
 
+static void test_lobby_standard_sizes(void) {
+	// Every size with a kernel of its own, and one without.
+	const size_t sizes[] = { 9, 13, 19, 10 };
+
+	for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+		const size_t n = sizes[i];
+		Lobby *l = lobby_create(n, n);
+
+		ASSERT(lobby_place(l, 'O', n, 0) < 0);
+		ASSERT(lobby_place(l, 'O', 0, n) < 0);
+
+		// Surrounded in the corner whose right neighbour would wrap to the
+		// next row.
+		ASSERT(lobby_place(l, 'O', 0, n - 1) == 0);
+		ASSERT(lobby_place(l, 'X', 1, n - 1) == 0);
+		ASSERT(lobby_place(l, 'O', n / 2, n / 2) == 0);
+		ASSERT(lobby_winner(l) == -1);
+		ASSERT(lobby_place(l, 'X', 0, n - 2) == 0);
+		ASSERT(lobby_winner(l) == 'X');
+
+		// And in the one whose left neighbour would wrap to the row before.
+		for (size_t j = 0; j < 4; j++) {
+			ASSERT(lobby_undo(l) == 0);
+		}
+		ASSERT(lobby_place(l, 'O', n - 1, 0) == 0);
+		ASSERT(lobby_place(l, 'X', n - 2, 0) == 0);
+		ASSERT(lobby_place(l, 'O', n / 2, n / 2) == 0);
+		ASSERT(lobby_winner(l) == -1);
+		ASSERT(lobby_place(l, 'X', n - 1, 1) == 0);
+		ASSERT(lobby_winner(l) == 'X');
+
+		lobby_free(l);
+	}
+}
+
+static void test_lobby_reconnect(void) {
+	T t;
+	test_setup(&t);
+
+	const Player player1 = (Player){ .fd = 1 };
+	const Player player2 = (Player){ .fd = 2 };
+	const Player player2_again = (Player){ .fd = 7 };
+
+	lobby_join(t.l, &player1);
+	lobby_join(t.l, &player2);
+	lobby_play_move_e(t.l, &player1, "0", "0");
+
+	ASSERT(lobby_reconnect(t.l, 3, &player2_again) == -1);
+	ASSERT(lobby_reconnect(t.l, 2, &player2_again) == 0);
+	ASSERT(t.l->players_len == 2);
+	ASSERT(t.l->players[1].fd == 7);
+	ASSERT(t.l->players[1].team == 'X');
+
+	// The new connection plays the seat's moves.
+	ASSERT(lobby_play_move(t.l, &player2, "1", "1") == -1);
+	lobby_play_move_e(t.l, &player2_again, "1", "1");
+
+	test_teardown(&t);
+}
+
+static void test_lobby_undo(void) {
+	T t;
+	test_setup(&t);
+
+	const Player player1 = (Player){ .fd = 1 };
+	const Player player2 = (Player){ .fd = 2 };
+
+	lobby_join(t.l, &player1);
+	lobby_join(t.l, &player2);
+
+	ASSERT(lobby_undo(t.l) == -1);
+
+	lobby_play_move_e(t.l, &player1, "1", "3");
+	lobby_play_move_e(t.l, &player2, "6", "0");
+
+	ASSERT(lobby_undo(t.l) == 0);
+	ASSERT(lobby_moves_len(t.l) == 1);
+
+	// It is X's turn again and the undone space is free.
+	ASSERT(lobby_play_move(t.l, &player1, "2", "2") == -1);
+	lobby_play_move_e(t.l, &player2, "6", "0");
+
+	ASSERT(lobby_undo(t.l) == 0);
+	ASSERT(lobby_undo(t.l) == 0);
+	ASSERT(lobby_undo(t.l) == -1);
+
+	const char *expect = (
+		". . . . .\n"
+		". . . . .\n"
+		". . . . .\n"
+		". . . . .\n"
+		". . . . .\n"
+		". . . . .\n"
+		". . . . ."
+	);
+	char *actual = board_str(t.l);
+
+	ASSERT(strcmp(expect, actual) == 0);
+
+	free(actual);
+	test_teardown(&t);
+}
+
+static void test_lobby_undo_winning_move(void) {
+	T t;
+	test_setup(&t);
+
+	const Player player1 = (Player){ .fd = 1 };
+	const Player player2 = (Player){ .fd = 2 };
+
+	lobby_join(t.l, &player1);
+	lobby_join(t.l, &player2);
+
+	lobby_play_move_e(t.l, &player1, "0", "1");
+	lobby_play_move_e(t.l, &player2, "0", "0");
+	lobby_play_move_e(t.l, &player1, "1", "0");
+	ASSERT(lobby_winner(t.l) == 'O');
+
+	ASSERT(lobby_undo(t.l) == 0);
+	ASSERT(lobby_winner(t.l) == -1);
+
+	lobby_play_move_e(t.l, &player1, "1", "1");
+	ASSERT(lobby_winner(t.l) == -1);
+
+	LobbyMove move;
+	ASSERT(lobby_last_move(t.l, &move) == 0);
+	ASSERT(move.team == 'O' && move.row == 1 && move.col == 1);
+
+	test_teardown(&t);
+}
+
+static void test_lobby_hash(void) {
+	T t;
+	test_setup(&t);
+
+	const uint64_t empty = lobby_hash(t.l);
+
+	// The same position reached in a different order has the same hash.
+	Lobby *other = lobby_create(7, 5);
+	ASSERT(lobby_hash(other) == empty);
+
+	lobby_place(t.l, 'O', 3, 3);
+	lobby_place(t.l, 'X', 4, 4);
+	lobby_place(t.l, 'O', 2, 2);
+	ASSERT(lobby_hash(t.l) != empty);
+
+	lobby_place(other, 'O', 2, 2);
+	lobby_place(other, 'X', 4, 4);
+	lobby_place(other, 'O', 3, 3);
+	ASSERT(lobby_hash(other) == lobby_hash(t.l));
+
+	// The team of a piece is part of the hash.
+	lobby_undo(other);
+	lobby_undo(other);
+	lobby_place(other, 'X', 3, 3);
+	lobby_place(other, 'O', 4, 4);
+	ASSERT(lobby_hash(other) != lobby_hash(t.l));
+
+	Lobby *clone = lobby_clone(t.l);
+	ASSERT(lobby_hash(clone) == lobby_hash(t.l));
+	lobby_free(clone);
+
+	// Undoing every move gets back to the empty board.
+	while (lobby_undo(t.l) == 0) {
+	}
+	ASSERT(lobby_hash(t.l) == empty);
+
+	// Empty boards of different sizes differ.
+	Lobby *small = lobby_create(5, 7);
+	ASSERT(lobby_hash(small) != empty);
+	lobby_free(small);
+
+	lobby_free(other);
+	test_teardown(&t);
+}
+
+static void test_lobby_snapshot(void) {
+	T t;
+	test_setup(&t);
+
+	// 35 empty cells pack in to 9 zero bytes, which run-length encode to one run.
+	size_t len;
+	const char *snapshot = lobby_snapshot(t.l, &len);
+	const char empty[] = "GOTBOARD 7 5 O - 0 AQAJ\r\n";
+	ASSERT(len == strlen(empty) && memcmp(snapshot, empty, len) == 0);
+
+	// Cached until the next move.
+	size_t again_len;
+	ASSERT(lobby_snapshot(t.l, &again_len) == snapshot && again_len == len);
+
+	lobby_place(t.l, 'O', 0, 0);
+	snapshot = lobby_snapshot(t.l, &len);
+	const char one[] = "GOTBOARD 7 5 X - 1 AQEACA==\r\n";
+	ASSERT(len == strlen(one) && memcmp(snapshot, one, len) == 0);
+
+	Lobby *clone = lobby_clone(t.l);
+	snapshot = lobby_snapshot(clone, &len);
+	ASSERT(len == strlen(one) && memcmp(snapshot, one, len) == 0);
+	lobby_free(clone);
+
+	lobby_undo(t.l);
+	snapshot = lobby_snapshot(t.l, &len);
+	ASSERT(len == strlen(empty) && memcmp(snapshot, empty, len) == 0);
+
+	// A full byte does not run-length encode any shorter.
+	Lobby *small = lobby_create(2, 2);
+	lobby_place(small, 'O', 0, 0);
+	lobby_place(small, 'X', 0, 1);
+	snapshot = lobby_snapshot(small, &len);
+	const char packed[] = "GOTBOARD 2 2 O - 2 AAk=\r\n";
+	ASSERT(len == strlen(packed) && memcmp(snapshot, packed, len) == 0);
+	lobby_free(small);
+
+	// The winner is part of the snapshot.
+	lobby_place(t.l, 'O', 0, 1);
+	lobby_place(t.l, 'X', 0, 0);
+	lobby_place(t.l, 'O', 1, 0);
+	snapshot = lobby_snapshot(t.l, &len);
+	ASSERT(memcmp(snapshot, "GOTBOARD 7 5 X O 3 ", 19) == 0);
+
+	test_teardown(&t);
+}
+
+static void test_lobby_sleep(void) {
+	T t;
+	test_setup(&t);
+
+	lobby_join(t.l, &(Player){ .fd = 1 });
+	lobby_join(t.l, &(Player){ .fd = 2 });
+	lobby_place(t.l, 'O', 0, 1);
+	lobby_place(t.l, 'X', 0, 0);
+	const uint64_t hash = lobby_hash(t.l);
+
+	// Seats can change while the board is gone.
+	lobby_sleep(t.l);
+	ASSERT(lobby_is_asleep(t.l));
+	ASSERT(lobby_leave(t.l, &(Player){ .fd = 2 }) == 0);
+	ASSERT(lobby_join(t.l, &(Player){ .fd = 3 }) == 0);
+
+	// Moves that can't have been played leave it asleep.
+	ASSERT(lobby_wake(t.l, (const uint16_t[]){ 1, 1 }, 2) == -1);
+	ASSERT(lobby_wake(t.l, (const uint16_t[]){ 35 }, 1) == -1);
+	ASSERT(lobby_is_asleep(t.l));
+
+	ASSERT(lobby_wake(t.l, (const uint16_t[]){ 1, 0 }, 2) == 0);
+	ASSERT(!lobby_is_asleep(t.l));
+	ASSERT(lobby_hash(t.l) == hash);
+	ASSERT(lobby_turn(t.l) == 'O');
+	ASSERT(lobby_get(t.l, 0, 0) == 'X' && lobby_get(t.l, 0, 1) == 'O');
+
+	// A game that was over when it went to sleep is still over.
+	lobby_place(t.l, 'O', 1, 0);
+	ASSERT(lobby_winner(t.l) == 'O');
+	lobby_sleep(t.l);
+	ASSERT(lobby_wake(t.l, (const uint16_t[]){ 1, 0, 5 }, 3) == 0);
+	ASSERT(lobby_winner(t.l) == 'O');
+	ASSERT(lobby_place(t.l, 'X', 3, 3) == -1);
+
+	// Asleep lobbies can be freed.
+	lobby_sleep(t.l);
+	test_teardown(&t);
+}
+
 int main(void) {
 	test_lobby_join();
 	test_lobby_join_full();
 	test_lobby_join_same_player();
 	test_lobby_leave();
+	test_lobby_reconnect();
 	test_lobby_play_move();
 	test_lobby_play_move_overflow();
 	test_lobby_play_move_player_not_in_lobby();
@@ -392,4 +672,10 @@ int main(void) {
 	test_lobby_declares_winner_x();
 	test_lobby_declares_winner_o();
 	test_lobby_declares_winner_o_big_group();
+	test_lobby_standard_sizes();
+	test_lobby_undo();
+	test_lobby_undo_winning_move();
+	test_lobby_hash();
+	test_lobby_snapshot();
+	test_lobby_sleep();
 }
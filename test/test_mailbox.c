@@ -0,0 +1,82 @@
+#include <poll.h>
+#include <pthread.h>
+
+#include "mailbox.h"
+#include "task.h"
+
+#define PUTS 10000
+
+static bool is_readable(const Mailbox *mb) {
+	struct pollfd pfd = { .fd = mailbox_fd(mb), .events = POLLIN };
+	return poll(&pfd, 1, 0) == 1;
+}
+
+static void *put_all(void *arg) {
+	Mailbox *mb = arg;
+	for (int i = 0; i < PUTS; i++) {
+		mailbox_put(mb, &i);
+	}
+	return NULL;
+}
+
+static void test_mailbox_put_get(void) {
+	Mailbox *mb = mailbox_create(sizeof(int));
+	ASSERT(mb != NULL);
+
+	int elem;
+	ASSERT(!mailbox_get(mb, &elem));
+	ASSERT(!is_readable(mb));
+
+	for (int i = 0; i < 3; i++) {
+		ASSERT(mailbox_put(mb, &i) == 0);
+	}
+	ASSERT(is_readable(mb));
+
+	for (int i = 0; i < 3; i++) {
+		ASSERT(mailbox_get(mb, &elem));
+		ASSERT(elem == i);
+	}
+
+	// The descriptor stops polling readable once the mailbox is empty.
+	ASSERT(!mailbox_get(mb, &elem));
+	ASSERT(!is_readable(mb));
+
+	mailbox_free(mb);
+}
+
+static void test_mailbox_threads(void) {
+	Mailbox *mb = mailbox_create(sizeof(int));
+
+	pthread_t threads[2];
+	for (int i = 0; i < 2; i++) {
+		pthread_create(&threads[i], NULL, put_all, mb);
+	}
+
+	// Every element put by either thread comes out exactly once.
+	static int seen[PUTS];
+	int got = 0;
+	while (got < PUTS * 2) {
+		int elem;
+		if (mailbox_get(mb, &elem)) {
+			ASSERT(elem >= 0 && elem < PUTS);
+			seen[elem]++;
+			got++;
+		}
+	}
+
+	for (int i = 0; i < PUTS; i++) {
+		ASSERT(seen[i] == 2);
+	}
+
+	for (int i = 0; i < 2; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	ASSERT(!is_readable(mb));
+
+	mailbox_free(mb);
+}
+
+int main(void) {
+	test_mailbox_put_get();
+	test_mailbox_threads();
+}
@@ -0,0 +1,110 @@
+#include <stdint.h>
+
+#include "matchmaker.h"
+#include "task.h"
+
+static const MatchmakerConfig config = { .window_base = 50, .window_per_sec = 100, .window_max = 300 };
+
+static void test_matchmaker_pairs_same_bucket_oldest_first(void) {
+	Matchmaker *mm = matchmaker_create(&config);
+	ASSERT(mm != NULL);
+
+	ASSERT(matchmaker_enqueue(mm, 5, 1510, 0) == 0);
+	ASSERT(matchmaker_enqueue(mm, 6, 1520, 1) == 0);
+	ASSERT(matchmaker_enqueue(mm, 7, 1530, 2) == 0);
+	ASSERT(matchmaker_enqueue(mm, 5, 1510, 3) < 0); // Already queued.
+	ASSERT(matchmaker_queued(mm) == 3);
+
+	MatchmakerPair pairs[4];
+	ASSERT(matchmaker_tick(mm, 10, pairs, 4) == 1);
+	ASSERT(pairs[0].fds[0] == 5);
+	ASSERT(pairs[0].fds[1] == 6);
+	ASSERT(matchmaker_queued(mm) == 1);
+
+	matchmaker_free(mm);
+}
+
+static void test_matchmaker_widens_window(void) {
+	Matchmaker *mm = matchmaker_create(&config);
+
+	ASSERT(matchmaker_enqueue(mm, 1, 1000, 0) == 0);
+	ASSERT(matchmaker_enqueue(mm, 2, 1200, 0) == 0);
+
+	// 200 points apart needs both windows at 200, which takes a second and a half.
+	MatchmakerPair pairs[1];
+	ASSERT(matchmaker_tick(mm, 0, pairs, 1) == 0);
+	ASSERT(matchmaker_tick(mm, 1000, pairs, 1) == 0);
+	ASSERT(matchmaker_tick(mm, 1500, pairs, 1) == 1);
+	ASSERT(matchmaker_queued(mm) == 0);
+	ASSERT(pairs[0].fds[0] == 1);
+
+	// Nobody is ever matched beyond window_max.
+	ASSERT(matchmaker_enqueue(mm, 3, 100, 0) == 0);
+	ASSERT(matchmaker_enqueue(mm, 4, 900, 0) == 0);
+	ASSERT(matchmaker_tick(mm, 1000000, pairs, 1) == 0);
+	ASSERT(matchmaker_queued(mm) == 2);
+
+	matchmaker_free(mm);
+}
+
+static void test_matchmaker_cancel(void) {
+	Matchmaker *mm = matchmaker_create(&config);
+
+	ASSERT(matchmaker_enqueue(mm, 1, 1500, 0) == 0);
+	ASSERT(matchmaker_enqueue(mm, 2, 1500, 0) == 0);
+	ASSERT(matchmaker_enqueue(mm, 3, 1500, 0) == 0);
+	ASSERT(matchmaker_cancel(mm, 2) == 0);
+	ASSERT(matchmaker_cancel(mm, 2) < 0);
+	ASSERT(matchmaker_cancel(mm, 1000) < 0);
+
+	MatchmakerPair pairs[2];
+	ASSERT(matchmaker_tick(mm, 0, pairs, 2) == 1);
+	ASSERT(pairs[0].fds[0] == 1);
+	ASSERT(pairs[0].fds[1] == 3);
+
+	// Freed entries and large fds are reused and grown in to.
+	ASSERT(matchmaker_enqueue(mm, 1000, 1500, 0) == 0);
+	ASSERT(matchmaker_enqueue(mm, 2, 1500, 0) == 0);
+	ASSERT(matchmaker_tick(mm, 0, pairs, 2) == 1);
+	ASSERT(pairs[0].fds[0] == 1000);
+
+	matchmaker_free(mm);
+}
+
+static void test_matchmaker_batches_and_stats(void) {
+	Matchmaker *mm = matchmaker_create(&config);
+
+	for (int fd = 0; fd < 1000; fd++) {
+		ASSERT(matchmaker_enqueue(mm, fd, (fd * 37) % MATCHMAKER_RATING_MAX, (uint64_t)fd) == 0);
+	}
+
+	// Batches smaller than the number of possible pairs pick up where the
+	// last one stopped.
+	MatchmakerPair pairs[64];
+	size_t total = 0;
+	size_t made;
+	while ((made = matchmaker_tick(mm, 2000, pairs, 64)) == 64) {
+		total += made;
+	}
+	total += made;
+	ASSERT(total > 450);
+	ASSERT(matchmaker_tick(mm, 2000, pairs, 64) == 0);
+
+	MatchmakerStats stats;
+	matchmaker_stats(mm, &stats);
+	ASSERT(stats.queued == 1000 - total * 2);
+	ASSERT(stats.matched == total * 2);
+	ASSERT(stats.wait_max_ms <= 2000);
+	ASSERT(stats.wait_avg_ms > 1000 && stats.wait_avg_ms < 2000);
+	ASSERT(stats.wait_p50_ms <= stats.wait_p99_ms);
+	ASSERT(stats.wait_p99_ms <= 2000);
+
+	matchmaker_free(mm);
+}
+
+int main(void) {
+	test_matchmaker_pairs_same_bucket_oldest_first();
+	test_matchmaker_widens_window();
+	test_matchmaker_cancel();
+	test_matchmaker_batches_and_stats();
+}
@@ -0,0 +1,102 @@
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "pool.h"
+#include "task.h"
+
+typedef struct Counter {
+	pthread_mutex_t lock;
+	int count;
+} Counter;
+
+static void increment(void *arg) {
+	Counter *c = arg;
+
+	pthread_mutex_lock(&c->lock);
+	c->count++;
+	pthread_mutex_unlock(&c->lock);
+}
+
+static void test_pool_runs_all_tasks(void) {
+	Pool *pool = pool_create(4);
+	ASSERT(pool != NULL);
+	ASSERT(pool_threads(pool) == 4);
+
+	Counter c = { .lock = PTHREAD_MUTEX_INITIALIZER, .count = 0 };
+	for (int i = 0; i < 1000; i++) {
+		ASSERT(pool_submit(pool, increment, &c) == 0);
+	}
+
+	pool_wait(pool);
+	ASSERT(c.count == 1000);
+
+	// The pool can be reused after waiting.
+	for (int i = 0; i < 10; i++) {
+		ASSERT(pool_submit(pool, increment, &c) == 0);
+	}
+
+	pool_wait(pool);
+	ASSERT(c.count == 1010);
+
+	pool_free(pool);
+}
+
+static void test_pool_free_finishes_tasks(void) {
+	Pool *pool = pool_create(2);
+
+	Counter c = { .lock = PTHREAD_MUTEX_INITIALIZER, .count = 0 };
+	for (int i = 0; i < 100; i++) {
+		pool_submit(pool, increment, &c);
+	}
+
+	pool_free(pool);
+	ASSERT(c.count == 100);
+}
+
+typedef struct Gate {
+	pthread_mutex_t lock;
+	pthread_cond_t opened;
+	bool is_open;
+} Gate;
+
+static void wait_for_gate(void *arg) {
+	Gate *g = arg;
+
+	pthread_mutex_lock(&g->lock);
+	while (!g->is_open) {
+		pthread_cond_wait(&g->opened, &g->lock);
+	}
+	pthread_mutex_unlock(&g->lock);
+}
+
+static void test_pool_waits_for_group(void) {
+	Pool *pool = pool_create(2);
+
+	// Someone else's task keeps a thread busy until the group is done.
+	Gate gate = { .lock = PTHREAD_MUTEX_INITIALIZER, .opened = PTHREAD_COND_INITIALIZER, .is_open = false };
+	ASSERT(pool_submit(pool, wait_for_gate, &gate) == 0);
+
+	Counter c = { .lock = PTHREAD_MUTEX_INITIALIZER, .count = 0 };
+	PoolGroup group = { 0 };
+	for (int i = 0; i < 100; i++) {
+		ASSERT(pool_submit_group(pool, &group, increment, &c) == 0);
+	}
+
+	pool_wait_group(pool, &group);
+	ASSERT(c.count == 100);
+	ASSERT(group.pending == 0);
+
+	pthread_mutex_lock(&gate.lock);
+	gate.is_open = true;
+	pthread_cond_signal(&gate.opened);
+	pthread_mutex_unlock(&gate.lock);
+
+	pool_wait(pool);
+	pool_free(pool);
+}
+
+int main(void) {
+	test_pool_runs_all_tasks();
+	test_pool_free_finishes_tasks();
+	test_pool_waits_for_group();
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lobby.h"
+#include "selfplay.h"
+#include "task.h"
+
+#define SELFPLAY_PATH "test_selfplay.bin"
+
+static void run_games(const SelfplayConfig *config, SelfplayStats *stats) {
+	FILE *out = fopen(SELFPLAY_PATH, "wb");
+	ASSERT(out != NULL);
+	ASSERT(selfplay_run(config, out, stats) == 0);
+	const int closed = fclose(out);
+	ASSERT(closed == 0);
+}
+
+static void test_selfplay_games_replay(void) {
+	remove(SELFPLAY_PATH);
+
+	const SelfplayConfig config = { .rows = 5, .cols = 4, .games = 500, .threads = 4, .seed = 42 };
+	SelfplayStats stats;
+	run_games(&config, &stats);
+
+	ASSERT(stats.games == 500);
+	ASSERT(stats.o_wins + stats.x_wins == 500);
+
+	FILE *in = fopen(SELFPLAY_PATH, "rb");
+	ASSERT(in != NULL);
+	ASSERT(selfplay_read_header(in) == 0);
+
+	// Every game in the file replays to the recorded winner.
+	SelfplayGame game;
+	memset(&game, 0, sizeof game);
+	unsigned long games = 0;
+	unsigned long moves = 0;
+	int status;
+	while ((status = selfplay_read(in, &game)) == 1) {
+		ASSERT(game.rows == 5 && game.cols == 4);
+
+		Lobby *l = lobby_create(game.rows, game.cols);
+		for (size_t i = 0; i < game.moves_len; i++) {
+			ASSERT(lobby_place(l, lobby_turn(l), game.moves[i] / game.cols, game.moves[i] % game.cols) == 0);
+		}
+		ASSERT(lobby_winner(l) == game.winner);
+		lobby_free(l);
+
+		games++;
+		moves += game.moves_len;
+	}
+	ASSERT(status == 0);
+	ASSERT(games == stats.games);
+	ASSERT(moves == stats.moves);
+
+	free(game.moves);
+	fclose(in);
+	remove(SELFPLAY_PATH);
+}
+
+static void test_selfplay_more_threads_than_games(void) {
+	remove(SELFPLAY_PATH);
+
+	const SelfplayConfig config = { .rows = 3, .cols = 3, .games = 2, .threads = 8, .seed = 1 };
+	SelfplayStats stats;
+	run_games(&config, &stats);
+	ASSERT(stats.games == 2);
+
+	remove(SELFPLAY_PATH);
+}
+
+static void test_selfplay_bad_file(void) {
+	FILE *f = fopen(SELFPLAY_PATH, "wb");
+	ASSERT(f != NULL);
+	fputs("not a self-play file", f);
+	fclose(f);
+
+	f = fopen(SELFPLAY_PATH, "rb");
+	ASSERT(selfplay_read_header(f) == -1);
+	fclose(f);
+
+	remove(SELFPLAY_PATH);
+}
+
+int main(void) {
+	test_selfplay_games_replay();
+	test_selfplay_more_threads_than_games();
+	test_selfplay_bad_file();
+}
@@ -0,0 +1,191 @@
+#include <string.h>
+
+#include "session.h"
+#include "task.h"
+
+#define GRACE_MS 1000
+
+static void test_session_resume(void) {
+	Sessions *s = sessions_create(GRACE_MS);
+	ASSERT(s != NULL);
+
+	char token[SESSION_TOKEN_SIZE];
+	ASSERT(sessions_open(s, 5, token) == 0);
+	ASSERT(strlen(token) == SESSION_TOKEN_LEN);
+	ASSERT(sessions_open(s, 5, token) < 0);
+
+	// Live connections are sent to.
+	ASSERT(sessions_deliver(s, 5, "A", 1) == 5);
+	char new_token[SESSION_TOKEN_SIZE];
+	int old_fd;
+	const char *pending;
+	size_t pending_len;
+
+	// Output for a detached connection is held.
+	ASSERT(sessions_detach(s, 5, 100) == 0);
+	ASSERT(sessions_detach(s, 5, 100) < 0);
+	ASSERT(sessions_detached(s) == 1);
+	ASSERT(sessions_deliver(s, 5, "GOTMOVE 0 0\r\n", 13) == -1);
+	ASSERT(sessions_deliver(s, 5, "GOTMOVE 0 1\r\n", 13) == -1);
+
+	// Only the right secret takes it over.
+	char wrong[SESSION_TOKEN_SIZE];
+	memcpy(wrong, token, sizeof wrong);
+	wrong[SESSION_TOKEN_LEN - 1] = wrong[SESSION_TOKEN_LEN - 1] == '0' ? '1' : '0';
+	ASSERT(sessions_resume(s, wrong, 9, new_token, &old_fd, &pending, &pending_len) < 0);
+	ASSERT(sessions_resume(s, "short", 9, new_token, &old_fd, &pending, &pending_len) < 0);
+
+	// A connection far past the first slots takes over.
+	ASSERT(sessions_resume(s, token, 200, new_token, &old_fd, &pending, &pending_len) == 0);
+	ASSERT(old_fd == 5);
+	ASSERT(pending_len == 26 && memcmp(pending, "GOTMOVE 0 0\r\nGOTMOVE 0 1\r\n", 26) == 0);
+	ASSERT(strcmp(new_token, token) != 0);
+	ASSERT(sessions_detached(s) == 0);
+
+	// Output still sent to the old connection is forwarded, and the old token is spent.
+	ASSERT(sessions_deliver(s, 5, "GOTLEAVE\r\n", 10) == 200);
+	ASSERT(sessions_resume(s, token, 9, new_token, &old_fd, &pending, &pending_len) < 0);
+
+	// Also when the new connection is lost before the old one is released.
+	ASSERT(sessions_detach(s, 200, 200) == 0);
+	ASSERT(sessions_deliver(s, 5, "GOTWINNER O\r\n", 13) == -1);
+	char last_token[SESSION_TOKEN_SIZE];
+	ASSERT(sessions_resume(s, new_token, 7, last_token, &old_fd, &pending, &pending_len) == 0);
+	ASSERT(old_fd == 200);
+	ASSERT(pending_len == 13 && memcmp(pending, "GOTWINNER O\r\n", 13) == 0);
+	ASSERT(sessions_deliver(s, 5, "GOTLEAVE\r\n", 10) == 7);
+
+	sessions_release(s, 5);
+	sessions_release(s, 200);
+	ASSERT(sessions_deliver(s, 5, "GOTLEAVE\r\n", 10) == 5);
+	ASSERT(sessions_open(s, 5, token) == 0);
+
+	sessions_free(s);
+}
+
+static void test_session_take_over_live(void) {
+	Sessions *s = sessions_create(GRACE_MS);
+
+	// A loss that was not noticed yet.
+	char token[SESSION_TOKEN_SIZE];
+	char new_token[SESSION_TOKEN_SIZE];
+	int old_fd;
+	const char *pending;
+	size_t pending_len;
+	ASSERT(sessions_open(s, 3, token) == 0);
+	ASSERT(sessions_resume(s, token, 4, new_token, &old_fd, &pending, &pending_len) == 0);
+	ASSERT(old_fd == 3 && pending_len == 0);
+	ASSERT(sessions_detached(s) == 0);
+	ASSERT(sessions_deliver(s, 3, "OK\r\n", 4) == 4);
+	ASSERT(sessions_detach(s, 3, 0) < 0);
+
+	sessions_free(s);
+}
+
+static void test_session_expire(void) {
+	Sessions *s = sessions_create(GRACE_MS);
+
+	char token[SESSION_TOKEN_SIZE];
+	int expired[4];
+	ASSERT(sessions_open(s, 3, token) == 0);
+	ASSERT(sessions_open(s, 4, token) == 0);
+	ASSERT(sessions_detach(s, 3, 0) == 0);
+	ASSERT(sessions_detach(s, 4, 500) == 0);
+
+	ASSERT(sessions_expire(s, GRACE_MS - 1, expired, 4) == 0);
+	ASSERT(sessions_expire(s, GRACE_MS, expired, 4) == 1);
+	ASSERT(expired[0] == 3);
+	ASSERT(sessions_detached(s) == 1);
+
+	// Expired connections are sent nothing until released.
+	ASSERT(sessions_deliver(s, 3, "OK\r\n", 4) == -1);
+	sessions_release(s, 3);
+
+	// Holding too much gives up on the session right away.
+	ASSERT(sessions_open(s, 6, token) == 0);
+	ASSERT(sessions_detach(s, 6, 2000) == 0);
+	static char big[SESSION_PENDING_MAX];
+	int old_fd;
+	const char *pending;
+	size_t pending_len;
+	char new_token[SESSION_TOKEN_SIZE];
+	ASSERT(sessions_deliver(s, 6, big, sizeof big) == -1);
+	ASSERT(sessions_deliver(s, 6, "OK\r\n", 4) == -1);
+	ASSERT(sessions_resume(s, token, 10, new_token, &old_fd, &pending, &pending_len) < 0);
+	ASSERT(sessions_expire(s, 2000, expired, 4) == 2);
+	ASSERT(expired[0] == 4 && expired[1] == 6);
+	ASSERT(sessions_detached(s) == 0);
+
+	sessions_free(s);
+}
+
+static void test_session_restore(void) {
+	Sessions *s = sessions_create(GRACE_MS);
+	Sessions *next = sessions_create(GRACE_MS);
+
+	// The token stays good on the server the session was handed to.
+	char token[SESSION_TOKEN_SIZE];
+	char handed[SESSION_TOKEN_SIZE];
+	ASSERT(sessions_token(s, 3, handed) < 0);
+	ASSERT(sessions_open(s, 3, token) == 0);
+	ASSERT(sessions_token(s, 3, handed) == 0);
+	ASSERT(strcmp(handed, token) == 0);
+	ASSERT(sessions_restore(next, handed) == 0);
+	ASSERT(sessions_restore(next, handed) < 0);
+	ASSERT(sessions_restore(next, "short") < 0);
+
+	char new_token[SESSION_TOKEN_SIZE];
+	int old_fd;
+	const char *pending;
+	size_t pending_len;
+	ASSERT(sessions_detach(next, 3, 0) == 0);
+	ASSERT(sessions_resume(next, token, 4, new_token, &old_fd, &pending, &pending_len) == 0);
+	ASSERT(old_fd == 3);
+
+	// Only live sessions are handed on.
+	ASSERT(sessions_token(next, 3, handed) < 0);
+
+	sessions_free(s);
+	sessions_free(next);
+}
+
+static void test_session_node(void) {
+	Sessions *s = sessions_create(GRACE_MS);
+	Sessions *other = sessions_create(GRACE_MS);
+
+	// Tokens name the node they were issued on.
+	char token[SESSION_TOKEN_SIZE];
+	ASSERT(sessions_open(s, 3, token) == 0);
+	ASSERT(sessions_node(token) == 0);
+	sessions_set_node(s, 7);
+	sessions_set_node(other, 255);
+	ASSERT(sessions_open(s, 4, token) == 0);
+	ASSERT(sessions_node(token) == 7);
+	ASSERT(strncmp(token, "07000004", 8) == 0);
+	ASSERT(sessions_node("short") == -1);
+
+	// Only the node the token names takes it, even for the same connection.
+	char new_token[SESSION_TOKEN_SIZE];
+	int old_fd;
+	const char *pending;
+	size_t pending_len;
+	ASSERT(sessions_open(other, 4, new_token) == 0);
+	ASSERT(sessions_resume(other, token, 9, new_token, &old_fd, &pending, &pending_len) < 0);
+	ASSERT(sessions_resume(s, token, 9, new_token, &old_fd, &pending, &pending_len) == 0);
+	ASSERT(old_fd == 4);
+	ASSERT(sessions_node(new_token) == 7);
+
+	// Connections that would spill in to the node are not issued a token.
+	ASSERT(sessions_open(s, 1 << 24, token) < 0);
+
+	sessions_free(s);
+	sessions_free(other);
+}
+
+int main(void) {
+	test_session_resume();
+	test_session_take_over_live();
+	test_session_expire();
+	test_session_restore();
+	test_session_node();
+}
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lobby.h"
+#include "solver.h"
+#include "task.h"
+
+#define TABLE_PATH "test_solver.bin"
+
+typedef struct T {
+	Lobby *l;
+	Solver *solver;
+} T;
+
+static void test_setup(T *t) {
+	remove(TABLE_PATH);
+
+	t->l = lobby_create(3, 3);
+	t->solver = solver_create(2, 16);
+	ASSERT(t->solver != NULL);
+}
+
+static void test_teardown(T *t) {
+	solver_free(t->solver);
+	lobby_free(t->l);
+	remove(TABLE_PATH);
+}
+
+static void test_solver_finds_winning_move(void) {
+	T t;
+	test_setup(&t);
+
+	// 	"X O ."
+	// 	". . ."
+	// 	". . ."
+	// O to move wins by playing 1 0.
+	lobby_place(t.l, 'O', 0, 1);
+	lobby_place(t.l, 'X', 0, 0);
+
+	LobbyMove move;
+	SolverStats stats;
+	ASSERT(solver_solve(t.solver, t.l, 0, &move, &stats) == SOLVER_WIN);
+	ASSERT(move.team == 'O');
+	ASSERT(stats.nodes > 0);
+
+	// The searched lobby is left untouched.
+	ASSERT(lobby_moves_len(t.l) == 2);
+
+	// After the winning move the opponent is lost.
+	ASSERT(lobby_place(t.l, move.team, move.row, move.col) == 0);
+	ASSERT(solver_solve(t.solver, t.l, 0, NULL, NULL) == SOLVER_LOSS);
+
+	test_teardown(&t);
+}
+
+static void test_solver_game_over(void) {
+	T t;
+	test_setup(&t);
+
+	lobby_place(t.l, 'O', 0, 1);
+	lobby_place(t.l, 'X', 0, 0);
+	lobby_place(t.l, 'O', 1, 0);
+	ASSERT(lobby_winner(t.l) == 'O');
+
+	ASSERT(solver_solve(t.solver, t.l, 0, NULL, NULL) == SOLVER_LOSS);
+
+	test_teardown(&t);
+}
+
+static void test_solver_threads_agree(void) {
+	T t;
+	test_setup(&t);
+
+	Solver *single = solver_create(1, 16);
+	ASSERT(single != NULL);
+
+	const SolverResult expected = solver_solve(single, t.l, 0, NULL, NULL);
+	ASSERT(expected != SOLVER_UNKNOWN);
+	ASSERT(solver_solve(t.solver, t.l, 0, NULL, NULL) == expected);
+
+	solver_free(single);
+	test_teardown(&t);
+}
+
+static void test_solver_out_of_time(void) {
+	T t;
+	test_setup(&t);
+
+	Lobby *l = lobby_create(7, 7);
+	ASSERT(solver_solve(t.solver, l, 1, NULL, NULL) == SOLVER_UNKNOWN);
+	ASSERT(solver_probe(t.solver, l, NULL) == SOLVER_UNKNOWN);
+	lobby_free(l);
+
+	// Too large to be searched at all.
+	l = lobby_create(9, 9);
+	ASSERT(solver_solve(t.solver, l, 1, NULL, NULL) == SOLVER_UNKNOWN);
+	lobby_free(l);
+
+	test_teardown(&t);
+}
+
+static void test_solver_save_load(void) {
+	T t;
+	test_setup(&t);
+
+	lobby_place(t.l, 'O', 1, 1);
+
+	LobbyMove expected_move = { 0 };
+	const SolverResult expected = solver_solve(t.solver, t.l, 0, &expected_move, NULL);
+	ASSERT(expected != SOLVER_UNKNOWN);
+	ASSERT(solver_save(t.solver, TABLE_PATH) == 0);
+
+	// A fresh solver answers from the loaded table without searching.
+	Solver *loaded = solver_create(1, 4);
+	ASSERT(loaded != NULL);
+	ASSERT(solver_probe(loaded, t.l, NULL) == SOLVER_UNKNOWN);
+	ASSERT(solver_load(loaded, TABLE_PATH) == 0);
+
+	LobbyMove move = { 0 };
+	ASSERT(solver_probe(loaded, t.l, &move) == expected);
+	if (expected == SOLVER_WIN) {
+		ASSERT(move.row == expected_move.row && move.col == expected_move.col);
+	}
+
+	// Saving again keeps the loaded positions.
+	ASSERT(solver_save(loaded, TABLE_PATH) == 0);
+	ASSERT(solver_load(loaded, TABLE_PATH) == 0);
+	ASSERT(solver_probe(loaded, t.l, NULL) == expected);
+
+	solver_free(loaded);
+
+	ASSERT(solver_load(t.solver, "does_not_exist.bin") == -1);
+
+	test_teardown(&t);
+}
+
+int main(void) {
+	test_solver_finds_winning_move();
+	test_solver_game_over();
+	test_solver_threads_agree();
+	test_solver_out_of_time();
+	test_solver_save_load();
+}
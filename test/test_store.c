@@ -0,0 +1,163 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lobby.h"
+#include "store.h"
+#include "task.h"
+
+typedef struct T {
+	char dir[32];
+	Store *s;
+} T;
+
+static void test_setup(T *t) {
+	strcpy(t->dir, "test_store_XXXXXX");
+	ASSERT(mkdtemp(t->dir) != NULL);
+
+	t->s = store_open(t->dir);
+	ASSERT(t->s != NULL);
+}
+
+static void test_teardown(T *t) {
+	store_close(t->s);
+
+	// The store's file is gone as soon as it is created.
+	ASSERT(rmdir(t->dir) == 0);
+}
+
+/**
+ * @brief Plays moves in a fixed pseudo random order until the game is over or
+ * the given number of moves were played.
+ *
+ */
+static void play(Lobby *l, size_t moves, uint64_t seed) {
+	uint16_t spaces[19 * 19];
+	for (size_t i = 0; i < moves && lobby_winner(l) == -1; i++) {
+		const size_t empty = lobby_empty(l, spaces);
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		const uint16_t space = spaces[(seed >> 33) % empty];
+		ASSERT(lobby_place(l, lobby_turn(l), space / l->board.cols, space % l->board.cols) == 0);
+	}
+}
+
+static void assert_same(const Lobby *a, const Lobby *b) {
+	ASSERT(lobby_hash(a) == lobby_hash(b));
+	ASSERT(lobby_turn(a) == lobby_turn(b));
+	ASSERT(lobby_winner(a) == lobby_winner(b));
+	ASSERT(lobby_moves_len(a) == lobby_moves_len(b));
+	for (size_t i = 0; i < lobby_moves_len(a); i++) {
+		const LobbyMove ma = lobby_move_at(a, i);
+		const LobbyMove mb = lobby_move_at(b, i);
+		ASSERT(ma.team == mb.team && ma.row == mb.row && ma.col == mb.col);
+	}
+	for (size_t row = 0; row < a->board.rows; row++) {
+		for (size_t col = 0; col < a->board.cols; col++) {
+			ASSERT(lobby_get(a, row, col) == lobby_get(b, row, col));
+		}
+	}
+}
+
+static void test_store_round_trip(void) {
+	T t;
+	test_setup(&t);
+
+	Lobby *l = lobby_create(9, 9);
+	lobby_join(l, &(Player){ .fd = 4, .name = "Player1" });
+	lobby_join(l, &(Player){ .fd = 5, .name = "Player2" });
+	play(l, 12, 1);
+	Lobby *expect = lobby_clone(l);
+
+	ASSERT(store_put(t.s, l) == 0);
+	ASSERT(lobby_is_asleep(l));
+	ASSERT(store_lobbies(t.s) == 1);
+	ASSERT(l->players_len == 2 && strcmp(l->players[1].name, "Player2") == 0);
+
+	ASSERT(store_take(t.s, l) == 0);
+	ASSERT(!lobby_is_asleep(l));
+	ASSERT(store_lobbies(t.s) == 0);
+	assert_same(l, expect);
+
+	// The game carries on where it was.
+	play(l, 3, 2);
+	play(expect, 3, 2);
+	assert_same(l, expect);
+
+	// An empty board round trips too.
+	Lobby *empty = lobby_create(9, 9);
+	ASSERT(store_put(t.s, empty) == 0);
+	ASSERT(store_take(t.s, empty) == 0);
+	ASSERT(lobby_moves_len(empty) == 0 && lobby_turn(empty) == 'O');
+
+	lobby_free(empty);
+	lobby_free(expect);
+	lobby_free(l);
+	test_teardown(&t);
+}
+
+static void test_store_sizes(void) {
+	T t;
+	test_setup(&t);
+
+	// Boards of more than 256 spaces take two bytes a move.
+	const size_t sizes[][2] = { { 5, 7 }, { 9, 9 }, { 13, 13 }, { 19, 19 }, { 17, 16 } };
+	for (size_t i = 0; i < sizeof sizes / sizeof *sizes; i++) {
+		Lobby *l = lobby_create(sizes[i][0], sizes[i][1]);
+		play(l, sizes[i][0] * sizes[i][1], i + 1);
+		Lobby *expect = lobby_clone(l);
+
+		ASSERT(store_put(t.s, l) == 0);
+		ASSERT(store_take(t.s, l) == 0);
+		assert_same(l, expect);
+		ASSERT(lobby_winner(l) != -1);
+
+		lobby_free(expect);
+		lobby_free(l);
+	}
+
+	test_teardown(&t);
+}
+
+static void test_store_many(void) {
+	T t;
+	test_setup(&t);
+
+	// Slots given back are reused without mixing up whose moves are whose.
+	enum { LOBBIES = 200 };
+	Lobby *lobbies[LOBBIES];
+	Lobby *expect[LOBBIES];
+	for (size_t round = 0; round < 3; round++) {
+		for (size_t i = 0; i < LOBBIES; i++) {
+			if (round == 0) {
+				lobbies[i] = lobby_create(19, 19);
+			}
+			play(lobbies[i], i % 40, i * 3 + round);
+			expect[i] = lobby_clone(lobbies[i]);
+			ASSERT(store_put(t.s, lobbies[i]) == 0);
+		}
+		ASSERT(store_lobbies(t.s) == LOBBIES);
+
+		for (size_t i = LOBBIES; i-- > 0;) {
+			ASSERT(store_take(t.s, lobbies[i]) == 0);
+			assert_same(lobbies[i], expect[i]);
+			lobby_free(expect[i]);
+		}
+		ASSERT(store_lobbies(t.s) == 0);
+	}
+
+	// Lobbies freed while asleep give their slot back.
+	for (size_t i = 0; i < LOBBIES; i++) {
+		ASSERT(store_put(t.s, lobbies[i]) == 0);
+		store_drop(t.s, lobbies[i]);
+		lobby_free(lobbies[i]);
+	}
+	ASSERT(store_lobbies(t.s) == 0);
+
+	test_teardown(&t);
+}
+
+int main(void) {
+	test_store_round_trip();
+	test_store_sizes();
+	test_store_many();
+}
@@ -0,0 +1,183 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "task.h"
+#include "tournament.h"
+
+#define MAX_ENTRANTS 16
+
+/**
+ * @brief Plays every game of the tournament, the lower numbered entrant
+ * always winning. Records who met whom and the most games running at once.
+ *
+ */
+static void play_out(Tournament *t, int met[MAX_ENTRANTS][MAX_ENTRANTS], size_t *most_running) {
+	TournamentGame running[MAX_ENTRANTS];
+	size_t running_len = 0;
+	*most_running = 0;
+
+	while (!tournament_is_over(t)) {
+		running_len += tournament_start_games(t, &running[running_len], MAX_ENTRANTS - running_len);
+		ASSERT(running_len > 0);
+		if (running_len > *most_running) {
+			*most_running = running_len;
+		}
+
+		const TournamentGame g = running[--running_len];
+		met[g.entrants[0]][g.entrants[1]]++;
+		met[g.entrants[1]][g.entrants[0]]++;
+
+		ASSERT(tournament_finish(t, g.id, g.entrants[0] < g.entrants[1] ? 0 : 1) == 0);
+		ASSERT(tournament_finish(t, g.id, 0) < 0); // Already finished.
+	}
+}
+
+static void test_tournament_round_robin(void) {
+	const size_t sizes[] = { 6, 5 };
+
+	for (size_t s = 0; s < sizeof sizes / sizeof *sizes; s++) {
+		const size_t n = sizes[s];
+		Tournament *t = tournament_create(&(TournamentConfig){ .format = TOURNAMENT_ROUND_ROBIN, .parallel = 2 });
+		ASSERT(t != NULL);
+
+		for (size_t i = 0; i < n; i++) {
+			ASSERT(tournament_enter(t, 100 + (int)i) == 0);
+		}
+		ASSERT(tournament_begin(t) == 0);
+		ASSERT(tournament_enter(t, 200) < 0);
+
+		int met[MAX_ENTRANTS][MAX_ENTRANTS] = { 0 };
+		size_t most_running;
+		play_out(t, met, &most_running);
+		ASSERT(most_running == 2);
+
+		// Everyone met everyone else exactly once.
+		for (size_t a = 0; a < n; a++) {
+			for (size_t b = 0; b < n; b++) {
+				ASSERT(met[a][b] == (a == b ? 0 : 1));
+			}
+		}
+
+		TournamentStanding standings[MAX_ENTRANTS];
+		ASSERT(tournament_standings(t, standings, MAX_ENTRANTS) == n);
+		for (size_t i = 0; i < n; i++) {
+			ASSERT(standings[i].entrant == i);
+			ASSERT(standings[i].handle == 100 + (int)i);
+			ASSERT(standings[i].wins == n - 1 - i);
+		}
+
+		tournament_free(t);
+	}
+}
+
+static void test_tournament_swiss(void) {
+	Tournament *t = tournament_create(&(TournamentConfig){ .format = TOURNAMENT_SWISS, .parallel = 3, .seed = 7 });
+
+	for (int i = 0; i < MAX_ENTRANTS; i++) {
+		ASSERT(tournament_enter(t, i) == 0);
+	}
+	ASSERT(tournament_begin(t) == 0);
+
+	int met[MAX_ENTRANTS][MAX_ENTRANTS] = { 0 };
+	size_t most_running;
+	play_out(t, met, &most_running);
+	ASSERT(most_running == 3);
+	ASSERT(tournament_round(t) == 4);
+
+	// Nobody played anyone twice, and four rounds leave a single unbeaten entrant.
+	for (size_t a = 0; a < MAX_ENTRANTS; a++) {
+		for (size_t b = 0; b < MAX_ENTRANTS; b++) {
+			ASSERT(met[a][b] <= 1);
+		}
+	}
+
+	TournamentStanding standings[2];
+	ASSERT(tournament_standings(t, standings, 2) == 2);
+	ASSERT(standings[0].entrant == 0);
+	ASSERT(standings[0].score == 4);
+	ASSERT(standings[1].score == 3);
+
+	tournament_free(t);
+}
+
+static void test_tournament_withdraw(void) {
+	Tournament *t = tournament_create(&(TournamentConfig){ .format = TOURNAMENT_SWISS, .rounds = 3, .parallel = 8 });
+
+	for (int i = 0; i < 5; i++) {
+		ASSERT(tournament_enter(t, i * 10) == 0);
+	}
+	uint32_t entrant;
+	ASSERT(tournament_find(t, 30, &entrant) == 0);
+	ASSERT(entrant == 3);
+	ASSERT(tournament_find(t, 31, &entrant) < 0);
+	tournament_set_handle(t, 3, 31);
+	ASSERT(tournament_find(t, 31, &entrant) == 0 && entrant == 3);
+	ASSERT(tournament_find(t, 30, &entrant) < 0);
+	tournament_set_handle(t, 3, 30);
+
+	// Large handles and ones below 0 are found as well.
+	ASSERT(tournament_set_handle(t, 4, 1000) == 0);
+	ASSERT(tournament_find(t, 1000, &entrant) == 0 && entrant == 4);
+	ASSERT(tournament_set_handle(t, 4, -5) == 0);
+	ASSERT(tournament_find(t, -5, &entrant) == 0 && entrant == 4);
+	ASSERT(tournament_find(t, 1000, &entrant) < 0);
+	ASSERT(tournament_set_handle(t, 4, 40) == 0);
+	ASSERT(tournament_begin(t) == 0);
+
+	// Five entrants make two games and a bye.
+	TournamentGame games[4];
+	ASSERT(tournament_start_games(t, games, 4) == 2);
+
+	// Withdrawing loses the running game.
+	const TournamentGame g = games[0];
+	tournament_withdraw(t, g.entrants[0]);
+	TournamentGame check;
+	ASSERT(tournament_game(t, g.id, &check) < 0);
+	ASSERT(tournament_finish(t, g.id, 0) < 0);
+
+	ASSERT(tournament_game(t, games[1].id, &check) == 0);
+	ASSERT(check.entrants[0] == games[1].entrants[0]);
+	ASSERT(tournament_finish(t, games[1].id, 1) == 0);
+
+	// Later rounds leave the entrant out.
+	while (!tournament_is_over(t)) {
+		const size_t made = tournament_start_games(t, games, 4);
+		ASSERT(made > 0);
+		for (size_t i = 0; i < made; i++) {
+			ASSERT(games[i].entrants[0] != g.entrants[0]);
+			ASSERT(games[i].entrants[1] != g.entrants[0]);
+			ASSERT(tournament_finish(t, games[i].id, 0) == 0);
+		}
+	}
+
+	TournamentStanding standings[5];
+	ASSERT(tournament_standings(t, standings, 5) == 5);
+	for (size_t i = 0; i < 5; i++) {
+		if (standings[i].entrant == g.entrants[0]) {
+			ASSERT(standings[i].score == 0);
+			ASSERT(standings[i].losses == 1);
+		}
+	}
+
+	tournament_free(t);
+}
+
+static void test_tournament_needs_two_entrants(void) {
+	Tournament *t = tournament_create(&(TournamentConfig){ .format = TOURNAMENT_ROUND_ROBIN, .parallel = 1 });
+
+	ASSERT(tournament_begin(t) < 0);
+	ASSERT(tournament_enter(t, 1) == 0);
+	ASSERT(tournament_begin(t) < 0);
+	ASSERT(!tournament_is_over(t));
+
+	tournament_free(t);
+
+	ASSERT(tournament_create(&(TournamentConfig){ .format = TOURNAMENT_SWISS, .parallel = 0 }) == NULL);
+}
+
+int main(void) {
+	test_tournament_round_robin();
+	test_tournament_swiss();
+	test_tournament_withdraw();
+	test_tournament_needs_two_entrants();
+}